@@ -0,0 +1,359 @@
+// 求交内核与BVH遍历的性能测试（micro-benchmark）
+//
+// 用法: bin/bench_kernels [--reps N] [--warmup N] [--rays N] [scene.txt ...]
+// 需要在 code/ 目录下运行（和 PA1 一样，mesh/ 与 textures/ 用相对路径）。
+// 不指定场景时使用 testcases/ 下自带的场景。
+//
+// 每个内核对三种光线集合分别计时：
+//   camera  - 按扫描线顺序生成的相机光线（相干）
+//   diffuse - 从相机光线的第一个交点向半球随机散射（不相干）
+//   shadow  - 从第一个交点射向物体上方一个点光源（有 tmax）
+// 所有随机数都来自固定种子的生成器，每次运行得到相同的光线。
+// BVH 还会测一次光线包遍历（相机光线按 4x4 像素块组成 16 条光线的包），
+// 并检查结果与单光线遍历一致。
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "aabb.hpp"
+#include "arena.hpp"
+#include "bvh.hpp"
+#include "camera.hpp"
+#include "curve.hpp"
+#include "group.hpp"
+#include "mesh.hpp"
+#include "packet.hpp"
+#include "revsurface.hpp"
+#include "scene_parser.hpp"
+#include "sphere.hpp"
+#include "transform.hpp"
+#include "triangle.hpp"
+
+using namespace std;
+
+struct RaySet {
+    string name;
+    vector<Ray> rays;
+    vector<float> tmax;   // 每条光线的最远距离（阴影光线为到光源的距离）
+};
+
+struct BenchResult {
+    double minNs, medianNs, meanNs, stddevNs;  // 每条光线（或每次测试）的纳秒数
+    double hitRate;
+};
+
+static int reps = 7;
+static int warmup = 2;
+static int numRays = 1 << 16;
+
+static mt19937 rng(20200601);   // 固定种子，保证光线集合可复现
+
+static float uniform() {
+    static uniform_real_distribution<float> distri(0.0f, 1.0f);
+    return distri(rng);
+}
+
+static Vector3f randomUnitVec3() {
+    float a = 2 * PI * uniform();
+    float z = 2 * uniform() - 1;
+    float r = sqrt(1 - z * z);
+    return Vector3f(r * cos(a), r * sin(a), z);
+}
+
+// 从包围盒外对准包围盒中心的相机
+static PerspectiveCamera frameBox(const Aabb& box, int w, int h) {
+    Vector3f center = 0.5f * (box.getMin() + box.getMax());
+    float radius = 0.5f * (box.getMax() - box.getMin()).length();
+    Vector3f eye = center + Vector3f(0.3f, 0.4f, 1.0f).normalized() * (3.0f * radius);
+    return PerspectiveCamera(eye, center - eye, Vector3f(0, 1, 0), w, h, 40 * PI / 180, 0, (center - eye).length());
+}
+
+// 扫描线顺序的相机光线，像素数约等于 numRays
+static RaySet cameraRays(Camera& cam) {
+    RaySet set;
+    set.name = "camera";
+    float aspect = (float) cam.getWidth() / cam.getHeight();
+    int h = max(1, (int) sqrt(numRays / aspect));
+    int w = max(1, numRays / h);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            Vector2f p((x + 0.5f) / w * cam.getWidth(), (y + 0.5f) / h * cam.getHeight());
+            set.rays.push_back(cam.generateRay(p));
+            set.tmax.push_back(INF);
+        }
+    }
+    return set;
+}
+
+// 用相机光线在 target 上的第一个交点生成散射光线和阴影光线
+static void secondaryRays(Object3D* target, const RaySet& camera, const Aabb& box,
+                          RaySet& diffuse, RaySet& shadow) {
+    diffuse.name = "diffuse";
+    shadow.name = "shadow";
+    Vector3f extent = box.getMax() - box.getMin();
+    Vector3f light = 0.5f * (box.getMin() + box.getMax()) + Vector3f(0, extent.length(), 0);
+    for (size_t i = 0; i < camera.rays.size(); i++) {
+        Hit hit;
+        if (!target->intersect(camera.rays[i], hit, 0.0001, INF)) continue;
+        Vector3f dir = (hit.getNormal() + randomUnitVec3()).normalized();
+        diffuse.rays.push_back(Ray(hit.getPos(), dir));
+        diffuse.tmax.push_back(INF);
+
+        Vector3f toLight = light + 0.1f * extent.length() * randomUnitVec3() - hit.getPos();
+        float dist = toLight.length();
+        shadow.rays.push_back(Ray(hit.getPos(), toLight / dist));
+        shadow.tmax.push_back(dist);
+    }
+    // 打乱散射光线的顺序，模拟真实渲染中不相干的访问
+    shuffle(diffuse.rays.begin(), diffuse.rays.end(), rng);
+}
+
+// kernel(i) 对第 i 条光线（或第 i 个光线包）求交，返回相交的次数；testsPerRay 用于把时间折算到每次测试
+static BenchResult runKernel(int n, int testsPerRay, const function<int(int)>& kernel) {
+    long long hits = 0;
+    for (int r = 0; r < warmup; r++) {
+        for (int i = 0; i < n; i++) hits += kernel(i);
+    }
+    vector<double> samples;
+    for (int r = 0; r < reps; r++) {
+        hits = 0;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < n; i++) hits += kernel(i);
+        auto end = chrono::steady_clock::now();
+        double ns = chrono::duration<double, nano>(end - start).count();
+        samples.push_back(ns / ((double) n * testsPerRay));
+    }
+    sort(samples.begin(), samples.end());
+    BenchResult res;
+    res.minNs = samples.front();
+    res.medianNs = samples[samples.size() / 2];
+    res.meanNs = 0;
+    for (double s : samples) res.meanNs += s;
+    res.meanNs /= samples.size();
+    res.stddevNs = 0;
+    for (double s : samples) res.stddevNs += (s - res.meanNs) * (s - res.meanNs);
+    res.stddevNs = sqrt(res.stddevNs / samples.size());
+    res.hitRate = n > 0 ? (double) hits / ((double) n * testsPerRay) : 0;
+    return res;
+}
+
+static void printHeader() {
+    printf("%-30s %-8s %8s %10s %10s %10s %8s %10s %6s\n",
+           "kernel", "rays", "count", "median ns", "min ns", "mean ns", "stddev", "Mrays/s", "hit%");
+}
+
+static void printResult(const string& kernel, const RaySet& set, const BenchResult& r) {
+    printf("%-30s %-8s %8d %10.2f %10.2f %10.2f %8.2f %10.2f %6.1f\n",
+           kernel.c_str(), set.name.c_str(), (int) set.rays.size(), r.medianNs, r.minNs, r.meanNs,
+           r.stddevNs, r.medianNs > 0 ? 1e3 / r.medianNs : 0.0, 100 * r.hitRate);
+}
+
+// 对一个物体跑三种光线：求交用 obj->intersect
+static void benchObject(const string& name, Object3D* obj, Camera& cam, const Aabb& box) {
+    RaySet camera = cameraRays(cam);
+    RaySet diffuse, shadow;
+    secondaryRays(obj, camera, box, diffuse, shadow);
+    for (const RaySet* set : {&camera, &diffuse, &shadow}) {
+        if (set->rays.empty()) continue;
+        BenchResult r = runKernel(set->rays.size(), 1, [&](int i) {
+            Hit hit;
+            return obj->intersect(set->rays[i], hit, 0.0001, set->tmax[i]) && hit.getT() < set->tmax[i];
+        });
+        printResult(name, *set, r);
+    }
+}
+
+static void benchAabb(const Aabb& box, Object3D* target) {
+    PerspectiveCamera cam = frameBox(box, 256, 256);
+    RaySet camera = cameraRays(cam);
+    RaySet diffuse, shadow;
+    secondaryRays(target, camera, box, diffuse, shadow);
+    for (const RaySet* set : {&camera, &diffuse, &shadow}) {
+        if (set->rays.empty()) continue;
+        BenchResult r = runKernel(set->rays.size(), 1, [&](int i) {
+            return box.intersect(set->rays[i], 0.0001, set->tmax[i]);
+        });
+        printResult("Aabb::intersect", *set, r);
+    }
+}
+
+// 一次光线-三角形测试：光线、三角形和测试时的 t 上限
+struct TriangleTest {
+    int ray;
+    Triangle* tri;
+    float tmax;
+};
+
+// 按 BvhNode::intersect 的顺序遍历网格的 BVH，记下光线到达的叶子上的三角形，
+// 以及测试时已缩短的 t 上限（三角形用 hit 的 t 作为上限）
+static void collectTriangleTests(Object3D* node, const Ray& ray, int rayIndex, float& tmax, vector<TriangleTest>& tests) {
+    if (node->objType == bhvNode) {
+        BvhNode* bvh = static_cast<BvhNode*>(node);
+        if (!bvh->box.intersect(ray, 0.0001, tmax)) return;
+        collectTriangleTests(bvh->left, ray, rayIndex, tmax, tests);
+        if (bvh->right != bvh->left) collectTriangleTests(bvh->right, ray, rayIndex, tmax, tests);
+    } else if (node->objType == triangle) {
+        Triangle* tri = static_cast<Triangle*>(node);
+        tests.push_back({rayIndex, tri, tmax});
+        Hit hit(Vector3f::ZERO, tmax, nullptr, Vector3f::ZERO);
+        if (tri->intersect(ray, hit, 0.0001, tmax)) tmax = hit.getT();
+    }
+}
+
+// 三角形测试取自真实遍历：每条光线与 BVH 遍历时到达的叶子上的三角形求交，
+// 命中率与渲染时一致，时间折算到每次光线-三角形测试
+static void benchTriangles(Mesh* mesh, const Aabb& box) {
+    PerspectiveCamera cam = frameBox(box, 256, 256);
+    RaySet camera = cameraRays(cam);
+    RaySet diffuse, shadow;
+    secondaryRays(mesh, camera, box, diffuse, shadow);
+    for (const RaySet* set : {&camera, &diffuse, &shadow}) {
+        if (set->rays.empty()) continue;
+        vector<TriangleTest> tests;
+        for (size_t i = 0; i < set->rays.size(); i++) {
+            float tmax = set->tmax[i];
+            collectTriangleTests(mesh->tree, set->rays[i], i, tmax, tests);
+        }
+        if (tests.empty()) continue;
+        BenchResult r = runKernel(tests.size(), 1, [&](int i) {
+            const TriangleTest& test = tests[i];
+            Hit hit(Vector3f::ZERO, test.tmax, nullptr, Vector3f::ZERO);
+            return test.tri->intersect(set->rays[test.ray], hit, 0.0001, test.tmax);
+        });
+        printResult("Triangle::intersect", *set, r);
+        printf("  %.1f triangle tests per ray\n", (double) tests.size() / set->rays.size());
+    }
+}
+
+// 按 4x4 像素块生成相机光线包，光线总数约等于 numRays
+static vector<RayPacket> cameraPackets(Camera& cam, RaySet& flat) {
+    flat.name = "camera";
+    vector<RayPacket> packets;
+    float aspect = (float) cam.getWidth() / cam.getHeight();
+    int h = max(4, (int) sqrt(numRays / aspect) / 4 * 4);
+    int w = max(4, numRays / h / 4 * 4);
+    for (int y0 = 0; y0 < h; y0 += 4) {
+        for (int x0 = 0; x0 < w; x0 += 4) {
+            RayPacket packet;
+            for (int x = x0; x < x0 + 4; x++) {
+                for (int y = y0; y < y0 + 4; y++) {
+                    Vector2f p((x + 0.5f) / w * cam.getWidth(), (y + 0.5f) / h * cam.getHeight());
+                    packet.add(cam.generateRay(p));
+                    flat.rays.push_back(packet.rays[packet.size - 1]);
+                }
+            }
+            packet.finalize();
+            packets.push_back(packet);
+        }
+    }
+    return packets;
+}
+
+// 光线包遍历，时间折算到每条光线；先检查每条光线的交点与单光线遍历相同
+static void benchPacket(const string& name, BvhNode* root, Camera& cam) {
+    RaySet flat;
+    vector<RayPacket> packets = cameraPackets(cam, flat);
+    int mismatches = 0;
+    for (const RayPacket& packet : packets) {
+        Hit hits[RayPacket::maxSize];
+        unsigned mask = root->intersectPacket(packet, hits, 0.0001);
+        for (int i = 0; i < packet.size; i++) {
+            Hit ref;
+            bool refHit = root->intersect(packet.rays[i], ref, 0.0001, INF);
+            // RevSurface 的牛顿迭代与传入的 t 区间有关，遍历顺序不同时 t 会有极小的差别
+            bool sameT = fabs(ref.getT() - hits[i].getT()) <= 1e-4f * max(1.0f, ref.getT());
+            if (refHit != (bool) (mask & (1u << i)) || (refHit && !sameT)) mismatches++;
+        }
+    }
+    BenchResult r = runKernel(packets.size(), RayPacket::maxSize, [&](int i) {
+        Hit hits[RayPacket::maxSize];
+        return __builtin_popcount(root->intersectPacket(packets[i], hits, 0.0001));
+    });
+    printResult(name + " packet16", flat, r);
+    if (mismatches > 0) {
+        printf("  WARNING: %d rays differ from single-ray traversal\n", mismatches);
+    }
+}
+
+static void benchScene(const char* filename) {
+    Arena sceneArena;   // 每个场景测完即释放
+    ArenaScope scope(sceneArena);
+    SceneParser parser(filename);
+    Group* grp = parser.getGroup();
+    if (grp == nullptr || grp->getGroupSize() == 0) {
+        printf("%-30s (no objects, skipped)\n", filename);
+        return;
+    }
+    BvhNode* root = arenaNew<BvhNode>(arenaAccel, grp);
+    Aabb box;
+    root->hitbox(box);
+    string name = string("BVH ") + filename;
+    benchObject(name, root, *parser.getCamera(), box);
+    benchPacket(name, root, *parser.getCamera());
+}
+
+int main(int argc, char* argv[]) {
+    vector<const char*> scenes;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--reps") && i + 1 < argc) {
+            reps = max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+            warmup = max(0, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "--rays") && i + 1 < argc) {
+            numRays = max(1, atoi(argv[++i]));
+        } else if (argv[i][0] == '-') {
+            printf("Usage: ./bin/bench_kernels [--reps N] [--warmup N] [--rays N] [scene.txt ...]\n");
+            return 1;
+        } else {
+            scenes.push_back(argv[i]);
+        }
+    }
+    if (scenes.empty()) {
+        scenes = {"testcases/empty.txt", "testcases/minecraft.txt", "testcases/space.txt", "testcases/waterdrop.txt"};
+    }
+
+    printf("reps %d, warmup %d, about %d rays per set\n", reps, warmup, numRays);
+
+    Material* mat = arenaNew<Lambert>(arenaMaterial, arenaNew<SolidColor>(arenaTexture, 0.8, 0.8, 0.8));
+    Mesh* bunny = arenaNew<Mesh>(arenaGeometry, "mesh/bunny_1k.obj", mat);
+    Mesh* cube = arenaNew<Mesh>(arenaGeometry, "mesh/cube.obj", mat);
+    Sphere* sphere = arenaNew<Sphere>(arenaGeometry, Vector3f(0, 0, 0), 1, mat);
+    vector<Vector3f> controls = {Vector3f(0, 2, 0), Vector3f(0, 1, 0), Vector3f(2, -2, 0), Vector3f(0, -2, 0)};
+    RevSurface* vase = arenaNew<RevSurface>(arenaGeometry, arenaNew<BezierCurve>(arenaGeometry, controls), mat);
+
+    printHeader();
+
+    Aabb bunnyBox, cubeBox, sphereBox, vaseBox;
+    bunny->hitbox(bunnyBox);
+    cube->hitbox(cubeBox);
+    sphere->hitbox(sphereBox);
+    vase->hitbox(vaseBox);
+
+    benchAabb(bunnyBox, bunny);
+    benchTriangles(bunny, bunnyBox);
+
+    PerspectiveCamera sphereCam = frameBox(sphereBox, 256, 256);
+    benchObject("Sphere::intersect", sphere, sphereCam, sphereBox);
+
+    PerspectiveCamera vaseCam = frameBox(vaseBox, 256, 256);
+    benchObject("RevSurface::intersect", vase, vaseCam, vaseBox);
+
+    PerspectiveCamera bunnyCam = frameBox(bunnyBox, 256, 256);
+    benchObject("BVH bunny_1k.obj", bunny, bunnyCam, bunnyBox);
+    benchPacket("BVH bunny_1k.obj", bunny->tree, bunnyCam);
+    PerspectiveCamera cubeCam = frameBox(cubeBox, 256, 256);
+    benchObject("BVH cube.obj", cube, cubeCam, cubeBox);
+
+    for (const char* scene : scenes) {
+        benchScene(scene);
+    }
+    return 0;
+}
@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+"""End-to-end scene benchmark for bin/PA1.
+
+Renders every testcase at a fixed spp and seed. For each scene it records
+wall time, Mrays/s (from the "Render summary" line PA1 prints) and the
+renderer's peak RSS. Each output image is compared against a stored
+reference with RMSE and relative MSE. Results go to a JSON and a CSV
+report, and the script exits with status 1 when any scene regresses past
+the thresholds or has no reference image. The references for
+testcases/*.txt at the default spp and seed are committed in
+bench/reference/. To keep them small they are stored box-filtered by
+--ref-scale (4x4 pixels by default, recorded in meta.json), and each
+render is filtered the same way before the comparison.
+
+Run from code/ after building:
+
+    python3 bench/bench_scenes.py                      # compare against bench/reference/
+    python3 bench/bench_scenes.py --update-refs        # (re)create the reference images
+    python3 bench/bench_scenes.py --baseline old.json  # also gate render time
+
+    # compare the wavefront integrator against the recursive one
+    python3 bench/bench_scenes.py --report output/bench/recursive
+    python3 bench/bench_scenes.py --args="--integrator wavefront" --baseline output/bench/recursive.json
+
+Only the Python standard library is used.
+"""
+
+import argparse
+import csv
+import glob
+import json
+import os
+import re
+import shlex
+import subprocess
+import sys
+import time
+
+SUMMARY_RE = re.compile(r"Render summary: time ([0-9.]+) s, rays ([0-9]+), ([0-9.]+) Mrays/s")
+
+
+def read_ppm(path):
+    """Reads a binary (P6) PPM as written by Image::SavePPM."""
+    with open(path, "rb") as f:
+        data = f.read()
+    fields = []
+    pos = 0
+    while len(fields) < 4:
+        # skip whitespace and comments between header fields
+        while data[pos:pos + 1].isspace():
+            pos += 1
+        if data[pos:pos + 1] == b"#":
+            pos = data.index(b"\n", pos) + 1
+            continue
+        end = pos
+        while not data[end:end + 1].isspace():
+            end += 1
+        fields.append(data[pos:end])
+        pos = end
+    if fields[0] != b"P6" or int(fields[3]) != 255:
+        raise ValueError("%s: unsupported PPM format" % path)
+    width, height = int(fields[1]), int(fields[2])
+    pixels = data[pos + 1:pos + 1 + 3 * width * height]
+    return width, height, pixels
+
+
+def write_ppm(path, width, height, pixels):
+    with open(path, "wb") as f:
+        f.write(b"P6\n%d %d\n255\n" % (width, height))
+        f.write(pixels)
+
+
+def downsample(width, height, pixels, scale):
+    """Averages each scale x scale block; a partial last row or column of blocks is dropped."""
+    if scale == 1:
+        return width, height, pixels
+    w, h = width // scale, height // scale
+    out = bytearray(3 * w * h)
+    n = scale * scale
+    for y in range(h):
+        for c in range(3):
+            sums = [0] * w
+            for yy in range(y * scale, (y + 1) * scale):
+                channel = pixels[3 * width * yy + c:3 * width * (yy + 1):3]
+                for k in range(scale):
+                    sums = [s + v for s, v in zip(sums, channel[k:w * scale:scale])]
+            out[3 * w * y + c:3 * w * (y + 1):3] = bytes((s + n // 2) // n for s in sums)
+    return w, h, bytes(out)
+
+
+def compare_images(out_path, ref_path, scale):
+    """Returns (rmse, relmse) over all channels, in [0, 1] units, after filtering the render by scale."""
+    w0, h0, a = downsample(*read_ppm(out_path), scale)
+    w1, h1, b = read_ppm(ref_path)
+    if (w0, h0) != (w1, h1):
+        raise ValueError("image size %dx%d differs from reference %dx%d" % (w0, h0, w1, h1))
+    n = len(a)
+    se = 0.0
+    rel = 0.0
+    for x, y in zip(a, b):
+        d = (x - y) / 255.0
+        r = y / 255.0
+        se += d * d
+        rel += d * d / (r * r + 1e-2)
+    return (se / n) ** 0.5, rel / n
+
+
+def render(args, scene, name):
+    cmd = [args.binary, scene, name, "--spp", str(args.spp), "--seed", str(args.seed)] + shlex.split(args.args)
+    start = time.time()
+    proc = subprocess.Popen(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    output = proc.stdout.read().decode(errors="replace")
+    # wait4 reports the peak RSS of this child only (kilobytes on Linux)
+    _, status, usage = os.wait4(proc.pid, 0)
+    proc.returncode = os.waitstatus_to_exitcode(status) if hasattr(os, "waitstatus_to_exitcode") else status
+    wall = time.time() - start
+    result = {
+        "scene": scene,
+        "exit_code": proc.returncode,
+        "wall_time_s": round(wall, 3),
+        "peak_rss_mb": round(usage.ru_maxrss / 1024.0, 1),
+    }
+    m = SUMMARY_RE.search(output)
+    if m:
+        result["render_time_s"] = float(m.group(1))
+        result["rays"] = int(m.group(2))
+        result["mrays_per_s"] = float(m.group(3))
+    if proc.returncode != 0 or not m:
+        result["log_tail"] = output[-2000:]
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("scenes", nargs="*", help="scene files (default: testcases/*.txt)")
+    parser.add_argument("--binary", default="bin/PA1")
+    parser.add_argument("--spp", type=int, default=4)
+    parser.add_argument("--args", default="", help="extra arguments passed to PA1, e.g. \"--integrator wavefront\"")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--refs", default="bench/reference", help="directory of reference .ppm images")
+    parser.add_argument("--report", default="output/bench/report", help="report path without extension")
+    parser.add_argument("--baseline", help="previous JSON report to compare render time against")
+    parser.add_argument("--time-threshold", type=float, default=0.10,
+                        help="flag a time regression when slower than baseline by this fraction")
+    parser.add_argument("--relmse-threshold", type=float, default=1e-3,
+                        help="flag a quality regression when relative MSE exceeds this")
+    parser.add_argument("--update-refs", action="store_true", help="store the new renders in --refs")
+    parser.add_argument("--ref-scale", type=int, default=4,
+                        help="with --update-refs, store the references box-filtered by this factor")
+    args = parser.parse_args()
+
+    scenes = args.scenes or sorted(glob.glob("testcases/*.txt"))
+    # PA1 writes intermediate snapshots under output/temp/
+    for d in ("output/temp/bmp", "output/temp/ppm", os.path.dirname(args.report) or "."):
+        os.makedirs(d, exist_ok=True)
+
+    # references are only comparable when rendered with the same spp and seed
+    meta_path = os.path.join(args.refs, "meta.json")
+    ref_scale = 1
+    if args.update_refs:
+        ref_scale = max(1, args.ref_scale)
+        os.makedirs(args.refs, exist_ok=True)
+        with open(meta_path, "w") as f:
+            json.dump({"spp": args.spp, "seed": args.seed, "scale": ref_scale}, f)
+    elif os.path.exists(meta_path):
+        with open(meta_path) as f:
+            meta = json.load(f)
+        ref_scale = meta.get("scale", 1)
+        if (meta.get("spp"), meta.get("seed")) != (args.spp, args.seed):
+            print("WARNING: references were rendered with spp %s, seed %s; this run uses spp %d, seed %d" % (
+                meta.get("spp"), meta.get("seed"), args.spp, args.seed))
+
+    baseline = {}
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = {r["scene"]: r for r in json.load(f)["results"]}
+
+    results = []
+    for scene in scenes:
+        name = "bench_" + os.path.splitext(os.path.basename(scene))[0]
+        print("Rendering %s ..." % scene, flush=True)
+        r = render(args, scene, name)
+        out_ppm = os.path.join("output", name + ".ppm")
+        ref_ppm = os.path.join(args.refs, name + ".ppm")
+        regressions = []
+
+        if r["exit_code"] != 0 or "rays" not in r:
+            regressions.append("failed")
+        elif args.update_refs:
+            write_ppm(ref_ppm, *downsample(*read_ppm(out_ppm), ref_scale))
+            r["reference"] = "updated"
+        elif os.path.exists(ref_ppm):
+            try:
+                r["rmse"], r["relmse"] = compare_images(out_ppm, ref_ppm, ref_scale)
+                if r["relmse"] > args.relmse_threshold:
+                    regressions.append("quality")
+            except ValueError as e:
+                r["compare_error"] = str(e)
+                regressions.append("quality")
+        else:
+            # without a reference the quality gate cannot run, so this is a failure (create it with --update-refs)
+            r["reference"] = "missing"
+            regressions.append("no-reference")
+
+        base = baseline.get(scene)
+        if base and "render_time_s" in base and "render_time_s" in r:
+            r["baseline_time_s"] = base["render_time_s"]
+            r["time_ratio"] = round(r["render_time_s"] / max(base["render_time_s"], 1e-9), 3)
+            if r["time_ratio"] > 1 + args.time_threshold:
+                regressions.append("time")
+
+        r["regressions"] = regressions
+        results.append(r)
+        print("  time %.2fs  %.3f Mrays/s  rss %.1f MB  relMSE %s  %s" % (
+            r.get("render_time_s", float("nan")), r.get("mrays_per_s", float("nan")), r["peak_rss_mb"],
+            "%.2e" % r["relmse"] if "relmse" in r else r.get("reference", "-"),
+            ("REGRESSION: " + ",".join(regressions)) if regressions else "ok"), flush=True)
+
+    report = {
+        "spp": args.spp,
+        "seed": args.seed,
+        "binary": args.binary,
+        "args": args.args,
+        "time_threshold": args.time_threshold,
+        "relmse_threshold": args.relmse_threshold,
+        "results": results,
+    }
+    with open(args.report + ".json", "w") as f:
+        json.dump(report, f, indent=2)
+    columns = ["scene", "exit_code", "wall_time_s", "render_time_s", "rays", "mrays_per_s", "peak_rss_mb",
+               "rmse", "relmse", "baseline_time_s", "time_ratio", "regressions"]
+    with open(args.report + ".csv", "w", newline="") as f:
+        w = csv.writer(f)
+        w.writerow(columns)
+        for r in results:
+            w.writerow([";".join(r[c]) if c == "regressions" else r.get(c, "") for c in columns])
+    print("Report written to %s.json and %s.csv" % (args.report, args.report))
+
+    return 1 if any(r["regressions"] for r in results) else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
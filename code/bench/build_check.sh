@@ -0,0 +1,33 @@
+#!/bin/sh
+# 检查所有构建配置都能编译、链接并渲染：Debug、每个 CMakePresets.json 的 preset（含 PGO 的两步）。
+# 只有 Release -O3 能链接的错误（例如类内初始化的 static const 被按引用使用却没有定义）在这里暴露出来。
+#
+# 用法（在 code/ 下运行）: bench/build_check.sh [scene.txt]
+# 每个配置构建后用 --spp 1 渲染一次场景（默认 testcases/minecraft.txt）。
+# 所有配置都写 bin/PA1，最后构建的是 release，结束后 bin/PA1 为普通的发布版本。
+set -e
+
+SCENE=${1:-testcases/minecraft.txt}
+JOBS=$(nproc 2>/dev/null || echo 4)
+mkdir -p output/temp/bmp output/temp/ppm
+
+smoke() {
+    bin/PA1 "$SCENE" build_check --spp 1 --seed 1 --checkpoint 0 > /dev/null
+    rm -f output/build_check.bmp output/build_check.ppm
+}
+
+echo "== Debug"
+cmake -S . -B build/debug -DCMAKE_BUILD_TYPE=Debug > /dev/null
+cmake --build build/debug -j "$JOBS"
+smoke
+
+# 清掉之前的 profile（例如 pgo_build.sh 留下的），否则插桩版本会与旧的 .gcda 校验和不符
+rm -rf build/pgo/pgo-profile
+for preset in native lto pgo-generate pgo-use release; do
+    echo "== preset $preset"
+    cmake --preset "$preset" > /dev/null
+    cmake --build --preset "$preset" -j "$JOBS"
+    smoke
+done
+rm -rf build/pgo/pgo-profile
+echo "All build configurations link and render"
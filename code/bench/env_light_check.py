@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""Equal-spp check of the environment light estimator.
+
+Renders a scene twice at the same spp and seed: once with the sky as an
+importance-sampled environment light (--env-light 1, light sampling combined
+with the BSDF bounce by MIS), and once with the sky as the old emissive
+sphere (--env-light 0, BSDF sampling only). Both estimate the same image, so
+their means must agree; a wrong MIS weight or pdf shows up as a brighter or
+darker image. The images are compared in linear space (the output is gamma 2,
+so pixel values are squared), where the mean does not depend on the noise
+level. The default scene is testcases/empty.txt plus the SceneGenerator house
+at 160x90, with the camera near the origin so that the 100-radius sphere and
+the environment at infinity show the sky in nearly the same directions.
+
+The script checks the overall mean of each channel and the mean of every cell
+of a --grid x --grid partition. It exits with status 1 when a difference
+exceeds the tolerance, or when the camera is enclosed (then PA1 falls back to
+the sphere and both renders would use it).
+
+Run from code/ after building:
+
+    python3 bench/env_light_check.py
+    python3 bench/env_light_check.py --spp 128 --tolerance 0.01
+
+Only the Python standard library is used.
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from bench_scenes import read_ppm  # noqa: E402
+
+
+def render(args, env_light):
+    name = "env_check_%s" % ("on" if env_light else "off")
+    cmd = [args.binary, args.scene, name, "--spp", str(args.spp), "--seed", str(args.seed),
+           "--env-light", str(env_light), "--generator", "scene1", "--format", "ppm", "--checkpoint", "0", "--texture-filter", "nearest"]
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+    output = proc.stdout.decode(errors="replace")
+    if proc.returncode != 0:
+        sys.exit("%s failed:\n%s" % (" ".join(cmd), output[-2000:]))
+    if env_light and "enclosed by scene geometry" in output:
+        sys.exit("%s: the camera is enclosed, the environment light is not used; pick an open scene" % args.scene)
+    return read_ppm(os.path.join("output", name + ".ppm"))
+
+
+def cell_means(image, grid):
+    """Linear mean of each channel over the whole image and over grid x grid cells."""
+    w, h, pixels = image
+    sums = [[[0.0] * 3 for _ in range(grid)] for _ in range(grid)]
+    counts = [[0] * grid for _ in range(grid)]
+    for y in range(h):
+        cy = y * grid // h
+        for x in range(w):
+            cx = x * grid // w
+            i = (y * w + x) * 3
+            cell = sums[cy][cx]
+            for c in range(3):
+                v = pixels[i + c] / 255.0
+                cell[c] += v * v
+            counts[cy][cx] += 1
+    total = [sum(sums[cy][cx][c] for cy in range(grid) for cx in range(grid)) / (w * h) for c in range(3)]
+    cells = [[[s / counts[cy][cx] for s in sums[cy][cx]] for cx in range(grid)] for cy in range(grid)]
+    return total, cells
+
+
+def relative(a, b):
+    return abs(a - b) / max(b, 1e-4)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--binary", default="bin/PA1")
+    parser.add_argument("--scene", default="bench/env_light_open.txt")
+    parser.add_argument("--spp", type=int, default=32)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--tolerance", type=float, default=0.03,
+                        help="largest relative difference of the overall mean per channel")
+    parser.add_argument("--grid", type=int, default=4)
+    parser.add_argument("--cell-tolerance", type=float, default=0.10,
+                        help="largest relative difference of a cell mean per channel")
+    args = parser.parse_args()
+    os.makedirs("output/temp/ppm", exist_ok=True)
+
+    on_total, on_cells = cell_means(render(args, 1), args.grid)
+    off_total, off_cells = cell_means(render(args, 0), args.grid)
+
+    failed = False
+    diffs = [relative(on_total[c], off_total[c]) for c in range(3)]
+    print("mean (linear rgb)  env-light 1: %.4f %.4f %.4f   env-light 0: %.4f %.4f %.4f   difference %s" % (
+        tuple(on_total) + tuple(off_total) + (" ".join("%.2f%%" % (100 * d) for d in diffs),)))
+    if max(diffs) > args.tolerance:
+        print("FAIL: overall mean differs by more than %.1f%%" % (100 * args.tolerance))
+        failed = True
+
+    worst = 0.0
+    for cy in range(args.grid):
+        for cx in range(args.grid):
+            for c in range(3):
+                d = relative(on_cells[cy][cx][c], off_cells[cy][cx][c])
+                worst = max(worst, d)
+                if d > args.cell_tolerance:
+                    print("FAIL: cell (%d, %d) channel %d: %.4f vs %.4f" % (
+                        cx, cy, c, on_cells[cy][cx][c], off_cells[cy][cx][c]))
+                    failed = True
+    print("largest cell difference %.2f%% (%dx%d cells)" % (100 * worst, args.grid, args.grid))
+    print("FAIL" if failed else "ok")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,39 @@
+#!/bin/sh
+# PGO 发布构建：插桩构建 -> 用 testcases/ 的基准场景训练 -> 用训练得到的 profile 重新构建
+#
+# 用法（在 code/ 下运行）: bench/pgo_build.sh [--spp N] [scene.txt ...]
+# 结果是 bin/PA1。训练用 bench_scenes.py 的场景和固定种子，默认 spp 为 4。
+set -e
+
+SPP=4
+if [ "$1" = "--spp" ]; then
+    SPP=$2
+    shift 2
+fi
+SCENES="$*"
+if [ -z "$SCENES" ]; then
+    SCENES=$(ls testcases/*.txt)
+fi
+PROFILE_DIR=build/pgo/pgo-profile
+
+echo "== PGO 1/3: instrumented build"
+cmake --preset pgo-generate
+cmake --build --preset pgo-generate -j "$(nproc 2>/dev/null || echo 4)"
+
+echo "== PGO 2/3: training on $SCENES"
+rm -rf "$PROFILE_DIR"
+mkdir -p "$PROFILE_DIR" output/temp/bmp output/temp/ppm
+for scene in $SCENES; do
+    name=pgo_train_$(basename "$scene" .txt)
+    bin/PA1 "$scene" "$name" --spp "$SPP" --seed 1 > /dev/null
+    rm -f "output/$name.bmp" "output/$name.ppm"
+done
+# clang 写出 .profraw，需要合并
+if ls "$PROFILE_DIR"/*.profraw > /dev/null 2>&1; then
+    llvm-profdata merge -output="$PROFILE_DIR/default.profdata" "$PROFILE_DIR"/*.profraw
+fi
+
+echo "== PGO 3/3: optimized build"
+cmake --preset pgo-use
+cmake --build --preset pgo-use -j "$(nproc 2>/dev/null || echo 4)"
+echo "PGO build written to bin/PA1"
@@ -1,6 +1,8 @@
 #ifndef MATRIX4F_H
 #define MATRIX4F_H
 
+#include "VecmathConfig.h"
+
 #include <cstdio>
 
 class Matrix2f;
@@ -106,4 +108,35 @@ Vector4f operator * ( const Matrix4f& m, const Vector4f& v );
 // Matrix-Matrix multiplication
 Matrix4f operator * ( const Matrix4f& x, const Matrix4f& y );
 
+#include "Vector4f.h"
+
+//////////////////////////////////////////////////////////////////////////
+// Inline definitions
+//////////////////////////////////////////////////////////////////////////
+
+VECMATH_INLINE const float& Matrix4f::operator () ( int i, int j ) const
+{
+	return m_elements[ j * 4 + i ];
+}
+
+VECMATH_INLINE float& Matrix4f::operator () ( int i, int j )
+{
+	return m_elements[ j * 4 + i ];
+}
+
+VECMATH_INLINE Vector4f operator * ( const Matrix4f& m, const Vector4f& v )
+{
+	Vector4f output( 0, 0, 0, 0 );
+
+	for( int i = 0; i < 4; ++i )
+	{
+		for( int j = 0; j < 4; ++j )
+		{
+			output[ i ] += m( i, j ) * v[ j ];
+		}
+	}
+
+	return output;
+}
+
 #endif // MATRIX4F_H
@@ -0,0 +1,25 @@
+#ifndef VECMATH_CONFIG_H
+#define VECMATH_CONFIG_H
+
+// Vector2f / Vector3f / Vector4f are header-only: every operation is defined
+// in the header and force-inlined, so the renderer's hot arithmetic does not
+// go through calls into libvecmath.a.
+#if defined( _MSC_VER )
+#define VECMATH_INLINE __forceinline
+#elif defined( __GNUC__ ) || defined( __clang__ )
+#define VECMATH_INLINE inline __attribute__( ( always_inline ) )
+#else
+#define VECMATH_INLINE inline
+#endif
+
+// Optional SSE layout for Vector3f: 4 lanes (the 4th is padding and never read),
+// 16-byte aligned, arithmetic done with SSE2 intrinsics.
+// Enable with the CMake option VECMATH_SSE.
+#if defined( VECMATH_SSE ) && ( defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 ) )
+#define VECMATH_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define VECMATH_USE_SSE 0
+#endif
+
+#endif // VECMATH_CONFIG_H
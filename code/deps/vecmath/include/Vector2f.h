@@ -1,6 +1,8 @@
 #ifndef VECTOR_2F_H
 #define VECTOR_2F_H
 
+#include "VecmathConfig.h"
+
 #include <cmath>
 
 class Vector3f;
@@ -13,14 +15,14 @@ public:
 	static const Vector2f UP;
 	static const Vector2f RIGHT;
 
-    Vector2f( float f = 0.f );
-    Vector2f( float x, float y );
+    constexpr Vector2f( float f = 0.f ) : m_elements{ f, f } {}
+    constexpr Vector2f( float x, float y ) : m_elements{ x, y } {}
 
 	// copy constructors
-    Vector2f( const Vector2f& rv );
+    Vector2f( const Vector2f& rv ) = default;
 
 	// assignment operators
-	Vector2f& operator = ( const Vector2f& rv );
+	Vector2f& operator = ( const Vector2f& rv ) = default;
 
 	// no destructor necessary
 
@@ -87,4 +89,198 @@ Vector2f operator / ( const Vector2f& v, float f );
 bool operator == ( const Vector2f& v0, const Vector2f& v1 );
 bool operator != ( const Vector2f& v0, const Vector2f& v1 );
 
+#include "Vector3f.h"
+
+//////////////////////////////////////////////////////////////////////////
+// Inline definitions
+//////////////////////////////////////////////////////////////////////////
+
+VECMATH_INLINE const float& Vector2f::operator [] ( int i ) const
+{
+    return m_elements[i];
+}
+
+VECMATH_INLINE float& Vector2f::operator [] ( int i )
+{
+    return m_elements[i];
+}
+
+VECMATH_INLINE float& Vector2f::x()
+{
+    return m_elements[0];
+}
+
+VECMATH_INLINE float& Vector2f::y()
+{
+    return m_elements[1];
+}
+
+VECMATH_INLINE float Vector2f::x() const
+{
+    return m_elements[0];
+}	
+
+VECMATH_INLINE float Vector2f::y() const
+{
+    return m_elements[1];
+}
+
+VECMATH_INLINE Vector2f Vector2f::xy() const
+{
+    return *this;
+}
+
+VECMATH_INLINE Vector2f Vector2f::yx() const
+{
+    return Vector2f( m_elements[1], m_elements[0] );
+}
+
+VECMATH_INLINE Vector2f Vector2f::xx() const
+{
+    return Vector2f( m_elements[0], m_elements[0] );
+}
+
+VECMATH_INLINE Vector2f Vector2f::yy() const
+{
+    return Vector2f( m_elements[1], m_elements[1] );
+}
+
+VECMATH_INLINE Vector2f Vector2f::normal() const
+{
+    return Vector2f( -m_elements[1], m_elements[0] );
+}
+
+VECMATH_INLINE float Vector2f::abs() const
+{
+    return sqrt(absSquared());
+}
+
+VECMATH_INLINE float Vector2f::absSquared() const
+{
+    return m_elements[0] * m_elements[0] + m_elements[1] * m_elements[1];
+}
+
+VECMATH_INLINE void Vector2f::normalize()
+{
+    float norm = abs();
+    m_elements[0] /= norm;
+    m_elements[1] /= norm;
+}
+
+VECMATH_INLINE Vector2f Vector2f::normalized() const
+{
+    float norm = abs();
+    return Vector2f( m_elements[0] / norm, m_elements[1] / norm );
+}
+
+VECMATH_INLINE void Vector2f::negate()
+{
+    m_elements[0] = -m_elements[0];
+    m_elements[1] = -m_elements[1];
+}
+
+VECMATH_INLINE Vector2f::operator const float* () const
+{
+    return m_elements;
+}
+
+VECMATH_INLINE Vector2f::operator float* ()
+{
+    return m_elements;
+}
+
+VECMATH_INLINE Vector2f& Vector2f::operator += ( const Vector2f& v )
+{
+	m_elements[ 0 ] += v.m_elements[ 0 ];
+	m_elements[ 1 ] += v.m_elements[ 1 ];
+	return *this;
+}
+
+VECMATH_INLINE Vector2f& Vector2f::operator -= ( const Vector2f& v )
+{
+	m_elements[ 0 ] -= v.m_elements[ 0 ];
+	m_elements[ 1 ] -= v.m_elements[ 1 ];
+	return *this;
+}
+
+VECMATH_INLINE Vector2f& Vector2f::operator *= ( float f )
+{
+	m_elements[ 0 ] *= f;
+	m_elements[ 1 ] *= f;
+	return *this;
+}
+
+// static
+VECMATH_INLINE float Vector2f::dot( const Vector2f& v0, const Vector2f& v1 )
+{
+    return v0[0] * v1[0] + v0[1] * v1[1];
+}
+
+// static
+VECMATH_INLINE Vector3f Vector2f::cross( const Vector2f& v0, const Vector2f& v1 )
+{
+	return Vector3f
+		(
+			0,
+			0,
+			v0.x() * v1.y() - v0.y() * v1.x()
+		);
+}
+
+// static
+VECMATH_INLINE Vector2f Vector2f::lerp( const Vector2f& v0, const Vector2f& v1, float alpha )
+{
+	return alpha * ( v1 - v0 ) + v0;
+}
+
+VECMATH_INLINE Vector2f operator + ( const Vector2f& v0, const Vector2f& v1 )
+{
+    return Vector2f( v0.x() + v1.x(), v0.y() + v1.y() );
+}
+
+VECMATH_INLINE Vector2f operator - ( const Vector2f& v0, const Vector2f& v1 )
+{
+    return Vector2f( v0.x() - v1.x(), v0.y() - v1.y() );
+}
+
+VECMATH_INLINE Vector2f operator * ( const Vector2f& v0, const Vector2f& v1 )
+{
+    return Vector2f( v0.x() * v1.x(), v0.y() * v1.y() );
+}
+
+VECMATH_INLINE Vector2f operator / ( const Vector2f& v0, const Vector2f& v1 )
+{
+    return Vector2f( v0.x() / v1.x(), v0.y() / v1.y() );
+}
+
+VECMATH_INLINE Vector2f operator - ( const Vector2f& v )
+{
+    return Vector2f( -v.x(), -v.y() );
+}
+
+VECMATH_INLINE Vector2f operator * ( float f, const Vector2f& v )
+{
+    return Vector2f( f * v.x(), f * v.y() );
+}
+
+VECMATH_INLINE Vector2f operator * ( const Vector2f& v, float f )
+{
+    return Vector2f( f * v.x(), f * v.y() );
+}
+
+VECMATH_INLINE Vector2f operator / ( const Vector2f& v, float f )
+{
+    return Vector2f( v.x() / f, v.y() / f );
+}
+
+VECMATH_INLINE bool operator == ( const Vector2f& v0, const Vector2f& v1 )
+{
+    return( v0.x() == v1.x() && v0.y() == v1.y() );
+}
+
+VECMATH_INLINE bool operator != ( const Vector2f& v0, const Vector2f& v1 )
+{
+    return !( v0 == v1 );
+}
+
 #endif // VECTOR_2F_H
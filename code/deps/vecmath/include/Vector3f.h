@@ -1,9 +1,17 @@
 #ifndef VECTOR_3F_H
 #define VECTOR_3F_H
 
+#include "VecmathConfig.h"
+
+#include <cmath>
+
 class Vector2f;
 
+#if VECMATH_USE_SSE
+class alignas( 16 ) Vector3f{
+#else
 class Vector3f{
+#endif
 public:
 
 	static const Vector3f ZERO;
@@ -11,17 +19,24 @@ public:
 	static const Vector3f RIGHT;
 	static const Vector3f FORWARD;
 
-    Vector3f( float f = 0.f );
-    Vector3f( float x, float y, float z );
+#if VECMATH_USE_SSE
+    constexpr Vector3f( float f = 0.f ) : m_elements{ f, f, f, 0.f } {}
+    constexpr Vector3f( float x, float y, float z ) : m_elements{ x, y, z, 0.f } {}
+    explicit Vector3f( __m128 v ) : m_simd( v ) {}
+    __m128 simd() const { return m_simd; }
+#else
+    constexpr Vector3f( float f = 0.f ) : m_elements{ f, f, f } {}
+    constexpr Vector3f( float x, float y, float z ) : m_elements{ x, y, z } {}
+#endif
 
 	Vector3f( const Vector2f& xy, float z );
 	Vector3f( float x, const Vector2f& yz );
 
 	// copy constructors
-    Vector3f( const Vector3f& rv );
+    Vector3f( const Vector3f& rv ) = default;
 
 	// assignment operators
-    Vector3f& operator = ( const Vector3f& rv );
+    Vector3f& operator = ( const Vector3f& rv ) = default;
 
 	// no destructor necessary
 
@@ -79,7 +94,15 @@ public:
 	static Vector3f cubicInterpolate( const Vector3f& p0, const Vector3f& p1, const Vector3f& p2, const Vector3f& p3, float t );
 
 protected:
+#if VECMATH_USE_SSE
+	// m_elements[ 3 ] 只是填充，不参与任何运算结果
+	union {
+		float m_elements[ 4 ];
+		__m128 m_simd;
+	};
+#else
 	float m_elements[ 3 ];
+#endif
 };
 
 // component-wise operators
@@ -99,4 +122,344 @@ Vector3f operator / ( const Vector3f& v, float f );
 bool operator == ( const Vector3f& v0, const Vector3f& v1 );
 bool operator != ( const Vector3f& v0, const Vector3f& v1 );
 
+#include "Vector2f.h"
+
+//////////////////////////////////////////////////////////////////////////
+// Inline definitions
+//////////////////////////////////////////////////////////////////////////
+
+VECMATH_INLINE Vector3f::Vector3f( const Vector2f& xy, float z )
+{
+	m_elements[0] = xy.x();
+	m_elements[1] = xy.y();
+	m_elements[2] = z;
+}
+
+VECMATH_INLINE Vector3f::Vector3f( float x, const Vector2f& yz )
+{
+	m_elements[0] = x;
+	m_elements[1] = yz.x();
+	m_elements[2] = yz.y();
+}
+
+VECMATH_INLINE const float& Vector3f::operator [] ( int i ) const
+{
+    return m_elements[i];
+}
+
+VECMATH_INLINE float& Vector3f::operator [] ( int i )
+{
+    return m_elements[i];
+}
+
+VECMATH_INLINE float& Vector3f::x()
+{
+    return m_elements[0];
+}
+
+VECMATH_INLINE float& Vector3f::y()
+{
+    return m_elements[1];
+}
+
+VECMATH_INLINE float& Vector3f::z()
+{
+    return m_elements[2];
+}
+
+VECMATH_INLINE float Vector3f::x() const
+{
+    return m_elements[0];
+}
+
+VECMATH_INLINE float Vector3f::y() const
+{
+    return m_elements[1];
+}
+
+VECMATH_INLINE float Vector3f::z() const
+{
+    return m_elements[2];
+}
+
+VECMATH_INLINE Vector2f Vector3f::xy() const
+{
+	return Vector2f( m_elements[0], m_elements[1] );
+}
+
+VECMATH_INLINE Vector2f Vector3f::xz() const
+{
+	return Vector2f( m_elements[0], m_elements[2] );
+}
+
+VECMATH_INLINE Vector2f Vector3f::yz() const
+{
+	return Vector2f( m_elements[1], m_elements[2] );
+}
+
+VECMATH_INLINE Vector3f Vector3f::xyz() const
+{
+	return Vector3f( m_elements[0], m_elements[1], m_elements[2] );
+}
+
+VECMATH_INLINE Vector3f Vector3f::yzx() const
+{
+	return Vector3f( m_elements[1], m_elements[2], m_elements[0] );
+}
+
+VECMATH_INLINE Vector3f Vector3f::zxy() const
+{
+	return Vector3f( m_elements[2], m_elements[0], m_elements[1] );
+}
+
+VECMATH_INLINE float Vector3f::length() const
+{
+	return sqrt( m_elements[0] * m_elements[0] + m_elements[1] * m_elements[1] + m_elements[2] * m_elements[2] );
+}
+
+VECMATH_INLINE float Vector3f::squaredLength() const
+{
+    return
+        (
+            m_elements[0] * m_elements[0] +
+            m_elements[1] * m_elements[1] +
+            m_elements[2] * m_elements[2]
+        );
+}
+
+VECMATH_INLINE void Vector3f::normalize()
+{
+	float norm = length();
+	m_elements[0] /= norm;
+	m_elements[1] /= norm;
+	m_elements[2] /= norm;
+}
+
+VECMATH_INLINE Vector3f Vector3f::normalized() const
+{
+	float norm = length();
+	return Vector3f
+		(
+			m_elements[0] / norm,
+			m_elements[1] / norm,
+			m_elements[2] / norm
+		);
+}
+
+VECMATH_INLINE Vector2f Vector3f::homogenized() const
+{
+	return Vector2f
+		(
+			m_elements[ 0 ] / m_elements[ 2 ],
+			m_elements[ 1 ] / m_elements[ 2 ]
+		);
+}
+
+VECMATH_INLINE void Vector3f::negate()
+{
+	m_elements[0] = -m_elements[0];
+	m_elements[1] = -m_elements[1];
+	m_elements[2] = -m_elements[2];
+}
+
+VECMATH_INLINE Vector3f::operator const float* () const
+{
+    return m_elements;
+}
+
+VECMATH_INLINE Vector3f::operator float* (){
+    return m_elements;
+}
+
+VECMATH_INLINE Vector3f& Vector3f::operator += (const Vector3f& v){
+#if VECMATH_USE_SSE
+	m_simd = _mm_add_ps( m_simd, v.m_simd );
+	return *this;
+#else
+	m_elements[0] += v.m_elements[0];
+	m_elements[1] += v.m_elements[1];
+	m_elements[2] += v.m_elements[2];
+	return *this;
+#endif
+}
+
+VECMATH_INLINE Vector3f& Vector3f::operator -= (const Vector3f& v){
+#if VECMATH_USE_SSE
+	m_simd = _mm_sub_ps( m_simd, v.m_simd );
+	return *this;
+#else
+	m_elements[0] -= v.m_elements[0];
+	m_elements[1] -= v.m_elements[1];
+	m_elements[2] -= v.m_elements[2];
+	return *this;
+#endif
+}
+
+VECMATH_INLINE Vector3f& Vector3f::operator *= (float f){
+#if VECMATH_USE_SSE
+	m_simd = _mm_mul_ps( m_simd, _mm_set1_ps( f ) );
+	return *this;
+#else
+	m_elements[0] *= f;
+	m_elements[1] *= f;
+	m_elements[2] *= f;
+	return *this;
+#endif
+}
+
+VECMATH_INLINE Vector3f& Vector3f::operator /= (float f) {
+#if VECMATH_USE_SSE
+	m_simd = _mm_div_ps( m_simd, _mm_set1_ps( f ) );
+	return *this;
+#else
+	m_elements[0] /= f;
+	m_elements[1] /= f;
+	m_elements[2] /= f;
+	return *this;
+#endif
+}
+
+// static
+VECMATH_INLINE float Vector3f::dot(const Vector3f& v0, const Vector3f& v1){
+#if VECMATH_USE_SSE
+    // 只累加 x, y, z 三个分量，顺序与标量版本相同
+    __m128 m = _mm_mul_ps( v0.m_simd, v1.m_simd );
+    __m128 y = _mm_shuffle_ps( m, m, _MM_SHUFFLE( 1, 1, 1, 1 ) );
+    __m128 z = _mm_shuffle_ps( m, m, _MM_SHUFFLE( 2, 2, 2, 2 ) );
+    return _mm_cvtss_f32( _mm_add_ss( _mm_add_ss( m, y ), z ) );
+#else
+    return v0[0] * v1[0] + v0[1] * v1[1] + v0[2] * v1[2];
+#endif
+}
+
+// static
+VECMATH_INLINE Vector3f Vector3f::cross(const Vector3f& v0, const Vector3f& v1){
+#if VECMATH_USE_SSE
+    // (y, z, x) 轮换: c = a * b.yzx - a.yzx * b，结果再轮换一次
+    __m128 a = _mm_shuffle_ps( v0.m_simd, v0.m_simd, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+    __m128 b = _mm_shuffle_ps( v1.m_simd, v1.m_simd, _MM_SHUFFLE( 3, 0, 2, 1 ) );
+    __m128 c = _mm_sub_ps( _mm_mul_ps( v0.m_simd, b ), _mm_mul_ps( a, v1.m_simd ) );
+    return Vector3f( _mm_shuffle_ps( c, c, _MM_SHUFFLE( 3, 0, 2, 1 ) ) );
+#else
+    return Vector3f(
+            v0.y() * v1.z() - v0.z() * v1.y(),
+            v0.z() * v1.x() - v0.x() * v1.z(),
+            v0.x() * v1.y() - v0.y() * v1.x()
+        );
+#endif
+}
+
+// static
+VECMATH_INLINE float Vector3f::angleBetween(const Vector3f& v0, const Vector3f& v1) {
+	return acos(dot(v0, v1) / (v0.length() * v1.length()) ) ;
+}
+
+// static
+VECMATH_INLINE Vector3f Vector3f::lerp( const Vector3f& v0, const Vector3f& v1, float alpha ){
+	return alpha * ( v1 - v0 ) + v0;
+}
+
+// static
+VECMATH_INLINE Vector3f Vector3f::cubicInterpolate( const Vector3f& p0, const Vector3f& p1, const Vector3f& p2, const Vector3f& p3, float t )
+{
+	// geometric construction:
+	//            t
+	//   (t+1)/2     t/2
+	// t+1        t	        t-1
+
+	// bottom level
+	Vector3f p0p1 = Vector3f::lerp( p0, p1, t + 1 );
+	Vector3f p1p2 = Vector3f::lerp( p1, p2, t );
+	Vector3f p2p3 = Vector3f::lerp( p2, p3, t - 1 );
+
+	// middle level
+	Vector3f p0p1_p1p2 = Vector3f::lerp( p0p1, p1p2, 0.5f * ( t + 1 ) );
+	Vector3f p1p2_p2p3 = Vector3f::lerp( p1p2, p2p3, 0.5f * t );
+
+	// top level
+	return Vector3f::lerp( p0p1_p1p2, p1p2_p2p3, t );
+}
+
+VECMATH_INLINE Vector3f operator + ( const Vector3f& v0, const Vector3f& v1 )
+{
+#if VECMATH_USE_SSE
+    return Vector3f( _mm_add_ps( v0.simd(), v1.simd() ) );
+#else
+    return Vector3f( v0[0] + v1[0], v0[1] + v1[1], v0[2] + v1[2] );
+#endif
+}
+
+VECMATH_INLINE Vector3f operator - ( const Vector3f& v0, const Vector3f& v1 )
+{
+#if VECMATH_USE_SSE
+    return Vector3f( _mm_sub_ps( v0.simd(), v1.simd() ) );
+#else
+    return Vector3f( v0[0] - v1[0], v0[1] - v1[1], v0[2] - v1[2] );
+#endif
+}
+
+VECMATH_INLINE Vector3f operator * ( const Vector3f& v0, const Vector3f& v1 )
+{
+#if VECMATH_USE_SSE
+    return Vector3f( _mm_mul_ps( v0.simd(), v1.simd() ) );
+#else
+    return Vector3f( v0[0] * v1[0], v0[1] * v1[1], v0[2] * v1[2] );
+#endif
+}
+
+VECMATH_INLINE Vector3f operator / ( const Vector3f& v0, const Vector3f& v1 )
+{
+#if VECMATH_USE_SSE
+    return Vector3f( _mm_div_ps( v0.simd(), v1.simd() ) );
+#else
+    return Vector3f( v0[0] / v1[0], v0[1] / v1[1], v0[2] / v1[2] );
+#endif
+}
+
+VECMATH_INLINE Vector3f operator - ( const Vector3f& v )
+{
+#if VECMATH_USE_SSE
+    return Vector3f( _mm_xor_ps( v.simd(), _mm_set1_ps( -0.f ) ) );
+#else
+    return Vector3f( -v[0], -v[1], -v[2] );
+#endif
+}
+
+VECMATH_INLINE Vector3f operator * ( float f, const Vector3f& v )
+{
+#if VECMATH_USE_SSE
+    return Vector3f( _mm_mul_ps( v.simd(), _mm_set1_ps( f ) ) );
+#else
+    return Vector3f( v[0] * f, v[1] * f, v[2] * f );
+#endif
+}
+
+VECMATH_INLINE Vector3f operator * ( const Vector3f& v, float f )
+{
+#if VECMATH_USE_SSE
+    return Vector3f( _mm_mul_ps( v.simd(), _mm_set1_ps( f ) ) );
+#else
+    return Vector3f( v[0] * f, v[1] * f, v[2] * f );
+#endif
+}
+
+VECMATH_INLINE Vector3f operator / ( const Vector3f& v, float f )
+{
+#if VECMATH_USE_SSE
+    return Vector3f( _mm_div_ps( v.simd(), _mm_set1_ps( f ) ) );
+#else
+    return Vector3f( v[0] / f, v[1] / f, v[2] / f );
+#endif
+}
+
+VECMATH_INLINE bool operator == ( const Vector3f& v0, const Vector3f& v1 )
+{
+    return( v0.x() == v1.x() && v0.y() == v1.y() && v0.z() == v1.z() );
+}
+
+VECMATH_INLINE bool operator != ( const Vector3f& v0, const Vector3f& v1 )
+{
+    return !( v0 == v1 );
+}
+
 #endif // VECTOR_3F_H
@@ -1,9 +1,11 @@
 #ifndef AABB_H
 #define AABB_H
 
+#include <algorithm>
 #include <vecmath.h>
 #include <iostream>
 #include "ray.hpp"
+#include "stats.hpp"
 
 class Aabb {
 public:
@@ -14,6 +16,7 @@ public:
     Vector3f getMax() const { return mx; }
 
     inline bool intersect(const Ray& r, float tmin, float tmax) const {
+        STATS_INC(aabbTests);
         for (int i = 0; i < 3; i++){
             float inv = 1.0f / r.getDirection()[i];
             float t0 = (mn[i] - r.getOrigin()[i]) * inv;
@@ -42,6 +45,24 @@ public:
         return Aabb(mn, mx);
     }
 
+    // 经过仿射变换 m 之后的包围盒：旋转后原来的 min / max 不一定还是角点，取 8 个角点变换后的包围盒
+    Aabb transformed(const Matrix4f& m) const {
+        Vector3f lo, hi;
+        for (int i = 0; i < 8; i++) {
+            Vector3f corner(i & 1 ? mx.x() : mn.x(), i & 2 ? mx.y() : mn.y(), i & 4 ? mx.z() : mn.z());
+            Vector3f p = (m * Vector4f(corner, 1)).xyz();
+            if (i == 0) {
+                lo = hi = p;
+                continue;
+            }
+            for (int a = 0; a < 3; a++) {
+                lo[a] = std::min(lo[a], p[a]);
+                hi[a] = std::max(hi[a], p[a]);
+            }
+        }
+        return Aabb(lo, hi);
+    }
+
     void print() {
         std::cout << "AABB:\n  ";
         mn.print();
@@ -0,0 +1,67 @@
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <vector>
+#include <vecmath.h>
+#include "aabb.hpp"
+#include "utils.hpp"
+
+// 动画和运动模糊。时间的单位由场景自己定（关键帧的 time、球的 velocity 用同一个单位，
+// 默认一帧一个单位，见 settings 的 frame-step）：
+//   - 一帧的快门区间为 [open, close]，相机光线的时刻在区间内均匀分布，散射光线和阴影光线沿用相机光线的时刻
+//   - 运动的物体（有关键帧的 Transform、有 velocity 的 Sphere）按光线的时刻求交，
+//     包围盒取整个快门区间内的并集；换帧后由 BvhNode::refit 自底向上更新，不必重新建树
+// close == open 时没有运动模糊，相机光线不消耗随机数，静止场景的渲染结果与没有动画时相同
+class Shutter {
+public:
+    static void set(float _open, float _close) {
+        open = _open;
+        close = _close;
+    }
+    static float getOpen() { return open; }
+    static float getClose() { return close; }
+
+    // 相机光线的时刻
+    static float sample() {
+        return close > open ? open + Utils::randomFloat() * (close - open) : open;
+    }
+
+private:
+    static float open, close;
+};
+
+// 关键帧动画的变换：每个关键帧的矩阵分解为 平移 * 旋转 * 拉伸（极分解，Shoemake & Duff 1992），
+// 相邻关键帧之间平移、拉伸线性插值，旋转用四元数球面插值（走较短的一边，相邻关键帧的旋转应小于 180°）。
+// 直接插值矩阵会让旋转中的物体缩小、变形，分解后插值不会。
+// 第一个关键帧之前、最后一个之后保持端点的变换
+class TransformTrack {
+public:
+    // 关键帧按时间递增的顺序加入
+    void addKey(float time, const Matrix4f& m);
+
+    int numKeys() const { return (int) keys.size(); }
+    float keyTime(int i) const { return keys[i].time; }
+
+    // 时刻 t 的变换及其逆
+    void matrices(float t, Matrix4f& m, Matrix4f& inv) const;
+    Matrix4f matrixAt(float t) const {
+        Matrix4f m, inv;
+        matrices(t, m, inv);
+        return m;
+    }
+
+    // box 在 [t0, t1] 内经过变换扫过的包围盒
+    Aabb sweep(const Aabb& box, float t0, float t1) const;
+
+private:
+    struct Key {
+        float time;
+        Vector3f translation;
+        Quat4f rotation;
+        Matrix3f stretch;
+    };
+
+    std::vector<Key> keys;
+};
+
+#endif // ANIMATION_H
@@ -0,0 +1,86 @@
+#ifndef AOV_H
+#define AOV_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <vecmath.h>
+
+class Material;
+class Object3D;
+
+// 可单独输出的渲染通道（arbitrary output variables），--aov 按名字选择
+enum AovType {
+    colorAov,       // "color"：最终颜色（未做伽马纠正）
+    albedoAov,      // "albedo"：第一个交点处材质的颜色，未击中时为背景颜色
+    normalAov,      // "normal"：第一个交点的法线（单位向量），未击中为 0
+    depthAov,       // "depth"：第一个交点的距离，未击中为 0
+    objectIdAov,    // "object_id"：第一个交点所属物体在场景 Group 中的序号，未击中为 -1
+    materialIdAov,  // "material_id"：材质在场景文件中的序号（程序生成的材质排在之后），未击中为 -1
+    directAov,      // "direct"：第一个交点的直接光照（下一个顶点是光源或天空）
+    indirectAov,    // "indirect"：其余的间接光照；emission + direct + indirect = color
+    emissionAov,    // "emission"：直接看到的光源和天空
+    varianceAov,    // "variance"：颜色平均值的亮度方差
+    numAovs
+};
+
+// 一个相机采样的各通道值。积分器只填写 AovBuffers 请求的通道，其余字段保持默认值
+struct AovSample {
+    bool hit = false;
+    Vector3f albedo, normal;
+    float depth = 0;
+    int objectId = -1, materialId = -1;
+    Vector3f direct, indirect, emission;
+};
+
+// 每个请求的通道一块 float 帧缓冲，各自累加、各自输出一个文件。
+// 未请求的通道不分配内存，积分器也不计算（见 main.cpp 的 shadeFirstHit）
+class AovBuffers {
+public:
+    AovBuffers(int width, int height, unsigned mask);
+
+    // 逗号分隔的通道名，或 all；出错时打印信息并返回 false
+    static bool parseList(const std::string& list, unsigned& mask);
+    static const char* name(AovType t);
+    static int channels(AovType t);     // 每像素 float 个数：1 或 3
+
+    bool has(AovType t) const { return (mask >> t) & 1u; }
+    unsigned getMask() const { return mask; }
+    // 是否需要把颜色拆成 direct / indirect / emission
+    bool needsLightSplit() const { return has(directAov) || has(indirectAov) || has(emissionAov); }
+
+    // object_id / material_id 的编号
+    void setObjects(const std::vector<Object3D*>& objects);
+    void addMaterial(const Material* m);
+    int objectId(Object3D* obj) const;
+    int materialId(const Material* m);
+
+    // 累加 (x, y) 的一个采样，radiance 是该采样的颜色
+    void add(int x, int y, const AovSample& s, const Vector3f& radiance);
+
+    // 渲染结束后调用一次：把累加值变成每个像素的结果
+    void resolve();
+    // 清空所有通道，渲染下一帧（物体、材质编号不变）
+    void clear();
+
+    // resolve 之后每个通道的数据，按 (y * width + x) * channels 存放；未请求的通道返回 nullptr
+    const float* get(AovType t) const { return has(t) ? buffers[t].data() : nullptr; }
+
+    // 每个通道写出 <prefix>_<name>.pfm（浮点原值）和 .bmp（预览）；only 为要写出的通道掩码
+    void save(const std::string& prefix, unsigned only) const;
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+private:
+    int width, height;
+    unsigned mask;
+    std::vector<float> buffers[numAovs];
+    std::vector<int> samples;       // 每个像素的采样数
+    std::vector<int> hits;          // 每个像素击中场景的采样数（normal / depth 需要）
+    std::vector<float> lumSq;       // 每个采样亮度的平方和（variance 需要，亮度之和暂存在 buffers[varianceAov]）
+    std::unordered_map<Object3D*, int> objectIds;
+    std::unordered_map<const Material*, int> materialIds;
+};
+
+#endif // AOV_H
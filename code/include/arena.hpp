@@ -0,0 +1,108 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// 场景内存池（arena / bump allocator）
+//
+// 场景里的物体、材质、纹理、BVH 节点都从当前线程的 Arena 中分配，按分配顺序
+// 连续存放在大块内存里，由 Arena 统一持有：
+//   - 物体之间不再互相 delete（Group、RevSurface、Box 都不释放子物体）
+//   - reset() 析构所有对象，保留内存块给下一个场景（多帧渲染时内存占用稳定）
+//   - 析构 Arena 时一次释放所有内存块
+// 分配时按类别计数，printReport() 输出每个类别的对象数和字节数。
+//
+// 用法：
+//   Arena sceneArena;
+//   ArenaScope scope(sceneArena);          // 之后 arenaNew 都从 sceneArena 分配
+//   Sphere* s = arenaNew<Sphere>(arenaGeometry, center, r, mat);
+// 没有 ArenaScope 时使用进程级的默认 Arena。
+
+enum ArenaCategory {arenaGeometry, arenaMaterial, arenaTexture, arenaAccel, arenaOther, numArenaCategories};
+
+class Arena {
+public:
+    static const size_t blockSize = 256 * 1024;
+
+    Arena() {}
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // 分配未初始化的内存
+    void* allocate(size_t bytes, size_t align, ArenaCategory cat);
+
+    // 在 arena 中构造对象；需要析构的类型会登记析构函数，reset() 时按相反顺序调用
+    template <class T, class... Args>
+    T* make(ArenaCategory cat, Args&&... args) {
+        void* p = allocate(sizeof(T), alignof(T), cat);
+        T* obj = new (p) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            destructors.push_back({obj, [](void* q) { static_cast<T*>(q)->~T(); }});
+        }
+        ++counts[cat];
+        return obj;
+    }
+
+    // 由 arena 中的对象持有、但不在 arena 里的内存（纹理像素、网格三角形数组），只用于统计
+    void addExternal(ArenaCategory cat, size_t bytes) { external[cat] += bytes; }
+
+    // 析构所有对象，保留内存块
+    void reset();
+
+    size_t bytesUsed() const;
+    size_t bytesReserved() const;
+
+    void printReport(const char* title) const;
+
+    // 当前线程正在使用的 arena
+    static Arena& current();
+
+private:
+    friend class ArenaScope;
+
+    struct Block {
+        char* data;
+        size_t size;
+    };
+    struct Destructor {
+        void* obj;
+        void (*destroy)(void*);
+    };
+
+    std::vector<Block> blocks;
+    size_t curBlock = 0;    // 正在分配的内存块
+    size_t offset = 0;      // 当前块中已用的字节数
+    std::vector<Destructor> destructors;
+
+    size_t bytes[numArenaCategories] = {};
+    size_t counts[numArenaCategories] = {};
+    size_t external[numArenaCategories] = {};
+
+    static Arena*& currentSlot();
+};
+
+// 在作用域内把 arena 设为当前线程的 Arena::current()，离开时恢复
+class ArenaScope {
+public:
+    explicit ArenaScope(Arena& arena) : prev(Arena::currentSlot()) { Arena::currentSlot() = &arena; }
+    ~ArenaScope() { Arena::currentSlot() = prev; }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    Arena* prev;
+};
+
+template <class T, class... Args>
+inline T* arenaNew(ArenaCategory cat, Args&&... args) {
+    return Arena::current().make<T>(cat, std::forward<Args>(args)...);
+}
+
+#endif // ARENA_H
@@ -5,19 +5,21 @@
 #include <vector>
 #include "object3d.hpp"
 #include "rectangle.hpp"
+#include "arena.hpp"
 
 class Box : public Object3D {
 public:
     Box (){}
     Box(const Vector3f& v0, const Vector3f& v1, Material* m) : Object3D(m) {
+        objType = box;
         mn = v0;
         mx = v1;
-        back = new RectZ(v0.x(), v1.x(), v0.y(), v1.y(), v0.z(), m);
-        front = new RectZ(v0.x(), v1.x(), v0.y(), v1.y(), v1.z(), m);
-        bottom = new RectY(v0.x(), v1.x(), v0.z(), v1.z(), v0.y(), m);
-        top = new RectY(v0.x(), v1.x(), v0.z(), v1.z(), v1.y(), m);
-        left = new RectX(v0.y(), v1.y(), v0.z(), v1.z(), v0.x(), m);
-        right = new RectX(v0.y(), v1.y(), v0.z(), v1.z(), v1.x(), m);
+        back = arenaNew<RectZ>(arenaGeometry, v0.x(), v1.x(), v0.y(), v1.y(), v0.z(), m);
+        front = arenaNew<RectZ>(arenaGeometry, v0.x(), v1.x(), v0.y(), v1.y(), v1.z(), m);
+        bottom = arenaNew<RectY>(arenaGeometry, v0.x(), v1.x(), v0.z(), v1.z(), v0.y(), m);
+        top = arenaNew<RectY>(arenaGeometry, v0.x(), v1.x(), v0.z(), v1.z(), v1.y(), m);
+        left = arenaNew<RectX>(arenaGeometry, v0.y(), v1.y(), v0.z(), v1.z(), v0.x(), m);
+        right = arenaNew<RectX>(arenaGeometry, v0.y(), v1.y(), v0.z(), v1.z(), v1.x(), m);
     
         // 上下左右前后
         faces.resize(6);
@@ -30,10 +32,15 @@ public:
     }
 
     bool intersect(const Ray& ray, Hit& hit, float tmin, float tmax) {
+        STATS_PRIM(box);
+        // 六个面的类型是确定的，直接调用（可内联），顺序与 faces 相同
         bool ret = false;
-        for (Object3D* face : faces){
-            ret |= face->intersect(ray, hit, tmin, tmax);
-        }
+        ret |= top->RectY::intersect(ray, hit, tmin, tmax);
+        ret |= bottom->RectY::intersect(ray, hit, tmin, tmax);
+        ret |= left->RectX::intersect(ray, hit, tmin, tmax);
+        ret |= right->RectX::intersect(ray, hit, tmin, tmax);
+        ret |= front->RectZ::intersect(ray, hit, tmin, tmax);
+        ret |= back->RectZ::intersect(ray, hit, tmin, tmax);
         return ret;
     }
 
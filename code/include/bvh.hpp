@@ -2,10 +2,12 @@
 #define BVH_H
 
 #include <algorithm>
+#include <map>
 #include "object3d.hpp"
 #include "group.hpp"
 #include "mesh.hpp"
 #include "aabb.hpp"
+#include "packet.hpp"
 
 inline bool boxCmp(const Object3D* a, const Object3D* b, int dim) {
     Aabb boxA;
@@ -32,21 +34,61 @@ inline bool boxCmpZ(const Object3D* a, const Object3D* b) {
 
 class BvhNode : public Object3D {
 public:
-    BvhNode(){}
+    BvhNode() { objType = bhvNode; }
     BvhNode(Group *grp) : BvhNode(grp->getObjects(), 0, grp->getGroupSize()) {}
     // BvhNode(Mesh *m) : BvhNode(m->getTriangles(), 0, m->getMeshSize()) {}
     BvhNode(std::vector<Object3D*>& objects, int lo, int hi);
     BvhNode(std::vector<Triangle*>& triangles, int lo, int hi);
 
-    
+    // 对 Group 建树。sah 为 false 时同 BvhNode(grp)：每层随机选一个轴，按中位数划分；
+    // 为 true 时按表面积启发式（SAH）选择每层的划分轴和位置，不消耗随机数
+    static BvhNode* build(Group* grp, bool sah);
+
+    // 换帧后自底向上重新计算包围盒，树的结构不变，O(n)。运动的物体（animation.hpp）的包围盒取当前快门区间内的并集。
+    // 经 Transform 引用的原型（Define）的 BVH 也一起更新，被多个实例共用的只更新一次；网格自己的 BVH 不变
+    void refit();
+
+    // refit 之后这棵树的节点表面积相对建树时平均增长的倍数（每个节点同等权重，不含经 Transform 引用的原型、
+    // 网格自己的 BVH；建树后为 1）。物体移动后兄弟节点的重叠变多、包围盒变大，光线访问的节点随之变多（SAH 代价升高），
+    // 据此决定是否重新建树。不按根节点的面积归一化：场景里有很大的物体（地面）时，小物体的变化在根节点面积面前体现不出来
+    float refitGrowth() const;
+
+    // 热重载（reload.hpp）：把叶子上的物体换成 leaves 中对应的物体，树的结构不变，之后要 refit。
+    // leaves 以建树时的所有物体为键（没变的映射到自己），不在其中的子节点是这棵树自己的节点。返回换掉的个数
+    int replaceLeaves(const std::map<Object3D*, Object3D*>& leaves);
+
 
     virtual bool intersect(const Ray& ray, Hit& hit, float tmin, float tmax) override;
     virtual bool hitbox(Aabb& box) const;
 
+    // 光线包遍历：共享一个节点栈，用区间算术和 SIMD 包围盒测试剔除节点，
+    // 包内活跃光线太少时退回单光线遍历。hits[i] 对应 packet.rays[i]，
+    // 与 intersect(rays[i], hits[i], tmin, INF) 的结果相同。返回有交点的光线掩码。
+    unsigned intersectPacket(const RayPacket& packet, Hit* hits, float tmin);
+
+    // 阴影光线：(tmin, tmax) 内有任意交点就返回 true，不求最近交点
+    bool occluded(const Ray& ray, float tmin, float tmax);
+
+    // 同 intersect，另外返回最近交点所在的叶子物体（BVH 的输入物体之一），没有交点时返回 nullptr
+    Object3D* pick(const Ray& ray, Hit& hit, float tmin, float tmax);
+
+    // 活跃光线数不超过这个值时退回单光线遍历
+    static const int packetFallbackRays = 2;
+    // 包遍历的节点栈大小。树深到栈放不下两个子节点时，这棵子树也退回单光线遍历
+    static const int packetStackSize = 256;
+
 public:
     Object3D* left;
     Object3D* right;
     Aabb box;
+    int axis;   // 建树时排序用的轴，左子树在这个轴上更靠前
+    float builtArea = 0;    // 建树时包围盒的表面积
+
+private:
+    void refit(int epoch);
+    static void refitObject(Object3D* obj, int epoch);
+
+    int refitEpoch = 0;     // 上次 refit 的编号
 };
 
 #endif // BVH_H
\ No newline at end of file
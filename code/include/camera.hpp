@@ -1,6 +1,7 @@
 #ifndef CAMERA_H
 #define CAMERA_H
 
+#include "animation.hpp"
 #include "ray.hpp"
 #include <vecmath.h>
 #include <float.h>
@@ -28,6 +29,13 @@ public:
     int getWidth() const { return width; }
     int getHeight() const { return height; }
 
+    // 预览服务器（preview.hpp）读取当前参数；up 返回正交化后的方向
+    const Vector3f& getCenter() const { return pos; }
+    const Vector3f& getDirection() const { return localZ; }
+    const Vector3f& getUp() const { return localY; }
+    float getAperture() const { return lensRadius * 2; }
+    float getFocusDistance() const { return focusDist; }
+
 protected:
     // Extrinsic parameters
     Vector3f pos;
@@ -49,6 +57,7 @@ protected:
     Vector3f imgPlaneBottomLeft;
     float imgPlaneWidth;
     float imgPlaneHeight;
+    float pixelSpread;      // 一个像素对应的张角（弧度）
 public:
     PerspectiveCamera(const Vector3f &center, const Vector3f& _dir,
             const Vector3f &up, int imgW, int imgH, float angle, float _aperture, float _focusDist) : Camera(center, _dir, up, imgW, imgH, _aperture, _focusDist) {
@@ -58,8 +67,11 @@ public:
         
         imgPlaneWidth = focusDist * tan(angle/2);
         imgPlaneHeight = imgPlaneWidth / width * height;
+        pixelSpread = 2 * tan(angle/2) / width;
     }
 
+    float getAngle() const { return angle; }   // 弧度
+
     Ray generateRay(const Vector2f &point) override {
         Vector2f tmp = lensRadius * Utils::randomInUnitDisk();
         Vector3f offset = localX * tmp.x() + localY * tmp.y();
@@ -69,7 +81,10 @@ public:
         Vector3f rayDirZ = localZ * focusDist;
 
         Vector3f rayDir = rayDirZ + rayDirX + rayDirY - offset;
-        return Ray(pos + offset, rayDir.normalized());
+        Ray ray(pos + offset, rayDir.normalized());
+        ray.setCone(0, pixelSpread);   // 光线锥从一个像素的张角开始
+        ray.setTime(Shutter::sample());   // 快门打开的时间内随机取一个时刻（运动模糊），在镜头采样之后取
+        return ray;
     }
 };
 
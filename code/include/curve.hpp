@@ -12,7 +12,7 @@ class Curve : public Object3D {
 protected:
     std::vector<Vector3f> controls;
 public:
-    explicit Curve(std::vector<Vector3f> points) : controls(std::move(points)) {}
+    explicit Curve(std::vector<Vector3f> points) : controls(std::move(points)) { objType = curveObj; }
 
     bool intersect(const Ray &r, Hit &h, float tmin, float tmax) override {
         return false;  // 永远不相交
@@ -24,6 +24,13 @@ public:
 
     virtual float B(float t, int i, int n) = 0;
     virtual float BDeriv(float t, int i, int n) = 0;
+
+    // 曲线上t对应的点及其导数（求交时的热点，不分配内存）
+    virtual Vector3f getPoint(float t) const = 0;
+    virtual Vector3f getDeriv(float t) const = 0;
+
+    // 求参数区间[u0, u1]内曲线的包围盒
+    virtual void spanBounds(float u0, float u1, Vector3f& mn, Vector3f& mx) const = 0;
 };
 
 // Bezier曲线
@@ -34,6 +41,42 @@ public:
             printf("Number of control points of BezierCurve must be 3n+1!\n");
             exit(0);
         }
+        computePowerBasis();
+    }
+
+    // 用Horner法则求幂基多项式的值
+    Vector3f getPoint(float t) const override {
+        return horner(coeffs, t);
+    }
+
+    Vector3f getDeriv(float t) const override {
+        return horner(derivCoeffs, t);
+    }
+
+    // 用de Casteljau算法截出[u0, u1]段的控制点，由凸包性质得到包围盒
+    void spanBounds(float u0, float u1, Vector3f& mn, Vector3f& mx) const override {
+        std::vector<Vector3f> q = controls;
+        int n = q.size() - 1;
+        // 在u1处分割，保留左半段（[0, u1]）
+        for (int k = 1; k <= n; k++) {
+            for (int i = n; i >= k; i--) {
+                q[i] = (1 - u1) * q[i-1] + u1 * q[i];
+            }
+        }
+        // 在u0/u1处分割，保留右半段（[u0, u1]）
+        float s = u1 > 0 ? u0 / u1 : 0;
+        for (int k = 1; k <= n; k++) {
+            for (int i = 0; i <= n - k; i++) {
+                q[i] = (1 - s) * q[i] + s * q[i+1];
+            }
+        }
+        mn = mx = q[0];
+        for (const Vector3f& p : q) {
+            for (int i = 0; i < 3; i++) {
+                mn[i] = fmin(mn[i], p[i]);
+                mx[i] = fmax(mx[i], p[i]);
+            }
+        }
     }
 
     float BDeriv(float t, int i, int n) {
@@ -56,22 +99,50 @@ public:
         return ret;
     }
 
-    long long int nCr(int n, int r) {
-        long long* row = new long long[n + 1]; // DP
-        for (int i = 0; i <= n; i++) row[i] = 0;
-
-        row[0] = 1;
-        for (int i = 1; i <= n; i++){
-            for (int j = i; j > 0; j--) {
-                row[j] += row[j-1];
-            }
+    static long long int nCr(int n, int r) {
+        if (r < 0 || n < r) return 0;
+        if (r > n - r) r = n - r;
+        long long ret = 1;
+        for (int i = 1; i <= r; i++) {
+            ret = ret * (n - r + i) / i;  // 每一步都能整除
         }
-        float ret = row[r];
-        delete [] row; // free memory
         return ret;
     }
 
 protected:
+    // 把Bernstein基转成幂基：P(t) = sum_j coeffs[j] * t^j
+    // coeffs[j] = C(n,j) * sum_{i<=j} (-1)^(j-i) * C(j,i) * P_i
+    void computePowerBasis() {
+        int n = controls.size() - 1;
+        coeffs.assign(n + 1, Vector3f::ZERO);
+        for (int j = 0; j <= n; j++) {
+            Vector3f c = Vector3f::ZERO;
+            for (int i = 0; i <= j; i++) {
+                float sign = ((j - i) % 2 == 0) ? 1.0f : -1.0f;
+                c += (sign * nCr(j, i)) * controls[i];
+            }
+            coeffs[j] = (float) nCr(n, j) * c;
+        }
+        // 导数：P'(t) = sum_j (j+1) * coeffs[j+1] * t^j
+        derivCoeffs.assign(n > 0 ? n : 1, Vector3f::ZERO);
+        for (int j = 0; j < n; j++) {
+            derivCoeffs[j] = (float) (j + 1) * coeffs[j + 1];
+        }
+    }
+
+    static inline Vector3f horner(const std::vector<Vector3f>& c, float t) {
+        float x = 0, y = 0, z = 0;
+        for (int i = (int) c.size() - 1; i >= 0; i--) {
+            const float* ci = c[i];
+            x = x * t + ci[0];
+            y = y * t + ci[1];
+            z = z * t + ci[2];
+        }
+        return Vector3f(x, y, z);
+    }
+
+    std::vector<Vector3f> coeffs;       // 位置的幂基系数
+    std::vector<Vector3f> derivCoeffs;  // 导数的幂基系数
 };
 
 #endif // CURVE_HPP
@@ -0,0 +1,27 @@
+#ifndef DENOISE_H
+#define DENOISE_H
+
+#include <vector>
+#include "aov.hpp"
+
+// SVGF 式的 à-trous 小波滤波（Schied et al. 2017，去掉时间累积部分）：
+// 先用反照率解调得到辐照度，再做 iterations 次 5x5 B 样条卷积，第 i 次的采样间隔为 2^i；
+// 每个邻居的权重由法线夹角、深度差（按深度梯度缩放）和亮度差（按方差缩放）决定，
+// 不跨越物体边缘和纹理边缘；最后乘回反照率。
+// 按行分给多个线程，每行 4 个像素一组用 SSE 计算（没有 SSE 时逐像素计算，公式相同）。
+class Denoiser {
+public:
+    int iterations = 5;
+    float sigmaLuminance = 4;   // 越大越模糊，亮度差以标准差为单位
+    float sigmaDepth = 1;
+    int threads = 0;            // 0 表示用硬件线程数
+
+    // 需要的通道，渲染前加入 AovBuffers 的掩码
+    static const unsigned requiredAovs = (1u << colorAov) | (1u << albedoAov) | (1u << normalAov) |
+                                         (1u << depthAov) | (1u << varianceAov);
+
+    // aovs 已 resolve，返回去噪后的线性颜色，每像素 3 个 float
+    std::vector<float> denoise(const AovBuffers& aovs) const;
+};
+
+#endif // DENOISE_H
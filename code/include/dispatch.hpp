@@ -0,0 +1,46 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include "object3d.hpp"
+#include "bvh.hpp"
+#include "mesh.hpp"
+#include "box.hpp"
+#include "plane.hpp"
+#include "rectangle.hpp"
+#include "revsurface.hpp"
+#include "sphere.hpp"
+#include "triangle.hpp"
+#include "voxel_world.hpp"
+
+// 按 objType 标签分派求交：BVH 遍历中最常见的几类物体直接调用具体类的 intersect，
+// 编译器可以内联，避免虚函数的间接跳转。其余类型（Transform、Group 等）仍走虚函数。
+inline bool intersectByType(Object3D* obj, const Ray& ray, Hit& hit, float tmin, float tmax) {
+    switch (obj->objType) {
+        case bhvNode:
+            return static_cast<BvhNode*>(obj)->BvhNode::intersect(ray, hit, tmin, tmax);
+        case mesh:
+            return static_cast<Mesh*>(obj)->tree->BvhNode::intersect(ray, hit, tmin, tmax);
+        case triangle:
+            return static_cast<Triangle*>(obj)->Triangle::intersect(ray, hit, tmin, tmax);
+        case sphere:
+            return static_cast<Sphere*>(obj)->Sphere::intersect(ray, hit, tmin, tmax);
+        case box:
+            return static_cast<Box*>(obj)->Box::intersect(ray, hit, tmin, tmax);
+        case rectX:
+            return static_cast<RectX*>(obj)->RectX::intersect(ray, hit, tmin, tmax);
+        case rectY:
+            return static_cast<RectY*>(obj)->RectY::intersect(ray, hit, tmin, tmax);
+        case rectZ:
+            return static_cast<RectZ*>(obj)->RectZ::intersect(ray, hit, tmin, tmax);
+        case plane:
+            return static_cast<Plane*>(obj)->Plane::intersect(ray, hit, tmin, tmax);
+        case revSurface:
+            return static_cast<RevSurface*>(obj)->RevSurface::intersect(ray, hit, tmin, tmax);
+        case voxelObj:
+            return static_cast<VoxelChunk*>(obj)->VoxelChunk::intersect(ray, hit, tmin, tmax);
+        default:
+            return obj->intersect(ray, hit, tmin, tmax);
+    }
+}
+
+#endif // DISPATCH_H
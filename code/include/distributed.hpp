@@ -0,0 +1,113 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// 多进程分布式渲染（协调者 / 工作者），通过 TCP 连接通信，本机和渲染农场的多台机器都可用。
+//
+//   协调者：PA1 <scene> <output> --serve PORT [--spawn N]
+//     解析场景后把图像切成 tileSize x tileSize 的块，每块的采样再按 unitSamples 分段，
+//     (块, 采样段) 即一个工作单元。协调者不渲染，只分发单元、收集结果，
+//     把返回的浮点颜色之和按单元顺序累加，最后写出图片。
+//     --spawn N 在本机启动 N 个工作者进程（参数与协调者相同，端口为 0 时自动选择）。
+//     默认只监听 127.0.0.1；多台机器时用 --bind 指定网卡的地址（0.0.0.0 为所有网卡）。
+//     HELLO 只检查场景哈希，不是身份验证，只在可信的网络上这样做。
+//   工作者：PA1 <scene> <output> --worker HOST:PORT [其余参数与协调者相同]
+//     自己解析同一个场景文件，连上协调者后循环：收到单元 -> 渲染 -> 发回颜色之和。
+//
+// 每个单元用自己的随机数种子（由 --seed 和单元编号得到），所以结果与工作者数量、
+// 分配顺序无关；工作者断开（进程退出、被杀）时它手上的单元重新分配给其他工作者，
+// 图片不受影响。工作者超过 unitTimeout 秒没有交回单元（卡住但没有断开）时协调者断开它，单元同样重新分配。
+// 用 --spawn 启动的工作者全部退出后，协调者自己渲染剩下的单元。
+//
+// 协议（主机字节序，所有机器须同为小端）：每条消息以 MessageHeader 开头
+//   工作者 -> 协调者  HELLO  ints = {场景哈希低 32 位, 高 32 位, 宽, 高}
+//   协调者 -> 工作者  UNIT   ints = {单元编号, x0, y0, x1, y1, 采样数, 种子}
+//                     DONE   没有更多单元，工作者退出
+//   工作者 -> 协调者  RESULT ints = {单元编号, 浮点数个数, 光线数低 32 位, 高 32 位}，
+//                     后面跟着 (x1-x0)*(y1-y0)*3 个 float
+
+struct WorkUnit {
+    int id;
+    int x0, y0, x1, y1;     // 像素范围 [x0, x1) x [y0, y1)
+    int samples;            // 每个像素的采样数
+    unsigned int seed;
+};
+
+// 渲染一个单元：颜色之和（线性，未除以采样数）按 ((y - y0) * (x1 - x0) + (x - x0)) * 3 存放，
+// 返回追踪的光线数
+typedef std::function<long long(const WorkUnit& unit, float* accum)> RenderUnitFn;
+
+// 场景文件内容的哈希（FNV-1a），协调者用来确认工作者渲染的是同一个场景
+unsigned long long sceneFileHash(const char* path);
+
+class RenderCoordinator {
+public:
+    RenderCoordinator(int width, int height, int spp, unsigned int seed, unsigned long long sceneHash);
+
+    // 在 IPv4 地址 host 上监听端口（0 表示由系统选择），失败返回 false
+    bool listen(const std::string& host, int port);
+    int getPort() const { return port; }
+    long long getRaysTraced() const { return raysTraced; }   // 所有工作者追踪的光线数
+
+    // 在本机启动 n 个工作者：workerArgs 为除 --worker 之外的完整命令行（argv[0] 在最前）
+    void spawnWorkers(int n, const std::vector<std::string>& workerArgs);
+
+    // 分发所有单元直到完成；render 用于所有工作者都退出后自己渲染剩下的单元。
+    // 返回每个像素的颜色之和，按 y * width + x 存放，每个像素 3 个 float
+    std::vector<float> run(const RenderUnitFn& render);
+
+    int tileSize = 32;
+    int unitSamples = 16;       // 每个单元的采样数上限
+    int unitTimeout = 300;      // 秒：工作者渲染一个单元超过这么久就断开它，0 表示不限制
+
+private:
+    struct Connection {
+        int fd;
+        int unit = -1;                  // 正在渲染的单元，-1 表示空闲
+        std::chrono::steady_clock::time_point assigned;     // 分配 unit 的时刻
+        bool greeted = false;           // 已收到并验证 HELLO
+        std::vector<char> inbuf;
+    };
+    struct TileState {
+        int nextChunk = 0;              // 下一个要累加的采样段（按顺序累加，结果与到达顺序无关）
+        std::vector<std::pair<int, std::vector<float>>> pending;
+    };
+
+    void makeUnits();
+    void acceptWorker();
+    bool handleInput(Connection& c);    // 返回 false 表示连接出错，需要关闭
+    void dropConnection(size_t index);
+    void dropTimedOut();
+    void assign(Connection& c);
+    void accumulate(int unitId, std::vector<float>& data);
+    void addToFilm(const WorkUnit& unit, const float* data);
+    int liveChildren();
+
+    int width, height, spp;
+    unsigned int seed;
+    unsigned long long sceneHash;
+    int listenFd = -1;
+    std::string host;
+    int port = 0;
+
+    std::vector<WorkUnit> units;
+    std::vector<int> queue;             // 待分配的单元（从尾部取）
+    std::vector<TileState> tiles;
+    int chunksPerTile = 1;
+    int unitsDone = 0;
+    long long raysTraced = 0;
+    std::vector<Connection> conns;
+    std::vector<pid_t> children;
+    std::vector<float> film;
+};
+
+// 连接协调者并循环渲染单元，直到收到 DONE 或连接断开。返回进程退出码
+int runRenderWorker(const std::string& address, unsigned long long sceneHash, int width, int height,
+                    const RenderUnitFn& render);
+
+#endif // DISTRIBUTED_H
@@ -0,0 +1,61 @@
+#ifndef ENVMAP_H
+#define ENVMAP_H
+
+#include <vector>
+#include <vecmath.h>
+#include "ray.hpp"
+#include "hit.hpp"
+#include "object3d.hpp"
+#include "texture.hpp"
+
+// 环境光（无穷远处的天空）：光线未击中场景时按方向在等距柱状投影的图片上取色，
+// 取代原来半径 100 的发光天空球（不再参与 BVH 求交）。
+// uv 与 Sphere::getUvSphere 相同，所以同一张图片的朝向不变。
+//
+// 构造时按亮度（乘以 sinθ，即每个格子的立体角）建立二维分段常数分布：
+// 先按行的边缘分布选一行，再按该行的条件分布选一列。
+// 漫反射表面用 sampleDirect 向天空亮的地方发射阴影光线（next event estimation），
+// 与漫反射采样到的方向按 MIS（power heuristic）合并，两种采样都不会重复计算。
+class EnvironmentMap {
+public:
+    static const int maxDistWidth = 256;    // 采样分布的分辨率上限（与图片分辨率无关）
+
+    EnvironmentMap(ImageTexture* texture);
+
+    // 按光线方向取色；光线锥的扩张角决定 mip 层级。pdf 非空时同时返回 sample 选中该方向的概率密度
+    Vector3f eval(const Ray& ray, float* pdf = nullptr) const;
+
+    // 按亮度采样一个方向（单位向量），返回该方向的颜色；pdf 为立体角上的概率密度，
+    // uvWidth 同 ImageTexture::sample
+    Vector3f sample(float r1, float r2, Vector3f& dir, float& pdf, float uvWidth = 0) const;
+
+    float pdf(const Vector3f& dir) const;
+
+    // 漫反射交点处的直接光照：采样一个方向并发射阴影光线，未被遮挡时返回 MIS 加权后的
+    // radiance * cosθ / π / pdf（不含反照率，由调用方乘上）。
+    // scattered 是同一交点漫反射采样得到的光线，只用它的光线锥选择 mip 层级；rays 累加发射的阴影光线数
+    Vector3f sampleDirect(const Hit& hit, const Ray& scattered, Object3D* scene, long long& rays) const;
+
+    // 两种采样策略各取一个样本时的 power heuristic 权重
+    static float powerHeuristic(float pdfA, float pdfB) {
+        float a = pdfA * pdfA, b = pdfB * pdfB;
+        return a + b > 0 ? a / (a + b) : 0;
+    }
+
+private:
+    static void dirToUv(const Vector3f& dir, float& u, float& v);
+    static Vector3f uvToDir(float u, float v, float sinTheta);
+    float pdfUv(float u, float v) const;
+    // 按分布选一个 uv 及对应的方向，pdf 为 0 时返回 false
+    bool sampleUv(float r1, float r2, float& u, float& v, Vector3f& dir, float& pdf) const;
+
+    ImageTexture* texture;
+    int distW, distH;
+    std::vector<float> func;            // 每个格子的亮度 * sinθ，按行存放
+    std::vector<float> conditionalCdf;  // 每行 distW + 1 个值，行内归一化
+    std::vector<float> rowIntegral;     // 每行 func 的平均值
+    std::vector<float> marginalCdf;     // distH + 1 个值
+    float integral;                     // func 在 [0,1]^2 上的积分
+};
+
+#endif // ENVMAP_H
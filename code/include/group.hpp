@@ -13,7 +13,7 @@
 class Group : public Object3D {
 public:
     Group() {
-
+        objType = group;
     }
 
     explicit Group (int num_objects) {
@@ -21,12 +21,8 @@ public:
         objType = group;
     }
 
-    ~Group() override {
-        // 需要手动释放空间吗？
-        for (auto obj : objects){
-            delete obj;
-        }
-    }
+    // 子物体由 Arena 持有，这里不释放
+    ~Group() override = default;
 
     bool intersect(const Ray &r, Hit &h, float tmin, float tmax) override {
         bool result = false;
@@ -12,6 +12,7 @@ public:
     Hit() {
         material = nullptr;
         t = 1e38;
+        uvScale = 0;
     }
 
     Hit(Vector3f _pos, float _t, Material *m, const Vector3f &n) {
@@ -19,12 +20,14 @@ public:
         t = _t;
         material = m;
         normal = n;
+        uvScale = 0;
     }
 
     Hit(const Hit &h) {
         pos = h.pos;
         t = h.t;
         material = h.material;
+        uvScale = h.uvScale;
     }
 
     // destructor
@@ -33,6 +36,7 @@ public:
     float getT() const { return t; }
     float getU() const { return u; }
     float getV() const { return v; }
+    float getUvScale() const { return uvScale; }
 
     const Vector3f getPos() const {return pos;}
 
@@ -57,6 +61,7 @@ public:
         pos = _pos;
         t = _t;
         material = m;
+        uvScale = 0;
     }
     void setU(float x) {u=x;}
     void setV(float x) {v=x;}
@@ -64,11 +69,14 @@ public:
         u = _u;
         v = _v;
     }
+    // 在 set() 之后调用
+    void setUvScale(float s) {uvScale = s;}
 private:
     Vector3f pos;
     float t; // ray's t value at pos
     float u; // UV value for texturing 
     float v; // UV value for texturing
+    float uvScale;   // uv 坐标变化 1 对应的世界空间长度，0 表示未知（纹理不做 LOD）
     Material *material;
     Vector3f normal; // always pointing towards the side the ray is coming from
     bool isOuter;    // whether normal is pointing outwards (in terms of the object)
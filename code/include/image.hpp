@@ -2,6 +2,7 @@
 #define IMAGE_H
 
 #include <cassert>
+#include <vector>
 #include <vecmath.h>
 
 // Simple image class
@@ -56,6 +57,9 @@ public:
 
     int SaveBMP(const char *filename);
 
+    // BMP 文件的全部字节写入 out（与 SaveBMP 写出的相同）
+    void EncodeBMP(std::vector<unsigned char> &out) const;
+
     void SaveImage(const char *filename);
 
 private:
@@ -11,11 +11,14 @@
 #include <iostream>
 #include <algorithm>
 
+// 材质类型标签，scatterByType / emitColorByType 按它分派
+enum MaterialType {lambertMat, metalMat, dielectricMat, emissiveMat, otherMat};
+
 // 虚类
 class Material {
 public:
-    Material() {}
-    Material(Texture* _t) : texture(_t) {}
+    Material() : matType(otherMat) {}
+    Material(Texture* _t) : texture(_t), matType(otherMat) {}
     virtual ~Material() = default;
 
     virtual Vector3f getEmitColor(float u, float v, const Vector3f& pos) const {
@@ -23,35 +26,72 @@ public:
     }
     
     virtual bool scatter(const Ray& ray, const Hit& hit, Vector3f& attentuation, Ray& scattered) const = 0;
+
+    // 交点处材质的颜色（反照率；发光材质为发光颜色），不消耗随机数。去噪时用于解调
+    Vector3f getAlbedo(const Ray& ray, const Hit& hit) const {
+        if (matType == otherMat) return Vector3f(1, 1, 1);   // 其他材质的 texture 可能未设置
+        return textureColor(ray, hit);
+    }
+
+    // 预览服务器（preview.hpp）修改材质：只在没有光线在追踪时调用
+    Texture* getTexture() const { return texture; }
+    void setTexture(Texture* _t) { texture = _t; }
+
+    MaterialType matType;
 protected:
+    // 交点处光线锥在 uv 空间的宽度，用于选择纹理的 mip 层级
+    static float uvFootprint(const Ray& ray, const Hit& hit) {
+        if (hit.getUvScale() <= 0) return 0;
+        return ray.coneWidthAt(hit.getT()) / hit.getUvScale();
+    }
+
+    // 交点处的纹理颜色：图片纹理按 uv 空间的锥宽度选 mip 层级，程序化纹理按世界空间的锥宽度去掉过细的频率
+    Vector3f textureColor(const Ray& ray, const Hit& hit) const {
+        return textureColorByType(texture, hit.getU(), hit.getV(), hit.getPos(), uvFootprint(ray, hit), ray.coneWidthAt(hit.getT()));
+    }
+
+    // 散射光线从交点处的锥宽度开始，扩张角加上材质本身的散射角（漫反射越粗糙，后续纹理越模糊）；
+    // 时刻与入射光线相同，整条路径看到的是同一时刻的场景
+    static void spreadCone(const Ray& ray, const Hit& hit, Ray& scattered, float extraSpread) {
+        scattered.setCone(ray.coneWidthAt(hit.getT()), ray.getConeSpread() + extraSpread);
+        scattered.setTime(ray.getTime());
+    }
+
     Texture* texture;
 };
 
 class Lambert : public Material {
 public:
-    Lambert(Texture* _t) : Material(_t) {}
+    Lambert(Texture* _t) : Material(_t) { matType = lambertMat; }
 
     virtual bool scatter(const Ray& ray, const Hit& hit, Vector3f& color, Ray& scattered) const {
         // std::cout << "scatter on lambert\n";
         Vector3f scatterDir = hit.getNormal() + Utils::randomUnitVec3();
         scattered = Ray(hit.getPos(), scatterDir.normalized());
-        color = texture->getColor(hit.getU(), hit.getV(), hit.getPos());
+        spreadCone(ray, hit, scattered, coneSpread);
+        color = textureColor(ray, hit);
         return true;
     }
+
+    static constexpr float coneSpread = 0.25f;   // 漫反射光线锥的扩张角（弧度），路径锥的近似
 }; 
 
 // shiny
 class Metal : public Material {
 public:
-    Metal (Texture* _t, float fuzz) : Material(_t), fuzziness(fuzz) {}
+    Metal (Texture* _t, float fuzz) : Material(_t), fuzziness(fuzz) { matType = metalMat; }
 
     virtual bool scatter(const Ray& ray, const Hit& hit, Vector3f& color, Ray& scattered) const {
         Vector3f reflected = Utils::reflect(ray.getDirection(), hit.getNormal());
         Vector3f rayDir = reflected + fuzziness * Utils::randomInUnitSphere();
         scattered = Ray(hit.getPos(), rayDir.normalized());
-        color = texture->getColor(hit.getU(), hit.getV(), hit.getPos());
+        spreadCone(ray, hit, scattered, 0.5f * fuzziness);
+        color = textureColor(ray, hit);
         return (Vector3f::dot(scattered.getDirection(), hit.getNormal()) > 0);
     }
+
+    float getFuzziness() const { return fuzziness; }
+    void setFuzziness(float fuzz) { fuzziness = fuzz; }
 protected:
     // Texture* texture;
     float fuzziness;
@@ -60,7 +100,7 @@ protected:
 // glass, water, diamond
 class Dielectric : public Material {
 public:
-    Dielectric (Texture* _t, float ri) : Material(_t), refractIdx(ri) {}
+    Dielectric (Texture* _t, float ri) : Material(_t), refractIdx(ri) { matType = dielectricMat; }
 
     static float schlick(float cos, float refractIdx) {
         float r = (1 - refractIdx) / (1 + refractIdx);
@@ -69,7 +109,7 @@ public:
     }
 
     virtual bool scatter (const Ray& ray, const Hit& hit, Vector3f& color, Ray& scattered) const {
-        color = texture->getColor(hit.getU(), hit.getV(), hit.getPos());
+        color = textureColor(ray, hit);
         float etaRatio = hit.getIsOuter() ? (1 / refractIdx) : refractIdx;
 
         Vector3f rayDir = ray.getDirection();
@@ -86,9 +126,13 @@ public:
             Vector3f refracted = Utils::refract(rayDir, hit.getNormal(), etaRatio);
             scattered = Ray(hit.getPos(), refracted.normalized());
         }
+        spreadCone(ray, hit, scattered, 0);
         return true;
     }
 
+    float getRefractionIndex() const { return refractIdx; }
+    void setRefractionIndex(float ri) { refractIdx = ri; }
+
 protected:
     float refractIdx;
 };
@@ -97,15 +141,49 @@ protected:
 // 用于发光，不反射（直接吃掉光线）
 class EmissiveMaterial : public Material {
 public:
-    EmissiveMaterial(Texture* _t) : Material(_t){}
+    EmissiveMaterial(Texture* _t) : Material(_t) { matType = emissiveMat; }
 
     virtual bool scatter(const Ray& ray, const Hit& hit, Vector3f& color, Ray& scattered) const {
         return false;  // Emissive Material don't scatter 
     }
 
     virtual Vector3f getEmitColor(float u, float v, const Vector3f& pos) const {
-        return texture->getColor(u, v, pos);  
+        return textureColorByType(texture, u, v, pos);  
+    }
+
+    // 已知光线时按光线锥选择纹理层级
+    Vector3f emit(const Ray& ray, const Hit& hit) const {
+        return textureColor(ray, hit);
     }
 };
 
+// 按 matType 分派，具体类的 scatter 直接调用（可内联）；未知类型仍走虚函数
+inline bool scatterByType(const Material* m, const Ray& ray, const Hit& hit, Vector3f& color, Ray& scattered) {
+    switch (m->matType) {
+        case lambertMat:
+            return static_cast<const Lambert*>(m)->Lambert::scatter(ray, hit, color, scattered);
+        case metalMat:
+            return static_cast<const Metal*>(m)->Metal::scatter(ray, hit, color, scattered);
+        case dielectricMat:
+            return static_cast<const Dielectric*>(m)->Dielectric::scatter(ray, hit, color, scattered);
+        case emissiveMat:
+            return false;
+        default:
+            return m->scatter(ray, hit, color, scattered);
+    }
+}
+
+inline Vector3f emitColorByType(const Material* m, const Ray& ray, const Hit& hit) {
+    switch (m->matType) {
+        case emissiveMat:
+            return static_cast<const EmissiveMaterial*>(m)->emit(ray, hit);
+        case lambertMat:
+        case metalMat:
+        case dielectricMat:
+            return Vector3f(0, 0, 0);
+        default:
+            return m->getEmitColor(hit.getU(), hit.getV(), hit.getPos());
+    }
+}
+
 #endif // MATERIAL_H
@@ -12,7 +12,7 @@ class BvhNode;
 
 class Mesh : public Object3D {
 public:
-    Mesh(){}
+    Mesh() : tree(nullptr) { objType = mesh; }
     Mesh(const char *filename, Material *m);
 
     struct TriangleIndex {
@@ -34,7 +34,8 @@ public:
 private:
     // Normal can be used for light estimation
     void computeTriangles(vector<Vector3f>& vertices, vector<Vector3f>& faces);
-    std::vector<Triangle*> triangles;
+    std::vector<Triangle*> triangles;   // 指向 triangleStore，BVH 建树时会重新排序
+    std::vector<Triangle> triangleStore; // 所有三角形连续存放
 };
 
 #endif
@@ -6,16 +6,18 @@
 #include "material.hpp"
 #include "aabb.hpp"
 
-enum ObjectType {group, mesh, sphere, rectX, rectY, rectZ, triangle, bhvNode, aabb};
+// 求交时按这个标签分派到具体的类（见 dispatch.hpp），所以每个子类都要设置正确的 objType
+enum ObjectType {group, mesh, sphere, rectX, rectY, rectZ, triangle, bhvNode, aabb, revSurface, plane, box,
+                 transformObj, curveObj, voxelObj, otherObj};
 
 // Base class for all 3d entities.
 class Object3D {
 public:
-    Object3D() : material(nullptr) {}
+    Object3D() : objType(otherObj), material(nullptr) {}
 
     virtual ~Object3D() = default;
 
-    explicit Object3D(Material *material) {
+    explicit Object3D(Material *material) : objType(otherObj) {
         this->material = material;
     }
 
@@ -0,0 +1,60 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+#include <cmath>
+#include <algorithm>
+#include <vecmath.h>
+#include "ray.hpp"
+
+// 光线包（packet）：一个像素块（tile block）里同一次采样的相机光线，
+// 一起遍历 BVH（见 BvhNode::intersectPacket）。
+// 原点和方向倒数按 SoA 存放，包围盒测试可以用 SSE 一次算 4 条光线；
+// 同时记录整包的区间范围，用区间算术一次性剔除整包都不会相交的节点。
+class RayPacket {
+public:
+    static const int maxSize = 16;
+
+    RayPacket() : size(0) {}
+
+    void clear() { size = 0; }
+
+    void add(const Ray& r) { rays[size++] = r; }
+
+    // 所有光线加入后、遍历之前调用：填充 SoA 数组和区间
+    void finalize() {
+        for (int a = 0; a < 3; a++) {
+            oMin[a] = invMin[a] = INFINITY;
+            oMax[a] = invMax[a] = -INFINITY;
+            for (int i = 0; i < maxSize; i++) {
+                // 不足 maxSize 的部分用第 0 条光线填充，SIMD 测试时由掩码屏蔽
+                const Ray& r = rays[i < size ? i : 0];
+                float d = r.getDirection()[a];
+                // 方向分量为 0 时用极小值代替，避免 0 * inf 产生 NaN
+                if (std::fabs(d) < 1e-20f) d = d < 0 ? -1e-20f : 1e-20f;
+                org[a][i] = r.getOrigin()[a];
+                inv[a][i] = 1.0f / d;
+                if (i < size) {
+                    oMin[a] = std::min(oMin[a], org[a][i]);
+                    oMax[a] = std::max(oMax[a], org[a][i]);
+                    invMin[a] = std::min(invMin[a], inv[a][i]);
+                    invMax[a] = std::max(invMax[a], inv[a][i]);
+                }
+            }
+            // 方向分量符号不一致时，这一维的区间测试没有意义
+            sameSign[a] = (invMin[a] > 0) == (invMax[a] > 0);
+        }
+    }
+
+    unsigned fullMask() const { return size >= 32 ? ~0u : (1u << size) - 1; }
+
+public:
+    int size;
+    Ray rays[maxSize];
+    alignas(16) float org[3][maxSize];
+    alignas(16) float inv[3][maxSize];
+    float oMin[3], oMax[3];
+    float invMin[3], invMax[3];
+    bool sameSign[3];
+};
+
+#endif // PACKET_H
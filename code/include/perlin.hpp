@@ -2,142 +2,105 @@
 #define PERLIN_H
 
 #include <cmath>
+#include <random>
 #include <vecmath.h>
-#include "utils.hpp"
-
-// Incomplete.. has bugs, does not generate anything
-// TODO: complete this Perlin class
 
+// 梯度噪声（Perlin 2002, "Improving Noise"）：
+// 整数格点上取 12 个棱方向之一作为梯度，格内用 6t^5 - 15t^4 + 10t^3 插值，结果约在 [-1, 1]，格点上为 0。
+// 置换表由构造时的 seed 生成（独立的 mt19937，不消耗 Utils 的随机数），同一 seed 的噪声在任何机器上相同。
+//
+// 单点的 noise / fbm / turbulence 在头文件里内联；批量版本（perlin.cpp）每 4 个点一组用 SSE2 计算，
+// 没有 SSE2 时逐点计算，运算顺序与单点版本相同。
 class Perlin {
-    public:
-        Perlin() {
-            randfloats = new float[pointCnt];
-            for (int i = 0; i < pointCnt; i++) {
-                randfloats[i] = Utils::randomFloat();
-            }
-
-            permX = perlinGenPerm();
-            permY = perlinGenPerm();
-            permZ = perlinGenPerm();
-        }
-
-        ~Perlin() {
-            delete[] randfloats;
-            delete[] permX;
-            delete[] permY;
-            delete[] permZ;
-        }
-
-        float noise(const Vector3f& p) const {
-            float u = p.x() - floor(p.x());
-            float v = p.y() - floor(p.y());
-            float w = p.z() - floor(p.z());
-
-            int i = (int) (p.x());
-            int j = (int) (p.y());
-            int k = (int) (p.z());
-            double c[2][2][2];
-
-            for (int di = 0; di < 2; di++)
-                for (int dj = 0; dj < 2; dj++)
-                    for (int dk = 0; dk < 2; dk++)
-                        c[di][dj][dk] = randfloats[
-                            permX[(i+di) & 255] ^
-                            permY[(j+dj) & 255] ^
-                            permZ[(k+dk) & 255]
-                        ];
-
-            auto sum = 0.0;
-            for (int i = 0; i < 2; i++)
-                for (int j = 0; j < 2; j++)
-                    for (int k = 0; k < 2; k++)
-                        sum += (i*u + (1-i)*(1-u)) *
-                               (j*v + (1-j)*(1-v)) *
-                               (k*w + (1-k)*(1-w)) * c[i][j][k];
-
-            return sum;
-        }
-
-        float noise2d(float x, float y) {
-            x %= 256;
-            y %= 256;
-            int xi = (int) x & 255;
-            int yi = (int) y & 255;
-            float xf = x - (int) x;
-            float yf = y - (int) y;
-
-            Vector2f TR = Vector2f(u-1, v-1);
-            Vector2f TL = Vector2f(u, v-1);
-            Vector2f BR = Vector2f(u-1, v);
-            Vector2f BL = Vector2f(u, v);
-
-            int* P = perlinGenPerm();
-
-            int vTR = P[P[X+1]+Y+1];
-            int vTL = P[P[X]+Y+1];
-            int vBR = P[P[X+1]+Y];
-            int vBL = P[P[X]+Y];
-
-            for (int di = 0; di < 2; di++)
-                for (int dj = 0; dj < 2; dj++)
-                    for (int dk = 0; dk < 2; dk++)
-                        c[di][dj][dk] = randfloats[
-                            permX[(i+di) & 255] ^
-                            permY[(j+dj) & 255] ^
-                            permZ[(k+dk) & 255]
-                        ];
-
-            auto sum = 0.0;
-            for (int i = 0; i < 2; i++)
-                for (int j = 0; j < 2; j++)
-                    for (int k = 0; k < 2; k++)
-                        sum += (i*u + (1-i)*(1-u)) *
-                               (j*v + (1-j)*(1-v)) *
-                               (k*w + (1-k)*(1-w)) * c[i][j][k];
-
-            return sum;
+public:
+    explicit Perlin(unsigned int seed = 0) {
+        std::mt19937 rng(seed);
+        for (int i = 0; i < 256; i++) perm[i] = i;
+        for (int i = 255; i > 0; i--) {
+            int j = (int) (rng() % (unsigned) (i + 1));
+            int tmp = perm[i];
+            perm[i] = perm[j];
+            perm[j] = tmp;
         }
-
-        float face(float t) {
-            return t * t * t * (t * (t * 6 - 15) + 10);
+        for (int i = 0; i < 256; i++) perm[256 + i] = perm[i];
+    }
+
+    float noise(float x, float y, float z) const {
+        int ix = fastFloor(x), iy = fastFloor(y), iz = fastFloor(z);
+        int X = ix & 255, Y = iy & 255, Z = iz & 255;
+        x -= ix;
+        y -= iy;
+        z -= iz;
+        float u = fade(x), v = fade(y), w = fade(z);
+
+        int A = perm[X] + Y, AA = perm[A] + Z, AB = perm[A + 1] + Z;
+        int B = perm[X + 1] + Y, BA = perm[B] + Z, BB = perm[B + 1] + Z;
+        return lerp(w, lerp(v, lerp(u, grad(perm[AA], x, y, z), grad(perm[BA], x - 1, y, z)),
+                               lerp(u, grad(perm[AB], x, y - 1, z), grad(perm[BB], x - 1, y - 1, z))),
+                       lerp(v, lerp(u, grad(perm[AA + 1], x, y, z - 1), grad(perm[BA + 1], x - 1, y, z - 1)),
+                               lerp(u, grad(perm[AB + 1], x, y - 1, z - 1), grad(perm[BB + 1], x - 1, y - 1, z - 1))));
+    }
+
+    float noise(const Vector3f& p) const {
+        return noise(p.x(), p.y(), p.z());
+    }
+
+    // 分形叠加：第 i 层的频率为 lacunarity^i、振幅为 gain^i，结果按振幅之和归一化到约 [-1, 1]
+    float fbm(const Vector3f& p, int octaves, float lacunarity = 2.0f, float gain = 0.5f) const {
+        float sum = 0, amp = 1, norm = 0, freq = 1;
+        for (int i = 0; i < octaves; i++) {
+            sum += amp * noise(p.x() * freq, p.y() * freq, p.z() * freq);
+            norm += amp;
+            amp *= gain;
+            freq *= lacunarity;
         }
-
-    private:
-        static const int pointCnt = 256;
-        float* randfloats;
-        int* permX;
-        int* permY;
-        int* permZ;
-
-        Vector2f getConstVec(int x) {
-            int h = x % 4;
-            if (h == 0)
-                return Vector2f(1, 1);
-            else if (h == 1)
-                return Vector2f(-1, 1);
-            else if (h == 2)
-                return Vector2f(-1, -1);
-            else 
-                return Vector2f(1, -1);
-        }
-
-        static int* perlinGenPerm() {
-            int* p = new int[pointCnt];
-            for (int i = 0; i < Perlin::pointCnt; i++)
-                p[i] = i;
-
-            shuffle(p, pointCnt);
-            return p;
-        }
-
-        static void shuffle(int* p, int n) {
-            for (int i = n-1; i > 0; i--) {
-                int target = Utils::randomInt(0, i);
-                int tmp = p[i];
-                p[i] = p[target];
-                p[target] = tmp;
-            }
+        return norm > 0 ? sum / norm : 0;
+    }
+
+    // 同 fbm，但每层取绝对值，结果在 [0, 1]
+    float turbulence(const Vector3f& p, int octaves, float lacunarity = 2.0f, float gain = 0.5f) const {
+        float sum = 0, amp = 1, norm = 0, freq = 1;
+        for (int i = 0; i < octaves; i++) {
+            sum += amp * std::fabs(noise(p.x() * freq, p.y() * freq, p.z() * freq));
+            norm += amp;
+            amp *= gain;
+            freq *= lacunarity;
         }
+        return norm > 0 ? sum / norm : 0;
+    }
+
+    // 批量版本：out[i] = noise(x[i], y[i], z[i])，i < n
+    void noise(const float* x, const float* y, const float* z, float* out, int n) const;
+    // out[i] = fbm(Vector3f(x[i], y[i], z[i]), octaves, lacunarity, gain)
+    void fbm(const float* x, const float* y, const float* z, float* out, int n,
+             int octaves, float lacunarity = 2.0f, float gain = 0.5f) const;
+
+    // 截断后修正为向下取整，比 std::floor 快（不用处理超出 int 的值）
+    static int fastFloor(float x) {
+        int i = (int) x;
+        return x < i ? i - 1 : i;
+    }
+
+    static float fade(float t) {
+        return t * t * t * (t * (t * 6 - 15) + 10);
+    }
+
+    static float lerp(float t, float a, float b) {
+        return a + t * (b - a);
+    }
+
+    // hash 的低 4 位选 12 个棱方向之一（12..15 重复其中 4 个）。
+    // 查表而不用分支：hash 是随机的，分支几乎每次都预测错
+    static float grad(int hash, float x, float y, float z) {
+        static const float gx[16] = {1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 0, 0, 1, 0, -1, 0};
+        static const float gy[16] = {1, 1, -1, -1, 0, 0, 0, 0, 1, -1, 1, -1, 1, -1, 1, -1};
+        static const float gz[16] = {0, 0, 0, 0, 1, 1, -1, -1, 1, 1, -1, -1, 0, 1, 0, -1};
+        int h = hash & 15;
+        return gx[h] * x + gy[h] * y + gz[h] * z;
+    }
+
+private:
+    int perm[512];      // 0..255 的置换，重复两遍，省去下标取模
 };
 
-#endif // PERLIN_H
\ No newline at end of file
+#endif // PERLIN_H
@@ -14,11 +14,13 @@ public:
     Plane(const Vector3f &normal, float d, Material *m) : Object3D(m) {
         this->normal = normal;
         this->d = d;
+        objType = plane;
     }
 
     ~Plane() override = default;
 
     bool intersect(const Ray &r, Hit &h, float tmin, float tmax) override {
+        STATS_PRIM(plane);
         float t = (d - Vector3f::dot(normal, r.getOrigin())) / Vector3f::dot(normal, r.getDirection());
 
         if (tmin < t && t < h.getT()) {
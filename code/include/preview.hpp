@@ -0,0 +1,104 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Image;
+class PerspectiveCamera;
+class SceneParser;
+
+// 交互式预览：PA1 <scene> <output> --preview PORT
+// 场景和 BVH 只解析、建立一次，常驻内存；渲染线程（主线程）每遍每像素 1 次采样不断累加，
+// 每遍结束后把图片交给 PreviewServer。浏览器打开 http://127.0.0.1:PORT/ 即可看到逐渐收敛的画面，
+// 并修改相机和材质参数：修改在下一个像素列之前应用，累加清零，不重新解析场景、不重建 BVH。
+// 相机和材质不影响 BVH；修改后先渲染几遍粗略的预览（main.cpp 的 renderPreview），几十毫秒内就能看到效果。
+//
+// HTTP 接口（只监听 127.0.0.1，每个连接一个线程，响应后关闭连接）：
+//   GET  /            控制页面
+//   GET  /stream      multipart/x-mixed-replace 的 BMP 帧流，<img> 直接显示，最多 streamFps 帧每秒
+//   GET  /frame.bmp   当前图片
+//   GET  /status      {"spp", "width", "height", "version", "passMs", "updateMs"}，version 每遍加一
+//   GET  /scene       当前相机参数和材质列表（JSON）
+//   POST /camera      表单：center、direction、up、angle（度）、aperture、focusDistance，只给出要改的项
+//   POST /material    表单：index（必需）、color、texture（纹理编号）、fuzziness、refractionIndex
+//   POST /quit        停止预览，写出当前图片后退出
+// 向量写作 "x y z" 或 "x,y,z"。POST 等到渲染线程应用修改后才响应：成功为 200，参数有误为 400 和错误信息。
+
+// 一次修改，由 HTTP 线程创建，渲染线程应用
+struct PreviewRequest {
+    std::string target;                             // "camera" / "material"
+    std::map<std::string, std::string> fields;
+    std::chrono::steady_clock::time_point received;
+    bool done = false;
+    std::string error;                              // 空表示已应用
+};
+
+class PreviewServer {
+public:
+    static const int streamFps = 20;
+
+    ~PreviewServer() { stop(); }
+
+    // 监听 127.0.0.1:port（0 表示由系统选择）并启动接受连接的线程，失败返回 false
+    bool start(int port);
+    // 关闭监听，等所有连接结束
+    void stop();
+    int getPort() const { return port; }
+
+    // 以下由渲染线程调用
+
+    // 有未应用的修改（渲染线程每列检查一次，尽快中断当前这一遍）
+    bool hasRequests() const { return pending; }
+    bool quitRequested() const { return quit; }
+    // 阻塞直到有修改或要求退出，最多 timeoutMs 毫秒（图片已收敛时用，超时后检查场景文件是否改过）
+    void waitForRequests(int timeoutMs);
+    // 取出所有未应用的修改；应用后调用 finish 通知等待的 HTTP 线程
+    std::vector<std::shared_ptr<PreviewRequest>> takeRequests();
+    void finish(const std::vector<std::shared_ptr<PreviewRequest>>& requests);
+
+    // 一遍结束：编码图片并唤醒 /stream 的连接。passMs 为最近完整一遍（1 spp）的用时，
+    // updateMs 为最近一次修改到它之后第一帧（粗略预览）的用时
+    void publish(const Image& img, int spp, double passMs, double updateMs);
+    // /scene 返回的内容
+    void setSceneInfo(const std::string& json);
+
+private:
+    void acceptLoop();
+    void handleConnection(int fd);
+    void streamFrames(int fd);
+    std::string submit(const std::shared_ptr<PreviewRequest>& request);   // 返回错误信息，空表示成功
+
+    int listenFd = -1;
+    int port = -1;
+    std::thread acceptThread;
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> pending{false};
+    std::atomic<bool> quit{false};
+
+    std::mutex mutex;                   // 保护以下所有成员
+    std::condition_variable changed;    // 新的帧、修改入队 / 应用、连接结束、退出
+    std::vector<std::shared_ptr<PreviewRequest>> queue;
+    std::vector<unsigned char> frame;   // BMP 文件的字节
+    long long version = 0;
+    int width = 0, height = 0, spp = 0;
+    double passMs = 0, updateMs = 0;
+    std::string sceneInfo = "{}";
+    int connections = 0;
+};
+
+// 应用一次修改（在渲染线程中，没有光线在追踪时）。参数有误时不做任何修改，错误信息写入 request.error；
+// 返回场景是否改变
+bool applyPreviewRequest(PreviewRequest& request, PerspectiveCamera* cam, SceneParser& parser);
+
+// 当前相机参数和材质列表，供 /scene 返回
+std::string previewSceneInfo(const PerspectiveCamera* cam, const SceneParser& parser);
+
+#endif // PREVIEW_H
@@ -18,12 +18,30 @@ public:
     Ray(const Ray &r) {
         origin = r.origin;
         direction = r.direction;
+        coneWidth = r.coneWidth;
+        coneSpread = r.coneSpread;
+        time = r.time;
     }
 
     const Vector3f &getOrigin() const { return origin; }
 
     const Vector3f &getDirection() const {  return direction; }
 
+    // 光线锥（ray cone）：起点处的宽度与每单位距离的扩张角，用于选择纹理的 mip 层级
+    void setCone(float width, float spread) {
+        coneWidth = width;
+        coneSpread = spread;
+    }
+    float getConeWidth() const { return coneWidth; }
+    float getConeSpread() const { return coneSpread; }
+
+    // 距离 t 处光线锥的宽度
+    float coneWidthAt(float t) const { return coneWidth + coneSpread * t; }
+
+    // 光线的时刻（animation.hpp）：相机光线在快门区间内取一个时刻，之后的散射光线、阴影光线沿用
+    float getTime() const { return time; }
+    void setTime(float t) { time = t; }
+
     Vector3f pointAtParameter(float t) const {
         return origin + direction * t;
     }
@@ -31,6 +49,9 @@ public:
 private:
     Vector3f origin;
     Vector3f direction;
+    float coneWidth = 0;
+    float coneSpread = 0;
+    float time = 0;
 
 };
 
@@ -20,6 +20,7 @@ public:
 
     // 求交并将信息存到 hit 中
     virtual bool intersect(const Ray& ray, Hit& hit, float tmin, float tmax) {
+        STATS_PRIM(rectX);
         if (ray.getDirection().x() == 0) return false; // parallell to the plane => assume no intersection
         float t = (d - ray.getOrigin().x()) / ray.getDirection().x();  
         if (t < tmin || hit.getT() < t) return false;    // limited by tmin and current closest hit
@@ -33,6 +34,7 @@ public:
         hit.setU((z-z0) / (z1-z0));
         hit.setV((y-y0) / (y1-y0));
         hit.set(p, t, material);
+        hit.setUvScale(sqrt((y1-y0) * (z1-z0)));
         hit.setNormal(ray, Vector3f(1, 0, 0));
         return true;
     }
@@ -64,6 +66,7 @@ public:
     }
 
     virtual bool intersect(const Ray& ray, Hit& hit, float tmin, float tmax) {
+        STATS_PRIM(rectY);
         if (ray.getDirection().y() == 0) return false; // parallell to the plane => assume no intersection
         float t = (d - ray.getOrigin().y()) / ray.getDirection().y();  
         if (t < tmin || hit.getT() < t) return false;    // limited by tmin and current closest hit
@@ -77,6 +80,7 @@ public:
         hit.setU((x-x0) / (x1-x0));
         hit.setV((z-z0) / (z1-z0));
         hit.set(p, t, material);
+        hit.setUvScale(sqrt((x1-x0) * (z1-z0)));
         hit.setNormal(ray, Vector3f(0, 1, 0));
         return true;
     }
@@ -106,6 +110,7 @@ public:
     }
 
     virtual bool intersect(const Ray& ray, Hit& hit, float tmin, float tmax) {
+        STATS_PRIM(rectZ);
         if (ray.getDirection().z() == 0) return false; // parallell to the plane => assume no intersection
         float t = (d - ray.getOrigin().z()) / ray.getDirection().z();  
         if (t < tmin || hit.getT() < t) return false;    // limited by tmin and current closest hit
@@ -119,6 +124,7 @@ public:
         hit.setU((x-x0) / (x1-x0));
         hit.setV((y-y0) / (y1-y0)); // render upside down along y-axis
         hit.set(p, t, material);
+        hit.setUvScale(sqrt((x1-x0) * (y1-y0)));
         hit.setNormal(ray, Vector3f(0, 0, 1));
         return true;
     }
@@ -0,0 +1,66 @@
+#ifndef RELOAD_H
+#define RELOAD_H
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <vecmath.h>
+#include "arena.hpp"
+#include "scene_parser.hpp"
+
+class BvhNode;
+
+// 场景热重载（--preview 时，settings 的 watch）：
+//   - 每 pollMs 毫秒检查一次场景文件和它引用的文件（Include、OBJ、图片）的修改时间和大小，
+//     改过并且连续两次检查的结果相同（编辑器已写完）时重新解析
+//   - 新的解析沿用签名没变的纹理、材质、原型、物体和网格（SceneParser 的 previous），只新建改过的部分；
+//     改过的图片先从 TextureManager 中去掉，再重新读入
+//   - 物体个数不变时把 BVH 叶子上改过的物体换成新的并 refit，节点表面积增长超过 refit-threshold 才重新建树；
+//     个数变了时重新建顶层的 BVH，网格和原型自己的 BVH 仍然沿用
+//   - 相机块改过时新的参数写入常驻的相机（分辨率不能改变）；没改过时保留在预览页面上的修改。RenderSettings 块不再读取
+//   - 出错（语法错误、文件不存在、分辨率改变）时打印错误，继续使用原来的场景
+// 新的对象分配在每次重新载入新建的 Arena 中，沿用的对象还在之前的 Arena 里，所有 Arena 保留到程序结束。
+// 重新载入后由调用者清空累加的图片
+class SceneReloader {
+public:
+    static const int pollMs = 250;
+
+    // parser 为 main 解析的场景（由 main 持有），generated 为 SceneGenerator 加入 Group 的物体（重新载入后保留），
+    // bvh 为对整个 Group 建立的 BVH
+    SceneReloader(const std::string& filename, SceneParser* parser, const std::vector<Object3D*>& generated,
+                  BvhNode* bvh, bool sah, float refitThreshold);
+
+    // 距上次检查超过 pollMs 时检查依赖的文件，需要重新载入时返回 true（渲染线程每列调用一次）
+    bool changed();
+    // 重新解析并更新场景，失败时场景不变，返回是否成功（没有光线在追踪时调用）
+    bool reload();
+
+    SceneParser& getParser() const { return *parser; }
+    PerspectiveCamera* getCamera() const { return camera; }
+    BvhNode* getBvh() const { return bvh; }
+    Vector3f getBackgroundColor() const { return parser->getBackgroundColor(); }
+
+private:
+    // 对 objects 重新建立 BVH，分配在 arena 中
+    void rebuild(Arena& arena);
+
+    std::string filename;
+    SceneParser* parser;
+    std::unique_ptr<SceneParser> reloaded;          // 重新载入的场景，parser 指向它
+    std::vector<std::unique_ptr<Arena>> arenas;
+    std::vector<Object3D*> generated;
+    std::vector<Object3D*> objects;                 // 当前 BVH 的物体：Group 块中的物体和 generated
+    PerspectiveCamera* camera;
+    BvhNode* bvh;
+    bool sah;
+    float refitThreshold;
+    int numReloads = 0;
+
+    std::map<std::string, FileStamp> watched;       // 上次检查时依赖的文件的状态
+    std::map<std::string, FileStamp> pending;       // 改过、还没有稳定下来的状态
+    std::chrono::steady_clock::time_point lastPoll;
+};
+
+#endif // RELOAD_H
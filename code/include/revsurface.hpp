@@ -3,18 +3,42 @@
 
 #include "object3d.hpp"
 #include "curve.hpp"
+#include "transform.hpp"
 #include "ray.hpp"
 #include <vecmath.h>
 #include <tuple>
 #include <vector>
 
+// 轮廓曲线上一段关于y单调的参数区间，及其包围的圆环柱（绕y轴）
+struct CurveSpan {
+    float u0, u1;   // 参数区间
+    float y0, y1;   // P(u0).y 和 P(u1).y，用于由高度反求u
+    float yMin, yMax;
+    float rMin, rMax;
+};
+
+// 曲线段的小型BVH节点，叶子节点的span >= 0
+struct SpanNode {
+    float yMin, yMax;
+    float rMin, rMax;
+    int left, right;
+    int span;
+};
+
 // Bezier Surface of revolution about y axis, control points are on xy plane
 class RevSurface : public Object3D {
 public:
     Curve *pCurve;
     Aabb aabb;
+    std::vector<CurveSpan> spans;
+    std::vector<SpanNode> spanTree;
+
+    static const int rootSamples = 64;     // 找y'(u)的零点时的采样数
+    static const int piecesPerSpan = 4;    // 每段单调区间再细分的段数
+    static const int bracketSamples = 4;   // 每段内找f(u)变号时的采样数
 public:
     RevSurface(Curve *pCurve, Material* material) : pCurve(pCurve), Object3D(material) {
+        objType = revSurface;
         // Make sure all points are on xy plane
         for (const auto &cp : pCurve->getControls()) {
             if (cp.z() != 0.0) {
@@ -23,52 +47,70 @@ public:
             }
         }
 
-        // 计算包围盒 (AABB)，TODO：分段加速？
-        float maxX, minY, maxY;
-        vector<Vector3f> cp = pCurve->getControls();
-        minY = maxY = cp[0].y();
-        // only save max x coordinate, because this surface revolves 
-        // around y axis, and control points are all on xy plane
-        maxX = fabs(cp[0].x());
-        if (cp.size() == 1) {    // 只有一个控制节点
-            Vector3f small(0.0001, 0.0001, 0.0001);
-            Vector3f mn(-maxX, minY, -maxX);
-            Vector3f mx(maxX, minY, maxX);
-            aabb = Aabb(mn - small, mx + small);
-        } else {                // 一般情况
-            for (Vector3f& p : cp) {
-                minY = fmin(minY, p.y());
-                maxY = fmax(maxY, p.y());
-
-                maxX = fmax(maxX, fabs(p.x())); // always on positive side
-            }
-            Vector3f mn(-maxX, minY, -maxX);
-            Vector3f mx(maxX, maxY, maxX);
-            aabb = Aabb(mn, mx);
-        }
-    }
+        // 分段加速：把轮廓曲线分成关于y单调的若干段，并建立小型BVH
+        buildSpans();
+        buildSpanTree(0, spans.size());
 
-    ~RevSurface() override {
-        delete pCurve;
+        // 计算包围盒 (AABB)，即根节点的圆柱
+        const SpanNode& root = spanTree[0];
+        Vector3f mn(-root.rMax, root.yMin, -root.rMax);
+        Vector3f mx(root.rMax, root.yMax, root.rMax);
+        Vector3f small(0.0001, 0.0001, 0.0001);
+        aabb = Aabb(mn - small, mx + small);
     }
 
+    ~RevSurface() override = default;   // pCurve 由 Arena 持有
+
     bool intersect(const Ray &ray, Hit &hit, float tmin, float tmax) override {
+        STATS_PRIM(revSurface);
         if (!aabb.intersect(ray, tmin, tmax)) return false; 
+        if (ray.getDirection().y() == 0) return false;   // 与y轴垂直，f(u)无定义
 
-        // 一元牛顿法
-        float u;
-        if (!newtonOne(ray, u)) return false;  // 没找到根
+        // 只在射线穿过的曲线段内求根，取最近的交点
+        float bestT = fmin(tmax, hit.getT());
+        float bestU = -1;
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const SpanNode& node = spanTree[stack[--top]];
+            float ta, tb;
+            if (!intersectTube(ray, node.yMin, node.yMax, node.rMin, node.rMax, tmin, bestT, ta, tb)) continue;
+            if (node.span < 0) {
+                stack[top++] = node.left;
+                stack[top++] = node.right;
+                continue;
+            }
+            float u, t;
+            if (solveSpan(ray, spans[node.span], ta, tb, tmin, bestT, u, t)) {
+                bestT = t;
+                bestU = u;
+            }
+        }
+        if (bestU < 0) return false;  // 没找到根
 
+        float u = bestU;
+        float t = bestT;
         Vector3f p = P(u);
-        float t = (p.y() - ray.getOrigin().y()) / ray.getDirection().y();
-        if (t < tmin || hit.getT() < t) return false;  // 要求在 tmin 和 hit 的最小的 t 之间
         Vector3f pos = ray.pointAtParameter(t);
-        float v = acos(pos.x() / p.x());
-        if (v < 0) v += 2 * PI; 
+        // 交点在旋转轴上（p.x() == 0，曲线端点落在轴上时会击中）时 v 没有意义，取 0
+        bool onAxis = fabs(p.x()) < 1e-6f;
+        float v = 0;
+        if (!onAxis) {
+            v = acos(Utils::clamp(pos.x() / p.x(), -1, 1));
+            if (pos.z() > 0) v = 2 * PI - v;   // rotateY(v) 把 (r, y, 0) 转到 z = -r sin(v)
+        }
 
         Vector3f tangentU = pointAtu(u, v);
-        Vector3f tangentV = pointAtv(u, v);
-        Vector3f outwardNormal = Vector3f::cross(tangentV, tangentU);
+        Vector3f outwardNormal;
+        if (onAxis) {
+            // 轴上 v 方向的切线为零，取 v = 0 处从 x > 0 一侧趋近轴时法线的极限方向
+            Vector3f pu = PDeriv(u);
+            outwardNormal = Vector3f(pu.y(), -pu.x(), 0);
+        } else {
+            Vector3f tangentV = pointAtv(u, v);
+            outwardNormal = Vector3f::cross(tangentV, tangentU);
+        }
 
         // 保存hit信息
         hit.set(pos, t, material);
@@ -83,63 +125,227 @@ public:
         return true;
     }
 
-    // 牛顿法求ray和参数曲面交点
-    bool newtonOne(const Ray& ray, float& root) {
-        Vector3f d = ray.getDirection().normalized();
-        Vector3f o = ray.getOrigin();
-        // helpers
-        float o_r, d_r;
-        o_r = distFromYAxis(o);
-        d_r = distFromYAxis(d);
-
-        float maxError = 0.0001;
-        int patience = 4;
-        int worseCnt = 0;
-        float yDist = 0;
-        bool converged = false;
-        for (float start = 0.0001; start < 1; start += 0.099) {
-            float u0 = start;
-            // float u0 = Utils::randomFloat(0.0001, 0.9999); // pick a random starting point
-            float fu = f(u0, ray);
-            float fuprime = fprime(u0, ray);
-            float u = u0 - fu / fuprime;
-            u = Utils::clamp(u, 0.0001, 0.9999);   // u has to be in [0, 1]
-            float prev = 0;  // used to check whether is converging 
-            for (int j = 0; j < 20; j++) {
-                fu = f(u, ray);
-                if (fabs(fu) < maxError) {
-                    float tmpY = fabs(P(u).y() - o.y());
-                    if (!converged) { // found first root
-                        root = u;
-                        yDist = tmpY;
-                        converged = true;
-                    } else {
-                        if (tmpY < yDist) { 
-                            // will only process the newly found root 
-                            // if it's closer to the ray's origin
-                            yDist = tmpY;
-                            root = u;
-                        }
-                    }
-                } else if (worseCnt > patience) {
-                    worseCnt = 0;
-                    break;
-                }
-                // iterate 
-                u0 = u;
-                fuprime = fprime(u, ray);
-
-                u = u0 - fu / fuprime;
-                u = Utils::clamp(u, 0.001, 0.999);    // u has to be in [0, 1]
-                if (fu > prev - 0.0001) ++worseCnt;   // got worse result
-                else worseCnt = 0;                    // got better result
-                prev = fu;
+    // 在一段单调区间内求射线在(tmin, tmax)内最近的交点。
+    // 段内y关于u单调，所以射线的t也关于u单调：先把射线在圆环柱内的[ta, tb]换算成u的区间，
+    // 按t从小到大找f(u)的变号区间，在区间内用带二分保护的牛顿法求根；
+    // 找不到变号时（相切或两个根很近）再从区间两端试牛顿法。
+    bool solveSpan(const Ray& ray, const CurveSpan& s, float ta, float tb,
+                   float tmin, float tmax, float& root, float& tRoot) {
+        float ua = uAtY(s, ray.getOrigin().y() + ta * ray.getDirection().y());
+        float ub = uAtY(s, ray.getOrigin().y() + tb * ray.getDirection().y());
+        // 从射线进入的一端到离开的一端采样，于是采样顺序就是t从小到大的顺序
+        float us[bracketSamples + 1];
+        float fs[bracketSamples + 1];
+        for (int i = 0; i <= bracketSamples; i++) {
+            us[i] = ua + (ub - ua) * i / bracketSamples;
+            fs[i] = f(us[i], ray);
+        }
+        bool bracketed = false;
+        for (int i = 0; i < bracketSamples; i++) {
+            if ((fs[i] > 0) == (fs[i+1] > 0)) continue;
+            bracketed = true;
+            float u;
+            float lo = fmin(us[i], us[i+1]), hi = fmax(us[i], us[i+1]);
+            if (!newtonBracket(ray, lo, hi, us[i] < us[i+1] ? fs[i] : fs[i+1], u)) continue;
+            float t = tAtU(ray, u);
+            if (t < tmin) continue;       // 在起点后面，看下一个变号区间
+            if (tmax < t) return false;   // 更远的根只会更远
+            root = u;
+            tRoot = t;
+            return true;
+        }
+        if (bracketed) return false;
+
+        float seeds[2] = {ua, ub};
+        bool found = false;
+        for (float uSeed : seeds) {
+            float u;
+            if (!newtonSpan(ray, s, uSeed, u)) continue;
+            float t = tAtU(ray, u);
+            if (t < tmin || tmax < t) continue;
+            root = u;
+            tRoot = tmax = t;
+            found = true;
+        }
+        return found;
+    }
+
+    // 在单调区间内求 P(u).y = y 的u（先线性插值，再带二分保护的牛顿法）
+    float uAtY(const CurveSpan& s, float y) const {
+        if (s.y1 == s.y0) return 0.5f * (s.u0 + s.u1);
+        float a = (y - s.y0) / (s.y1 - s.y0);
+        if (a <= 0) return s.u0;
+        if (a >= 1) return s.u1;
+        float lo = s.u0, hi = s.u1;
+        float u = s.u0 + a * (s.u1 - s.u0);
+        bool increasing = s.y1 > s.y0;
+        for (int j = 0; j < 8; j++) {
+            float h = P(u).y() - y;
+            if (fabs(h) < 1e-6f) break;
+            if ((h < 0) == increasing) lo = u;
+            else hi = u;
+            float next = u - h / PDeriv(u).y();
+            u = (lo < next && next < hi) ? next : 0.5f * (lo + hi);
+        }
+        return u;
+    }
+
+    // 已知f(lo)和f(hi)异号，带二分保护的牛顿法
+    bool newtonBracket(const Ray& ray, float lo, float hi, float flo, float& root) {
+        const float maxError = 0.0001;
+        bool loPositive = flo > 0;
+        float u = 0.5f * (lo + hi);
+        for (int j = 0; j < 30; j++) {
+            STATS_INC(newtonIterations);
+            float fu = f(u, ray);
+            if (fabs(fu) < maxError || hi - lo < 1e-7f) {
+                root = u;
+                return true;
+            }
+            if ((fu > 0) == loPositive) lo = u;
+            else hi = u;
+            float fuprime = fprime(u, ray);
+            float next = u - fu / fuprime;
+            // 牛顿步跑出区间时退回二分
+            u = (lo < next && next < hi) ? next : 0.5f * (lo + hi);
+        }
+        return false;
+    }
+
+    // 在一段单调区间内用牛顿法求ray和参数曲面交点
+    bool newtonSpan(const Ray& ray, const CurveSpan& s, float u, float& root) {
+        const float maxError = 0.0001;
+        for (int j = 0; j < 20; j++) {
+            STATS_INC(newtonIterations);
+            float fu = f(u, ray);
+            if (fabs(fu) < maxError) {
+                root = u;
+                return true;
             }
+            float fuprime = fprime(u, ray);
+            if (fuprime == 0 || std::isnan(fuprime)) return false;
+            u = Utils::clamp(u - fu / fuprime, s.u0, s.u1);   // u 不离开这一段
         }
-        if (!converged) return false;   // 没有找到根
+        return false;
+    }
+
+    // u对应的高度上射线的参数t
+    inline float tAtU(const Ray& ray, float u) const {
+        return (P(u).y() - ray.getOrigin().y()) / ray.getDirection().y();
+    }
+
+    // 射线与圆环柱（yMin <= y <= yMax，rMin <= r <= rMax）求交，得到射线在外圆柱内的区间[ta, tb]
+    static bool intersectTube(const Ray& ray, float yMin, float yMax, float rMin, float rMax,
+                              float tmin, float tmax, float& ta, float& tb) {
+        const Vector3f& o = ray.getOrigin();
+        const Vector3f& d = ray.getDirection();
+        // y方向的板
+        if (d.y() != 0) {
+            float inv = 1.0f / d.y();
+            float t0 = (yMin - o.y()) * inv;
+            float t1 = (yMax - o.y()) * inv;
+            if (inv < 0) std::swap(t0, t1);
+            tmin = fmax(tmin, t0);
+            tmax = fmin(tmax, t1);
+        } else if (o.y() < yMin || yMax < o.y()) {
+            return false;
+        }
+        if (tmax < tmin) return false;
+
+        // xz平面上的外圆柱：a t^2 + 2b t + c <= 0
+        float a = d.x() * d.x() + d.z() * d.z();
+        float b = o.x() * d.x() + o.z() * d.z();
+        float c = o.x() * o.x() + o.z() * o.z() - rMax * rMax;
+        if (a == 0) {
+            if (c > 0) return false;
+        } else {
+            float disc = b * b - a * c;
+            if (disc < 0) return false;
+            float sq = sqrt(disc);
+            tmin = fmax(tmin, (-b - sq) / a);
+            tmax = fmin(tmax, (-b + sq) / a);
+            if (tmax < tmin) return false;
+        }
+
+        // 若区间两端都在内圆柱内（r^2关于t是凸函数），则整段都碰不到曲面
+        if (rMin > 0) {
+            float r2 = rMin * rMin;
+            float ra = a * tmin * tmin + 2 * b * tmin + c + rMax * rMax;
+            float rb = a * tmax * tmax + 2 * b * tmax + c + rMax * rMax;
+            if (ra < r2 && rb < r2) return false;
+        }
+        ta = tmin;
+        tb = tmax;
         return true;
     }
 
+    // 找y'(u)的零点，把[0, 1]分成关于y单调的段，再均匀细分
+    void buildSpans() {
+        std::vector<float> breaks;
+        breaks.push_back(0);
+        float prevU = 0;
+        float prevD = PDeriv(0).y();
+        for (int i = 1; i <= rootSamples; i++) {
+            float u = (float) i / rootSamples;
+            float d = PDeriv(u).y();
+            if ((prevD < 0 && d > 0) || (prevD > 0 && d < 0)) {
+                float lo = prevU, hi = u;   // 二分求零点
+                for (int k = 0; k < 30; k++) {
+                    float mid = 0.5f * (lo + hi);
+                    if ((PDeriv(mid).y() > 0) == (prevD > 0)) lo = mid;
+                    else hi = mid;
+                }
+                breaks.push_back(0.5f * (lo + hi));
+            }
+            prevU = u;
+            prevD = d;
+        }
+        breaks.push_back(1);
+
+        for (int i = 0; i + 1 < breaks.size(); i++) {
+            float a = breaks[i], b = breaks[i+1];
+            for (int k = 0; k < piecesPerSpan; k++) {
+                CurveSpan s;
+                s.u0 = a + (b - a) * k / piecesPerSpan;
+                s.u1 = a + (b - a) * (k + 1) / piecesPerSpan;
+                s.y0 = P(s.u0).y();
+                s.y1 = P(s.u1).y();
+                Vector3f mn, mx;
+                pCurve->spanBounds(s.u0, s.u1, mn, mx);
+                s.yMin = mn.y();
+                s.yMax = mx.y();
+                s.rMax = fmax(fabs(mn.x()), fabs(mx.x()));
+                s.rMin = (mn.x() <= 0 && 0 <= mx.x()) ? 0 : fmin(fabs(mn.x()), fabs(mx.x()));
+                spans.push_back(s);
+            }
+        }
+    }
+
+    // 按u的顺序对[lo, hi)的曲线段建立二叉树，返回节点下标
+    int buildSpanTree(int lo, int hi) {
+        int idx = spanTree.size();
+        spanTree.push_back(SpanNode());
+        SpanNode node;
+        if (hi - lo == 1) {
+            const CurveSpan& s = spans[lo];
+            node.yMin = s.yMin; node.yMax = s.yMax;
+            node.rMin = s.rMin; node.rMax = s.rMax;
+            node.left = node.right = -1;
+            node.span = lo;
+        } else {
+            int mid = (lo + hi) / 2;
+            node.left = buildSpanTree(lo, mid);
+            node.right = buildSpanTree(mid, hi);
+            const SpanNode& l = spanTree[node.left];
+            const SpanNode& r = spanTree[node.right];
+            node.yMin = fmin(l.yMin, r.yMin); node.yMax = fmax(l.yMax, r.yMax);
+            node.rMin = fmin(l.rMin, r.rMin); node.rMax = fmax(l.rMax, r.rMax);
+            node.span = -1;
+        }
+        spanTree[idx] = node;
+        return idx;
+    }
+
     // 返回在u对应的与y垂直的平面上，射线与参数曲面的距离
     float f(float u, const Ray& r) {
         Vector3f p = P(u);
@@ -195,26 +401,14 @@ public:
         return transformPoint(ry, p);
     }
 
-    // 参数曲线的位置
-    Vector3f P(float t) {
-        Vector3f p (0, 0, 0);
-        vector<Vector3f>& controls = pCurve->getControls();
-        int n = controls.size() - 1;
-        for (int i = 0; i <= n; i++) {
-            p += pCurve->B(t, i, n) * controls[i];
-        }
-        return p;
+    // 参数曲线的位置（幂基系数在BezierCurve构造时已算好）
+    inline Vector3f P(float t) const {
+        return pCurve->getPoint(t);
     }
 
-    // 参数曲线的位置的倒数
-    Vector3f PDeriv(float t) {
-        Vector3f p (0, 0, 0);
-        vector<Vector3f>& controls = pCurve->getControls();
-        int n = controls.size() - 1;
-        for (int i = 0; i <= n; i++) {
-            p += pCurve->BDeriv(t, i, n) * controls[i];
-        }
-        return p;
+    // 参数曲线的位置的导数
+    inline Vector3f PDeriv(float t) const {
+        return pCurve->getDeriv(t);
     }
 };
 
@@ -1,19 +1,25 @@
 #ifndef SCENE_GENERATOR_H
 #define SCENE_GENERATOR_H
 
+#include <map>
+#include <tuple>
 #include <vector>
 #include <vecmath.h>
 #include <iostream>
 #include "utils.hpp"
-// #include "perlin.hpp"
+#include "perlin.hpp"
+#include "arena.hpp"
 #include "group.hpp"
 #include "object3d.hpp"
 #include "utils.hpp"
 #include "material.hpp"
 #include "texture.hpp"
+#include "texture_manager.hpp"
 #include "box.hpp"
+#include "envmap.hpp"
 #include "mesh.hpp"
 #include "sphere.hpp"
+#include "voxel_world.hpp"
 
 using namespace std;
 
@@ -22,101 +28,135 @@ using namespace std;
 // 场景由一个函数生成，程序化生成一个三维数组，
 // 元素为MinecraftBlock枚举类型，最后遍历该数组，
 // 给场景的Group添加对应的物体。
+// 大场景用 getWorld：方块存在 VoxelWorld 中，不创建物体（见 voxel_world.hpp）。
 
 enum MinecraftBlock {emptyBlock, grass, dirt, oakPlank, oakLog, stone, lightBlock};
 
 class SceneGenerator {
 public:
-    Texture* white        = new SolidColor(1, 1, 1);
-    Texture* black        = new SolidColor(0.1, 0.1, 0.1);
-    Texture* defaultColor = new SolidColor(0.8, 0.8, 0.8);
-    Texture* sunsetColor  = new SolidColor(0.9, 0.6, 0.5);
-    Texture* red          = new SolidColor(0.9, 0.6, 0.6);
-    Texture* green        = new SolidColor(0.6, 0.9, 0.6);
-    Texture* blue         = new SolidColor(0.6, 0.6, 0.9);
-    Texture* textureDirt      = new ImageTexture("textures/minecraft/dirt.png");
-    Texture* textureGrassSide = new ImageTexture("textures/minecraft/grass_side.png");
-    Texture* textureGrassTop  = new ImageTexture("textures/minecraft/grass_top.png");
-    Texture* textureOakPlank  = new ImageTexture("textures/minecraft/oak_planks.png");
-    Texture* textureOakLog    = new ImageTexture("textures/minecraft/oak_log.png");
-    Texture* textureOakLogTop = new ImageTexture("textures/minecraft/oak_log_top.png");
-    Texture* textureStone     = new ImageTexture("textures/minecraft/stone.png");
-    Lambert* matDirt       = new Lambert(textureDirt);
-    Lambert* matGrassSide  = new Lambert(textureGrassSide);
-    Lambert* matGrassTop   = new Lambert(textureGrassTop);
-    Lambert* matOakPlank   = new Lambert(textureOakPlank);
-    Lambert* matOakLog     = new Lambert(textureOakLog);
-    Lambert* matOakLogTop  = new Lambert(textureOakLogTop);
-    Lambert* matStone      = new Lambert(textureStone);
-    Lambert* defaultMat    = new Lambert(defaultColor);
-    Lambert* whiteMat      = new Lambert(white);
-    Lambert* blackMat      = new Lambert(black);
-    Lambert* redMat        = new Lambert(red);
-    Lambert* greenMat      = new Lambert(green);
-    Lambert* blueMat       = new Lambert(blue);
+    Texture* white        = arenaNew<SolidColor>(arenaTexture, 1, 1, 1);
+    Texture* black        = arenaNew<SolidColor>(arenaTexture, 0.1, 0.1, 0.1);
+    Texture* defaultColor = arenaNew<SolidColor>(arenaTexture, 0.8, 0.8, 0.8);
+    Texture* sunsetColor  = arenaNew<SolidColor>(arenaTexture, 0.9, 0.6, 0.5);
+    Texture* red          = arenaNew<SolidColor>(arenaTexture, 0.9, 0.6, 0.6);
+    Texture* green        = arenaNew<SolidColor>(arenaTexture, 0.6, 0.9, 0.6);
+    Texture* blue         = arenaNew<SolidColor>(arenaTexture, 0.6, 0.6, 0.9);
+    Texture* textureDirt      = TextureManager::instance().load("textures/minecraft/dirt.png");
+    Texture* textureGrassSide = TextureManager::instance().load("textures/minecraft/grass_side.png");
+    Texture* textureGrassTop  = TextureManager::instance().load("textures/minecraft/grass_top.png");
+    Texture* textureOakPlank  = TextureManager::instance().load("textures/minecraft/oak_planks.png");
+    Texture* textureOakLog    = TextureManager::instance().load("textures/minecraft/oak_log.png");
+    Texture* textureOakLogTop = TextureManager::instance().load("textures/minecraft/oak_log_top.png");
+    Texture* textureStone     = TextureManager::instance().load("textures/minecraft/stone.png");
+    Lambert* matDirt       = arenaNew<Lambert>(arenaMaterial, textureDirt);
+    Lambert* matGrassSide  = arenaNew<Lambert>(arenaMaterial, textureGrassSide);
+    Lambert* matGrassTop   = arenaNew<Lambert>(arenaMaterial, textureGrassTop);
+    Lambert* matOakPlank   = arenaNew<Lambert>(arenaMaterial, textureOakPlank);
+    Lambert* matOakLog     = arenaNew<Lambert>(arenaMaterial, textureOakLog);
+    Lambert* matOakLogTop  = arenaNew<Lambert>(arenaMaterial, textureOakLogTop);
+    Lambert* matStone      = arenaNew<Lambert>(arenaMaterial, textureStone);
+    Lambert* defaultMat    = arenaNew<Lambert>(arenaMaterial, defaultColor);
+    Lambert* whiteMat      = arenaNew<Lambert>(arenaMaterial, white);
+    Lambert* blackMat      = arenaNew<Lambert>(arenaMaterial, black);
+    Lambert* redMat        = arenaNew<Lambert>(arenaMaterial, red);
+    Lambert* greenMat      = arenaNew<Lambert>(arenaMaterial, green);
+    Lambert* blueMat       = arenaNew<Lambert>(arenaMaterial, blue);
 
     Vector3f boxSize = Vector3f(1, 1, 1);
     Vector3f minPos = Vector3f(-6, -4, -6);   // 场景中坐标最小的位置
     Vector3f nBlocks = Vector3f(12, 12, 12);  // 不同方向的方体个数
 
     vector<vector<vector<enum MinecraftBlock>>> minecraftBlocks;
+    std::map<std::tuple<float, float, float>, Material*> lightMats;
 public:
+    bool useEnvironmentLight = true;            // false：天空仍用半径 100 的发光球（旧做法）
+    EnvironmentMap* environment = nullptr;      // 场景的天空（环境光），由 addSkySphere / addNightSphere 设置
+    Texture* skyTexture = nullptr;              // 环境光的图片和 addSky 时 Group 的大小，replaceEnvironmentWithSphere 用
+    int skyIndex = 0;
+
     SceneGenerator () {}
 
     // 用于获得材质
 
     void addSkySphere(Group* grp) {
-        Material* skyMat = new EmissiveMaterial(new ImageTexture("textures/skymap.jpg"));
-        Sphere* s = new Sphere(Vector3f(0,0,0), 100, skyMat);  // sky sphere
-        grp->addObject(s);
+        addSky(grp, "textures/skymap.jpg");     // daylight
     }
 
     void addNightSphere(Group* grp) {
-        Material* skyMat = new EmissiveMaterial(new ImageTexture("textures/space.png"));
-        Sphere* s = new Sphere(Vector3f(0,0,0), 100, skyMat);  // sky sphere
-        grp->addObject(s);
+        addSky(grp, "textures/space.png");
+    }
+
+    void addSky(Group* grp, const char* imgFile) {
+        ImageTexture* sky = TextureManager::instance().load(imgFile);
+        if (useEnvironmentLight) {
+            environment = arenaNew<EnvironmentMap>(arenaTexture, sky);
+            skyTexture = sky;
+            skyIndex = grp->getGroupSize();
+            return;
+        }
+        grp->addObject(getSkySphere(sky));
+    }
+
+    // 相机被场景的几何体完全包围时（例如 space.txt 的半径 500 的球，main 检查），无穷远的环境光照不进来。
+    // 换回半径 100 的发光球，放在 addSky 时的位置，与 --env-light 0 的场景相同
+    void replaceEnvironmentWithSphere(Group* grp) {
+        if (environment == nullptr) return;
+        std::vector<Object3D*>& objects = grp->getObjects();
+        objects.insert(objects.begin() + skyIndex, getSkySphere(skyTexture));
+        environment = nullptr;
+    }
+
+    Sphere* getSkySphere(Texture* sky) {
+        Material* skyMat = arenaNew<EmissiveMaterial>(arenaMaterial, sky);
+        return arenaNew<Sphere>(arenaGeometry, Vector3f(0,0,0), 100, skyMat);  // sky sphere
     }
 
     inline Material* getLightMat(float x) {
-        return new EmissiveMaterial(new SolidColor(Vector3f(x, x, x)));
+        return getLightMat(Vector3f(x, x, x));
     }
 
+    // 同一颜色的光源共用一个材质
     inline Material* getLightMat(Vector3f color) {
-        return new EmissiveMaterial(new SolidColor(color));
+        auto key = std::make_tuple(color.x(), color.y(), color.z());
+        auto it = lightMats.find(key);
+        if (it != lightMats.end()) return it->second;
+        Material* m = arenaNew<EmissiveMaterial>(arenaMaterial, arenaNew<SolidColor>(arenaTexture, color));
+        lightMats[key] = m;
+        return m;
     }
     
     // 返回一些《我的世界》的方体
 
     inline Box* getBoxLight(Vector3f pos, Vector3f size, Vector3f color) {
-        Box* b = new Box(pos, pos + size, getLightMat(color));
+        Box* b = arenaNew<Box>(arenaGeometry, pos, pos + size, getLightMat(color));
         return b;
     }
 
     inline Box* getBoxGrass(Vector3f pos, Vector3f size) {
-        Box* b = new Box(pos, pos + size, matGrassSide);
+        Box* b = arenaNew<Box>(arenaGeometry, pos, pos + size, matGrassSide);
         b->setBottom(matDirt);
         b->setTop(matGrassTop);
         return b;
     }
 
     inline Box* getBoxDirt(Vector3f pos, Vector3f size) {
-        return new Box(pos, pos+size, matDirt);
+        return arenaNew<Box>(arenaGeometry, pos, pos+size, matDirt);
     }
 
     inline Box* getBoxOakPlank(Vector3f pos, Vector3f size) {
-        Box* b = new Box(pos, pos+size, matOakPlank);
+        Box* b = arenaNew<Box>(arenaGeometry, pos, pos+size, matOakPlank);
         return b;
     }
 
     inline Box* getBoxOakLog(Vector3f pos, Vector3f size) {
-        Box* b = new Box(pos, pos+size, matOakLog);
+        Box* b = arenaNew<Box>(arenaGeometry, pos, pos+size, matOakLog);
         b->setTop(matOakLogTop);
         b->setBottom(matOakLogTop);
         return b;
     }
 
     inline Box* getBoxStone(Vector3f pos, Vector3f size) {
-        Box* b = new Box(pos, pos+size, matStone);
+        Box* b = arenaNew<Box>(arenaGeometry, pos, pos+size, matStone);
         return b;
     }
 
@@ -203,9 +243,9 @@ public:
 
     // 一个小屋子，有些灯光，两只兔子，三个球。
     void getScene1(Group* grp) {
-        Material* glass = new Dielectric(white, 1.5);
-        Material* clearMetal = new Metal(white, 0);
-        Material* fuzzyMetal = new Metal(white, 0.2);
+        Material* glass = arenaNew<Dielectric>(arenaMaterial, white, 1.5);
+        Material* clearMetal = arenaNew<Metal>(arenaMaterial, white, 0);
+        Material* fuzzyMetal = arenaNew<Metal>(arenaMaterial, white, 0.2);
         int gndY = -minPos.y();
         minecraftBlocks.resize(nBlocks.x());
         for (int i = 0; i < nBlocks.x(); i++) {
@@ -300,17 +340,17 @@ public:
         // spheres
         float r0 = 0.3, r1 = 0.3, r2 = 0.3;
         tmp = gridToPos(cornerBL) + 1.3*vx + r0*vy - 1.5*vz;
-        grp->addObject(new Sphere(tmp, r0, glass));
+        grp->addObject(arenaNew<Sphere>(arenaGeometry, tmp, r0, glass));
         tmp = gridToPos(cornerBL) + 2*vx + r1*vy - 1.5*vz;
-        grp->addObject(new Sphere(tmp, r1, clearMetal));
+        grp->addObject(arenaNew<Sphere>(arenaGeometry, tmp, r1, clearMetal));
         tmp = gridToPos(cornerBL) + 2.7*vx + r2*vy - 1.5*vz;
-        grp->addObject(new Sphere(tmp, r2, fuzzyMetal));
+        grp->addObject(arenaNew<Sphere>(arenaGeometry, tmp, r2, fuzzyMetal));
 
         
-        Material* bunnyMat = new Lambert(new SolidColor(Vector3f(0.6, 0.6, 0.6)));
+        Material* bunnyMat = arenaNew<Lambert>(arenaMaterial, arenaNew<SolidColor>(arenaTexture, Vector3f(0.6, 0.6, 0.6)));
         char bunnyFile[] = "mesh/bunny_1k.obj";
-        Mesh* meshBunnyMetal = new Mesh(bunnyFile, fuzzyMetal);
-        Mesh* meshBunnyLambert = new Mesh(bunnyFile, bunnyMat);
+        Mesh* meshBunnyMetal = arenaNew<Mesh>(arenaGeometry, bunnyFile, fuzzyMetal);
+        Mesh* meshBunnyLambert = arenaNew<Mesh>(arenaGeometry, bunnyFile, bunnyMat);
 
         // transform metal bunny
         float scale = 3;
@@ -320,14 +360,14 @@ public:
         Matrix4f m = Matrix4f::identity();
         m = m * Matrix4f::translation(tmp);
         m = m * Matrix4f::uniformScaling(scale);
-        Transform* transformBunny0 = new Transform(m, meshBunnyMetal);
+        Transform* transformBunny0 = arenaNew<Transform>(arenaGeometry, m, meshBunnyMetal);
         
         tmp = cornerBR + vz;
         tmp = gridToPos(tmp) - 0.6*vx - offY*vy;
         m = Matrix4f::identity();
         m = m * Matrix4f::translation(tmp);
         m = m * Matrix4f::uniformScaling(scale);
-        Transform* transformBunny1 = new Transform(m, meshBunnyMetal);
+        Transform* transformBunny1 = arenaNew<Transform>(arenaGeometry, m, meshBunnyMetal);
 
         // add objects to group
 
@@ -338,15 +378,37 @@ public:
     }
     
 
+    // 程序化生成的体素世界：chunks x chunks 个区块，地面平均高度在 y = 0 附近，世界中心在原点
+    VoxelWorld* getWorld(Group* grp, int chunks, int height, unsigned int seed, int threads) {
+        VoxelWorld* world = arenaNew<VoxelWorld>(arenaGeometry, chunks, chunks, height, seed);
+        world->generate(threads);
+
+        Material* leaves = arenaNew<Lambert>(arenaMaterial, arenaNew<SolidColor>(arenaTexture, 0.25, 0.5, 0.15));
+        Material* coal = arenaNew<Lambert>(arenaMaterial, arenaNew<SolidColor>(arenaTexture, 0.12, 0.12, 0.12));
+        Material* gold = arenaNew<Metal>(arenaMaterial, arenaNew<SolidColor>(arenaTexture, 0.95, 0.75, 0.3), 0.3);
+        world->setMaterial(grassVoxel, matGrassTop, matDirt, matGrassSide);
+        world->setMaterial(dirtVoxel, matDirt, matDirt, matDirt);
+        world->setMaterial(stoneVoxel, matStone, matStone, matStone);
+        world->setMaterial(oakLogVoxel, matOakLogTop, matOakLogTop, matOakLog);
+        world->setMaterial(leavesVoxel, leaves, leaves, leaves);
+        world->setMaterial(coalOreVoxel, coal, coal, coal);
+        world->setMaterial(goldOreVoxel, gold, gold, gold);
+
+        Vector3f origin(-world->sizeX() / 2, -world->getBaseHeight(), -world->sizeZ() / 2);
+        world->addChunks(grp, origin);
+        addSkySphere(grp);
+        return world;
+    }
+
     // 简单《我的世界》场景
     Group* getMinecraftScene() {
-        Group* grp = new Group(0);
-        Texture* textureDirt = new ImageTexture("textures/minecraft/dirt.png");
-        Texture* textureGrassSide = new ImageTexture("textures/minecraft/grass_side.png");
-        Texture* textureGrassTop = new ImageTexture("textures/minecraft/grass_top.png");
-        Lambert* matDirt = new Lambert(textureDirt);
-        Lambert* matGrassSide = new Lambert(textureGrassSide);
-        Lambert* matGrassTop = new Lambert(textureGrassTop);
+        Group* grp = arenaNew<Group>(arenaGeometry, 0);
+        Texture* textureDirt = TextureManager::instance().load("textures/minecraft/dirt.png");
+        Texture* textureGrassSide = TextureManager::instance().load("textures/minecraft/grass_side.png");
+        Texture* textureGrassTop = TextureManager::instance().load("textures/minecraft/grass_top.png");
+        Lambert* matDirt = arenaNew<Lambert>(arenaMaterial, textureDirt);
+        Lambert* matGrassSide = arenaNew<Lambert>(arenaMaterial, textureGrassSide);
+        Lambert* matGrassTop = arenaNew<Lambert>(arenaMaterial, textureGrassTop);
         Vector3f boxSize(1, 1, 1);
         float yMin = 0;
         float xMin = -8, zMin = -8;
@@ -354,33 +416,14 @@ public:
         Vector3f minPos(xMin, yMin, zMin);
         vector<vector<int>> landscape(numBlockX, vector<int>(numBlockZ));
         
-        // // generate landscape with perlin noise
-        // Perlin perlin;
-        // for (int i = 0; i < numBlockX; i++){
-        //     for (int j = 0; j < numBlockZ; j++) {
-        //         float x = 5 * ((float) i ) / numBlockX;
-        //         float z = 5 * ((float) j ) / numBlockZ;
-        //         Vector3f p = (x, z, 0);
-        //         float n = perlin.noise(p);
-        //         cout << perlin.noise(p) << " ";
-        //         landscape[i][j] = 10 * perlin.noise(p);
-        //         cout << landscape[i][j];
-        //     }
-        //     cout << endl;
-        // }
-
-
-        // manually generate terrain
+        // generate landscape with perlin noise
+        Perlin perlin;
         for (int i = 0; i < numBlockX; i++){
             for (int j = 0; j < numBlockZ; j++) {
-                float ii = ((float) i) / numBlockX;
-                float jj = ((float) j) / numBlockZ;
-                
-                int height = (int) (abs(ii-0.5)*abs(ii-0.5)*20 + abs(jj-0.5)*abs(jj-0.5)*20);
-                cout << height;
-                landscape[i][j] = height+1;
+                Vector3f p(i / 8.0f, 0.5f, j / 8.0f);
+                landscape[i][j] = 3 + (int) floor(6 * perlin.fbm(p, 3));
+                landscape[i][j] = max(1, landscape[i][j]);
             }
-            cout << endl;
         }
 
         // fill blocks according to 2D array landscape
@@ -398,14 +441,14 @@ public:
                     Vector3f t(i, k, j);
                     Vector3f pos = gridToPos(t);
                     Vector3f size = pos + boxSize;
-                    Box* box = new Box(pos, size, matDirt);
+                    Box* box = arenaNew<Box>(arenaGeometry, pos, size, matDirt);
                     grp->addObject(box);
                 }
                 // add grass block
                 Vector3f t(i, k, j);
                 Vector3f pos = gridToPos(t);
                 Vector3f size = pos + boxSize;
-                Box* box = new Box(pos, size, matGrassSide);
+                Box* box = arenaNew<Box>(arenaGeometry, pos, size, matGrassSide);
                 box->setTop(matGrassTop);
                 grp->addObject(box);
             }
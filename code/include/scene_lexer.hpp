@@ -0,0 +1,104 @@
+#ifndef SCENE_LEXER_H
+#define SCENE_LEXER_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class SceneLexer;
+
+// 场景文件的关键字：X(枚举名, 文件中的写法)
+#define SCENE_KEYWORDS(X) \
+    X(LBrace, "{") X(RBrace, "}") X(LBracket, "[") X(RBracket, "]") \
+    X(PerspectiveCamera, "PerspectiveCamera") X(Background, "Background") X(RenderSettings, "RenderSettings") \
+    X(Lights, "Lights") X(Textures, "Textures") X(Materials, "Materials") X(Group, "Group") \
+    X(Center, "center") X(Direction, "direction") X(Up, "up") X(Angle, "angle") X(Width, "width") \
+    X(Height, "height") X(Aperture, "aperture") X(FocusDistance, "focusDistance") X(Color, "color") \
+    X(DirectionalLight, "DirectionalLight") X(PointLight, "PointLight") X(Position, "position") \
+    X(Checker, "Checker") X(Image, "Image") X(Color0, "color0") X(Color1, "color1") \
+    X(Texture0, "texture0") X(Texture1, "texture1") X(ImgFile, "imgFile") \
+    X(Noise, "Noise") X(Pattern, "pattern") X(Frequency, "frequency") X(Octaves, "octaves") X(Seed, "seed") \
+    X(Space, "space") X(Bake, "bake") \
+    X(Lambert, "Lambert") X(Metal, "Metal") X(Dielectric, "Dielectric") X(Emissive, "Emissive") \
+    X(Texture, "texture") X(Fuzziness, "fuzziness") X(RefractionIndex, "refractionIndex") \
+    X(NumObjects, "numObjects") X(MaterialIndex, "MaterialIndex") \
+    X(Sphere, "Sphere") X(Plane, "Plane") X(Triangle, "Triangle") X(TriangleMesh, "TriangleMesh") \
+    X(Transform, "Transform") X(BezierCurve, "BezierCurve") X(RevSurface, "RevSurface") \
+    X(Radius, "radius") X(Velocity, "velocity") X(Normal, "normal") X(Offset, "offset") \
+    X(Vertex0, "vertex0") X(Vertex1, "vertex1") X(Vertex2, "vertex2") X(ObjFile, "obj_file") \
+    X(Controls, "controls") X(Profile, "profile") \
+    X(Scale, "Scale") X(UniformScale, "UniformScale") X(Translate, "Translate") X(XRotate, "XRotate") \
+    X(YRotate, "YRotate") X(ZRotate, "ZRotate") X(Rotate, "Rotate") X(Matrix4f, "Matrix4f") \
+    X(Keyframe, "Keyframe") X(Time, "time") \
+    X(Include, "Include") X(Define, "Define") X(Instance, "Instance") X(Repeat, "Repeat") X(Count, "count")
+
+enum SceneKeyword {
+    kwNone,         // 不是关键字：数字、文件名、设置的名字和值
+#define SCENE_KEYWORD_ENUM(id, text) kw##id,
+    SCENE_KEYWORDS(SCENE_KEYWORD_ENUM)
+#undef SCENE_KEYWORD_ENUM
+    numSceneKeywords
+};
+
+// 场景文件的错误，what() 为 "文件:行:列: 信息"。首次解析时 main 打印后退出，
+// 热重载（reload.hpp）时打印后继续使用原来的场景
+struct SceneError : std::runtime_error {
+    explicit SceneError(const std::string& message) : std::runtime_error(message) {}
+};
+
+// 一个记号：指向文件缓冲区的一段，不以 '\0' 结尾
+struct SceneToken {
+    const char* text = "";
+    int length = 0;                 // 0 表示文件结束
+    SceneKeyword keyword = kwNone;
+    int line = 0, column = 0;       // 从 1 开始
+    const SceneLexer* source = nullptr;     // 读出它的 lexer，报错时取文件名
+
+    bool atEnd() const { return length == 0; }
+    bool is(SceneKeyword kw) const { return keyword == kw; }
+    std::string str() const { return std::string(text, length); }
+};
+
+// 场景文件的词法分析。一次读入整个文件，记号之间以空白分隔（与原来 fscanf("%s") 的格式相同）；
+// 关键字在切分时用哈希表查出，解析器按 SceneKeyword 分派，不再逐个 strcmp。
+// 数字直接从缓冲区解析，结果与 strtof 相同。出错时抛出 SceneError（文件:行:列 和信息）
+class SceneLexer {
+public:
+    // 载入失败时返回 false
+    bool open(const char* filename);
+
+    SceneToken next();
+    SceneToken peek();
+
+    // 读一个非关键字的记号（文件名等）。数值由 SceneParser 读，经过 Include 的展开
+    std::string readString();
+
+    // 抛出 SceneError("文件:行:列: 信息")，文件取 tok 的 source
+    [[noreturn]] void error(const SceneToken& tok, const char* fmt, ...) const;
+    // "expected <what>, found ..."
+    [[noreturn]] void unexpected(const SceneToken& tok, const char* what) const;
+
+    const std::string& getFilename() const { return filename; }
+
+    // 64 位 FNV-1a，signature 的初值为 signatureBasis。SceneParser 用它累加读出的记号，热重载时判断场景的哪些部分变了（reload.hpp）
+    static const unsigned long long signatureBasis = 14695981039346656037ull;
+    static void addSignature(unsigned long long& signature, const void* data, size_t size);
+
+    static const char* keywordText(SceneKeyword kw);
+    static SceneKeyword lookupKeyword(const char* text, int length);
+
+    // 解析整个记号为 float / int，格式不对时返回 false
+    static bool parseFloat(const char* text, int length, float& out);
+    static bool parseInt(const char* text, int length, int& out);
+
+private:
+    std::string filename;
+    std::vector<char> buffer;
+    const char* pos = nullptr;
+    const char* end = nullptr;
+    const char* lineStart = nullptr;
+    int line = 1;
+};
+
+#endif // SCENE_LEXER_H
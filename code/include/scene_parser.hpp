@@ -2,6 +2,9 @@
 #define SCENE_PARSER_H
 
 #include <cassert>
+#include <map>
+#include <memory>
+#include <string>
 #include <vecmath.h>
 #include <vector>
 
@@ -19,6 +22,7 @@
 #include "transform.hpp"
 #include "curve.hpp"
 #include "revsurface.hpp"
+#include "scene_lexer.hpp"
 
 class Camera;
 class Light;
@@ -32,14 +36,29 @@ class Transform;
 class Mesh;
 class Curve;
 class RevSurface;
+struct RenderSettings;
 
-#define MAX_PARSER_TOKEN_LENGTH 1024
+// 文件的修改时间和大小，热重载（reload.hpp）据此判断文件是否改过
+struct FileStamp {
+    long long mtime = -1;   // 纳秒，-1 表示文件不存在
+    long long size = -1;
+
+    bool operator==(const FileStamp &o) const { return mtime == o.mtime && size == o.size; }
+    bool operator!=(const FileStamp &o) const { return !(*this == o); }
+
+    static FileStamp of(const std::string &path);
+};
 
 class SceneParser {
 public:
 
     SceneParser() = delete;
-    SceneParser(const char *filename);
+    // settings 非空时，场景文件中的 RenderSettings 块写入其中。出错时抛出 SceneError。
+    // previous 非空时是热重载（reload.hpp）：每个纹理、材质、原型（Define）和 Group 中的每个物体都记下签名
+    // （它的记号、引用的纹理 / 材质 / 原型的对象、OBJ 和图片文件的 FileStamp），签名与 previous 中对应的一项相同时
+    // 沿用 previous 的对象；同一位置的材质类型没变、参数变了时也沿用原来的对象，新的参数由 commitMaterials 写入。
+    // 文件和材质都没变的网格不重新载入 OBJ、不重建网格的 BVH。previous 的对象要在新场景使用期间一直有效
+    SceneParser(const char *filename, RenderSettings *settings = nullptr, SceneParser *previous = nullptr);
 
     ~SceneParser();
 
@@ -74,17 +93,38 @@ public:
 
     Group *getGroup() const { return group; }
 
+    // 有动画的物体数（有关键帧的 Transform、有 velocity 的 Sphere），为 0 时换帧不必更新 BVH
+    int getNumAnimated() const { return numAnimated; }
+
+    // 以下供热重载使用
+
+    // 场景文件、Include 的文件、OBJ 和图片文件在解析时的 FileStamp
+    const std::map<std::string, FileStamp> &getDependencies() const { return dependencies; }
+    unsigned long long getCameraSignature() const { return cameraSignature; }
+    // Group 块中的物体，即 SceneGenerator 加入物体之前 getGroup() 的内容
+    const std::vector<Object3D*> &getRootObjects() const { return rootObjects; }
+    // 把参数变了的材质的新参数写入沿用的材质对象（没有光线在追踪时调用）
+    void commitMaterials();
+
+    // 沿用 previous 的对象的个数
+    struct ReuseStats {
+        int textures = 0, materials = 0, materialsUpdated = 0, prototypes = 0, objects = 0, meshes = 0;
+    };
+    const ReuseStats &getReuseStats() const { return reuseStats; }
+
 private:
 
     void parseFile();
     void parsePerspectiveCamera();
     void parseBackground();
+    void parseRenderSettings();
     void parseLights();
     Light *parsePointLight();
     Light *parseDirectionalLight();
     void parseTextures();
     CheckerTexture *parseCheckerTexture();
     ImageTexture *parseImageTexture();
+    NoiseTexture *parseNoiseTexture();
 
     void parseMaterials();
     Lambert *parseLambert();
@@ -92,8 +132,24 @@ private:
     Dielectric* parseDielectric();
     EmissiveMaterial *parseEmissiveMaterial();
 
-    Object3D *parseObject(char token[MAX_PARSER_TOKEN_LENGTH]);
-    Group *parseGroup();
+    // 物体列表（Group、Define、Repeat 的内容）中的一项放到 items 末尾，返回是否是物体（而不是 MaterialIndex）
+    struct PlacedObject {
+        Object3D *object;
+        Matrix4f matrix;        // 放置的变换，transformed 为 false 时是单位矩阵
+        bool transformed;
+    };
+    bool parseItem(const SceneToken &token, std::vector<PlacedObject> &items);
+    Object3D *makeObject(const PlacedObject &p);
+    bool parseTransformStep(const SceneToken &token, Matrix4f &matrix);
+    Matrix4f parseKeyframe(TransformTrack &track);
+    void parseDefine();
+    PlacedObject parseInstance();
+    void parseRepeat(std::vector<PlacedObject> &items);
+    void pushInclude(const SceneToken &token);
+
+    Object3D *parseObject(const SceneToken &token);
+    // root 为 true 时是场景的 Group 块，记下每个物体的签名
+    Group *parseGroup(bool root = false);
     Sphere *parseSphere();
     Plane *parsePlane();
     Triangle *parseTriangle();
@@ -103,14 +159,36 @@ private:
     Curve *parseBsplineCurve();
     RevSurface *parseRevSurface();
 
-    int getToken(char token[MAX_PARSER_TOKEN_LENGTH]);
-
+    Texture *readTexture();
+    void requireMaterial(const SceneToken &token);
+
+    // 签名：beginSignature 之后读出的记号（不含 Include 和它的路径）都累加到 signature
+    void beginSignature() { signature = SceneLexer::signatureBasis; }
+    void addSignature(const void *data, size_t size) { SceneLexer::addSignature(signature, data, size); }
+    // 刚解析的纹理 / 材质签名没变时换成 previous 的对象
+    Texture *reuseTexture(Texture *t);
+    Material *reuseMaterial(Material *m);
+    // 记录依赖的文件，返回它现在的 FileStamp
+    FileStamp addDependency(const std::string &path);
+
+    // 读下一个记号；Include 在这里展开，被包含的文件读完后回到原文件。
+    // 所有的读取都经过 next，数值、物体的块都可以跨过 Include 的边界
+    SceneToken next();
+    SceneToken peek();
+    SceneToken expect(SceneKeyword kw);
+    std::string readString();
     Vector3f readVector3f();
-
     float readFloat();
     int readInt();
-
-    FILE *file;
+    // 从当前文件读一个记号，展开 Include，不累加签名
+    SceneToken lex();
+
+    std::vector<std::unique_ptr<SceneLexer>> lexers;   // 打开过的所有文件，解析结束前不释放（记号指向它们的缓冲区）
+    std::vector<SceneLexer*> includeStack;              // 场景文件和正在读的 Include 文件，最后一个是当前文件
+    SceneLexer *lexer;
+    SceneToken peeked;                                  // peek 读出、还没有被 next 取走的记号
+    bool hasPeeked = false;
+    std::map<std::string, Object3D*> prototypes;        // Define 的原型，Instance 按名字引用
     Camera *camera;
     Vector3f background_color;
     std::vector<Light*> lights;
@@ -118,6 +196,22 @@ private:
     std::vector<Texture*> textures;
     Material *current_material;
     Group *group;
+    RenderSettings *settings;
+    int numAnimated = 0;
+
+    // 热重载
+    SceneParser *previous;
+    unsigned long long signature = SceneLexer::signatureBasis;  // 所有 lexer 都累加到这里
+    unsigned long long cameraSignature = 0;
+    std::vector<unsigned long long> textureSignatures;
+    std::vector<unsigned long long> materialSignatures;
+    std::map<std::string, unsigned long long> prototypeSignatures;
+    std::vector<Object3D*> rootObjects;
+    std::vector<unsigned long long> objectSignatures;          // 与 rootObjects 对应
+    std::map<std::pair<std::string, Material*>, Mesh*> meshes;  // (OBJ 文件, 材质) -> 网格
+    std::map<std::string, FileStamp> dependencies;
+    std::vector<std::pair<Material*, Material*>> pendingMaterials;  // (沿用的材质, 新的参数)
+    ReuseStats reuseStats;
 };
 
 #endif // SCENE_PARSER_H
@@ -0,0 +1,83 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <random>
+#include <set>
+#include <string>
+
+// 渲染设置：命令行参数和场景文件中可选的 RenderSettings 块共用同一套名字，
+// 命令行 --name value 与场景文件中的 name value 等价：
+//
+//   RenderSettings {
+//       spp 64
+//       max-depth 50
+//       format bmp,tga
+//   }
+//
+// 命令行给出的设置优先，场景文件中的同名设置被忽略。RenderSettings 块应放在场景文件开头，
+// 纹理相关的设置（texture-linear / texture-budget）只对之后载入的纹理有效，seed 立即重置随机数。
+struct RenderSettings {
+    enum { bmpFormat = 1, ppmFormat = 2, tgaFormat = 4 };   // format 的位
+    enum Generator { noGenerator, scene1Generator, worldGenerator };
+
+    // 采样
+    int samplesPerPixel = 1000;         // spp：每像素采样数（SSAA）
+    int maxDepth = 600;                 // max-depth：光线跟踪深度上限
+    unsigned int seed = std::mt19937::default_seed;   // seed
+    float timeBudget = 0;               // time-budget：秒，0 表示不限制；限制时分多遍渲染，到时停止
+
+    // 积分器和加速结构
+    bool wavefront = false;             // integrator recursive|wavefront
+    bool raySort = true;                // ray-sort：波前模式的次级光线排序
+    int packetSize = 16;                // packet 1|4|8|16：相机光线包大小
+    bool sahBvh = false;                // accel median|sah：BVH 的建树方法
+    Generator generator = scene1Generator;  // generator scene1|world|none：加入 SceneGenerator::getScene1 / getWorld 的内容
+    bool envLight = true;               // env-light：天空作为环境光采样
+
+    // 纹理
+    bool textureLinear = true;          // texture-linear
+    // texture-filter、texture-budget 直接写入 ImageTexture / TextureManager
+
+    // 体素世界（generator world）
+    int worldChunks = 8;                // world-chunks：世界为 N x N 个 16 x 16 的区块
+    int worldHeight = 64;               // world-height：世界高度（方块）
+    unsigned int worldSeed = 1;         // world-seed：地形、洞穴、矿石和树的种子
+
+    // 动画（animation.hpp）：第 i 帧的快门区间为 [start-time + i * frame-step, 再加 shutter]
+    int frames = 1;                     // frames：帧数，多于一帧时输出 <name>_0000、<name>_0001 ...
+    float startTime = 0;                // start-time：第一帧的时刻
+    float frameStep = 1;                // frame-step：相邻两帧的时间间隔
+    float shutter = 0;                  // shutter：快门打开的时长，0 表示没有运动模糊
+    float refitThreshold = 1.3f;        // refit-threshold：换帧后 refit 的 BVH 节点表面积平均超过建树时的这么多倍就重新建树，0 表示每帧重建
+
+    // 并行：本地逐列渲染按列条分给多个线程（输出与线程数无关），--time-budget / wavefront / 预览仍是单线程
+    int threads = 0;                    // threads：本地渲染、去噪和体素世界生成的线程数，0 表示硬件线程数
+    int tileSize = 32;                  // tile-size：分布式渲染的块大小
+    int servePort = -1;                 // serve PORT（只能在命令行给出，下同）
+    int spawnCount = 0;                 // spawn N
+    std::string bindAddress = "127.0.0.1";  // bind ADDR：协调者监听的 IPv4 地址，0.0.0.0 为所有网卡
+    int unitTimeout = 300;              // unit-timeout：秒，工作者交回一个单元的期限，超过时重新分配；0 表示不限制
+    std::string workerAddress;          // worker HOST:PORT
+    int previewPort = -1;               // preview PORT：交互式预览（preview.hpp），只监听 127.0.0.1
+    bool watch = true;                  // watch：预览时场景文件改过后重新载入（reload.hpp）
+
+    // 输出
+    std::string outputDir = "output";   // output-dir：最终图片、AOV 写到这里，中间图片写到 <dir>/temp/<格式>/
+    unsigned formats = bmpFormat | ppmFormat;   // format：逗号分隔的 bmp、ppm、tga
+    int checkpointColumns = 10;         // checkpoint：每渲染多少列保存一次中间图片，0 表示不保存
+    unsigned aovMask = 0;               // aov：要输出的通道（aov.hpp）
+    bool denoise = false;               // denoise
+
+    // 设置一项（name 不带 --），fromScene 表示来自场景文件。出错时打印信息并返回 false
+    bool set(const std::string& name, const std::string& value, bool fromScene = false);
+
+    // 解析 argv[first..argc) 中的 --name value
+    bool parseArgs(int argc, char* argv[], int first);
+
+    static void printUsage();
+
+private:
+    std::set<std::string> fromCommandLine;
+};
+
+#endif // SETTINGS_H
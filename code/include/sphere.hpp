@@ -1,6 +1,7 @@
 #ifndef SPHERE_H
 #define SPHERE_H
 
+#include "animation.hpp"
 #include "object3d.hpp"
 #include <vecmath.h>
 #include <cmath>
@@ -21,10 +22,23 @@ public:
 
     ~Sphere() override = default;
 
+    // 运动的球：时刻 t 的球心为 center + velocity * t（animation.hpp）
+    void setVelocity(const Vector3f &v) {
+        velocity = v;
+        moving = v.squaredLength() > 0;
+    }
+    bool isMoving() const { return moving; }
+
+    Vector3f centerAt(float time) const {
+        return moving ? center + velocity * time : center;
+    }
+
     bool intersect(const Ray &r, Hit &h, float tmin, float tmax) override {
         // cout << "intersect on sphere\n";
+        STATS_PRIM(sphere);
         Vector3f rayDir = r.getDirection().normalized();
-        Vector3f oc = center - r.getOrigin();
+        Vector3f c = centerAt(r.getTime());
+        Vector3f oc = c - r.getOrigin();
         float ocLen = oc.length();
         float oh = Vector3f::dot(oc, rayDir);
         float ch2 = ocLen * ocLen - oh * oh;
@@ -46,19 +60,26 @@ public:
         
         Vector3f p = r.pointAtParameter(t);
         h.set(p, t, material);
-        Vector3f normal = (p - center).normalized();
+        Vector3f normal = (p - c).normalized();
         h.setNormal(r, normal);
         float u, v;
         getUvSphere(normal, u, v);
         h.setUv(u, v);
+        h.setUvScale(PI * 1.41421356f * radius);   // u 方向周长 2πr，v 方向 πr，取几何平均
         // cout << "done intersecting\n";
         return true;
     }
 
     bool hitbox(Aabb& box) const {
         float r = abs(radius);
-        box = Aabb(center - Vector3f(r, r, r), 
-                    center + Vector3f(r, r, r));
+        Vector3f c = centerAt(Shutter::getOpen());
+        box = Aabb(c - Vector3f(r, r, r), 
+                    c + Vector3f(r, r, r));
+        if (moving) {
+            // 匀速直线运动，快门区间两端的包围盒的并集即为扫过的范围
+            Vector3f c1 = centerAt(Shutter::getClose());
+            box = Aabb::surroundingBox(box, Aabb(c1 - Vector3f(r, r, r), c1 + Vector3f(r, r, r)));
+        }
         return true;
     }
 
@@ -71,7 +92,7 @@ public:
     // 计算球面上的uv值
     void getUvSphere(const Vector3f& pos, float& u, float& v) {
         float phi = atan2(pos.z(), pos.x());
-        float theta = asin(pos.y());
+        float theta = asin(Utils::clamp(pos.y(), -1.0, 1.0));   // 归一化误差可能使 |y| 略大于 1
         u = 0.5 - phi / (2 * PI);
         v = theta/PI + 0.5;
     }
@@ -79,6 +100,8 @@ public:
 protected:
     Vector3f center;
     float radius;
+    Vector3f velocity = Vector3f::ZERO;
+    bool moving = false;
 };
 
 
@@ -0,0 +1,71 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <vector>
+
+// 渲染统计（可选）。用 cmake -DPA1_STATS=ON 编译时定义 RT_STATS，
+// 否则下面的 STATS_* 宏全部展开为空，不产生任何开销。
+//
+// 每个线程有自己的一份计数器（thread_local），渲染结束后再汇总，
+// 所以计数时不需要加锁。
+
+class RenderStats {
+public:
+    static const int maxObjectTypes = 16;   // 足够放下 ObjectType 的所有取值
+    static const int pathLengthBins = 32;   // 路径长度直方图，最后一格存放更长的路径
+
+    long long cameraRays = 0;
+    long long secondaryRays = 0;
+    long long shadowRays = 0;               // 环境光采样的阴影光线
+    long long bvhNodesVisited = 0;
+    long long aabbTests = 0;
+    long long packetNodesVisited = 0;       // 光线包遍历的节点数（整包算一次）
+    long long packetFallbackRays = 0;       // 光线包发散后退回单光线遍历的光线数
+    long long primitiveTests[maxObjectTypes] = {};
+    long long newtonIterations = 0;         // RevSurface 求根的迭代次数
+    long long paths = 0;
+    long long pathLengthSum = 0;
+    long long pathLengths[pathLengthBins] = {};
+
+    inline void recordPath(int length) {
+        ++paths;
+        pathLengthSum += length;
+        ++pathLengths[length < pathLengthBins - 1 ? length : pathLengthBins - 1];
+    }
+
+    void add(const RenderStats& other);
+
+    // 当前线程的计数器，第一次调用时登记到全局列表中
+    static inline RenderStats& local() {
+        thread_local RenderStats* s = registerThread();
+        return *s;
+    }
+
+    // 所有线程计数器之和
+    static RenderStats total();
+
+    // 输出汇总信息，seconds 为渲染用时
+    static void report(float seconds);
+
+    // 逐像素统计：BVH 节点访问次数和采样数，用于输出热力图
+    static void initPixels(int width, int height);
+    static void recordPixel(int x, int y, long long nodeVisits, int spp);
+    static void saveHeatmaps(const char* prefix);
+
+private:
+    static RenderStats* registerThread();
+};
+
+#ifdef RT_STATS
+#define STATS_INC(field) (++RenderStats::local().field)
+#define STATS_ADD(field, n) (RenderStats::local().field += (n))
+#define STATS_PRIM(type) (++RenderStats::local().primitiveTests[(type)])
+#define STATS_PATH(length) (RenderStats::local().recordPath(length))
+#else
+#define STATS_INC(field) ((void) 0)
+#define STATS_ADD(field, n) ((void) 0)
+#define STATS_PRIM(type) ((void) 0)
+#define STATS_PATH(length) ((void) 0)
+#endif
+
+#endif // STATS_H
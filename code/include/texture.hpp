@@ -1,59 +1,116 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <string>
+#include <vector>
 #include <vecmath.h>
+#include "perlin.hpp"
+
+// 纹理类型标签，textureColorByType 按它分派，避免着色时的虚函数调用
+enum TextureType {solidTex, imageTex, checkerTex, noiseTex, otherTex};
 
 class Texture {
 public:
-    Texture(){}
+    Texture() : texType(otherTex) {}
     virtual Vector3f getColor(float u, float v, const Vector3f& pos) const = 0;
+
+    TextureType texType;
 };
 
 class SolidColor : public Texture {
 public:
-    SolidColor(){}
-    SolidColor(Vector3f c) : color(c){}
-    SolidColor(float r, float g, float b) : color(Vector3f(r, g, b)){}
+    SolidColor() { texType = solidTex; }
+    SolidColor(Vector3f c) : color(c) { texType = solidTex; }
+    SolidColor(float r, float g, float b) : color(Vector3f(r, g, b)) { texType = solidTex; }
 
     virtual Vector3f getColor(float u, float v, const Vector3f& pos) const {
         return color;
     }
+
+    const Vector3f& getSolidColor() const { return color; }
 private:
     Vector3f color;
 };
 
+// 图片纹理。载入时建立 mip 金字塔（每层长宽减半，2x2 平均），各层按 tileSize x tileSize
+// 的块（tile）存放，相邻纹素在内存中也相邻；纹素仍是 8 位，取色时查表（decodeLut）
+// 转换为线性值。图片纹理由 TextureManager 载入和持有（见 texture_manager.hpp）。
+// 取色时根据光线锥在 uv 空间的宽度选择层级：
+//   nearestFilter   - 原图最近邻，不用 mip
+//   bilinearFilter  - 原图双线性插值，不用 mip
+//   trilinearFilter - 缩小时在相邻两层之间做三线性插值；放大时（宽度不足一个纹素）
+//                     仍用最近邻，保持像素风纹理（《我的世界》方块）的清晰边缘
+enum TextureFilter {nearestFilter, bilinearFilter, trilinearFilter};
+
+class TextureManager;
+
 class ImageTexture : public Texture {
 public:
     static const int bytesPerPixel = 3;
+    static const int tileSize = 32;
+    static const int tileBytes = tileSize * tileSize * bytesPerPixel;
+    static TextureFilter filter;    // 所有图片纹理共用，由 --texture-filter 设置
+    static float decodeLut[256];    // 8 位值 -> 线性值，由 TextureManager::setLinearize 设置
 
-    ImageTexture() : img(nullptr), width(0), height(0), bytesPerRow(0) {}
-    ImageTexture(const char* filename);
+    ImageTexture() : loaded(false), paged(false), width(0), height(0) { texType = imageTex; }
+    // paged 为 true 时纹素块写入 manager 的后备文件，按需读入（受内存预算限制）
+    ImageTexture(const char* filename, TextureManager* manager, bool paged);
 
-    // destructor
-    ~ImageTexture() {
-        delete img;
-    }
+    ~ImageTexture();
 
+    // 不知道光线锥时按原图取色
     virtual Vector3f getColor(float u, float v, const Vector3f& pos) const;
 
+    // uvWidth：光线锥在 uv 空间的宽度，0 表示按原图取色
+    Vector3f sample(float u, float v, float uvWidth) const;
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getNumLevels() const { return (int) levels.size(); }
+    int getNumTiles() const { return (int) tiles.size(); }
+    bool isLoaded() const { return loaded; }
+
+    // 一个纹素块。data 为空表示不在内存中（只会出现在 paged 纹理上）
+    struct Tile {
+        unsigned char* data = nullptr;
+        long long fileOffset = -1;      // 在后备文件中的位置
+        bool referenced = false;        // CLOCK 置换用的访问位
+    };
+
 private:
-    unsigned char* img;
+    friend class TextureManager;
+
+    struct MipLevel {
+        int width, height;
+        int tilesX, tilesY;
+        int firstTile;                  // 本层第一个块在 tiles 中的下标
+    };
+
+    void buildTiles(const unsigned char* img, TextureManager* manager);
+    Vector3f texel(const MipLevel& level, int x, int y) const;
+    Vector3f nearest(float u, float v) const;
+    Vector3f bilinear(const MipLevel& level, float u, float v) const;
+
+    bool loaded;
+    bool paged;
+    TextureManager* manager = nullptr;
     int width, height;
-    int bytesPerRow;
+    std::vector<MipLevel> levels;
+    mutable std::vector<Tile> tiles;    // 所有层的块，paged 时按需换入换出
 };
 
 class CheckerTexture : public Texture {
 public:
-    CheckerTexture(){}
-    CheckerTexture(Texture* _t0, Texture* _t1) : texture0(_t0), texture1(_t1) {}
+    CheckerTexture() { texType = checkerTex; }
+    CheckerTexture(Texture* _t0, Texture* _t1) : texture0(_t0), texture1(_t1) { texType = checkerTex; }
 
     virtual Vector3f getColor(float u, float v, const Vector3f& pos) const {
+        return select(pos)->getColor(u, v, pos);
+    }
+
+    const Texture* select(const Vector3f& pos) const {
         float s = sin(1 * pos.x()) * sin(1 * pos.y()) * sin(1 * pos.z());
-        if (s < 0) {
-            return texture0->getColor(u, v, pos);
-        } else {
-            return texture1->getColor(u, v, pos);
-        }
+        return s < 0 ? texture0 : texture1;
     }
 
     void setTexture0(Texture* t) {texture0 = t;}
@@ -64,4 +121,74 @@ private:
     Texture *texture1;
 };
 
+// 程序化纹理：不占纹理内存，按图案值在 texture0 / texture1 之间插值。
+//   fbmPattern        - 分形噪声
+//   turbulencePattern - 湍流（每层噪声取绝对值）
+//   marblePattern     - 沿 x 的正弦条纹，用湍流扰动
+//   woodPattern       - 绕 y 轴的年轮，用 fbm 扰动
+//   worleyPattern     - 细胞噪声：到最近特征点的距离（每个单位格一个特征点）
+// 默认按交点的世界坐标取值（实体纹理，与物体的 uv 无关），uvSpace 时按 (u, v) 取值。
+// 坐标先乘 frequency。着色时给出光线锥宽度，频率超过锥宽度对应的奈奎斯特频率的噪声层淡出为平均值，
+// 所以远处不会出现噪点式的走样。
+// bake(N) 把 uv 空间的图案预先算成 N x N 的表（批量 SIMD 求值），之后双线性查表
+enum NoisePattern {fbmPattern, turbulencePattern, marblePattern, woodPattern, worleyPattern};
+
+class NoiseTexture : public Texture {
+public:
+    NoiseTexture(NoisePattern pattern, Texture* t0, Texture* t1, float frequency, int octaves, unsigned int seed, bool uvSpace);
+
+    virtual Vector3f getColor(float u, float v, const Vector3f& pos) const {
+        return sample(u, v, pos, 0, 0);
+    }
+
+    // uvWidth / worldWidth：光线锥在 uv 空间 / 世界空间的宽度，0 表示不限制频率
+    Vector3f sample(float u, float v, const Vector3f& pos, float uvWidth, float worldWidth) const;
+
+    // 图案值，在 [0, 1] 内。p 为纹理空间坐标（已乘 frequency），width 为纹理空间的足迹宽度
+    float value(const Vector3f& p, float width) const;
+    // 批量版本，噪声部分每 4 个点一组用 SSE2 计算
+    void values(const float* x, const float* y, const float* z, float width, float* out, int n) const;
+
+    // 预计算 N x N 的 uv 表，只用于 uvSpace 的纹理
+    void bake(int resolution);
+    bool isUvSpace() const { return uvSpace; }
+
+    static bool parsePattern(const std::string& name, NoisePattern& out);
+
+private:
+    float octaveSum(const Vector3f& p, float width, bool absolute) const;
+    void octaveSums(const float* x, const float* y, const float* z, float width, bool absolute, float* out, int n) const;
+    float worley(const Vector3f& p) const;
+    float shape(const Vector3f& p, float noise, float width) const;
+    float bakedValue(float u, float v, float uvWidth) const;
+
+    NoisePattern pattern;
+    Texture *texture0, *texture1;
+    float frequency;
+    int octaves;
+    unsigned int seed;
+    bool uvSpace;
+    Perlin perlin;
+    int bakeSize = 0;
+    std::vector<float> baked;
+};
+
+// 按 texType 分派的取色：纯色直接返回，棋盘格循环选出子纹理，图片纹理直接调用（非虚）。
+// uvWidth 为光线锥在 uv 空间的宽度，供图片纹理选择 mip 层级；worldWidth 为世界空间的宽度，供程序化纹理限制频率
+inline Vector3f textureColorByType(const Texture* t, float u, float v, const Vector3f& pos, float uvWidth = 0, float worldWidth = 0) {
+    while (t->texType == checkerTex) {
+        t = static_cast<const CheckerTexture*>(t)->select(pos);
+    }
+    switch (t->texType) {
+        case solidTex:
+            return static_cast<const SolidColor*>(t)->getSolidColor();
+        case imageTex:
+            return static_cast<const ImageTexture*>(t)->sample(u, v, uvWidth);
+        case noiseTex:
+            return static_cast<const NoiseTexture*>(t)->sample(u, v, pos, uvWidth, worldWidth);
+        default:
+            return t->getColor(u, v, pos);
+    }
+}
+
 #endif // TEXTURE_H
\ No newline at end of file
@@ -0,0 +1,70 @@
+#ifndef TEXTURE_MANAGER_H
+#define TEXTURE_MANAGER_H
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "texture.hpp"
+
+// 图片纹理的统一管理：
+//   - 按文件路径去重，同一张图片只载入一次（场景文件、SceneGenerator 共用）
+//   - setLinearize(true) 时纹素按 sRGB 解码为线性值（查表），mip 也在线性空间中平均
+//   - setBudget(bytes) 设定纹素内存上限：之后载入的纹理把所有块写入一个临时后备文件，
+//     取色时按需读入，超出预算时用 CLOCK（近似 LRU）换出最久未用的块
+// 纹理在整个进程内有效，多个场景（多帧）之间共用；程序结束时释放。
+class TextureManager {
+public:
+    static TextureManager& instance();
+
+    ~TextureManager();
+
+    // 载入（或取出已载入的）图片纹理
+    ImageTexture* load(const std::string& path);
+    // 图片文件改过（热重载，reload.hpp）：之后 load 重新读入。已载入的纹理可能还有材质引用，保留到程序结束
+    void forget(const std::string& path);
+
+    // 需要在载入纹理之前设置
+    void setLinearize(bool linear);
+    void setBudget(size_t bytes) { budget = bytes; }
+
+    size_t getBudget() const { return budget; }
+    size_t getResidentBytes() const { return residentBytes; }
+
+    void printReport() const;
+
+private:
+    friend class ImageTexture;
+
+    TextureManager();
+
+    // ImageTexture 载入时调用
+    void addResident(size_t bytes) { residentBytes += bytes; }
+    long long writeTile(const unsigned char* data);
+
+    // 把 paged 纹理的一个块复制到 out（线程安全）
+    void readPaged(ImageTexture* tex, int tileIndex, int offset, unsigned char out[ImageTexture::bytesPerPixel]);
+    unsigned char* takeBuffer();
+
+    struct ResidentTile {
+        ImageTexture* tex;
+        int tileIndex;
+    };
+
+    std::map<std::string, std::unique_ptr<ImageTexture>> textures;
+    std::vector<std::unique_ptr<ImageTexture>> retired;     // forget 之后的纹理
+    size_t budget = 0;                  // 0 表示不限制
+    size_t residentBytes = 0;
+    FILE* backing = nullptr;            // paged 纹理的后备文件（tmpfile，关闭后自动删除）
+    std::vector<ResidentTile> clock;    // 已换入的 paged 块，CLOCK 指针在其中循环
+    size_t clockHand = 0;
+    std::mutex mutex;
+
+    long long dedupHits = 0;
+    long long tileMisses = 0;
+    long long evictions = 0;
+};
+
+#endif // TEXTURE_MANAGER_H
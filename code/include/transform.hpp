@@ -1,7 +1,9 @@
 #ifndef TRANSFORM_H
 #define TRANSFORM_H
 
+#include <algorithm>
 #include <vecmath.h>
+#include "animation.hpp"
 #include "object3d.hpp"
 
 // transforms a 3D point using a matrix, returning a 3D point
@@ -17,29 +19,58 @@ static Vector3f transformDirection(const Matrix4f &mat, const Vector3f &dir) {
 // TODO: implement this class so that the intersect function first transforms the ray
 class Transform : public Object3D {
 public:
-    Transform() {}
+    Transform() { objType = transformObj; }
 
     Transform(const Matrix4f &m, Object3D *obj) : o(obj) {
         transform = m;
         inverse = m.inverse();
-        objType = obj->objType;
+        objType = transformObj;
+    }
+
+    // 关键帧动画（至少两个关键帧）：变换随光线的时刻变化
+    Transform(const TransformTrack &_track, Object3D *obj) : o(obj), track(_track) {
+        transform = track.matrixAt(track.keyTime(0));
+        inverse = transform.inverse();
+        objType = transformObj;
     }
 
     ~Transform() {
     }
 
     virtual bool intersect(const Ray &r, Hit &h, float tmin, float tmax) {
+        if (isAnimated()) {
+            Matrix4f m, inv;
+            track.matrices(r.getTime(), m, inv);
+            return intersectWith(m, inv, r, h, tmin, tmax);
+        }
+        return intersectWith(transform, inverse, r, h, tmin, tmax);
+    }
+
+    bool hitbox(Aabb& box) const {
+        // calculate and set box as the AABB (hitbox) of this Transform object
+        if (!o->hitbox(box)) return false;
+        // 动画的包围盒为当前快门区间内扫过的范围
+        box = isAnimated() ? track.sweep(box, Shutter::getOpen(), Shutter::getClose()) : box.transformed(transform);
+        return true; // always return true when this object has an AABB
+    }
+
+    bool isAnimated() const { return track.numKeys() > 1; }
+    Object3D *getObject() const { return o; }
+
+protected:
+    bool intersectWith(const Matrix4f &m, const Matrix4f &inv, const Ray &r, Hit &h, float tmin, float tmax) {
         // printf("intersect on transform\n");
-        Vector3f trSource = transformPoint(inverse, r.getOrigin());
-        Vector3f trDirection = transformDirection(inverse, r.getDirection());
+        Vector3f trSource = transformPoint(inv, r.getOrigin());
+        Vector3f trDirection = transformDirection(inv, r.getDirection());
         Ray tr(trSource, trDirection);
+        tr.setTime(r.getTime());
         bool intersected = o->intersect(tr, h, tmin, tmax);
         if (!intersected) return false;
         
         Vector3f pos = h.getPos();
         Vector3f n = h.getNormal();
-        pos = transformPoint(transform, pos);
-        n = transformDirection(transform, n).normalized();
+        pos = transformPoint(m, pos);
+        n = transformDirection(m, n).normalized();
 
         h.set(pos, h.getT(), h.getMaterial());
         h.setNormal(tr, n);
@@ -47,21 +78,10 @@ public:
         return true;
     }
 
-    bool hitbox(Aabb& box) const {
-        // calculate and set box as the AABB (hitbox) of this Transform object
-        if (!o->hitbox(box)) return false;
-        Vector3f mn = box.getMin();
-        Vector3f mx = box.getMax();
-        mn = transformPoint(transform, mn);
-        mx = transformPoint(transform, mx);
-        box = Aabb(mn, mx);
-        return true; // always return true when this object has an AABB
-    }
-
-protected:
     Object3D *o; //un-transformed object
     Matrix4f inverse;
     Matrix4f transform;
+    TransformTrack track;   // 没有动画时为空
 };
 
 #endif //TRANSFORM_H
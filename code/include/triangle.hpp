@@ -23,6 +23,7 @@ public:
 	}
 
 	bool intersect( const Ray& ray,  Hit& hit , float tmin, float tmax) override {
+		STATS_PRIM(triangle);
 		float dotProd = Vector3f::dot(normal, ray.getDirection());
 		if (dotProd == 0) return false;   // ray is perpendicular to normal => assume no intersection
 		float d = Vector3f::dot(normal, a);
@@ -54,6 +55,7 @@ public:
 		hit.set(p, t, material);
 		hit.setNormal(ray, normal);
 		hit.setUv(u, v);
+		hit.setUvScale(longestSide);
         return true;
 	}
 
@@ -3,6 +3,7 @@
 
 #include <random>
 #include <ctime>
+#include <vecmath.h>
 
 // constants
 const double PI = 3.14159265358979323846;
@@ -26,9 +27,22 @@ public:
     }
 
     static inline float randomFloat() {
-        static std::uniform_real_distribution<float> distri(0.0, 1.0);
-        static std::mt19937 generator;
-        return distri(generator);
+        static thread_local std::uniform_real_distribution<float> distri(0.0, 1.0);
+        return distri(generator());
+    }
+
+    // 固定随机数种子，使渲染结果可复现（只影响调用它的线程）
+    static inline void setSeed(unsigned int seed) {
+        generator().seed(seed);
+    }
+
+    // 由总种子和编号得到一个种子（splitmix64 的混合函数）：分块渲染时每块用自己的种子，
+    // 结果与块的渲染顺序、线程数和工作者数无关
+    static inline unsigned int mixSeed(unsigned int seed, int id) {
+        unsigned long long z = ((unsigned long long) seed << 32) + (unsigned) id + 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return (unsigned int) (z ^ (z >> 31));
     }
 
     static inline float randomFloat(float mn, float mx) {
@@ -90,6 +104,13 @@ public:
     static inline float snapGrid(float x, float gridSize) {
         return gridSize * (((int) x) / gridSize);
     }
+
+private:
+    // 每个线程一个生成器，多线程渲染时互不干扰
+    static inline std::mt19937& generator() {
+        static thread_local std::mt19937 gen;
+        return gen;
+    }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,97 @@
+#ifndef VOXEL_WORLD_H
+#define VOXEL_WORLD_H
+
+#include <vector>
+#include <vecmath.h>
+#include "group.hpp"
+#include "material.hpp"
+#include "object3d.hpp"
+#include "perlin.hpp"
+
+// 程序化生成的《我的世界》式体素世界：
+//   - 世界由 chunksX x chunksZ 个区块（chunk）组成，每个区块 16 x height x 16 个方块，每个方块一个字节
+//   - 地形：二维 fbm 高度图，石头上面三层泥土、顶层草方块；洞穴：两个三维噪声同时接近 0 的地方（"意面"形隧道）；
+//     矿石：石头中按坐标哈希随机放置煤矿、金矿（金矿只在深处）；树：按坐标哈希选位置，树冠可以跨越区块边界
+//   - 每个区块独立生成（只依赖 seed 和坐标），generate() 把区块分给多个线程
+//   - 不为方块创建物体：每个区块是一个 VoxelChunk 物体，加入场景的 Group 后由 BVH 在区块之间剔除，
+//     区块内部用 3D-DDA（Amanatides & Woo 1987）逐格前进，遇到第一个非空方块即为交点
+enum VoxelBlock : unsigned char {airVoxel, grassVoxel, dirtVoxel, stoneVoxel, oakLogVoxel, leavesVoxel,
+                                 coalOreVoxel, goldOreVoxel, numVoxelBlocks};
+
+enum VoxelFace {voxelTop, voxelBottom, voxelSide, numVoxelFaces};
+
+class VoxelWorld {
+public:
+    static const int chunkSize = 16;
+
+    VoxelWorld(int chunksX, int chunksZ, int height, unsigned int seed);
+
+    // 生成所有区块，threads 为 0 时用硬件线程数
+    void generate(int threads);
+
+    // 每个方块类型的顶面、底面、侧面材质；没有设置材质的类型不会被击中
+    void setMaterial(VoxelBlock block, Material* top, Material* bottom, Material* side) {
+        materials[block][voxelTop] = top;
+        materials[block][voxelBottom] = bottom;
+        materials[block][voxelSide] = side;
+    }
+    Material* getMaterial(int block, VoxelFace face) const { return materials[block][face]; }
+
+    // 为每个非空区块创建一个 VoxelChunk 加入 grp，方块 (0, 0, 0) 的最小角放在 origin
+    void addChunks(Group* grp, const Vector3f& origin);
+
+    // 世界坐标（方块为单位）的方块，超出世界时为空气
+    unsigned char getBlock(int x, int y, int z) const {
+        if (x < 0 || z < 0 || y < 0 || x >= sizeX() || z >= sizeZ() || y >= height) return airVoxel;
+        return chunkBlocks(x / chunkSize, z / chunkSize)[index(x % chunkSize, y, z % chunkSize)];
+    }
+
+    int sizeX() const { return chunksX * chunkSize; }
+    int sizeZ() const { return chunksZ * chunkSize; }
+    int getHeight() const { return height; }
+    // 平均地面高度（方块），用于摆放世界
+    int getBaseHeight() const { return baseHeight; }
+    size_t getBytes() const { return blocks.size(); }
+    long long countBlocks(VoxelBlock block) const;
+
+    // 区块 (cx, cz) 的方块数组，按 y、z、x 的顺序存放
+    const unsigned char* chunkBlocks(int cx, int cz) const {
+        return blocks.data() + ((size_t) cz * chunksX + cx) * chunkSize * chunkSize * height;
+    }
+    // 区块中最高的非空方块 + 1，0 表示整个区块为空
+    int chunkTop(int cx, int cz) const { return chunkTops[cz * chunksX + cx]; }
+
+    static int index(int x, int y, int z) { return (y * chunkSize + z) * chunkSize + x; }
+
+private:
+    void generateChunk(int cx, int cz);
+
+    int chunksX, chunksZ, height;
+    unsigned int seed;
+    int baseHeight;
+    Perlin terrainNoise, caveNoise0, caveNoise1;
+    std::vector<unsigned char> blocks;
+    std::vector<int> chunkTops;
+    Material* materials[numVoxelBlocks][numVoxelFaces] = {};
+};
+
+// 世界中的一个区块，包围盒为 16 x chunkTop x 16
+class VoxelChunk : public Object3D {
+public:
+    VoxelChunk(const VoxelWorld* world, int cx, int cz, const Vector3f& mn);
+
+    bool intersect(const Ray& ray, Hit& hit, float tmin, float tmax) override;
+
+    bool hitbox(Aabb& box) const override {
+        box = Aabb(mn, mn + Vector3f(dims[0], dims[1], dims[2]));
+        return true;
+    }
+
+private:
+    const unsigned char* blocks;
+    const VoxelWorld* world;
+    Vector3f mn;
+    int dims[3];
+};
+
+#endif // VOXEL_WORLD_H
@@ -0,0 +1,71 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <vector>
+#include <vecmath.h>
+#include "camera.hpp"
+#include "object3d.hpp"
+#include "aabb.hpp"
+#include "envmap.hpp"
+
+// 波前（wavefront）路径追踪：与 main.cpp 中逐像素递归的 rayTrace 结果在统计上相同，
+// 但一次处理一大批路径。每一轮（一次弹射）按阶段对整个队列执行：
+//   generate - 生成相机光线，填充路径队列
+//   sort     - 次级光线按 起点网格单元 / 方向卦限 排序，遍历 BVH 时更相干
+//   extend   - 所有光线与场景求交（相机光线按光线包求交）
+//   shade    - 按材质分组后依次调用 scatter（同一材质、同一纹理连续执行）
+//   connect  - 终止的路径（未击中 / 发光 / 深度用尽）把颜色累加到像素上，其余路径压缩后进入下一轮
+// 设置了 envMap 时，shade 阶段在漫反射交点处立即发射一条环境光的阴影光线（同 main.cpp 的 shade），
+// 漫反射光线未击中场景时按 MIS 加权。
+class WavefrontIntegrator {
+public:
+    WavefrontIntegrator(Camera* cam, Object3D* scene, const Vector3f& bgColor, int maxDepth);
+
+    // 每像素 spp 次采样，返回每个像素的平均颜色（线性，未做伽马纠正），按 y * width + x 存放
+    std::vector<Vector3f> render(int spp);
+
+    long long getRaysTraced() const { return raysTraced; }
+
+    int waveSize = 1 << 18;     // 一批最多同时存在的路径数
+    bool sortRays = true;       // 次级光线排序，可以关掉做对比
+    EnvironmentMap* envMap = nullptr;   // 环境光，为空时未击中的光线取 bgColor
+
+private:
+    // 路径状态，按 SoA 存放；下标相同的元素属于同一条路径
+    struct PathQueue {
+        std::vector<Ray> rays;
+        std::vector<Vector3f> throughput;   // 目前为止各次 scatter 颜色的乘积
+        std::vector<int> pixel;
+        std::vector<int> depth;             // 剩余可弹射次数，同递归版本的 depth
+        std::vector<float> bsdfPdf;         // 漫反射采样得到的光线的 pdf，用于 MIS；其余为 0
+        std::vector<Hit> hits;
+        std::vector<char> found;            // extend 阶段是否有交点
+
+        int size() const { return (int) rays.size(); }
+        void clear();
+        void push(const Ray& r, const Vector3f& t, int pix, int d, float pdf = 0);
+        void reserve(int n);
+    };
+
+    void generate(long long first, int count);
+    void sortQueue();
+    void extend(bool cameraRays);
+    void shadeAndConnect();
+    Vector3f background(const Ray& ray, float bsdfPdf) const;
+
+    // 起点所在网格单元的 Morton 码（每轴 5 位）与方向卦限（3 位）组合成排序键
+    unsigned sortKey(const Ray& r) const;
+
+    Camera* cam;
+    Object3D* scene;
+    Vector3f bgColor;
+    int maxDepth;
+    Aabb sceneBox;
+
+    PathQueue queue;
+    PathQueue next;             // 排序和压缩时的目标缓冲区，与 queue 交换
+    std::vector<Vector3f> film; // 每个像素的颜色之和
+    long long raysTraced = 0;
+};
+
+#endif // WAVEFRONT_H
@@ -0,0 +1,124 @@
+#include "animation.hpp"
+#include <algorithm>
+#include <cmath>
+
+float Shutter::open = 0;
+float Shutter::close = 0;
+
+namespace {
+
+// 旋转矩阵转为单位四元数（Shepperd 的方法：按最大的对角分量选公式，避免除以接近 0 的数）
+Quat4f rotationToQuat(const Matrix3f& r) {
+    float trace = r(0, 0) + r(1, 1) + r(2, 2);
+    float w, x, y, z;
+    if (trace > 0) {
+        float s = std::sqrt(trace + 1) * 2;
+        w = 0.25f * s;
+        x = (r(2, 1) - r(1, 2)) / s;
+        y = (r(0, 2) - r(2, 0)) / s;
+        z = (r(1, 0) - r(0, 1)) / s;
+    } else if (r(0, 0) > r(1, 1) && r(0, 0) > r(2, 2)) {
+        float s = std::sqrt(1 + r(0, 0) - r(1, 1) - r(2, 2)) * 2;
+        w = (r(2, 1) - r(1, 2)) / s;
+        x = 0.25f * s;
+        y = (r(0, 1) + r(1, 0)) / s;
+        z = (r(0, 2) + r(2, 0)) / s;
+    } else if (r(1, 1) > r(2, 2)) {
+        float s = std::sqrt(1 + r(1, 1) - r(0, 0) - r(2, 2)) * 2;
+        w = (r(0, 2) - r(2, 0)) / s;
+        x = (r(0, 1) + r(1, 0)) / s;
+        y = 0.25f * s;
+        z = (r(1, 2) + r(2, 1)) / s;
+    } else {
+        float s = std::sqrt(1 + r(2, 2) - r(0, 0) - r(1, 1)) * 2;
+        w = (r(1, 0) - r(0, 1)) / s;
+        x = (r(0, 2) + r(2, 0)) / s;
+        y = (r(1, 2) + r(2, 1)) / s;
+        z = 0.25f * s;
+    }
+    return Quat4f(w, x, y, z).normalized();
+}
+
+Matrix4f affine(const Matrix3f& linear, const Vector3f& translation) {
+    Matrix4f m = Matrix4f::identity();
+    m.setSubmatrix3x3(0, 0, linear);
+    for (int i = 0; i < 3; i++) m(i, 3) = translation[i];
+    return m;
+}
+
+} // namespace
+
+void TransformTrack::addKey(float time, const Matrix4f& m) {
+    Key key;
+    key.time = time;
+    key.translation = Vector3f(m(0, 3), m(1, 3), m(2, 3));
+
+    // 极分解 A = R S：反复取 R 与其逆转置的平均，收敛到最接近 A 的正交矩阵
+    Matrix3f a = m.getSubmatrix3x3(0, 0);
+    Matrix3f r = a;
+    for (int iter = 0; iter < 100; iter++) {
+        Matrix3f invT = r.inverse().transposed();
+        float diff = 0;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                float next = 0.5f * (r(i, j) + invT(i, j));
+                diff = std::max(diff, std::fabs(next - r(i, j)));
+                r(i, j) = next;
+            }
+        }
+        if (diff < 1e-6f) break;
+    }
+    // 含镜像的变换：R 取反成为旋转，镜像留在拉伸部分
+    if (r.determinant() < 0) {
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) r(i, j) = -r(i, j);
+        }
+    }
+    key.stretch = r.transposed() * a;
+    key.rotation = rotationToQuat(r);
+    // q 与 -q 是同一个旋转，取与上一个关键帧同侧的，插值走较短的一边
+    if (!keys.empty() && Quat4f::dot(keys.back().rotation, key.rotation) < 0) {
+        key.rotation = -1.0f * key.rotation;
+    }
+    keys.push_back(key);
+}
+
+void TransformTrack::matrices(float t, Matrix4f& m, Matrix4f& inv) const {
+    // 找到 t 所在的两个关键帧 a、b 和插值参数 s
+    int hi = (int) (std::upper_bound(keys.begin(), keys.end(), t, [](float time, const Key& k) {
+        return time < k.time;
+    }) - keys.begin());
+    const Key& a = keys[std::max(0, hi - 1)];
+    const Key& b = keys[std::min(hi, numKeys() - 1)];
+    float s = b.time > a.time ? (t - a.time) / (b.time - a.time) : 0;
+
+    Vector3f translation = a.translation + (b.translation - a.translation) * s;
+    Quat4f rotation = Quat4f::slerp(a.rotation, b.rotation, s, false).normalized();
+    Matrix3f stretch;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) stretch(i, j) = a.stretch(i, j) + (b.stretch(i, j) - a.stretch(i, j)) * s;
+    }
+
+    // M = T R S，M^-1 = S^-1 R^T T^-1，只需对拉伸部分求逆
+    Matrix3f rot = Matrix3f::rotation(rotation);
+    Matrix3f linear = rot * stretch;
+    Matrix3f invLinear = stretch.inverse() * rot.transposed();
+    m = affine(linear, translation);
+    inv = affine(invLinear, -(invLinear * translation));
+}
+
+Aabb TransformTrack::sweep(const Aabb& box, float t0, float t1) const {
+    Aabb result = box.transformed(matrixAt(t0));
+    if (t1 <= t0 || numKeys() < 2) return result;
+    // 区间内等距取若干时刻，再加上区间内的关键帧（运动方向在那里改变）
+    const int steps = 32;
+    for (int i = 1; i <= steps; i++) {
+        result = Aabb::surroundingBox(result, box.transformed(matrixAt(t0 + (t1 - t0) * i / steps)));
+    }
+    for (const Key& k : keys) {
+        if (k.time > t0 && k.time < t1) result = Aabb::surroundingBox(result, box.transformed(matrixAt(k.time)));
+    }
+    // 旋转时两个采样时刻之间的角点沿圆弧运动，可能略微超出（每步 180° / 32 时约为半径的 0.12%），放大一点
+    Vector3f pad = Vector3f(1, 1, 1) * ((result.getMax() - result.getMin()).length() * 0.002f);
+    return Aabb(result.getMin() - pad, result.getMax() + pad);
+}
@@ -0,0 +1,202 @@
+#include "aov.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "image.hpp"
+#include "utils.hpp"
+
+static const char* aovNames[numAovs] = {
+    "color", "albedo", "normal", "depth", "object_id", "material_id", "direct", "indirect", "emission", "variance"
+};
+
+static inline float luminance(const Vector3f& c) {
+    return 0.2126f * c.x() + 0.7152f * c.y() + 0.0722f * c.z();
+}
+
+const char* AovBuffers::name(AovType t) {
+    return aovNames[t];
+}
+
+int AovBuffers::channels(AovType t) {
+    switch (t) {
+        case depthAov:
+        case objectIdAov:
+        case materialIdAov:
+        case varianceAov:
+            return 1;
+        default:
+            return 3;
+    }
+}
+
+bool AovBuffers::parseList(const std::string& list, unsigned& mask) {
+    size_t start = 0;
+    while (start <= list.size()) {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        std::string item = list.substr(start, end - start);
+        start = end + 1;
+        if (item.empty()) continue;
+        if (item == "all") {
+            mask |= (1u << numAovs) - 1;
+            continue;
+        }
+        int t = 0;
+        while (t < numAovs && item != aovNames[t]) t++;
+        if (t == numAovs) {
+            printf("Unknown AOV '%s', expected one of:", item.c_str());
+            for (int i = 0; i < numAovs; i++) printf(" %s", aovNames[i]);
+            printf(" all\n");
+            return false;
+        }
+        mask |= 1u << t;
+    }
+    return true;
+}
+
+AovBuffers::AovBuffers(int _width, int _height, unsigned _mask) : width(_width), height(_height), mask(_mask) {
+    clear();
+}
+
+void AovBuffers::clear() {
+    int n = width * height;
+    for (int t = 0; t < numAovs; t++) {
+        if (!has((AovType) t)) continue;
+        float init = (t == objectIdAov || t == materialIdAov) ? -1 : 0;
+        buffers[t].assign(n * channels((AovType) t), init);
+    }
+    samples.assign(n, 0);
+    if (has(normalAov) || has(depthAov)) hits.assign(n, 0);
+    if (has(varianceAov)) lumSq.assign(n, 0);
+}
+
+void AovBuffers::setObjects(const std::vector<Object3D*>& objects) {
+    objectIds.clear();
+    for (size_t i = 0; i < objects.size(); i++) objectIds[objects[i]] = (int) i;
+}
+
+void AovBuffers::addMaterial(const Material* m) {
+    materialIds.insert(std::make_pair(m, (int) materialIds.size()));
+}
+
+int AovBuffers::objectId(Object3D* obj) const {
+    auto it = objectIds.find(obj);
+    return it == objectIds.end() ? -1 : it->second;
+}
+
+int AovBuffers::materialId(const Material* m) {
+    // 场景文件之外（SceneGenerator 生成）的材质按第一次遇到的顺序编号
+    addMaterial(m);
+    return materialIds[m];
+}
+
+void AovBuffers::add(int x, int y, const AovSample& s, const Vector3f& radiance) {
+    int i = y * width + x;
+    samples[i]++;
+    if (s.hit && !hits.empty()) hits[i]++;
+    auto add3 = [&](AovType t, const Vector3f& v) {
+        if (!has(t)) return;
+        float* p = &buffers[t][i * 3];
+        p[0] += v.x();
+        p[1] += v.y();
+        p[2] += v.z();
+    };
+    add3(colorAov, radiance);
+    add3(albedoAov, s.albedo);
+    add3(directAov, s.direct);
+    add3(indirectAov, s.indirect);
+    add3(emissionAov, s.emission);
+    if (s.hit) {
+        add3(normalAov, s.normal);
+        if (has(depthAov)) buffers[depthAov][i] += s.depth;
+        // 编号不能取平均，取第一个击中场景的采样
+        if (has(objectIdAov) && buffers[objectIdAov][i] < 0) buffers[objectIdAov][i] = s.objectId;
+        if (has(materialIdAov) && buffers[materialIdAov][i] < 0) buffers[materialIdAov][i] = s.materialId;
+    }
+    if (has(varianceAov)) {
+        float l = luminance(radiance);
+        buffers[varianceAov][i] += l;
+        lumSq[i] += l * l;
+    }
+}
+
+void AovBuffers::resolve() {
+    for (int i = 0; i < width * height; i++) {
+        int n = samples[i];
+        if (n == 0) continue;
+        float inv = 1.0f / n;
+        AovType averaged[] = {colorAov, albedoAov, directAov, indirectAov, emissionAov};
+        for (AovType t : averaged) {
+            if (!has(t)) continue;
+            for (int c = 0; c < 3; c++) buffers[t][i * 3 + c] *= inv;
+        }
+        if (has(normalAov)) {
+            float* p = &buffers[normalAov][i * 3];
+            float len = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+            for (int c = 0; c < 3; c++) p[c] = len > 0 ? p[c] / len : 0;
+        }
+        if (has(depthAov) && hits[i] > 0) buffers[depthAov][i] /= hits[i];
+        if (has(varianceAov)) {
+            // 无偏的样本方差除以采样数，得到平均值的方差；只有一个采样时无从估计，按最大噪声处理
+            float mean = buffers[varianceAov][i] * inv;
+            float sampleVar = n > 1 ? std::max(0.0f, (lumSq[i] - n * mean * mean) / (n - 1)) : mean * mean;
+            buffers[varianceAov][i] = sampleVar * inv;
+        }
+    }
+}
+
+// 编号的预览颜色：同一编号颜色固定，相邻编号差别大
+static Vector3f idColor(float id) {
+    if (id < 0) return Vector3f::ZERO;
+    unsigned h = (unsigned) id * 2654435761u;
+    h ^= h >> 15;
+    return Vector3f((h & 255) / 255.0f, ((h >> 8) & 255) / 255.0f, ((h >> 16) & 255) / 255.0f) * 0.8f + Vector3f(0.2f);
+}
+
+void AovBuffers::save(const std::string& prefix, unsigned only) const {
+    for (int t = 0; t < numAovs; t++) {
+        if (!has((AovType) t) || !((only >> t) & 1u)) continue;
+        const std::vector<float>& data = buffers[t];
+        int ch = channels((AovType) t);
+        std::string base = prefix + "_" + aovNames[t];
+
+        // PFM：行从下到上，与 Image 的 y 方向一致；比例为负表示小端
+        FILE* file = fopen((base + ".pfm").c_str(), "wb");
+        if (file == nullptr) {
+            printf("Cannot write %s.pfm\n", base.c_str());
+            continue;
+        }
+        fprintf(file, "%s\n%d %d\n-1.0\n", ch == 3 ? "PF" : "Pf", width, height);
+        fwrite(data.data(), sizeof(float), data.size(), file);
+        fclose(file);
+
+        // 预览：颜色类做伽马纠正，法线映射到 [0, 1]，深度和方差按最大值归一化，编号用随机颜色
+        float maxValue = 0;
+        if (ch == 1) {
+            for (float v : data) maxValue = std::max(maxValue, v);
+        }
+        Image preview(width, height);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                const float* p = &data[(y * width + x) * ch];
+                Vector3f c;
+                if (t == normalAov) {
+                    c = Vector3f(p[0], p[1], p[2]) * 0.5f + Vector3f(0.5f);
+                } else if (t == depthAov) {
+                    float d = p[0] > 0 ? 1 - p[0] / (maxValue * 1.05f) : 0;   // 近处亮、远处暗，未击中为黑
+                    c = Vector3f(d);
+                } else if (t == varianceAov) {
+                    c = Vector3f(maxValue > 0 ? std::sqrt(p[0] / maxValue) : 0);
+                } else if (ch == 1) {
+                    c = idColor(p[0]);
+                } else {
+                    Vector3f v(std::max(p[0], 0.0f), std::max(p[1], 0.0f), std::max(p[2], 0.0f));
+                    c = Utils::sqrtVec3(v);
+                }
+                preview.SetPixel(x, y, c);
+            }
+        }
+        preview.SaveBMP((base + ".bmp").c_str());
+    }
+}
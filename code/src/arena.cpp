@@ -0,0 +1,97 @@
+#include "arena.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+
+static const char* categoryName(int cat) {
+    switch (cat) {
+        case arenaGeometry: return "geometry";
+        case arenaMaterial: return "materials";
+        case arenaTexture: return "textures";
+        case arenaAccel: return "BVH";
+        default: return "other";
+    }
+}
+
+Arena::~Arena() {
+    reset();
+    for (Block& b : blocks) {
+        free(b.data);
+    }
+}
+
+void* Arena::allocate(size_t size, size_t align, ArenaCategory cat) {
+    while (curBlock < blocks.size()) {
+        Block& b = blocks[curBlock];
+        uintptr_t base = (uintptr_t) b.data;
+        size_t start = ((base + offset + align - 1) & ~(uintptr_t) (align - 1)) - base;
+        if (start + size <= b.size) {
+            offset = start + size;
+            bytes[cat] += size;
+            return b.data + start;
+        }
+        // 当前块放不下，换下一块（reset 之后会依次复用之前的块）
+        ++curBlock;
+        offset = 0;
+    }
+    // 过大的对象单独占一块
+    size_t newSize = size + align > blockSize ? size + align : blockSize;
+    char* data = (char*) malloc(newSize);
+    if (data == nullptr) {
+        printf("Arena: out of memory allocating %zu bytes\n", newSize);
+        exit(1);
+    }
+    blocks.push_back({data, newSize});
+    curBlock = blocks.size() - 1;
+    offset = 0;
+    return allocate(size, align, cat);
+}
+
+void Arena::reset() {
+    for (size_t i = destructors.size(); i-- > 0;) {
+        destructors[i].destroy(destructors[i].obj);
+    }
+    destructors.clear();
+    curBlock = 0;
+    offset = 0;
+    for (int c = 0; c < numArenaCategories; c++) {
+        bytes[c] = counts[c] = external[c] = 0;
+    }
+}
+
+size_t Arena::bytesUsed() const {
+    size_t sum = 0;
+    for (int c = 0; c < numArenaCategories; c++) sum += bytes[c];
+    return sum;
+}
+
+size_t Arena::bytesReserved() const {
+    size_t sum = 0;
+    for (const Block& b : blocks) sum += b.size;
+    return sum;
+}
+
+void Arena::printReport(const char* title) const {
+    printf("---- %s ----\n", title);
+    printf("  %-10s %10s %12s %12s\n", "category", "objects", "arena KB", "external KB");
+    size_t totalExternal = 0;
+    for (int c = 0; c < numArenaCategories; c++) {
+        if (counts[c] == 0 && bytes[c] == 0 && external[c] == 0) continue;
+        printf("  %-10s %10zu %12.1f %12.1f\n", categoryName(c), counts[c], bytes[c] / 1024.0, external[c] / 1024.0);
+        totalExternal += external[c];
+    }
+    printf("  arena: %.1f KB used in %zu blocks (%.1f KB reserved), external: %.1f KB\n",
+           bytesUsed() / 1024.0, blocks.size(), bytesReserved() / 1024.0, totalExternal / 1024.0);
+}
+
+Arena*& Arena::currentSlot() {
+    thread_local Arena* slot = nullptr;
+    return slot;
+}
+
+Arena& Arena::current() {
+    Arena* a = currentSlot();
+    if (a != nullptr) return *a;
+    static Arena defaultArena;   // 没有 ArenaScope 时使用，程序结束时释放
+    return defaultArena;
+}
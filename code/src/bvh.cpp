@@ -1,30 +1,345 @@
 
 #include "bvh.hpp"
+#include "dispatch.hpp"
+#include "arena.hpp"
 #include <vector>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define BVH_PACKET_SSE 1
+#endif
 #include "object3d.hpp"
 #include "mesh.hpp"
 #include "group.hpp"
+#include "transform.hpp"
 
 bool BvhNode::intersect(const Ray& ray, Hit& hit, float tmin, float tmax) {
+    STATS_INC(bvhNodesVisited);
     if (!box.intersect(ray, tmin, tmax)) {
         return false; // 若不与本节点的box交
     }
 
-    bool intersectLeft = left->intersect(ray, hit, tmin, tmax);
+    bool intersectLeft = intersectByType(left, ray, hit, tmin, tmax);
     bool intersectRight;
     if (intersectLeft) {
-        intersectRight = right->intersect(ray, hit, tmin, hit.getT());
+        intersectRight = intersectByType(right, ray, hit, tmin, hit.getT());
     } else {
-        intersectRight = right->intersect(ray, hit, tmin, tmax);
+        intersectRight = intersectByType(right, ray, hit, tmin, tmax);
     }
 
     return intersectLeft || intersectRight;
 }
 
+static inline bool occludedByType(Object3D* obj, const Ray& ray, float tmin, float tmax) {
+    if (obj->objType == bhvNode) {
+        return static_cast<BvhNode*>(obj)->occluded(ray, tmin, tmax);
+    }
+    Hit hit(Vector3f::ZERO, tmax, nullptr, Vector3f::ZERO);   // 部分物体只用 hit 的 t 作为上限
+    return intersectByType(obj, ray, hit, tmin, tmax);
+}
+
+bool BvhNode::occluded(const Ray& ray, float tmin, float tmax) {
+    STATS_INC(bvhNodesVisited);
+    if (!box.intersect(ray, tmin, tmax)) {
+        return false;
+    }
+    return occludedByType(left, ray, tmin, tmax) || occludedByType(right, ray, tmin, tmax);
+}
+
+static inline Object3D* pickByType(Object3D* obj, const Ray& ray, Hit& hit, float tmin, float tmax) {
+    if (obj->objType == bhvNode) {
+        return static_cast<BvhNode*>(obj)->pick(ray, hit, tmin, tmax);
+    }
+    return intersectByType(obj, ray, hit, tmin, tmax) ? obj : nullptr;
+}
+
+Object3D* BvhNode::pick(const Ray& ray, Hit& hit, float tmin, float tmax) {
+    STATS_INC(bvhNodesVisited);
+    if (!box.intersect(ray, tmin, tmax)) {
+        return nullptr;
+    }
+    Object3D* leftObj = pickByType(left, ray, hit, tmin, tmax);
+    Object3D* rightObj = pickByType(right, ray, hit, tmin, leftObj != nullptr ? hit.getT() : tmax);
+    return rightObj != nullptr ? rightObj : leftObj;
+}
+
+// 区间算术：整包光线的原点和方向倒数都在一个区间内，若所有光线都不可能与 box 相交，返回 true
+static bool packetCulled(const RayPacket& packet, const Aabb& box, float tmin, float tmax) {
+    Vector3f mn = box.getMin();
+    Vector3f mx = box.getMax();
+    float enter = tmin;
+    float leave = tmax;
+    for (int a = 0; a < 3; a++) {
+        if (!packet.sameSign[a]) continue;   // 方向跨过 0，这一维不做剔除
+        bool positive = packet.invMin[a] > 0;
+        float nearPlane = positive ? mn[a] : mx[a];
+        float farPlane = positive ? mx[a] : mn[a];
+        // (plane - o) * inv 在区间端点处取到最值
+        float n0 = nearPlane - packet.oMax[a], n1 = nearPlane - packet.oMin[a];
+        float f0 = farPlane - packet.oMax[a], f1 = farPlane - packet.oMin[a];
+        float i0 = packet.invMin[a], i1 = packet.invMax[a];
+        float enterLo = std::min(std::min(n0 * i0, n0 * i1), std::min(n1 * i0, n1 * i1));
+        float leaveHi = std::max(std::max(f0 * i0, f0 * i1), std::max(f1 * i0, f1 * i1));
+        enter = std::max(enter, enterLo);
+        leave = std::min(leave, leaveHi);
+        if (leave <= enter) return true;
+    }
+    return false;
+}
+
+// 对 mask 中的每条光线做 slab 测试，返回与 box 相交（且比当前最近交点更近）的光线掩码
+static unsigned packetBoxTest(const RayPacket& packet, const Aabb& box, unsigned mask, const Hit* hits, float tmin) {
+    Vector3f mn = box.getMin();
+    Vector3f mx = box.getMax();
+    unsigned result = 0;
+    for (int base = 0; base < packet.size; base += 4) {
+        if (((mask >> base) & 0xf) == 0) continue;
+#ifdef BVH_PACKET_SSE
+        __m128 tNear = _mm_set1_ps(tmin);
+        __m128 tFar = _mm_setr_ps(hits[base].getT(),
+                                  base + 1 < packet.size ? hits[base + 1].getT() : 0,
+                                  base + 2 < packet.size ? hits[base + 2].getT() : 0,
+                                  base + 3 < packet.size ? hits[base + 3].getT() : 0);
+        for (int a = 0; a < 3; a++) {
+            __m128 o = _mm_load_ps(&packet.org[a][base]);
+            __m128 inv = _mm_load_ps(&packet.inv[a][base]);
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(mn[a]), o), inv);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(mx[a]), o), inv);
+            tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+            tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+        }
+        unsigned lanes = _mm_movemask_ps(_mm_cmplt_ps(tNear, tFar));
+#else
+        unsigned lanes = 0;
+        for (int k = 0; k < 4 && base + k < packet.size; k++) {
+            float tNear = tmin;
+            float tFar = hits[base + k].getT();
+            for (int a = 0; a < 3; a++) {
+                float t0 = (mn[a] - packet.org[a][base + k]) * packet.inv[a][base + k];
+                float t1 = (mx[a] - packet.org[a][base + k]) * packet.inv[a][base + k];
+                tNear = std::max(tNear, std::min(t0, t1));
+                tFar = std::min(tFar, std::max(t0, t1));
+            }
+            if (tNear < tFar) lanes |= 1u << k;
+        }
+#endif
+        result |= lanes << base;
+    }
+    return result & mask;
+}
+
+static inline int popcount(unsigned x) {
+    int n = 0;
+    for (; x; x &= x - 1) n++;
+    return n;
+}
+
+unsigned BvhNode::intersectPacket(const RayPacket& packet, Hit* hits, float tmin) {
+    struct Entry {
+        Object3D* node;
+        unsigned mask;
+    };
+    Entry stack[packetStackSize];
+    int top = 0;
+    unsigned hitMask = 0;
+    stack[top++] = {this, packet.fullMask()};
+
+    while (top > 0) {
+        Entry e = stack[--top];
+        Object3D* node = e.node;
+        unsigned mask = e.mask;
+
+        // 退回单光线：活跃光线太少，不是 BVH 节点（叶子上的物体），或栈已放不下两个子节点
+        if (node->objType != bhvNode || popcount(mask) <= packetFallbackRays || top + 2 > packetStackSize) {
+            if (node->objType == ObjectType::mesh && popcount(mask) > packetFallbackRays) {
+                stack[top++] = {static_cast<Mesh*>(node)->tree, mask};   // 进入网格自己的 BVH，继续按包遍历
+                continue;
+            }
+            if (node->objType == bhvNode) STATS_ADD(packetFallbackRays, popcount(mask));
+            for (unsigned m = mask; m; m &= m - 1) {
+                int i = __builtin_ctz(m);
+                if (intersectByType(node, packet.rays[i], hits[i], tmin, hits[i].getT())) hitMask |= 1u << i;
+            }
+            continue;
+        }
+
+        BvhNode* bvh = static_cast<BvhNode*>(node);
+        STATS_INC(packetNodesVisited);
+        STATS_ADD(aabbTests, popcount(mask));
+
+        // 先用整包区间剔除，再逐光线做 SIMD 测试
+        float farthest = tmin;
+        for (unsigned m = mask; m; m &= m - 1) farthest = std::max(farthest, hits[__builtin_ctz(m)].getT());
+        if (packetCulled(packet, bvh->box, tmin, farthest)) continue;
+        mask = packetBoxTest(packet, bvh->box, mask, hits, tmin);
+        if (mask == 0) continue;
+
+        if (bvh->left == bvh->right) {
+            stack[top++] = {bvh->left, mask};
+            continue;
+        }
+        // 近的子节点后入栈、先遍历，尽早缩短 t 以剔除远处的节点
+        bool leftFirst = packet.rays[__builtin_ctz(mask)].getDirection()[bvh->axis] >= 0;
+        Object3D* nearChild = leftFirst ? bvh->left : bvh->right;
+        Object3D* farChild = leftFirst ? bvh->right : bvh->left;
+        stack[top++] = {farChild, mask};
+        stack[top++] = {nearChild, mask};
+    }
+    return hitMask;
+}
+
+namespace {
+
+struct SahItem {
+    Object3D* obj;
+    Aabb box;
+    Vector3f center;
+};
+
+float boxArea(const Aabb& b) {
+    Vector3f d = b.getMax() - b.getMin();
+    return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+void sortByCenter(std::vector<SahItem>& items, int lo, int hi, int axis) {
+    std::sort(items.begin() + lo, items.begin() + hi, [axis](const SahItem& a, const SahItem& b) {
+        return a.center[axis] < b.center[axis];
+    });
+}
+
+// [lo, hi) 至少一个物体；叶子与中位数建树相同：一个或两个物体，左边的在 axis 上更靠前
+BvhNode* buildSah(std::vector<SahItem>& items, int lo, int hi, std::vector<float>& rightArea) {
+    BvhNode* node = arenaNew<BvhNode>(arenaAccel);
+    int n = hi - lo;
+    if (n <= 2) {
+        Vector3f extent = items[hi - 1].center - items[lo].center;
+        node->axis = 0;
+        for (int a = 1; a < 3; a++) {
+            if (std::fabs(extent[a]) > std::fabs(extent[node->axis])) node->axis = a;
+        }
+        bool swap = items[hi - 1].box.getMin()[node->axis] < items[lo].box.getMin()[node->axis];
+        node->left = swap ? items[hi - 1].obj : items[lo].obj;
+        node->right = swap ? items[lo].obj : items[hi - 1].obj;
+        node->box = Aabb::surroundingBox(items[lo].box, items[hi - 1].box);
+        node->builtArea = boxArea(node->box);
+        return node;
+    }
+
+    // 每个轴按中心排序，前缀、后缀包围盒的面积乘以物体数之和最小处划分
+    float bestCost = INFINITY;
+    int bestAxis = 0, bestSplit = lo + n / 2;
+    for (int a = 0; a < 3; a++) {
+        sortByCenter(items, lo, hi, a);
+        Aabb acc = items[hi - 1].box;
+        for (int i = n - 1; i >= 1; i--) {
+            acc = Aabb::surroundingBox(acc, items[lo + i].box);
+            rightArea[i] = boxArea(acc);
+        }
+        acc = items[lo].box;
+        for (int i = 1; i < n; i++) {
+            float cost = boxArea(acc) * i + rightArea[i] * (n - i);
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = a;
+                bestSplit = lo + i;
+            }
+            acc = Aabb::surroundingBox(acc, items[lo + i].box);
+        }
+    }
+    if (bestAxis != 2) sortByCenter(items, lo, hi, bestAxis);
+    node->axis = bestAxis;
+    BvhNode* left = buildSah(items, lo, bestSplit, rightArea);
+    BvhNode* right = buildSah(items, bestSplit, hi, rightArea);
+    node->left = left;
+    node->right = right;
+    node->box = Aabb::surroundingBox(left->box, right->box);
+    node->builtArea = boxArea(node->box);
+    return node;
+}
+
+} // namespace
+
+BvhNode* BvhNode::build(Group* grp, bool sah) {
+    if (!sah) {
+        return arenaNew<BvhNode>(arenaAccel, grp);
+    }
+    std::vector<Object3D*>& objects = grp->getObjects();
+    std::vector<SahItem> items(objects.size());
+    for (size_t i = 0; i < objects.size(); i++) {
+        items[i].obj = objects[i];
+        if (!objects[i]->hitbox(items[i].box)) {
+            std::cerr << "Error: Attempted contructing BVH node on objects without bounding box\n";
+            exit(0);
+        }
+        items[i].center = (items[i].box.getMin() + items[i].box.getMax()) * 0.5f;
+    }
+    std::vector<float> rightArea(items.size());
+    return buildSah(items, 0, (int) items.size(), rightArea);
+}
+
+// 叶子上的物体：BVH 节点（原型）先更新，Transform 更新它引用的物体；其余物体的 hitbox() 每次都重新计算
+void BvhNode::refitObject(Object3D* obj, int epoch) {
+    if (obj->objType == bhvNode) {
+        static_cast<BvhNode*>(obj)->refit(epoch);
+    } else if (obj->objType == transformObj) {
+        refitObject(static_cast<Transform*>(obj)->getObject(), epoch);
+    }
+}
+
+void BvhNode::refit() {
+    static int epochs = 0;
+    refit(++epochs);
+}
+
+void BvhNode::refit(int epoch) {
+    if (refitEpoch == epoch) return;
+    refitEpoch = epoch;
+    refitObject(left, epoch);
+    if (right != left) refitObject(right, epoch);
+    Aabb boxLeft, boxRight;
+    left->hitbox(boxLeft);
+    right->hitbox(boxRight);
+    box = Aabb::surroundingBox(boxLeft, boxRight);
+}
+
+static void sumGrowth(const Object3D* obj, double& sum, int& count) {
+    if (obj->objType != bhvNode) return;
+    const BvhNode* node = static_cast<const BvhNode*>(obj);
+    sum += node->builtArea > 0 ? boxArea(node->box) / node->builtArea : 1;
+    count++;
+    sumGrowth(node->left, sum, count);
+    if (node->right != node->left) sumGrowth(node->right, sum, count);
+}
+
+float BvhNode::refitGrowth() const {
+    double sum = 0;
+    int count = 0;
+    sumGrowth(this, sum, count);
+    return (float) (sum / count);
+}
+
+int BvhNode::replaceLeaves(const std::map<Object3D*, Object3D*>& leaves) {
+    int replaced = 0;
+    bool single = left == right;    // 只有一个物体的叶子
+    Object3D** children[2] = {&left, &right};
+    for (int i = 0; i < (single ? 1 : 2); i++) {
+        Object3D*& child = *children[i];
+        auto it = leaves.find(child);
+        if (it == leaves.end()) {
+            replaced += static_cast<BvhNode*>(child)->replaceLeaves(leaves);
+        } else if (it->second != child) {
+            child = it->second;
+            replaced++;
+        }
+    }
+    if (single) right = left;
+    return replaced;
+}
+
 // Construct BVH Tree for a Group
 BvhNode::BvhNode(std::vector<Object3D*>& objects, int lo, int hi) {
     // comparator for sorting (random pick one axis)
-    int axis = Utils::randomInt(0, 2); 
+    objType = bhvNode;
+    axis = Utils::randomInt(0, 2); 
     auto cmp = (axis == 0) ? boxCmpX
              : (axis == 1) ? boxCmpY
              : boxCmpZ;
@@ -44,8 +359,8 @@ BvhNode::BvhNode(std::vector<Object3D*>& objects, int lo, int hi) {
     } else {  // general case
         std::sort(objects.begin() + lo, objects.begin() + hi, cmp);
         int mid = (lo + hi) / 2;
-        left =  new BvhNode(objects, lo, mid);
-        right = new BvhNode(objects, mid, hi);
+        left =  arenaNew<BvhNode>(arenaAccel, objects, lo, mid);
+        right = arenaNew<BvhNode>(arenaAccel, objects, mid, hi);
     }
 
     // compute hitbox
@@ -56,12 +371,14 @@ BvhNode::BvhNode(std::vector<Object3D*>& objects, int lo, int hi) {
     }
     
     box = Aabb::surroundingBox(boxLeft, boxRight);
+    builtArea = boxArea(box);
 }
 
 // Construct BVH Tree for a Mesh，跟给Group建立树步骤一样
 BvhNode::BvhNode(std::vector<Triangle*>& triangles, int lo, int hi) {
     // comparator for sorting (random pick one axis)
-    int axis = Utils::randomInt(0, 2); 
+    objType = bhvNode;
+    axis = Utils::randomInt(0, 2); 
     auto cmp = (axis == 0) ? boxCmpX
              : (axis == 1) ? boxCmpY
              : boxCmpZ;
@@ -81,8 +398,8 @@ BvhNode::BvhNode(std::vector<Triangle*>& triangles, int lo, int hi) {
     } else {  // general case
         std::sort(triangles.begin() + lo, triangles.begin() + hi, cmp);
         int mid = (lo + hi) / 2;
-        left = new BvhNode(triangles, lo, mid);
-        right = new BvhNode(triangles, mid, hi);
+        left = arenaNew<BvhNode>(arenaAccel, triangles, lo, mid);
+        right = arenaNew<BvhNode>(arenaAccel, triangles, mid, hi);
     }
 
     // compute hitbox
@@ -93,6 +410,7 @@ BvhNode::BvhNode(std::vector<Triangle*>& triangles, int lo, int hi) {
     }
 
     box = Aabb::surroundingBox(boxLeft, boxRight);
+    builtArea = boxArea(box);
     // printf("box\n");
     // box.print();
 }
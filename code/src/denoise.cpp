@@ -0,0 +1,277 @@
+#include "denoise.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DENOISE_SSE
+#endif
+
+static inline float luminance(float r, float g, float b) {
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+namespace {
+
+const float albedoEpsilon = 1e-3f;  // 解调时反照率的下限，避免除以 0
+const int normalSquarings = 7;      // 法线权重 max(0, n·n')^128
+const float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+
+// exp(x)，x <= 0：2^x 拆成整数部分（直接写指数位）和小数部分（多项式），相对误差约 1e-5
+inline float fastExp(float x) {
+    float y = std::max(x * 1.44269504f, -126.0f);
+    float n = std::floor(y);
+    float f = y - n;
+    float p = 1 + f * (0.693147f + f * (0.240227f + f * (0.0555041f + f * (0.00961813f + f * (0.00133336f + f * 0.000154035f)))));
+    int bits = ((int) n + 127) << 23;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+#ifdef DENOISE_SSE
+inline __m128 fastExp4(__m128 x) {
+    __m128 y = _mm_max_ps(_mm_mul_ps(x, _mm_set1_ps(1.44269504f)), _mm_set1_ps(-126.0f));
+    // 截断取整再修正为向下取整（SSE2 没有 floor）
+    __m128 n = _mm_cvtepi32_ps(_mm_cvttps_epi32(y));
+    n = _mm_sub_ps(n, _mm_and_ps(_mm_cmpgt_ps(n, y), _mm_set1_ps(1.0f)));
+    __m128 f = _mm_sub_ps(y, n);
+    __m128 p = _mm_set1_ps(0.000154035f);
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.00133336f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.00961813f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.0555041f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.240227f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.693147f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+    __m128i bits = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(p, _mm_castsi128_ps(bits));
+}
+
+inline __m128 abs4(__m128 x) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+}
+#endif
+
+// 加了边框的平面：边框宽度不小于最大采样偏移（再留出 SSE 一组 4 个像素的余量），
+// 内层循环不必判断越界。边框的 cat 为 0，与任何有效像素都不匹配，权重为 0
+struct Planes {
+    Planes(int _width, int _height, int iterations) : width(_width), height(_height) {
+        pad = (2 << (iterations - 1)) + 4;
+        stride = (width + 2 * pad + 3) & ~3;
+        size_t n = (size_t) stride * (height + 2 * pad);
+        for (int c = 0; c < 2; c++) {
+            r[c].assign(n, 0);
+            g[c].assign(n, 0);
+            b[c].assign(n, 0);
+            var[c].assign(n, 0);
+        }
+        cat.assign(n, 0);
+        nx.assign(n, 0);
+        ny.assign(n, 0);
+        nz.assign(n, 0);
+        z.assign(n, 0);
+        zGrad.assign(n, 0);
+        zEps.assign(n, 0);
+        lum.assign(n, 0);
+        invLum.assign(n, 0);
+    }
+
+    int index(int x, int y) const { return (y + pad) * stride + x + pad; }
+
+    int width, height, pad, stride;
+    std::vector<float> r[2], g[2], b[2], var[2];    // 辐照度和方差，两组轮流作为输入和输出
+    std::vector<float> cat;                         // 0 边框，1 未击中（天空），2 击中场景
+    std::vector<float> nx, ny, nz, z;
+    std::vector<float> zGrad;                       // sigmaDepth * 深度梯度
+    std::vector<float> zEps;                        // 深度差的容差下限（与深度成正比）
+    std::vector<float> lum, invLum;                 // 每次迭代：输入的亮度、1 / (sigmaL * 标准差)
+};
+
+// 把 [0, rows) 按行分给 threads 个线程执行 fn(y0, y1)
+void parallelRows(int rows, int threads, const std::function<void(int, int)>& fn) {
+    if (threads <= 1) {
+        fn(0, rows);
+        return;
+    }
+    std::vector<std::thread> pool;
+    int chunk = (rows + threads - 1) / threads;
+    for (int y0 = 0; y0 < rows; y0 += chunk) {
+        pool.emplace_back(fn, y0, std::min(y0 + chunk, rows));
+    }
+    for (std::thread& t : pool) t.join();
+}
+
+// 一次 à-trous 迭代中 [y0, y1) 行的滤波
+void filterRows(Planes& P, int src, int step, int y0, int y1) {
+    int dst = 1 - src;
+    const float *r = P.r[src].data(), *g = P.g[src].data(), *b = P.b[src].data(), *var = P.var[src].data();
+    float *outR = P.r[dst].data(), *outG = P.g[dst].data(), *outB = P.b[dst].data(), *outVar = P.var[dst].data();
+    const float *cat = P.cat.data(), *nx = P.nx.data(), *ny = P.ny.data(), *nz = P.nz.data(), *z = P.z.data();
+    const float *zGrad = P.zGrad.data(), *zEps = P.zEps.data(), *lum = P.lum.data(), *invLum = P.invLum.data();
+
+    int offset[25];
+    float h[25], dist[25];
+    for (int dy = -2, t = 0; dy <= 2; dy++) {
+        for (int dx = -2; dx <= 2; dx++, t++) {
+            offset[t] = (dy * P.stride + dx) * step;
+            h[t] = kernel[dx + 2] * kernel[dy + 2];
+            dist[t] = step * std::sqrt((float) (dx * dx + dy * dy));
+        }
+    }
+
+    for (int y = y0; y < y1; y++) {
+#ifdef DENOISE_SSE
+        for (int x = 0; x < P.width; x += 4) {
+            int i = P.index(x, y);
+            __m128 catP = _mm_loadu_ps(cat + i);
+            __m128 nxP = _mm_loadu_ps(nx + i), nyP = _mm_loadu_ps(ny + i), nzP = _mm_loadu_ps(nz + i);
+            __m128 zP = _mm_loadu_ps(z + i), zGradP = _mm_loadu_ps(zGrad + i), zEpsP = _mm_loadu_ps(zEps + i);
+            __m128 lumP = _mm_loadu_ps(lum + i), invLumP = _mm_loadu_ps(invLum + i);
+            __m128 sumR = _mm_setzero_ps(), sumG = _mm_setzero_ps(), sumB = _mm_setzero_ps();
+            __m128 sumVar = _mm_setzero_ps(), sumW = _mm_setzero_ps();
+            for (int t = 0; t < 25; t++) {
+                int j = i + offset[t];
+                __m128 same = _mm_cmpeq_ps(catP, _mm_loadu_ps(cat + j));
+                __m128 wn = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nxP, _mm_loadu_ps(nx + j)), _mm_mul_ps(nyP, _mm_loadu_ps(ny + j))),
+                                       _mm_mul_ps(nzP, _mm_loadu_ps(nz + j)));
+                wn = _mm_max_ps(wn, _mm_setzero_ps());
+                for (int k = 0; k < normalSquarings; k++) wn = _mm_mul_ps(wn, wn);
+                __m128 dl = _mm_mul_ps(abs4(_mm_sub_ps(lumP, _mm_loadu_ps(lum + j))), invLumP);
+                __m128 dz = _mm_div_ps(abs4(_mm_sub_ps(zP, _mm_loadu_ps(z + j))),
+                                       _mm_add_ps(_mm_mul_ps(zGradP, _mm_set1_ps(dist[t])), zEpsP));
+                __m128 w = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(h[t]), wn), fastExp4(_mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(dl, dz))));
+                w = _mm_and_ps(w, same);
+                sumR = _mm_add_ps(sumR, _mm_mul_ps(w, _mm_loadu_ps(r + j)));
+                sumG = _mm_add_ps(sumG, _mm_mul_ps(w, _mm_loadu_ps(g + j)));
+                sumB = _mm_add_ps(sumB, _mm_mul_ps(w, _mm_loadu_ps(b + j)));
+                sumVar = _mm_add_ps(sumVar, _mm_mul_ps(_mm_mul_ps(w, w), _mm_loadu_ps(var + j)));
+                sumW = _mm_add_ps(sumW, w);
+            }
+            // 超出图像宽度的几个像素落在边框里，输出保持为 0
+            __m128 valid = _mm_cmpneq_ps(catP, _mm_setzero_ps());
+            __m128 invW = _mm_div_ps(_mm_set1_ps(1.0f), sumW);
+            _mm_storeu_ps(outR + i, _mm_and_ps(_mm_mul_ps(sumR, invW), valid));
+            _mm_storeu_ps(outG + i, _mm_and_ps(_mm_mul_ps(sumG, invW), valid));
+            _mm_storeu_ps(outB + i, _mm_and_ps(_mm_mul_ps(sumB, invW), valid));
+            _mm_storeu_ps(outVar + i, _mm_and_ps(_mm_mul_ps(sumVar, _mm_mul_ps(invW, invW)), valid));
+        }
+#else
+        for (int x = 0; x < P.width; x++) {
+            int i = P.index(x, y);
+            float sumR = 0, sumG = 0, sumB = 0, sumVar = 0, sumW = 0;
+            for (int t = 0; t < 25; t++) {
+                int j = i + offset[t];
+                if (cat[j] != cat[i]) continue;
+                float wn = std::max(nx[i] * nx[j] + ny[i] * ny[j] + nz[i] * nz[j], 0.0f);
+                for (int k = 0; k < normalSquarings; k++) wn *= wn;
+                float dl = std::fabs(lum[i] - lum[j]) * invLum[i];
+                float dz = std::fabs(z[i] - z[j]) / (zGrad[i] * dist[t] + zEps[i]);
+                float w = h[t] * wn * fastExp(-(dl + dz));
+                sumR += w * r[j];
+                sumG += w * g[j];
+                sumB += w * b[j];
+                sumVar += w * w * var[j];
+                sumW += w;
+            }
+            outR[i] = sumR / sumW;
+            outG[i] = sumG / sumW;
+            outB[i] = sumB / sumW;
+            outVar[i] = sumVar / (sumW * sumW);
+        }
+#endif
+    }
+}
+
+} // namespace
+
+std::vector<float> Denoiser::denoise(const AovBuffers& aovs) const {
+    int width = aovs.getWidth(), height = aovs.getHeight();
+    const float *color = aovs.get(colorAov), *albedo = aovs.get(albedoAov), *normal = aovs.get(normalAov);
+    const float *depth = aovs.get(depthAov), *variance = aovs.get(varianceAov);
+    int numThreads = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    Planes P(width, height, iterations);
+
+    // 解调：颜色除以反照率得到辐照度，方差按亮度的平方缩放
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int s = y * width + x, i = P.index(x, y);
+            float a[3];
+            for (int c = 0; c < 3; c++) a[c] = std::max(albedo[s * 3 + c], albedoEpsilon);
+            P.r[0][i] = color[s * 3] / a[0];
+            P.g[0][i] = color[s * 3 + 1] / a[1];
+            P.b[0][i] = color[s * 3 + 2] / a[2];
+            float la = luminance(a[0], a[1], a[2]);
+            P.var[0][i] = variance[s] / (la * la);
+            bool hit = depth[s] > 0;
+            P.cat[i] = hit ? 2 : 1;
+            // 天空没有法线，统一取同一个方向，彼此之间的法线权重为 1
+            P.nx[i] = hit ? normal[s * 3] : 0;
+            P.ny[i] = hit ? normal[s * 3 + 1] : 0;
+            P.nz[i] = hit ? normal[s * 3 + 2] : 1;
+            P.z[i] = depth[s];
+            P.zEps[i] = 1e-3f * depth[s] + 1e-6f;
+        }
+    }
+    // 深度梯度：每个方向取前后差分中较小的一个（在物体边缘处不会被另一侧的深度拉大）
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int i = P.index(x, y);
+            if (P.cat[i] != 2) continue;
+            float grad[2];
+            int step[2] = {1, P.stride};
+            for (int a = 0; a < 2; a++) {
+                float d = INFINITY;
+                for (int dir = -1; dir <= 1; dir += 2) {
+                    int j = i + dir * step[a];
+                    if (P.cat[j] == 2) d = std::min(d, std::fabs(P.z[j] - P.z[i]));
+                }
+                grad[a] = std::isinf(d) ? 0 : d;
+            }
+            P.zGrad[i] = sigmaDepth * std::sqrt(grad[0] * grad[0] + grad[1] * grad[1]);
+        }
+    }
+
+    int src = 0;
+    for (int it = 0; it < iterations; it++) {
+        // 亮度权重的尺度：方差先做 3x3 高斯模糊，减少估计方差本身的噪声
+        parallelRows(height, numThreads, [&](int y0, int y1) {
+            const float* var = P.var[src].data();
+            for (int y = y0; y < y1; y++) {
+                for (int x = 0; x < width; x++) {
+                    int i = P.index(x, y);
+                    P.lum[i] = luminance(P.r[src][i], P.g[src][i], P.b[src][i]);
+                    float sum = 0, sumW = 0;
+                    for (int dy = -1; dy <= 1; dy++) {
+                        for (int dx = -1; dx <= 1; dx++) {
+                            int j = i + dy * P.stride + dx;
+                            if (P.cat[j] == 0) continue;
+                            float w = (dx == 0 ? 0.5f : 0.25f) * (dy == 0 ? 0.5f : 0.25f);
+                            sum += w * var[j];
+                            sumW += w;
+                        }
+                    }
+                    P.invLum[i] = 1.0f / (sigmaLuminance * std::sqrt(std::max(sum / sumW, 0.0f)) + 1e-4f);
+                }
+            }
+        });
+        parallelRows(height, numThreads, [&](int y0, int y1) {
+            filterRows(P, src, 1 << it, y0, y1);
+        });
+        src = 1 - src;
+    }
+
+    // 乘回反照率
+    std::vector<float> out(width * height * 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int s = y * width + x, i = P.index(x, y);
+            out[s * 3] = P.r[src][i] * std::max(albedo[s * 3], albedoEpsilon);
+            out[s * 3 + 1] = P.g[src][i] * std::max(albedo[s * 3 + 1], albedoEpsilon);
+            out[s * 3 + 2] = P.b[src][i] * std::max(albedo[s * 3 + 2], albedoEpsilon);
+        }
+    }
+    return out;
+}
@@ -0,0 +1,464 @@
+#include "distributed.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "utils.hpp"
+
+static const int protocolMagic = 0x57314150;   // "PA1W"
+
+enum MessageType {msgHello = 1, msgUnit, msgDone, msgResult};
+
+struct MessageHeader {
+    int magic;
+    int type;
+    int ints[8];
+};
+
+static bool sendAll(int fd, const void* data, size_t size) {
+    const char* p = (const char*) data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool recvAll(int fd, void* data, size_t size) {
+    char* p = (char*) data;
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool sendMessage(int fd, int type, const int* ints, int numInts) {
+    MessageHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = protocolMagic;
+    h.type = type;
+    for (int i = 0; i < numInts; i++) h.ints[i] = ints[i];
+    return sendAll(fd, &h, sizeof(h));
+}
+
+unsigned long long sceneFileHash(const char* path) {
+    unsigned long long h = 1469598103934665603ull;
+    FILE* f = fopen(path, "rb");
+    if (f == nullptr) return h;
+    int c;
+    while ((c = fgetc(f)) != EOF) {
+        h ^= (unsigned char) c;
+        h *= 1099511628211ull;
+    }
+    fclose(f);
+    return h;
+}
+
+// ====================================================================
+// 协调者
+// ====================================================================
+
+RenderCoordinator::RenderCoordinator(int _width, int _height, int _spp, unsigned int _seed, unsigned long long _sceneHash)
+    : width(_width), height(_height), spp(_spp), seed(_seed), sceneHash(_sceneHash) {}
+
+bool RenderCoordinator::listen(const std::string& _host, int _port) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(_port);
+    if (inet_pton(AF_INET, _host.c_str(), &addr.sin_addr) != 1) {
+        printf("Coordinator: --bind expects an IPv4 address, got '%s'\n", _host.c_str());
+        return false;
+    }
+    host = _host;
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        perror("socket");
+        return false;
+    }
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(listenFd, (sockaddr*) &addr, sizeof(addr)) < 0 || ::listen(listenFd, 64) < 0) {
+        perror("bind/listen");
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(listenFd, (sockaddr*) &addr, &len);
+    port = ntohs(addr.sin_port);
+    printf("Coordinator listening on %s:%d\n", host.c_str(), port);
+    return true;
+}
+
+void RenderCoordinator::spawnWorkers(int n, const std::vector<std::string>& workerArgs) {
+    // 监听所有网卡时本机的工作者走回环地址
+    std::string address = (host == "0.0.0.0" ? std::string("127.0.0.1") : host) + ":" + std::to_string(port);
+    for (int i = 0; i < n; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            break;
+        }
+        if (pid == 0) {
+            // 工作者的输出（参数、解析进度等）不混进协调者的输出，错误信息仍在 stderr
+            int devNull = open("/dev/null", O_WRONLY);
+            if (devNull >= 0) dup2(devNull, STDOUT_FILENO);
+            if (listenFd >= 0) close(listenFd);
+            std::vector<char*> argv;
+            for (const std::string& a : workerArgs) argv.push_back((char*) a.c_str());
+            argv.push_back((char*) "--worker");
+            argv.push_back((char*) address.c_str());
+            argv.push_back(nullptr);
+            execv("/proc/self/exe", argv.data());
+            execvp(argv[0], argv.data());
+            perror("exec worker");
+            _exit(127);
+        }
+        children.push_back(pid);
+    }
+    printf("Spawned %zu local workers\n", children.size());
+}
+
+void RenderCoordinator::makeUnits() {
+    int tilesX = (width + tileSize - 1) / tileSize;
+    int tilesY = (height + tileSize - 1) / tileSize;
+    chunksPerTile = (spp + unitSamples - 1) / unitSamples;
+    units.clear();
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            for (int c = 0; c < chunksPerTile; c++) {
+                WorkUnit u;
+                u.id = (int) units.size();
+                u.x0 = tx * tileSize;
+                u.y0 = ty * tileSize;
+                u.x1 = std::min(u.x0 + tileSize, width);
+                u.y1 = std::min(u.y0 + tileSize, height);
+                u.samples = std::min(unitSamples, spp - c * unitSamples);
+                u.seed = Utils::mixSeed(seed, u.id);
+                units.push_back(u);
+            }
+        }
+    }
+    // 从尾部取，所以倒序放入：按块的顺序分配，同一块的采样段挨在一起
+    queue.clear();
+    for (int i = (int) units.size() - 1; i >= 0; i--) queue.push_back(i);
+    tiles.assign(tilesX * tilesY, TileState());
+    unitsDone = 0;
+}
+
+void RenderCoordinator::acceptWorker() {
+    int fd = accept(listenFd, nullptr, nullptr);
+    if (fd < 0) return;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    Connection c;
+    c.fd = fd;
+    conns.push_back(c);
+}
+
+bool RenderCoordinator::handleInput(Connection& c) {
+    char buf[1 << 16];
+    ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return true;
+    if (n <= 0) return false;
+    c.inbuf.insert(c.inbuf.end(), buf, buf + n);
+
+    size_t pos = 0;
+    while (c.inbuf.size() - pos >= sizeof(MessageHeader)) {
+        MessageHeader h;
+        memcpy(&h, &c.inbuf[pos], sizeof(h));
+        if (h.magic != protocolMagic) {
+            printf("Coordinator: bad message from worker, closing connection\n");
+            return false;
+        }
+        if (h.type == msgHello) {
+            unsigned long long hash = (unsigned) h.ints[0] | ((unsigned long long) (unsigned) h.ints[1] << 32);
+            if (hash != sceneHash || h.ints[2] != width || h.ints[3] != height) {
+                printf("Coordinator: worker rendered a different scene (%dx%d), rejected\n", h.ints[2], h.ints[3]);
+                return false;
+            }
+            c.greeted = true;
+            pos += sizeof(h);
+        } else if (h.type == msgResult) {
+            int id = h.ints[0];
+            int count = h.ints[1];
+            if (id != c.unit || id < 0 || id >= (int) units.size()) {
+                printf("Coordinator: unexpected result for unit %d\n", id);
+                return false;
+            }
+            const WorkUnit& u = units[id];
+            if (count != (u.x1 - u.x0) * (u.y1 - u.y0) * 3) {
+                printf("Coordinator: result for unit %d has wrong size\n", id);
+                return false;
+            }
+            size_t bytes = sizeof(h) + count * sizeof(float);
+            if (c.inbuf.size() - pos < bytes) break;
+            std::vector<float> data(count);
+            memcpy(data.data(), &c.inbuf[pos + sizeof(h)], count * sizeof(float));
+            pos += bytes;
+            raysTraced += (unsigned) h.ints[2] | ((long long) (unsigned) h.ints[3] << 32);
+            c.unit = -1;
+            accumulate(id, data);
+        } else {
+            printf("Coordinator: unknown message type %d\n", h.type);
+            return false;
+        }
+    }
+    c.inbuf.erase(c.inbuf.begin(), c.inbuf.begin() + pos);
+    return true;
+}
+
+void RenderCoordinator::dropConnection(size_t index) {
+    Connection& c = conns[index];
+    if (c.unit >= 0) {
+        printf("Worker disconnected, reassigning unit %d\n", c.unit);
+        queue.push_back(c.unit);
+    }
+    close(c.fd);
+    conns.erase(conns.begin() + index);
+}
+
+void RenderCoordinator::dropTimedOut() {
+    if (unitTimeout <= 0) return;
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = conns.size(); i-- > 0;) {
+        const Connection& c = conns[i];
+        if (c.unit >= 0 && now - c.assigned > std::chrono::seconds(unitTimeout)) {
+            printf("Worker did not return unit %d within %d s, closing its connection\n", c.unit, unitTimeout);
+            dropConnection(i);
+        }
+    }
+}
+
+void RenderCoordinator::assign(Connection& c) {
+    if (queue.empty()) return;
+    int id = queue.back();
+    queue.pop_back();
+    const WorkUnit& u = units[id];
+    int ints[7] = {u.id, u.x0, u.y0, u.x1, u.y1, u.samples, (int) u.seed};
+    c.unit = id;
+    c.assigned = std::chrono::steady_clock::now();
+    // 发送失败时连接已断开，下一次 poll 会读到 EOF，由 dropConnection 回收这个单元
+    sendMessage(c.fd, msgUnit, ints, 7);
+}
+
+void RenderCoordinator::accumulate(int unitId, std::vector<float>& data) {
+    ++unitsDone;
+    TileState& tile = tiles[unitId / chunksPerTile];
+    int chunk = unitId % chunksPerTile;
+    if (chunk != tile.nextChunk) {
+        tile.pending.push_back(std::make_pair(chunk, std::move(data)));
+        return;
+    }
+    addToFilm(units[unitId], data.data());
+    ++tile.nextChunk;
+    // 之前提前到达的采样段
+    bool found = true;
+    while (found) {
+        found = false;
+        for (size_t i = 0; i < tile.pending.size(); i++) {
+            if (tile.pending[i].first != tile.nextChunk) continue;
+            addToFilm(units[unitId - chunk + tile.nextChunk], tile.pending[i].second.data());
+            tile.pending.erase(tile.pending.begin() + i);
+            ++tile.nextChunk;
+            found = true;
+            break;
+        }
+    }
+}
+
+void RenderCoordinator::addToFilm(const WorkUnit& u, const float* data) {
+    int w = u.x1 - u.x0;
+    for (int y = u.y0; y < u.y1; y++) {
+        for (int x = u.x0; x < u.x1; x++) {
+            const float* src = data + ((y - u.y0) * w + (x - u.x0)) * 3;
+            float* dst = &film[(y * width + x) * 3];
+            dst[0] += src[0];
+            dst[1] += src[1];
+            dst[2] += src[2];
+        }
+    }
+}
+
+int RenderCoordinator::liveChildren() {
+    int live = 0;
+    for (pid_t& pid : children) {
+        if (pid <= 0) continue;
+        int status;
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            printf("Worker process %d exited (status %d)\n", (int) pid,
+                   WIFEXITED(status) ? WEXITSTATUS(status) : -WTERMSIG(status));
+            pid = -1;
+            continue;
+        }
+        ++live;
+    }
+    return live;
+}
+
+std::vector<float> RenderCoordinator::run(const RenderUnitFn& render) {
+    makeUnits();
+    film.assign((size_t) width * height * 3, 0.0f);
+    bool spawned = !children.empty();
+    printf("Distributed render: %zu units (%dx%d tiles, %d samples per unit)\n",
+           units.size(), tileSize, tileSize, unitSamples);
+
+    time_t lastReport = time(nullptr);
+    while (unitsDone < (int) units.size()) {
+        std::vector<pollfd> fds;
+        fds.push_back({listenFd, POLLIN, 0});
+        for (const Connection& c : conns) fds.push_back({c.fd, POLLIN, 0});
+        int ready = poll(fds.data(), fds.size(), 500);
+        if (ready < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        if (ready > 0) {
+            // 倒序处理，关闭连接时不影响前面的下标
+            for (size_t i = conns.size(); i-- > 0;) {
+                if (fds[i + 1].revents == 0) continue;
+                if (!handleInput(conns[i])) dropConnection(i);
+            }
+            if (fds[0].revents & POLLIN) acceptWorker();
+        }
+        dropTimedOut();
+        for (Connection& c : conns) {
+            if (c.greeted && c.unit < 0) assign(c);
+        }
+
+        // 本机启动的工作者都退出了：剩下的单元自己渲染
+        if (spawned && conns.empty() && liveChildren() == 0 && !queue.empty()) {
+            printf("All workers exited, rendering the remaining %zu units locally\n", queue.size());
+            while (!queue.empty()) {
+                int id = queue.back();
+                queue.pop_back();
+                const WorkUnit& u = units[id];
+                std::vector<float> data((size_t) (u.x1 - u.x0) * (u.y1 - u.y0) * 3, 0.0f);
+                raysTraced += render(u, data.data());
+                accumulate(id, data);
+            }
+        }
+
+        time_t now = time(nullptr);
+        if (now - lastReport >= 1) {
+            lastReport = now;
+            printf("[distributed %5.1f%%] %d/%zu units, %zu workers\n",
+                   100.0 * unitsDone / units.size(), unitsDone, units.size(), conns.size());
+        }
+    }
+
+    for (Connection& c : conns) {
+        sendMessage(c.fd, msgDone, nullptr, 0);
+        close(c.fd);
+    }
+    conns.clear();
+    for (pid_t pid : children) {
+        if (pid > 0) waitpid(pid, nullptr, 0);
+    }
+    children.clear();
+    if (listenFd >= 0) close(listenFd);
+    listenFd = -1;
+    return film;
+}
+
+// ====================================================================
+// 工作者
+// ====================================================================
+
+static int connectTo(const std::string& address) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        printf("Worker: address must be HOST:PORT, got '%s'\n", address.c_str());
+        return -1;
+    }
+    std::string host = address.substr(0, colon);
+    std::string service = address.substr(colon + 1);
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    // 协调者可能还没开始监听，重试几秒
+    for (int attempt = 0; attempt < 50; attempt++) {
+        addrinfo* res = nullptr;
+        if (getaddrinfo(host.c_str(), service.c_str(), &hints, &res) == 0) {
+            for (addrinfo* ai = res; ai != nullptr; ai = ai->ai_next) {
+                int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+                if (fd < 0) continue;
+                if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+                    freeaddrinfo(res);
+                    int one = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    return fd;
+                }
+                close(fd);
+            }
+            freeaddrinfo(res);
+        }
+        usleep(100000);
+    }
+    printf("Worker: cannot connect to coordinator at %s\n", address.c_str());
+    return -1;
+}
+
+int runRenderWorker(const std::string& address, unsigned long long sceneHash, int width, int height,
+                    const RenderUnitFn& render) {
+    int fd = connectTo(address);
+    if (fd < 0) return 1;
+    int hello[4] = {(int) (sceneHash & 0xffffffffu), (int) (sceneHash >> 32), width, height};
+    if (!sendMessage(fd, msgHello, hello, 4)) {
+        close(fd);
+        return 1;
+    }
+    int rendered = 0;
+    std::vector<float> data;
+    while (true) {
+        MessageHeader h;
+        if (!recvAll(fd, &h, sizeof(h)) || h.magic != protocolMagic) {
+            fprintf(stderr, "Worker: lost connection to coordinator\n");
+            close(fd);
+            return 1;
+        }
+        if (h.type == msgDone) break;
+        if (h.type != msgUnit) continue;
+        WorkUnit u;
+        u.id = h.ints[0];
+        u.x0 = h.ints[1];
+        u.y0 = h.ints[2];
+        u.x1 = h.ints[3];
+        u.y1 = h.ints[4];
+        u.samples = h.ints[5];
+        u.seed = (unsigned int) h.ints[6];
+        int count = (u.x1 - u.x0) * (u.y1 - u.y0) * 3;
+        data.assign(count, 0.0f);
+        long long rays = render(u, data.data());
+        int header[4] = {u.id, count, (int) (rays & 0xffffffff), (int) (rays >> 32)};
+        if (!sendMessage(fd, msgResult, header, 4) || !sendAll(fd, data.data(), count * sizeof(float))) {
+            fprintf(stderr, "Worker: lost connection to coordinator\n");
+            close(fd);
+            return 1;
+        }
+        ++rendered;
+    }
+    close(fd);
+    printf("Worker finished, %d units rendered\n", rendered);
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include "envmap.hpp"
+#include <algorithm>
+#include <cmath>
+#include "bvh.hpp"
+#include "stats.hpp"
+#include "utils.hpp"
+
+// 天空在无穷远处，光线锥在 uv 上的宽度只由扩张角决定（同单位球的 uvScale）
+static const float uvPerRadian = 1.0f / (PI * 1.41421356f);
+
+const int EnvironmentMap::maxDistWidth;   // 构造函数中 std::min 按引用使用
+
+EnvironmentMap::EnvironmentMap(ImageTexture* _texture) : texture(_texture) {
+    distW = std::max(1, std::min(texture->getWidth(), maxDistWidth));
+    distH = std::max(1, std::min(texture->getHeight(), maxDistWidth / 2));
+    func.resize(distW * distH);
+    conditionalCdf.resize((distW + 1) * distH);
+    rowIntegral.resize(distH);
+    marginalCdf.resize(distH + 1);
+
+    // 每个格子取中心处（按格子大小预滤波）的亮度，乘以 sinθ 得到与立体角成正比的权重
+    for (int row = 0; row < distH; row++) {
+        float v = (row + 0.5f) / distH;
+        float sinTheta = std::sin((float) PI * v);
+        float* f = &func[row * distW];
+        float* cdf = &conditionalCdf[row * (distW + 1)];
+        cdf[0] = 0;
+        for (int col = 0; col < distW; col++) {
+            Vector3f c = texture->sample((col + 0.5f) / distW, v, 1.0f / distW);
+            float lum = 0.2126f * c.x() + 0.7152f * c.y() + 0.0722f * c.z();
+            f[col] = std::max(lum, 0.0f) * sinTheta;
+            cdf[col + 1] = cdf[col] + f[col] / distW;
+        }
+        rowIntegral[row] = cdf[distW];
+        for (int col = 1; col <= distW; col++) {
+            cdf[col] = rowIntegral[row] > 0 ? cdf[col] / rowIntegral[row] : (float) col / distW;
+        }
+    }
+    marginalCdf[0] = 0;
+    for (int row = 0; row < distH; row++) {
+        marginalCdf[row + 1] = marginalCdf[row] + rowIntegral[row] / distH;
+    }
+    integral = marginalCdf[distH];
+    for (int row = 1; row <= distH; row++) {
+        marginalCdf[row] = integral > 0 ? marginalCdf[row] / integral : (float) row / distH;
+    }
+}
+
+// 同 Sphere::getUvSphere
+void EnvironmentMap::dirToUv(const Vector3f& dir, float& u, float& v) {
+    float phi = atan2(dir.z(), dir.x());
+    float theta = asin(Utils::clamp(dir.y(), -1.0, 1.0));
+    u = 0.5 - phi / (2 * PI);
+    v = theta / PI + 0.5;
+}
+
+Vector3f EnvironmentMap::uvToDir(float u, float v, float sinTheta) {
+    float phi = (float) PI * (1 - 2 * u);
+    return Vector3f(sinTheta * std::cos(phi), -std::cos((float) PI * v), sinTheta * std::sin(phi));
+}
+
+float EnvironmentMap::pdfUv(float u, float v) const {
+    if (integral <= 0) return 0;
+    int col = std::min(std::max((int) (u * distW), 0), distW - 1);
+    int row = std::min(std::max((int) (v * distH), 0), distH - 1);
+    return func[row * distW + col] / integral;
+}
+
+float EnvironmentMap::pdf(const Vector3f& dir) const {
+    float u, v;
+    dirToUv(dir, u, v);
+    // uv 到立体角的雅可比：dω = 2π² sinθ du dv
+    float sinTheta = std::sin((float) PI * v);
+    if (sinTheta <= 0) return 0;
+    return pdfUv(u, v) / (2 * PI * PI * sinTheta);
+}
+
+Vector3f EnvironmentMap::eval(const Ray& ray, float* pdfOut) const {
+    Vector3f dir = ray.getDirection().normalized();
+    float u, v;
+    dirToUv(dir, u, v);
+    if (pdfOut != nullptr) {
+        float sinTheta = std::sin((float) PI * v);
+        *pdfOut = sinTheta > 0 ? pdfUv(u, v) / (2 * PI * PI * sinTheta) : 0;
+    }
+    return texture->sample(u, v, ray.getConeSpread() * uvPerRadian);
+}
+
+bool EnvironmentMap::sampleUv(float r1, float r2, float& u, float& v, Vector3f& dir, float& pdfOut) const {
+    pdfOut = 0;
+    if (integral <= 0) return false;
+    // 先选行，再在该行中选列；格子内均匀分布
+    int row = (int) (std::upper_bound(marginalCdf.begin(), marginalCdf.end(), r1) - marginalCdf.begin()) - 1;
+    row = std::min(std::max(row, 0), distH - 1);
+    float dv = (r1 - marginalCdf[row]) / std::max(marginalCdf[row + 1] - marginalCdf[row], 1e-12f);
+    const float* cdf = &conditionalCdf[row * (distW + 1)];
+    int col = (int) (std::upper_bound(cdf, cdf + distW + 1, r2) - cdf) - 1;
+    col = std::min(std::max(col, 0), distW - 1);
+    float du = (r2 - cdf[col]) / std::max(cdf[col + 1] - cdf[col], 1e-12f);
+
+    u = (col + Utils::clamp(du, 0.0, 1.0)) / distW;
+    v = (row + Utils::clamp(dv, 0.0, 1.0)) / distH;
+    float sinTheta = std::sin((float) PI * v);
+    if (sinTheta <= 0) return false;
+    dir = uvToDir(u, v, sinTheta);
+    pdfOut = func[row * distW + col] / integral / (2 * PI * PI * sinTheta);
+    return true;
+}
+
+Vector3f EnvironmentMap::sample(float r1, float r2, Vector3f& dir, float& pdfOut, float uvWidth) const {
+    float u, v;
+    if (!sampleUv(r1, r2, u, v, dir, pdfOut)) return Vector3f::ZERO;
+    return texture->sample(u, v, uvWidth);
+}
+
+Vector3f EnvironmentMap::sampleDirect(const Hit& hit, const Ray& scattered, Object3D* scene, long long& rays) const {
+    // 先选方向，在表面之下或被遮挡时不必取色
+    Vector3f dir;
+    float u, v, lightPdf;
+    float r1 = Utils::randomFloat(), r2 = Utils::randomFloat();
+    if (!sampleUv(r1, r2, u, v, dir, lightPdf)) {
+        return Vector3f::ZERO;
+    }
+    float cosTheta = Vector3f::dot(hit.getNormal(), dir);
+    if (cosTheta <= 0) {
+        return Vector3f::ZERO;
+    }
+    ++rays;
+    STATS_INC(shadowRays);
+    Ray shadow(hit.getPos(), dir);
+    shadow.setTime(scattered.getTime());
+    bool blocked;
+    if (scene->objType == bhvNode) {
+        blocked = static_cast<BvhNode*>(scene)->occluded(shadow, 0.0001, INF);
+    } else {
+        Hit occluder;
+        blocked = scene->intersect(shadow, occluder, 0.0001, INF);
+    }
+    if (blocked) {
+        return Vector3f::ZERO;
+    }
+    // 漫反射 BRDF * cosθ = 反照率 * cosθ / π，cosθ / π 正好是漫反射采样的 pdf
+    float bsdfPdf = cosTheta / PI;
+    Vector3f radiance = texture->sample(u, v, scattered.getConeSpread() * uvPerRadian);
+    return radiance * (bsdfPdf / lightPdf * powerHeuristic(lightPdf, bsdfPdf));
+}
@@ -216,15 +216,12 @@ struct BMPHeader
     int biClrImportant;   /* Number of important colors.  If 0, all colors 
                              are important */
 };
-int 
-
-Image::SaveBMP(const char *filename)
+// 编码为 24 位 BMP 文件的全部字节（主机为小端），预览服务器（preview.hpp）直接发送，不经过文件
+void Image::EncodeBMP(std::vector<unsigned char> &out) const
 {
     int i, j, ipos;
     int bytesPerLine;
-    unsigned char *line;
-	Vector3f*rgb = data;
-    FILE *file;
+    const Vector3f *rgb = data;
     struct BMPHeader bmph;
 
     /* The length of each line must be a multiple of 4 bytes */
@@ -247,34 +244,32 @@ Image::SaveBMP(const char *filename)
     bmph.biClrUsed = 0;       
     bmph.biClrImportant = 0; 
 
-    file = fopen (filename, "wb");
-    if (file == NULL) return(0);
-  
-    fwrite(&bmph.bfType, 2, 1, file);
-    fwrite(&bmph.bfSize, 4, 1, file);
-    fwrite(&bmph.bfReserved, 4, 1, file);
-    fwrite(&bmph.bfOffBits, 4, 1, file);
-    fwrite(&bmph.biSize, 4, 1, file);
-    fwrite(&bmph.biWidth, 4, 1, file);
-    fwrite(&bmph.biHeight, 4, 1, file);
-    fwrite(&bmph.biPlanes, 2, 1, file);
-    fwrite(&bmph.biBitCount, 2, 1, file);
-    fwrite(&bmph.biCompression, 4, 1, file);
-    fwrite(&bmph.biSizeImage, 4, 1, file);
-    fwrite(&bmph.biXPelsPerMeter, 4, 1, file);
-    fwrite(&bmph.biYPelsPerMeter, 4, 1, file);
-    fwrite(&bmph.biClrUsed, 4, 1, file);
-    fwrite(&bmph.biClrImportant, 4, 1, file);
-  
-    line = (unsigned char *)malloc(bytesPerLine);
-    if (line == NULL)
-    {
-        fprintf(stderr, "Can't allocate memory for BMP file.\n");
-        return(0);
-    }
+    out.assign(bmph.bfSize, 0);
+    unsigned char *p = out.data();
+    // 逐个字段写入，不受结构体对齐的影响
+    auto put = [&p](const void *field, int size) {
+        memcpy(p, field, size);
+        p += size;
+    };
+    put(&bmph.bfType, 2);
+    put(&bmph.bfSize, 4);
+    put(&bmph.bfReserved, 4);
+    put(&bmph.bfOffBits, 4);
+    put(&bmph.biSize, 4);
+    put(&bmph.biWidth, 4);
+    put(&bmph.biHeight, 4);
+    put(&bmph.biPlanes, 2);
+    put(&bmph.biBitCount, 2);
+    put(&bmph.biCompression, 4);
+    put(&bmph.biSizeImage, 4);
+    put(&bmph.biXPelsPerMeter, 4);
+    put(&bmph.biYPelsPerMeter, 4);
+    put(&bmph.biClrUsed, 4);
+    put(&bmph.biClrImportant, 4);
 
     for (i = 0; i < height ; i++)
     {
+        unsigned char *line = out.data() + bmph.bfOffBits + bytesPerLine * i;
         for (j = 0; j < width; j++)
         {
             ipos = (width * i + j);
@@ -282,10 +277,19 @@ Image::SaveBMP(const char *filename)
             line[3*j+1] =ClampColorComponent( rgb[ipos][1]);
             line[3*j+2] = ClampColorComponent( rgb[ipos][0]);
         }
-        fwrite(line, bytesPerLine, 1, file);
     }
+}
 
-    free(line);
+int 
+
+Image::SaveBMP(const char *filename)
+{
+    std::vector<unsigned char> bytes;
+    EncodeBMP(bytes);
+
+    FILE *file = fopen (filename, "wb");
+    if (file == NULL) return(0);
+    fwrite(bytes.data(), bytes.size(), 1, file);
     fclose(file);
 
     return(1);
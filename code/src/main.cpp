@@ -5,6 +5,10 @@
 #include <cmath>
 #include <iostream>
 #include <ctime>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 #include "scene_parser.hpp"
 #include "image.hpp"
@@ -15,6 +19,18 @@
 #include "bvh.hpp"
 #include "box.hpp"
 #include "sceneGenerator.hpp"
+#include "stats.hpp"
+#include "wavefront.hpp"
+#include "arena.hpp"
+#include "texture_manager.hpp"
+#include "envmap.hpp"
+#include "distributed.hpp"
+#include "animation.hpp"
+#include "aov.hpp"
+#include "denoise.hpp"
+#include "preview.hpp"
+#include "reload.hpp"
+#include "settings.hpp"
 // #include "perlin.hpp"
 
 #include <string>
@@ -22,24 +38,550 @@
 using namespace std;
 
 
-const int samplesPerPixel = 1000;   // SSAA
-const int maxDepth = 600;           // 光线跟踪深度上限
+RenderSettings settings;            // 渲染设置：命令行参数和场景文件的 RenderSettings 块（settings.hpp）
+EnvironmentMap* envMap = nullptr;   // 场景的环境光，没有时未击中的光线取 bgColor
+
+thread_local long long raysTraced = 0;  // 本线程已追踪的光线数（相机光线 + 次级光线），多线程渲染结束后加到主线程
+
+Vector3f rayTrace(Ray& ray, Object3D* scene, const Vector3f& bgColor, int depth, float bsdfPdf = 0);
+
+// 未击中场景的光线。bsdfPdf > 0 表示光线是漫反射采样得到的，
+// 这个方向也可能被环境光采样选中，需要按 MIS 加权
+Vector3f background(const Ray& ray, const Vector3f& bgColor, float bsdfPdf) {
+    if (envMap == nullptr) return bgColor;
+    if (bsdfPdf <= 0) return envMap->eval(ray);
+    float lightPdf;
+    Vector3f radiance = envMap->eval(ray, &lightPdf);
+    return radiance * EnvironmentMap::powerHeuristic(bsdfPdf, lightPdf);
+}
+
+// 已求得光线与场景的最近交点（hit）后的着色
+Vector3f shade(const Ray& ray, const Hit& hit, Object3D* scene, const Vector3f& bgColor, int depth) {
+    Ray scattered;            // 下一条射线
+    Vector3f color(0, 0, 0);  // 颜色
+    if (!scatterByType(hit.getMaterial(), ray, hit, color, scattered)) { 
+        // 既不反射亦不折射，是Emissive材质
+        STATS_PATH(settings.maxDepth - depth + 1);
+        return emitColorByType(hit.getMaterial(), ray, hit);
+    }
+    STATS_INC(secondaryRays);
+    if (envMap != nullptr && hit.getMaterial()->matType == lambertMat) {
+        // 漫反射：另外向天空采样一条阴影光线，与漫反射采样按 MIS 合并
+        Vector3f direct = envMap->sampleDirect(hit, scattered, scene, raysTraced);
+        float bsdfPdf = Vector3f::dot(hit.getNormal(), scattered.getDirection()) / PI;
+        return color * (direct + rayTrace(scattered, scene, bgColor, depth-1, bsdfPdf));
+    }
+    return color * rayTrace(scattered, scene, bgColor, depth-1);  // 递归
+}
 
 // 光线跟踪主要递归函数
-Vector3f rayTrace(Ray& ray, Object3D* scene, const Vector3f& bgColor, int depth) {
-    if (depth <= 0) return Vector3f(0.01, 0.01, 0.01);
+Vector3f rayTrace(Ray& ray, Object3D* scene, const Vector3f& bgColor, int depth, float bsdfPdf) {
+    ++raysTraced;
+    if (depth <= 0) {
+        STATS_PATH(settings.maxDepth);
+        return Vector3f(0.01, 0.01, 0.01);
+    }
     Hit hit;
     // 判断是否和场景有交点，并返回最近交点的信息（hit）
     if (!scene->intersect(ray, hit, 0.0001, INF)) {  // 若无交点，返回背景颜色
-        return bgColor;
+        STATS_PATH(settings.maxDepth - depth);
+        return background(ray, bgColor, bsdfPdf);
     }
-    Ray scattered;            // 下一条射线
-    Vector3f color(0, 0, 0);  // 颜色
-    if (!hit.getMaterial()->scatter(ray, hit, color, scattered)) { 
-        // 既不反射亦不折射，是Emissive材质
-        return hit.getMaterial()->getEmitColor(hit.getU(), hit.getV(), hit.getPos());
+    return shade(ray, hit, scene, bgColor, depth);
+}
+
+// 像素块的大小：一个块里同一次采样的相机光线组成一个光线包
+int blockWidth() {
+    return settings.packetSize == 16 ? 4 : (settings.packetSize >= 4 ? 2 : 1);
+}
+
+// 相机光线的第一个交点：着色，同时填写 aovs 请求的通道。
+// 需要拆分光照时展开 shade 的第一层（随机数的使用顺序不变，颜色与 shade 相同）
+Vector3f shadeFirstHit(const Ray& ray, const Hit& hit, BvhNode* scene, const Vector3f& bgColor,
+                       AovBuffers& aovs, AovSample& s) {
+    Material* m = hit.getMaterial();
+    s.hit = true;
+    s.normal = hit.getNormal();
+    s.depth = hit.getT();
+    if (aovs.has(albedoAov)) s.albedo = m->getAlbedo(ray, hit);
+    if (aovs.has(materialIdAov)) s.materialId = aovs.materialId(m);
+    if (aovs.has(objectIdAov)) {
+        Hit pickHit;
+        s.objectId = aovs.objectId(scene->pick(ray, pickHit, 0.0001, INF));
     }
-    return color * rayTrace(scattered, scene, bgColor, depth-1);  // 递归
+    if (!aovs.needsLightSplit()) {
+        return shade(ray, hit, scene, bgColor, settings.maxDepth);
+    }
+
+    Ray scattered;
+    Vector3f color(0, 0, 0);
+    if (!scatterByType(m, ray, hit, color, scattered)) {
+        STATS_PATH(1);
+        s.emission = emitColorByType(m, ray, hit);
+        return s.emission;
+    }
+    STATS_INC(secondaryRays);
+    Vector3f direct(0, 0, 0);
+    float bsdfPdf = 0;
+    if (envMap != nullptr && m->matType == lambertMat) {
+        direct = envMap->sampleDirect(hit, scattered, scene, raysTraced);
+        bsdfPdf = Vector3f::dot(hit.getNormal(), scattered.getDirection()) / PI;
+    }
+    // 同 rayTrace(scattered, scene, bgColor, maxDepth - 1, bsdfPdf)，另外记下一个顶点是不是光源
+    ++raysTraced;
+    Hit next;
+    Vector3f bounce;
+    bool bounceIsLight;
+    if (!scene->intersect(scattered, next, 0.0001, INF)) {
+        STATS_PATH(1);
+        bounce = background(scattered, bgColor, bsdfPdf);
+        bounceIsLight = true;
+    } else {
+        bounce = shade(scattered, next, scene, bgColor, settings.maxDepth - 1);
+        bounceIsLight = next.getMaterial()->matType == emissiveMat;
+    }
+    s.direct = color * (bounceIsLight ? direct + bounce : direct);
+    s.indirect = bounceIsLight ? Vector3f::ZERO : color * bounce;
+    return color * (direct + bounce);
+}
+
+// 相机光线求交之后的着色，hit 为 nullptr 表示未击中。aovs 非空时把这个采样累加到像素 (x, y) 的各通道
+Vector3f shadeCameraRay(const Ray& ray, const Hit* hit, BvhNode* scene, const Vector3f& bgColor,
+                        AovBuffers* aovs, int x, int y) {
+    if (aovs == nullptr) {
+        if (hit != nullptr) return shade(ray, *hit, scene, bgColor, settings.maxDepth);
+        STATS_PATH(0);
+        return background(ray, bgColor, 0);
+    }
+    AovSample s;
+    Vector3f radiance;
+    if (hit != nullptr) {
+        radiance = shadeFirstHit(ray, *hit, scene, bgColor, *aovs, s);
+    } else {
+        STATS_PATH(0);
+        radiance = background(ray, bgColor, 0);
+        // 直接看到的天空算作发光；反照率取天空颜色本身，去噪时天空不会被模糊
+        s.albedo = radiance;
+        s.emission = radiance;
+    }
+    aovs->add(x, y, s, radiance);
+    return radiance;
+}
+
+// 对像素块 [x0, xEnd) x [y0, yEnd)（不超过 packetSize 个像素）执行 samples 次采样，
+// 颜色之和累加到 blockColor，按 x 外层、y 内层的顺序存放。aovs 非空时同时累加各通道
+void sampleBlock(Camera* cam, BvhNode* bvhRoot, const Vector3f& bgColor, int x0, int xEnd, int y0, int yEnd,
+                 int samples, Vector3f* blockColor, AovBuffers* aovs = nullptr) {
+    RayPacket packet;
+    Hit hits[RayPacket::maxSize];
+    int blockH = yEnd - y0;
+    for (int s = 0; s < samples; s++){
+        if (settings.packetSize == 1) {
+            Vector2f screenPoint(x0 + Utils::randomFloat(), y0 + Utils::randomFloat()); // 景深效果
+            Ray camRay = cam->generateRay(screenPoint);                                 // 光线投射
+            STATS_INC(cameraRays);
+            if (aovs == nullptr) {
+                blockColor[0] += rayTrace(camRay, bvhRoot, bgColor, settings.maxDepth);          // 执行光线跟踪
+                continue;
+            }
+            // 同 rayTrace，但需要第一个交点
+            ++raysTraced;
+            Hit hit;
+            bool isHit = bvhRoot->intersect(camRay, hit, 0.0001, INF);
+            blockColor[0] += shadeCameraRay(camRay, isHit ? &hit : nullptr, bvhRoot, bgColor, aovs, x0, y0);
+            continue;
+        }
+        // 整块的相机光线一起求交，之后逐条着色
+        packet.clear();
+        for (int x = x0; x < xEnd; x++) {
+            for (int y = y0; y < yEnd; y++) {
+                Vector2f screenPoint(x + Utils::randomFloat(), y + Utils::randomFloat());
+                packet.add(cam->generateRay(screenPoint));
+            }
+        }
+        packet.finalize();
+        for (int i = 0; i < packet.size; i++) hits[i] = Hit();
+        unsigned hitMask = bvhRoot->intersectPacket(packet, hits, 0.0001);
+        STATS_ADD(cameraRays, packet.size);
+        raysTraced += packet.size;
+        for (int i = 0; i < packet.size; i++) {
+            const Hit* hit = (hitMask & (1u << i)) ? &hits[i] : nullptr;
+            blockColor[i] += shadeCameraRay(packet.rays[i], hit, bvhRoot, bgColor, aovs, x0 + i / blockH, y0 + i % blockH);
+        }
+    }
+}
+
+// 分布式渲染的一个单元：以单元自己的种子渲染一块像素，颜色之和写入 accum，返回追踪的光线数
+long long renderUnit(Camera* cam, BvhNode* bvhRoot, const Vector3f& bgColor, const WorkUnit& unit, float* accum) {
+    Utils::setSeed(unit.seed);
+    long long raysBefore = raysTraced;
+    int blockW = blockWidth(), blockH = settings.packetSize / blockW;
+    int w = unit.x1 - unit.x0;
+    Vector3f blockColor[RayPacket::maxSize];
+    for (int x0 = unit.x0; x0 < unit.x1; x0 += blockW) {
+        int xEnd = min(x0 + blockW, unit.x1);
+        for (int y0 = unit.y0; y0 < unit.y1; y0 += blockH) {
+            int yEnd = min(y0 + blockH, unit.y1);
+            int numPixels = (xEnd - x0) * (yEnd - y0);
+            for (int i = 0; i < numPixels; i++) blockColor[i] = Vector3f::ZERO;
+            sampleBlock(cam, bvhRoot, bgColor, x0, xEnd, y0, yEnd, unit.samples, blockColor);
+            for (int x = x0, i = 0; x < xEnd; x++) {
+                for (int y = y0; y < yEnd; y++, i++) {
+                    float* dst = accum + ((y - unit.y0) * w + (x - unit.x0)) * 3;
+                    dst[0] += blockColor[i].x();
+                    dst[1] += blockColor[i].y();
+                    dst[2] += blockColor[i].z();
+                }
+            }
+        }
+    }
+    return raysTraced - raysBefore;
+}
+
+// 按 settings.formats 保存图片，path 不带扩展名
+void saveImage(Image* img, const string& path) {
+    if (settings.formats & RenderSettings::bmpFormat) img->SaveBMP((path + ".bmp").c_str());
+    if (settings.formats & RenderSettings::ppmFormat) img->SavePPM((path + ".ppm").c_str());
+    if (settings.formats & RenderSettings::tgaFormat) img->SaveTGA((path + ".tga").c_str());
+}
+
+// 中间图片：<output-dir>/temp/<格式>/<name>.<格式>
+void saveCheckpoint(Image* img, const string& name) {
+    const char* exts[] = {"bmp", "ppm", "tga"};
+    for (int f = 0; f < 3; f++) {
+        if (!(settings.formats & (1u << f))) continue;
+        string fname = settings.outputDir + "/temp/" + exts[f] + "/" + name + "." + exts[f];
+        std::cout << "Image saved! File name: " << fname.c_str() << endl;
+        if (f == 0) img->SaveBMP(fname.c_str());
+        else if (f == 1) img->SavePPM(fname.c_str());
+        else img->SaveTGA(fname.c_str());
+    }
+}
+
+// 限时渲染（--time-budget）：分多遍遍历所有像素块，第一遍每像素 1 次采样，
+// 之后每遍按已测得的单次采样用时，取剩余时间的一半能完成的采样数，直到时间或 spp 用完
+int renderProgressive(Camera* cam, BvhNode* bvhRoot, const Vector3f& bgColor, Image* img, AovBuffers* aovs,
+                      const string& outputFile, std::chrono::steady_clock::time_point start) {
+    int w = cam->getWidth(), h = cam->getHeight();
+    int blockW = blockWidth(), blockH = settings.packetSize / blockW;
+    vector<Vector3f> film(w * h);
+    Vector3f blockColor[RayPacket::maxSize];
+    int samplesDone = 0, passSamples = 1;
+    while (true) {
+        for (int x0 = 0; x0 < w; x0 += blockW) {
+            int xEnd = min(x0 + blockW, w);
+            for (int y0 = 0; y0 < h; y0 += blockH) {
+                int yEnd = min(y0 + blockH, h);
+                int numPixels = (xEnd - x0) * (yEnd - y0);
+                for (int i = 0; i < numPixels; i++) blockColor[i] = Vector3f::ZERO;
+                sampleBlock(cam, bvhRoot, bgColor, x0, xEnd, y0, yEnd, passSamples, blockColor, aovs);
+                for (int x = x0, i = 0; x < xEnd; x++) {
+                    for (int y = y0; y < yEnd; y++, i++) film[y * w + x] += blockColor[i];
+                }
+            }
+        }
+        samplesDone += passSamples;
+        for (int x = 0; x < w; ++x) {
+            for (int y = 0; y < h; ++y) {
+                Vector3f pixelColor = film[y * w + x] / samplesDone;
+                img->SetPixel(x, y, Utils::sqrtVec3(pixelColor));   // 伽马纠正
+            }
+        }
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double perSample = elapsed / samplesDone;
+        double remaining = settings.timeBudget - elapsed;
+        printf("[%4d/%4d spp] Time elapsed: %.2f, budget left: %.2f\n", samplesDone, settings.samplesPerPixel,
+               elapsed, remaining);
+        if (settings.checkpointColumns > 0) saveCheckpoint(img, to_string(samplesDone) + "spp" + outputFile);
+        if (samplesDone >= settings.samplesPerPixel || remaining < perSample) break;
+        passSamples = max(1, (int) (remaining * 0.5 / perSample));
+        passSamples = min(passSamples, settings.samplesPerPixel - samplesDone);
+    }
+    return samplesDone;
+}
+
+// 逐列渲染的线程数：--threads，0 表示硬件线程数。material_id 按第一次遇到材质的顺序编号，
+// 请求这个通道时只用一个线程，编号才是确定的
+int renderThreads(const AovBuffers* aovs) {
+    if (aovs != nullptr && aovs->has(materialIdAov)) return 1;
+    return settings.threads > 0 ? settings.threads : max(1u, std::thread::hardware_concurrency());
+}
+
+// 本地渲染一帧（波前、限时或逐列），结果写入 img。seed 为逐列渲染的种子，start 为限时渲染的计时起点
+void renderLocal(Camera* cam, BvhNode* bvhRoot, const Vector3f& bgColor, Image* img, AovBuffers* aovs,
+                 const string& outputFile, unsigned int seed, std::chrono::steady_clock::time_point start) {
+    // 载入已渲染图片
+    int startX = 0;        // 已渲染的x
+    // string loadFilename = "output/temp/ppm/" + to_string(startX) + "empty.ppm";
+    // Image* img = Image::LoadPPM(loadFilename.c_str());    // 载入
+    // int samplesOnStart = 0;    // 已采样次数
+
+    if (settings.wavefront) {
+        // 波前模式一次渲染整幅图
+        WavefrontIntegrator integrator(cam, bvhRoot, bgColor, settings.maxDepth);
+        integrator.sortRays = settings.raySort;
+        integrator.envMap = envMap;
+        vector<Vector3f> film = integrator.render(settings.samplesPerPixel);
+        raysTraced += integrator.getRaysTraced();
+        for (int x = 0; x < cam->getWidth(); ++x) {
+            for (int y = 0; y < cam->getHeight(); ++y) {
+                img->SetPixel(x, y, Utils::sqrtVec3(film[y * cam->getWidth() + x]));   // 伽马纠正
+            }
+        }
+    } else if (settings.timeBudget > 0) {
+        int samplesDone = renderProgressive(cam, bvhRoot, bgColor, img, aovs, outputFile, start);
+        printf("Time budget used: %d samples per pixel\n", samplesDone);
+    } else {
+        // 图片按列切成宽为像素块宽度的条，各线程依次领取。每条用自己的种子（由 seed 和条的序号得到），
+        // 结果与线程数无关。渲染完的一条在锁内写入 img，进度和中间图片也在锁内输出
+        int w = cam->getWidth(), h = cam->getHeight();
+        int blockW = blockWidth(), blockH = settings.packetSize / blockW;
+        int numStrips = (w + blockW - 1) / blockW;
+        int numThreads = max(1, min(renderThreads(aovs), numStrips - startX / blockW));
+        std::atomic<int> nextStrip(startX / blockW);
+        std::mutex imgMutex;
+        int columnsDone = startX;
+        float lastTime = 0;
+        long long workerRays = 0;
+        auto renderStrips = [&]() {
+            vector<Vector3f> strip(blockW * h);
+            Vector3f blockColor[RayPacket::maxSize];
+            long long raysBefore = raysTraced;
+            for (int s = nextStrip++; s < numStrips; s = nextStrip++) {
+                int x0 = s * blockW;
+                int xEnd = min(x0 + blockW, w);
+                Utils::setSeed(Utils::mixSeed(seed, s));
+                for (int y0 = 0; y0 < h; y0 += blockH){      // 下至上
+                    int yEnd = min(y0 + blockH, h);
+                    int numPixels = (xEnd - x0) * (yEnd - y0);
+                    for (int i = 0; i < numPixels; i++) blockColor[i] = Vector3f::ZERO;
+#ifdef RT_STATS
+                    long long nodesBefore = RenderStats::local().bvhNodesVisited + RenderStats::local().packetNodesVisited;
+#endif
+
+                    // 每像素执行多次光线投射
+                    sampleBlock(cam, bvhRoot, bgColor, x0, xEnd, y0, yEnd, settings.samplesPerPixel, blockColor, aovs);
+
+                    // 若载入已采样图片
+                    // Vector3f prevColor = img->GetPixel(x, y);
+                    // prevColor = prevColor * prevColor;    // undo gamma correction
+                    // prevColor *= samplesOnStart;          // undo average 
+                    // pixelColor += prevColor;
+                    // pixelColor /= samplesPerPixel + samplesOnStart;  // average out samples (SSAA)
+
+                    for (int x = x0, i = 0; x < xEnd; x++) {
+                        for (int y = y0; y < yEnd; y++, i++) {
+#ifdef RT_STATS
+                            long long nodesAfter = RenderStats::local().bvhNodesVisited + RenderStats::local().packetNodesVisited;
+                            RenderStats::recordPixel(x, y, (nodesAfter - nodesBefore) / numPixels, settings.samplesPerPixel);
+#endif
+                            Vector3f pixelColor = blockColor[i] / settings.samplesPerPixel;  // 取采样颜色平均
+                            strip[(x - x0) * h + y] = Utils::sqrtVec3(pixelColor);          // 伽马纠正
+                        }
+                    }
+                }
+
+                std::lock_guard<std::mutex> lock(imgMutex);
+                for (int x = x0; x < xEnd; x++) {
+                    for (int y = 0; y < h; y++) img->SetPixel(x, y, strip[(x - x0) * h + y]);
+                }
+                int columnsBefore = columnsDone;
+                columnsDone += xEnd - x0;
+
+                // 每秒输出用时和预计剩余时间
+                float timeElapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+                if (timeElapsed - lastTime > 1.0f) {
+                    lastTime = timeElapsed;
+                    float estTimeLeft = ((float) (w - columnsDone) / columnsDone) * timeElapsed;
+                    printf("[%4d/%4d] ", columnsDone, w);          // 输出已处理多少列像素
+                    printf("Time elapsed: %.2f, Est. time left: %.2f\n", timeElapsed, estTimeLeft);
+                }
+
+                // 每完成 checkpoint 列（默认 10）保存中间图片
+                for (int c = columnsBefore; c < columnsDone && settings.checkpointColumns > 0; c++) {
+                    if (c % settings.checkpointColumns != 0) continue;
+                    saveCheckpoint(img, to_string(c) + outputFile);
+                }
+            }
+            std::lock_guard<std::mutex> lock(imgMutex);
+            workerRays += raysTraced - raysBefore;
+        };
+        vector<std::thread> workers;
+        for (int t = 0; t < numThreads; t++) workers.emplace_back(renderStrips);
+        for (std::thread& t : workers) t.join();
+        raysTraced += workerRays;
+    }
+}
+
+// 一帧渲染完之后：写出 AOV、去噪，保存图片
+void finishFrame(Image* img, AovBuffers* aovs, const string& outputFile) {
+    if (aovs != nullptr) {
+        aovs->resolve();
+        aovs->save(settings.outputDir + "/" + outputFile, settings.aovMask);   // 只写出 --aov 要求的通道
+    }
+    if (settings.denoise) {
+        // 去噪前的图片另外保存，最终结果为去噪后的图片
+        saveImage(img, settings.outputDir + "/" + outputFile + "_noisy");
+        auto denoiseStart = std::chrono::steady_clock::now();
+        Denoiser denoiser;
+        denoiser.threads = settings.threads;
+        vector<float> denoised = denoiser.denoise(*aovs);
+        for (int x = 0; x < img->Width(); ++x) {
+            for (int y = 0; y < img->Height(); ++y) {
+                const float* c = &denoised[(y * img->Width() + x) * 3];
+                Vector3f pixelColor(c[0], c[1], c[2]);
+                img->SetPixel(x, y, Utils::sqrtVec3(pixelColor));   // 伽马纠正
+            }
+        }
+        printf("Denoised in %.3f s\n", std::chrono::duration<double>(std::chrono::steady_clock::now() - denoiseStart).count());
+    }
+    // 保存结果
+    saveImage(img, settings.outputDir + "/" + outputFile);
+    std::cout << "Image saved! File name: " << outputFile.c_str() << endl;
+}
+
+// 交互式预览（--preview）：每遍每像素 1 次采样累加到 film，每遍结束后交给 server，
+// 达到 spp 后等待修改。每列像素之前检查一次修改和场景文件（--watch 1），有修改时放弃这一遍，
+// 应用修改或重新载入场景后清空 film。
+// 修改后先以 8x8、4x4、2x2 的像素块各渲染一遍（每块一条光线，不计入 film），
+// 完整的一遍要几秒时也能在几十毫秒内看到修改的效果。返回停止时的采样数
+int renderPreview(PreviewServer& server, SceneReloader& scene, Image* img) {
+    PerspectiveCamera* cam = scene.getCamera();     // 重新载入时参数写入同一个相机
+    int w = cam->getWidth(), h = cam->getHeight();
+    int blockW = blockWidth(), blockH = settings.packetSize / blockW;
+    vector<Vector3f> film(w * h), pass(w * h);
+    Vector3f blockColor[RayPacket::maxSize];
+    int samplesDone = 0, numUpdates = 0;
+    int coarse = 8;         // 粗略预览的像素块大小，1 表示逐像素累加
+    double passMs = 0, updateMs = 0;
+    bool afterUpdate = false;
+    std::chrono::steady_clock::time_point updateStart;
+    bool reloadPending = false;
+    auto interrupted = [&]() {
+        if (settings.watch && !reloadPending && scene.changed()) reloadPending = true;
+        return reloadPending || server.hasRequests() || server.quitRequested();
+    };
+    server.setSceneInfo(previewSceneInfo(cam, scene.getParser()));
+    while (!server.quitRequested()) {
+        if (samplesDone >= settings.samplesPerPixel && !interrupted()) {
+            server.waitForRequests(SceneReloader::pollMs);
+            continue;
+        }
+        if (reloadPending) {
+            reloadPending = false;
+            auto reloadStart = std::chrono::steady_clock::now();
+            if (scene.reload()) {
+                ++numUpdates;
+                printf("Preview update %d: scene reloaded\n", numUpdates);
+                if (!afterUpdate) updateStart = reloadStart;
+                afterUpdate = true;
+                std::fill(film.begin(), film.end(), Vector3f::ZERO);
+                samplesDone = 0;
+                coarse = 8;
+                server.setSceneInfo(previewSceneInfo(cam, scene.getParser()));
+            }
+            fflush(stdout);
+            continue;
+        }
+        vector<shared_ptr<PreviewRequest>> requests = server.takeRequests();
+        if (!requests.empty()) {
+            bool changed = false;
+            for (auto& r : requests) {
+                if (applyPreviewRequest(*r, cam, scene.getParser())) {
+                    changed = true;
+                    ++numUpdates;
+                    printf("Preview update %d: %s\n", numUpdates, r->target.c_str());
+                    if (!afterUpdate) updateStart = r->received;   // 从最早的未显示的修改开始计时
+                    afterUpdate = true;
+                } else {
+                    printf("Preview update rejected: %s\n", r->error.c_str());
+                }
+            }
+            server.finish(requests);
+            if (changed) {
+                // 只改相机和材质，场景的几何和 BVH 不变
+                std::fill(film.begin(), film.end(), Vector3f::ZERO);
+                samplesDone = 0;
+                coarse = 8;
+                server.setSceneInfo(previewSceneInfo(cam, scene.getParser()));
+            }
+            continue;
+        }
+
+        BvhNode* bvhRoot = scene.getBvh();
+        Vector3f bgColor = scene.getBackgroundColor();
+        auto passStart = std::chrono::steady_clock::now();
+        bool stopped = false;
+        if (coarse > 1) {
+            // 每个 coarse x coarse 的块以中心像素的一次采样填满
+            for (int x0 = 0; x0 < w && !stopped; x0 += coarse) {
+                stopped = interrupted();
+                for (int y0 = 0; y0 < h && !stopped; y0 += coarse) {
+                    int xc = min(x0 + coarse / 2, w - 1), yc = min(y0 + coarse / 2, h - 1);
+                    blockColor[0] = Vector3f::ZERO;
+                    sampleBlock(cam, bvhRoot, bgColor, xc, xc + 1, yc, yc + 1, 1, blockColor);
+                    Vector3f pixelColor = Utils::sqrtVec3(blockColor[0]);   // 伽马纠正
+                    for (int x = x0; x < min(x0 + coarse, w); x++) {
+                        for (int y = y0; y < min(y0 + coarse, h); y++) img->SetPixel(x, y, pixelColor);
+                    }
+                }
+            }
+            if (stopped) continue;
+            coarse /= 2;
+        } else {
+            for (int x0 = 0; x0 < w && !stopped; x0 += blockW) {
+                stopped = interrupted();
+                int xEnd = min(x0 + blockW, w);
+                for (int y0 = 0; y0 < h && !stopped; y0 += blockH) {
+                    int yEnd = min(y0 + blockH, h);
+                    int numPixels = (xEnd - x0) * (yEnd - y0);
+                    for (int i = 0; i < numPixels; i++) blockColor[i] = Vector3f::ZERO;
+                    sampleBlock(cam, bvhRoot, bgColor, x0, xEnd, y0, yEnd, 1, blockColor);
+                    for (int x = x0, i = 0; x < xEnd; x++) {
+                        for (int y = y0; y < yEnd; y++, i++) pass[y * w + x] = blockColor[i];
+                    }
+                }
+            }
+            if (stopped) continue;   // 这一遍不完整，不计入 film
+
+            samplesDone++;
+            for (int x = 0; x < w; ++x) {
+                for (int y = 0; y < h; ++y) {
+                    film[y * w + x] += pass[y * w + x];
+                    Vector3f pixelColor = film[y * w + x] / samplesDone;
+                    img->SetPixel(x, y, Utils::sqrtVec3(pixelColor));   // 伽马纠正
+                }
+            }
+            passMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - passStart).count();
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (afterUpdate) {
+            updateMs = std::chrono::duration<double, std::milli>(now - updateStart).count();
+            printf("Preview update %d: first frame after %.1f ms\n", numUpdates, updateMs);
+            afterUpdate = false;
+        }
+        server.publish(*img, samplesDone, passMs, updateMs);
+        if (samplesDone == settings.samplesPerPixel && coarse == 1) printf("Preview: converged at %d spp\n", samplesDone);
+        fflush(stdout);
+    }
+    return samplesDone;
+}
+
+// 从相机位置向各个方向（球面 Fibonacci 点）发出光线，全部被场景挡住时相机被完全包围，
+// 无穷远处的环境光照不进场景。在建立 BVH 之前直接对 Group 求交，不消耗随机数
+bool cameraEnclosed(Group* grp, const Vector3f& origin) {
+    const int numDirections = 256;
+    for (int i = 0; i < numDirections; i++) {
+        float z = 1 - (2 * i + 1.0f) / numDirections;
+        float r = sqrt(max(0.0f, 1 - z * z));
+        float phi = i * 2.39996323f;   // 黄金角
+        Ray ray(origin, Vector3f(r * cos(phi), r * sin(phi), z));
+        Hit hit;
+        if (!grp->intersect(ray, hit, 1e-3f, INF)) return false;
+    }
+    return true;
 }
 
 int main(int argc, char *argv[]) {
@@ -48,100 +590,228 @@ int main(int argc, char *argv[]) {
         std::cout << "Argument " << argNum << " is: " << argv[argNum] << std::endl;
     }
 
-    if (argc != 3) {
-        std::cout << "Usage: ./bin/PA1 <input scene file> <output bmp file>" << endl;
+    if (argc < 3) {
+        RenderSettings::printUsage();
         return 1;
     }
     string inputFile = argv[1];
     string outputFile = argv[2];  // 无文件格式
+    if (!settings.parseArgs(argc, argv, 3)) return 1;
+
+    // 场景中的物体、材质、纹理和 BVH 都分配在 sceneArena 中，main 结束时一起释放
+    Arena sceneArena;
+    ArenaScope arenaScope(sceneArena);
+    TextureManager::instance().setLinearize(settings.textureLinear);
 
     // 解析场景文件（txt）
     cout << "Parsing scene...\n";
-    SceneParser sceneParser(inputFile.c_str());
+    auto parseStart = std::chrono::steady_clock::now();
+    unique_ptr<SceneParser> parsedScene;
+    try {
+        parsedScene.reset(new SceneParser(inputFile.c_str(), &settings));    // 场景文件中的 RenderSettings 块写入 settings
+    } catch (const SceneError& e) {
+        printf("%s\n", e.what());
+        return 1;
+    }
+    SceneParser& sceneParser = *parsedScene;
     Camera *cam = sceneParser.getCamera();
     Group* grp = sceneParser.getGroup();
     Image* img = new Image(cam->getWidth(), cam->getHeight());    // 无已渲染图片 
-    cout << "Done parsing scene\n";
+    printf("Done parsing scene (%.3f s)\n", std::chrono::duration<double>(std::chrono::steady_clock::now() - parseStart).count());
 
-    // 载入已渲染图片
-    int startX = 0;        // 已渲染的x
-    // string loadFilename = "output/temp/ppm/" + to_string(startX) + "empty.ppm";
-    // Image* img = Image::LoadPPM(loadFilename.c_str());    // 载入
-    // int samplesOnStart = 0;    // 已采样次数
+    // 程序化修改场景（--generator none 时只渲染场景文件的内容）
+    SceneGenerator sceneGen;   // 场景生成器（比较简陋）
+    sceneGen.useEnvironmentLight = settings.envLight;
+    if (settings.generator == RenderSettings::scene1Generator) {
+        sceneGen.getScene1(grp);   // 一个 Minecraft 场景，小屋子，有矿的洞口
+    } else if (settings.generator == RenderSettings::worldGenerator) {
+        // 程序化生成的体素世界，每个区块一个物体
+        auto worldStart = std::chrono::steady_clock::now();
+        VoxelWorld* world = sceneGen.getWorld(grp, settings.worldChunks, settings.worldHeight, settings.worldSeed, settings.threads);
+        long long solid = 0;
+        for (int b = airVoxel + 1; b < numVoxelBlocks; b++) solid += world->countBlocks((VoxelBlock) b);
+        printf("Generated voxel world: %dx%dx%d blocks, %lld solid, %.1f MB (%.3f s)\n", world->sizeX(), world->getHeight(),
+               world->sizeZ(), solid, world->getBytes() / 1048576.0,
+               std::chrono::duration<double>(std::chrono::steady_clock::now() - worldStart).count());
+    }
+    if (sceneGen.environment != nullptr && cameraEnclosed(grp, cam->getCenter())) {
+        cout << "Environment light: the camera is enclosed by scene geometry, using the sky sphere instead\n";
+        sceneGen.replaceEnvironmentWithSphere(grp);
+    }
+    envMap = sceneGen.environment;
+    if (grp->getGroupSize() == 0) {
+        cout << "Scene has no objects (--generator none with an empty scene file)\n";
+        return 1;
+    }
 
+    if (settings.frames > 1 && (settings.servePort >= 0 || !settings.workerAddress.empty())) {
+        cout << "--frames: not supported with --serve or --worker\n";
+        return 1;
+    }
+    if (settings.previewPort >= 0) {
+        if (settings.servePort >= 0 || !settings.workerAddress.empty() || settings.frames > 1) {
+            cout << "--preview: not supported with --serve, --worker or --frames\n";
+            return 1;
+        }
+        if (settings.wavefront) {
+            cout << "--preview: uses the recursive integrator, --integrator wavefront ignored\n";
+            settings.wavefront = false;
+        }
+    }
 
-    // 程序化修改场景...
-    SceneGenerator sceneGen;   // 场景生成器（比较简陋）
-    sceneGen.getScene1(grp);   // 一个 Minecraft 场景，小屋子，有矿的洞口
-    
+    // 通道只由本地的递归积分器填写
+    if ((settings.aovMask != 0 || settings.denoise) && (settings.servePort >= 0 || settings.previewPort >= 0 || settings.wavefront)) {
+        cout << "AOVs / denoiser: not supported with --serve, --preview or --integrator wavefront, disabled\n";
+        settings.aovMask = 0;
+        settings.denoise = false;
+    }
+    AovBuffers* aovs = nullptr;
+    if (settings.aovMask != 0 || settings.denoise) {
+        aovs = new AovBuffers(cam->getWidth(), cam->getHeight(), settings.aovMask | (settings.denoise ? Denoiser::requiredAovs : 0));
+        // 物体编号按 Group 中的顺序，要在建立 BVH（会重排物体）之前记录
+        aovs->setObjects(grp->getObjects());
+        for (int i = 0; i < sceneParser.getNumMaterials(); i++) aovs->addMaterial(sceneParser.getMaterial(i));
+    }
 
 
     cout << "Camera resolution: " << cam->getWidth() << "x" << cam->getHeight() << "\n";
     cout << "Number of objects in scene: " << grp->getGroupSize() << "\n";
-    cout << "Sampling per pixel: " << samplesPerPixel << "\n";
-    cout << "Raytracing max bounce: " << maxDepth << "\n";
+    cout << "Sampling per pixel: " << settings.samplesPerPixel << "\n";
+    cout << "Raytracing max bounce: " << settings.maxDepth << "\n";
+    cout << "Accelerator: " << (settings.sahBvh ? "SAH BVH" : "median-split BVH") << "\n";
+    cout << "Integrator: " << (settings.wavefront ? (settings.raySort ? "wavefront (sorted)" : "wavefront (unsorted)") : "recursive") << "\n";
+    if (!settings.wavefront) cout << "Camera ray packet size: " << settings.packetSize << "\n";
+    cout << "Environment light: " << (envMap != nullptr ? "importance sampled" : "none") << "\n";
+    if (settings.timeBudget > 0) cout << "Time budget: " << settings.timeBudget << " s\n";
+    if (settings.frames > 1 || settings.shutter > 0 || sceneParser.getNumAnimated() > 0) {
+        printf("Animation: %d frame(s) from time %g, step %g, shutter %g, %d animated object(s)\n", settings.frames,
+               settings.startTime, settings.frameStep, settings.shutter, sceneParser.getNumAnimated());
+    }
+    if (settings.aovMask != 0) {
+        cout << "AOVs:";
+        for (int t = 0; t < numAovs; t++) {
+            if ((settings.aovMask >> t) & 1u) cout << " " << AovBuffers::name((AovType) t);
+        }
+        cout << "\n";
+    }
+
+    // 用于计时（墙钟时间，RT_STATS 的统计也用它）
+    auto wallStart = std::chrono::steady_clock::now();
+
+    // 预览时重新载入场景要保留 SceneGenerator 加入的物体，在建立 BVH（可能重排 Group）之前记下
+    vector<Object3D*> generated(grp->getObjects().begin() + sceneParser.getRootObjects().size(), grp->getObjects().end());
 
-    // 用于计时
-    clock_t startTime = clock();
-    float lastTime = 0;
+    // 第一帧的快门区间：运动的物体按它计算包围盒，要在建立 BVH 之前设置
+    Shutter::set(settings.startTime, settings.startTime + settings.shutter);
 
     // 建立BVH树
     cout << "Building BVH Tree for scene...\n";
-    BvhNode* bvhRoot = new BvhNode(grp);         //  求交加速：对整个场景的 Group （所有物体）建立 BVH 树
+    BvhNode* bvhRoot = BvhNode::build(grp, settings.sahBvh);   //  求交加速：对整个场景的 Group （所有物体）建立 BVH 树
     cout << "Done building BVH Tree\n";
+    sceneArena.printReport("Scene memory");
 
-    Vector3f bgColor = Vector3f::ZERO;
+    Vector3f bgColor = sceneParser.getBackgroundColor();   // 场景文件的 Background 块，没有环境光时未击中的光线取这个颜色
 
-    // 遍历像素
-    for (int x = startX; x < cam->getWidth(); ++x){    // 左至右
-        for (int y = 0; y < cam->getHeight(); ++y){      // 下至上
-            Vector3f pixelColor = Vector3f::ZERO;
+#ifdef RT_STATS
+    RenderStats::initPixels(cam->getWidth(), cam->getHeight());
+#endif
 
-            // 每像素(x,y)执行多次光线投射
-            for (int s = 0; s < samplesPerPixel; s++){
-                Vector2f screenPoint(x + Utils::randomFloat(), y + Utils::randomFloat()); // 景深效果
-                Ray camRay = cam->generateRay(screenPoint);                               // 光线投射
-                pixelColor += rayTrace(camRay, bvhRoot, bgColor, maxDepth);               // 执行光线跟踪
-            }
-
-            // 若载入已采样图片
-            // Vector3f prevColor = img->GetPixel(x, y);
-            // prevColor = prevColor * prevColor;    // undo gamma correction
-            // prevColor *= samplesOnStart;          // undo average 
-            // pixelColor += prevColor;
-            // pixelColor /= samplesPerPixel + samplesOnStart;  // average out samples (SSAA)
-
-            pixelColor /= samplesPerPixel;                     // 取采样颜色平均
-            pixelColor = Utils::sqrtVec3(pixelColor);          // 伽马纠正
-            img->SetPixel(x, y, pixelColor);
+    RenderUnitFn unitRenderer = [&](const WorkUnit& unit, float* accum) {
+        return renderUnit(cam, bvhRoot, bgColor, unit, accum);
+    };
+    if (!settings.workerAddress.empty()) {
+        // 工作者：只渲染协调者分配的单元，不写图片
+        return runRenderWorker(settings.workerAddress, sceneFileHash(inputFile.c_str()), cam->getWidth(), cam->getHeight(),
+                               unitRenderer);
+    }
 
-            // 每秒计算并输出用时和预计剩余时间
-            float timeElapsed = Utils::getTimeElapsed(startTime);
-            if (timeElapsed - lastTime > 1.0f) { 
-                lastTime += 1.0f;
-                float estTimeLeft = (((float) cam->getWidth() - x) / (x+1)) * timeElapsed;
-                printf("[%4d/%4d] ", x, cam->getWidth());          // 输出已处理多少列像素
-                printf("Time elapsed: %.2f, Est. time left: %.2f\n", timeElapsed, estTimeLeft);
+    if (settings.servePort >= 0) {
+        // 协调者：工作者的命令行与本进程相同，去掉 --serve / --spawn / --bind
+        RenderCoordinator coordinator(cam->getWidth(), cam->getHeight(), settings.samplesPerPixel, settings.seed,
+                                      sceneFileHash(inputFile.c_str()));
+        coordinator.tileSize = settings.tileSize;
+        coordinator.unitTimeout = settings.unitTimeout;
+        if (!coordinator.listen(settings.bindAddress, settings.servePort)) return 1;
+        if (settings.spawnCount > 0) {
+            vector<string> workerArgs;
+            for (int i = 0; i < argc; i++) {
+                if ((!strcmp(argv[i], "--serve") || !strcmp(argv[i], "--spawn") || !strcmp(argv[i], "--bind")) && i + 1 < argc) {
+                    i++;
+                    continue;
+                }
+                workerArgs.push_back(argv[i]);
             }
+            coordinator.spawnWorkers(settings.spawnCount, workerArgs);
         }
-
-        // 每10列保存中间图片
-        if ((x) % 10 == 0) {
-            string fnamebmp = "output/temp/bmp/" + to_string(x) + outputFile + ".bmp";
-            string fnameppm = "output/temp/ppm/" + to_string(x) + outputFile + ".ppm";
-            std::cout << "Image saved! File name: " << fnamebmp.c_str() << endl;
-            std::cout << "Image saved! File name: " << fnameppm.c_str() << endl;
-            img->SaveBMP(fnamebmp.c_str());
-            img->SavePPM(fnameppm.c_str());
+        vector<float> film = coordinator.run(unitRenderer);
+        raysTraced = coordinator.getRaysTraced();   // 包括协调者自己渲染的单元
+        for (int x = 0; x < cam->getWidth(); ++x) {
+            for (int y = 0; y < cam->getHeight(); ++y) {
+                const float* c = &film[(y * cam->getWidth() + x) * 3];
+                Vector3f pixelColor = Vector3f(c[0], c[1], c[2]) / settings.samplesPerPixel;
+                img->SetPixel(x, y, Utils::sqrtVec3(pixelColor));   // 伽马纠正
+            }
+        }
+        finishFrame(img, aovs, outputFile);
+    } else if (settings.previewPort >= 0) {
+        // 预览：直到收到 POST /quit，之后写出当前图片。场景文件只有 PerspectiveCamera 一种相机
+        PreviewServer server;
+        if (!server.start(settings.previewPort)) return 1;
+        SceneReloader scene(inputFile, &sceneParser, generated, bvhRoot, settings.sahBvh, settings.refitThreshold);
+        if (settings.watch) printf("Preview: watching %d scene file(s) for changes\n", (int) sceneParser.getDependencies().size());
+        int samplesDone = renderPreview(server, scene, img);
+        server.stop();
+        printf("Preview stopped at %d spp\n", samplesDone);
+        finishFrame(img, aovs, outputFile);
+    } else {
+        // 本地渲染：--frames N 时场景只解析一次、BVH 只建一次，依次渲染 N 帧。
+        // 换帧后先 refit BVH，节点表面积平均增长超过 refit-threshold 倍（SAH 代价明显升高）才重新建树
+        Arena frameArena;   // 换帧后重新建立的 BVH，再次重建时释放
+        for (int frame = 0; frame < settings.frames; frame++) {
+            string frameName = outputFile;
+            auto frameStart = std::chrono::steady_clock::now();
+            if (settings.frames > 1) {
+                char suffix[16];
+                snprintf(suffix, sizeof(suffix), "_%04d", frame);
+                frameName += suffix;
+            }
+            if (frame > 0) {
+                float t = settings.startTime + frame * settings.frameStep;
+                Shutter::set(t, t + settings.shutter);
+                if (sceneParser.getNumAnimated() > 0) {
+                    bvhRoot->refit();
+                    float growth = bvhRoot->refitGrowth();
+                    bool rebuild = growth > settings.refitThreshold;
+                    if (rebuild) {
+                        frameArena.reset();
+                        ArenaScope frameScope(frameArena);
+                        bvhRoot = BvhNode::build(grp, settings.sahBvh);
+                    }
+                    printf("Frame %d: time %g, BVH %s, node area x%.2f since build (%.3f ms)\n", frame, t,
+                           rebuild ? "rebuilt" : "refit", growth,
+                           std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+                }
+                if (aovs != nullptr) aovs->clear();
+            }
+            renderLocal(cam, bvhRoot, bgColor, img, aovs, frameName, settings.seed + frame, frame == 0 ? wallStart : frameStart);
+            finishFrame(img, aovs, frameName);
+            if (settings.frames > 1) {
+                printf("Frame %d done (%.3f s)\n", frame, std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count());
+            }
         }
     }
+    delete aovs;
 
-    // 保存最终结果
-    string fnamebmp = "output/" + outputFile + ".bmp";
-    string fnameppm = "output/" + outputFile + ".ppm";
-    img->SaveBMP(fnamebmp.c_str());
-    img->SavePPM(fnameppm.c_str());
-    std::cout << "Image saved! File name: " << outputFile.c_str() << endl;
+    // 供 bench/bench_scenes.py 解析的汇总信息
+    double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    printf("Render summary: time %.3f s, rays %lld, %.3f Mrays/s\n",
+           wallTime, raysTraced, wallTime > 0 ? raysTraced / wallTime * 1e-6 : 0.0);
+    TextureManager::instance().printReport();
+
+#ifdef RT_STATS
+    RenderStats::report((float) wallTime);
+    RenderStats::saveHeatmaps((settings.outputDir + "/" + outputFile + "_stats").c_str());
+#endif
     return 0;
 }
 
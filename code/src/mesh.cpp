@@ -5,6 +5,7 @@
 #include <cstdlib>
 #include <utility>
 #include <sstream>   // read obj file
+#include "arena.hpp"
 
 bool Mesh::intersect(const Ray &r, Hit &h, float tmin, float tmax) {
     return tree->intersect(r, h, tmin, tmax);
@@ -75,13 +76,16 @@ Mesh::Mesh(const char *filename, Material *material) : Object3D(material) {
     computeTriangles(vertices, faces);
 
     objType = mesh;
-    tree = new BvhNode(triangles, 0, triangles.size());
+    tree = arenaNew<BvhNode>(arenaAccel, triangles, 0, triangles.size());
+    Arena::current().addExternal(arenaGeometry, triangleStore.capacity() * sizeof(Triangle) + triangles.capacity() * sizeof(Triangle*));
 
     cout << "Loaded Mesh with " << triangles.size() << " trianges\n";
 }
 
 void Mesh::computeTriangles(vector<Vector3f>& vertices, vector<Vector3f>& faces) {
     triangles = vector<Triangle*>(faces.size());
+    triangleStore.clear();
+    triangleStore.reserve(faces.size());   // 之后不再扩容，triangles 里的指针保持有效
     Vector3f normal;
     for (int i = 0; i < faces.size(); i++) {
         Vector3f& face = faces[i];
@@ -89,7 +93,8 @@ void Mesh::computeTriangles(vector<Vector3f>& vertices, vector<Vector3f>& faces)
         Vector3f v1 = vertices[face[1]];
         Vector3f v2 = vertices[face[2]];
 
-        triangles[i] = new Triangle(v0, v1, v2, material);
+        triangleStore.emplace_back(v0, v1, v2, material);
+        triangles[i] = &triangleStore.back();
         Vector3f a = v1 - v0;
         Vector3f b = v2 - v0;
         b = Vector3f::cross(a, b);
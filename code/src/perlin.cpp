@@ -0,0 +1,125 @@
+#include "perlin.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PERLIN_SSE
+#endif
+
+#ifdef PERLIN_SSE
+namespace {
+
+inline __m128 select4(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline __m128 fade4(__m128 t) {
+    // t * t * t * (t * (t * 6 - 15) + 10)，运算顺序与 Perlin::fade 相同
+    __m128 inner = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6)), _mm_set1_ps(15))), _mm_set1_ps(10));
+    return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+}
+
+inline __m128 lerp4(__m128 t, __m128 a, __m128 b) {
+    return _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a)));
+}
+
+// 截断取整再修正为向下取整（SSE2 没有 floor）
+inline __m128 floor4(__m128 x) {
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1)));
+}
+
+// 与 Perlin::grad 相同的棱方向选择，4 个 hash 一起算
+inline __m128 grad4(__m128i hash, __m128 x, __m128 y, __m128 z) {
+    __m128i h = _mm_and_si128(hash, _mm_set1_epi32(15));
+    __m128 lt8 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(8)));
+    __m128 lt4 = _mm_castsi128_ps(_mm_cmplt_epi32(h, _mm_set1_epi32(4)));
+    __m128 useX = _mm_castsi128_ps(_mm_or_si128(_mm_cmpeq_epi32(h, _mm_set1_epi32(12)),
+                                                _mm_cmpeq_epi32(h, _mm_set1_epi32(14))));
+    __m128 u = select4(lt8, x, y);
+    __m128 v = select4(lt4, y, select4(useX, x, z));
+    // h & 1、h & 2 移到符号位上
+    __m128 signU = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(1)), 31));
+    __m128 signV = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(2)), 30));
+    return _mm_add_ps(_mm_xor_ps(u, signU), _mm_xor_ps(v, signV));
+}
+
+} // namespace
+#endif
+
+void Perlin::noise(const float* x, const float* y, const float* z, float* out, int n) const {
+    int i = 0;
+#ifdef PERLIN_SSE
+    const __m128 one = _mm_set1_ps(1);
+    for (; i + 4 <= n; i += 4) {
+        __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+        __m128 fx = floor4(px), fy = floor4(py), fz = floor4(pz);
+        alignas(16) int X[4], Y[4], Z[4];
+        __m128i mask = _mm_set1_epi32(255);
+        _mm_store_si128((__m128i*) X, _mm_and_si128(_mm_cvttps_epi32(fx), mask));
+        _mm_store_si128((__m128i*) Y, _mm_and_si128(_mm_cvttps_epi32(fy), mask));
+        _mm_store_si128((__m128i*) Z, _mm_and_si128(_mm_cvttps_epi32(fz), mask));
+
+        // 置换表查找没有 SSE2 指令可用（没有 gather），逐个计算 8 个角的 hash
+        alignas(16) int h[8][4];
+        for (int k = 0; k < 4; k++) {
+            int A = perm[X[k]] + Y[k], AA = perm[A] + Z[k], AB = perm[A + 1] + Z[k];
+            int B = perm[X[k] + 1] + Y[k], BA = perm[B] + Z[k], BB = perm[B + 1] + Z[k];
+            h[0][k] = perm[AA];
+            h[1][k] = perm[BA];
+            h[2][k] = perm[AB];
+            h[3][k] = perm[BB];
+            h[4][k] = perm[AA + 1];
+            h[5][k] = perm[BA + 1];
+            h[6][k] = perm[AB + 1];
+            h[7][k] = perm[BB + 1];
+        }
+
+        px = _mm_sub_ps(px, fx);
+        py = _mm_sub_ps(py, fy);
+        pz = _mm_sub_ps(pz, fz);
+        __m128 qx = _mm_sub_ps(px, one), qy = _mm_sub_ps(py, one), qz = _mm_sub_ps(pz, one);
+        __m128 u = fade4(px), v = fade4(py), w = fade4(pz);
+        __m128i* hv = (__m128i*) h;
+        __m128 g0 = grad4(_mm_load_si128(hv + 0), px, py, pz);
+        __m128 g1 = grad4(_mm_load_si128(hv + 1), qx, py, pz);
+        __m128 g2 = grad4(_mm_load_si128(hv + 2), px, qy, pz);
+        __m128 g3 = grad4(_mm_load_si128(hv + 3), qx, qy, pz);
+        __m128 g4 = grad4(_mm_load_si128(hv + 4), px, py, qz);
+        __m128 g5 = grad4(_mm_load_si128(hv + 5), qx, py, qz);
+        __m128 g6 = grad4(_mm_load_si128(hv + 6), px, qy, qz);
+        __m128 g7 = grad4(_mm_load_si128(hv + 7), qx, qy, qz);
+        __m128 r = lerp4(w, lerp4(v, lerp4(u, g0, g1), lerp4(u, g2, g3)),
+                            lerp4(v, lerp4(u, g4, g5), lerp4(u, g6, g7)));
+        _mm_storeu_ps(out + i, r);
+    }
+#endif
+    for (; i < n; i++) out[i] = noise(x[i], y[i], z[i]);
+}
+
+void Perlin::fbm(const float* x, const float* y, const float* z, float* out, int n,
+                 int octaves, float lacunarity, float gain) const {
+    // 每层把坐标缩放后整批求噪声，按块处理以便放在栈上
+    const int block = 64;
+    float sx[block], sy[block], sz[block], layer[block];
+    for (int start = 0; start < n; start += block) {
+        int m = n - start < block ? n - start : block;
+        float* dst = out + start;
+        for (int i = 0; i < m; i++) dst[i] = 0;
+        float amp = 1, norm = 0, freq = 1;
+        for (int o = 0; o < octaves; o++) {
+            for (int i = 0; i < m; i++) {
+                sx[i] = x[start + i] * freq;
+                sy[i] = y[start + i] * freq;
+                sz[i] = z[start + i] * freq;
+            }
+            noise(sx, sy, sz, layer, m);
+            for (int i = 0; i < m; i++) dst[i] += amp * layer[i];
+            norm += amp;
+            amp *= gain;
+            freq *= lacunarity;
+        }
+        if (norm > 0) {
+            for (int i = 0; i < m; i++) dst[i] /= norm;
+        }
+    }
+}
@@ -0,0 +1,583 @@
+#include "preview.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "arena.hpp"
+#include "image.hpp"
+#include "scene_parser.hpp"
+
+namespace {
+
+const int maxRequestBytes = 64 * 1024;
+const int receiveTimeoutSeconds = 5;
+const int applyTimeoutSeconds = 10;     // POST 等待渲染线程应用修改的上限
+
+const char* indexPage = R"(<!DOCTYPE html>
+<html><head><meta charset="utf-8"><title>PA1 preview</title>
+<style>
+body { font-family: sans-serif; margin: 16px; }
+form { margin: 8px 0; }
+label { display: inline-block; margin-right: 12px; }
+input[type=text] { width: 110px; }
+#frame { image-rendering: pixelated; border: 1px solid #888; }
+</style></head>
+<body>
+<img id="frame" src="/stream">
+<div id="status">connecting...</div>
+<form id="camera">
+  <b>Camera</b><br>
+  <label>center <input type="text" name="center"></label>
+  <label>direction <input type="text" name="direction"></label>
+  <label>up <input type="text" name="up"></label><br>
+  <label>angle <input type="text" name="angle"></label>
+  <label>aperture <input type="text" name="aperture"></label>
+  <label>focusDistance <input type="text" name="focusDistance"></label>
+  <button>apply</button>
+</form>
+<form id="material">
+  <b>Material</b><br>
+  <label>index <select name="index"></select></label>
+  <label>color <input type="text" name="color"></label>
+  <label>texture <input type="text" name="texture"></label>
+  <label>fuzziness <input type="text" name="fuzziness"></label>
+  <label>refractionIndex <input type="text" name="refractionIndex"></label>
+  <button>apply</button>
+</form>
+<div id="result"></div>
+<script>
+let scene = null;
+function fill(form, values) {
+  for (const el of form.elements) {
+    if (el.name && el.name !== 'index' && el.name in values) el.value = values[el.name];
+    else if (el.name && el.name !== 'index') el.value = '';
+  }
+}
+function showMaterial() {
+  const form = document.getElementById('material');
+  const m = scene.materials[form.index.value];
+  if (m) fill(form, m);
+}
+async function loadScene() {
+  scene = await (await fetch('/scene')).json();
+  fill(document.getElementById('camera'), scene.camera);
+  const select = document.getElementById('material').index;
+  const current = select.value;
+  select.innerHTML = '';
+  for (const m of scene.materials) select.add(new Option(m.index + ' ' + m.type, m.index));
+  if (current !== '') select.value = current;
+  showMaterial();
+}
+for (const id of ['camera', 'material']) {
+  document.getElementById(id).addEventListener('submit', async (e) => {
+    e.preventDefault();
+    const body = new URLSearchParams();
+    for (const [k, v] of new FormData(e.target)) if (v !== '') body.append(k, v);
+    const r = await fetch('/' + id, {method: 'POST', body: body});
+    document.getElementById('result').textContent = await r.text();
+    loadScene();
+  });
+}
+document.getElementById('material').index.addEventListener('change', showMaterial);
+setInterval(async () => {
+  const s = await (await fetch('/status')).json();
+  document.getElementById('status').textContent = s.width + 'x' + s.height + ', ' + s.spp + ' spp, ' +
+      s.passMs.toFixed(1) + ' ms/pass, last update ' + s.updateMs.toFixed(1) + ' ms to first frame';
+}, 500);
+loadScene();
+</script>
+</body></html>
+)";
+
+bool sendAll(int fd, const void* data, size_t size) {
+    const char* p = (const char*) data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool sendResponse(int fd, int status, const char* contentType, const void* body, size_t size) {
+    const char* reason = status == 200 ? "OK" : (status == 400 ? "Bad Request" : (status == 404 ? "Not Found" :
+                         (status == 503 ? "Service Unavailable" : "Error")));
+    char header[256];
+    int n = snprintf(header, sizeof(header),
+                     "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                     "Cache-Control: no-store\r\nConnection: close\r\n\r\n", status, reason, contentType, size);
+    return sendAll(fd, header, n) && sendAll(fd, body, size);
+}
+
+bool sendText(int fd, int status, const std::string& text) {
+    return sendResponse(fd, status, "text/plain; charset=utf-8", text.data(), text.size());
+}
+
+int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// application/x-www-form-urlencoded 的一项
+std::string urlDecode(const std::string& s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '+') {
+            out += ' ';
+        } else if (s[i] == '%' && i + 2 < s.size() && hexDigit(s[i + 1]) >= 0 && hexDigit(s[i + 2]) >= 0) {
+            out += (char) (hexDigit(s[i + 1]) * 16 + hexDigit(s[i + 2]));
+            i += 2;
+        } else {
+            out += s[i];
+        }
+    }
+    return out;
+}
+
+std::map<std::string, std::string> parseForm(const std::string& body) {
+    std::map<std::string, std::string> fields;
+    size_t start = 0;
+    while (start < body.size()) {
+        size_t end = body.find('&', start);
+        if (end == std::string::npos) end = body.size();
+        std::string item = body.substr(start, end - start);
+        start = end + 1;
+        if (item.empty()) continue;
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            fields[urlDecode(item)] = "";
+        } else {
+            fields[urlDecode(item.substr(0, eq))] = urlDecode(item.substr(eq + 1));
+        }
+    }
+    return fields;
+}
+
+bool parseNumber(const std::string& text, float& out) {
+    char* end = nullptr;
+    out = strtof(text.c_str(), &end);
+    while (end != nullptr && (*end == ' ' || *end == '\t')) end++;
+    return end != text.c_str() && *end == '\0' && std::isfinite(out);
+}
+
+// "x y z" 或 "x,y,z"
+bool parseVector(const std::string& text, Vector3f& out) {
+    const char* p = text.c_str();
+    for (int i = 0; i < 3; i++) {
+        while (*p == ' ' || *p == ',' || *p == '\t') p++;
+        char* end = nullptr;
+        out[i] = strtof(p, &end);
+        if (end == p || !std::isfinite(out[i])) return false;
+        p = end;
+    }
+    while (*p == ' ' || *p == '\t') p++;
+    return *p == '\0';
+}
+
+std::string formatVector(const Vector3f& v) {
+    char buf[96];
+    snprintf(buf, sizeof(buf), "%g %g %g", v.x(), v.y(), v.z());
+    return buf;
+}
+
+const char* materialTypeName(MaterialType t) {
+    switch (t) {
+        case lambertMat: return "Lambert";
+        case metalMat: return "Metal";
+        case dielectricMat: return "Dielectric";
+        case emissiveMat: return "Emissive";
+        default: return "other";
+    }
+}
+
+bool applyCamera(PreviewRequest& r, PerspectiveCamera* cam) {
+    Vector3f center = cam->getCenter(), direction = cam->getDirection(), up = cam->getUp();
+    float angle = cam->getAngle() * 180 / M_PI;
+    float aperture = cam->getAperture(), focusDist = cam->getFocusDistance();
+    for (const auto& f : r.fields) {
+        const std::string& k = f.first;
+        bool ok;
+        if (k == "center") {
+            ok = parseVector(f.second, center);
+        } else if (k == "direction") {
+            ok = parseVector(f.second, direction) && direction.length() > 0;
+        } else if (k == "up") {
+            ok = parseVector(f.second, up);
+        } else if (k == "angle") {
+            ok = parseNumber(f.second, angle) && angle > 0 && angle < 180;
+        } else if (k == "aperture") {
+            ok = parseNumber(f.second, aperture) && aperture >= 0;
+        } else if (k == "focusDistance") {
+            ok = parseNumber(f.second, focusDist) && focusDist > 0;
+        } else {
+            r.error = "unknown camera field '" + k + "'";
+            return false;
+        }
+        if (!ok) {
+            r.error = "invalid " + k + " '" + f.second + "'";
+            return false;
+        }
+    }
+    if (Vector3f::cross(direction, up).length() < 1e-6f * direction.length() * up.length()) {
+        r.error = "up must not be parallel to direction";
+        return false;
+    }
+    *cam = PerspectiveCamera(center, direction, up, cam->getWidth(), cam->getHeight(), angle * M_PI / 180, aperture, focusDist);
+    return true;
+}
+
+bool applyMaterial(PreviewRequest& r, SceneParser& parser) {
+    auto it = r.fields.find("index");
+    int index = -1;
+    float value;
+    if (it == r.fields.end() || !parseNumber(it->second, value) || value != (int) value ||
+        value < 0 || value >= parser.getNumMaterials()) {
+        r.error = "index must be a material index in [0, " + std::to_string(parser.getNumMaterials()) + ")";
+        return false;
+    }
+    index = (int) value;
+    Material* m = parser.getMaterial(index);
+
+    // 先检查所有项，全部有效后再修改
+    Texture* texture = m->getTexture();
+    bool newColor = false;
+    Vector3f color;
+    float fuzziness = m->matType == metalMat ? static_cast<Metal*>(m)->getFuzziness() : 0;
+    float refractionIndex = m->matType == dielectricMat ? static_cast<Dielectric*>(m)->getRefractionIndex() : 1;
+    for (const auto& f : r.fields) {
+        const std::string& k = f.first;
+        bool ok;
+        if (k == "index") {
+            continue;
+        } else if (k == "color") {
+            ok = parseVector(f.second, color) && m->matType != otherMat;
+            newColor = true;
+        } else if (k == "texture") {
+            ok = parseNumber(f.second, value) && value == (int) value && value >= 0 &&
+                 value < parser.getNumTexture() && m->matType != otherMat;
+            if (ok) texture = parser.getTexture((int) value);
+        } else if (k == "fuzziness") {
+            ok = m->matType == metalMat && parseNumber(f.second, fuzziness) && fuzziness >= 0;
+        } else if (k == "refractionIndex") {
+            ok = m->matType == dielectricMat && parseNumber(f.second, refractionIndex) && refractionIndex > 0;
+        } else {
+            r.error = "unknown material field '" + k + "'";
+            return false;
+        }
+        if (!ok) {
+            r.error = "invalid " + k + " '" + f.second + "' for " + materialTypeName(m->matType) + " material " +
+                      std::to_string(index);
+            return false;
+        }
+    }
+
+    // 纹理可能被多个材质共用，改颜色时换成新的 SolidColor 而不是改原来的
+    if (newColor) texture = arenaNew<SolidColor>(arenaTexture, color);
+    m->setTexture(texture);
+    if (m->matType == metalMat) static_cast<Metal*>(m)->setFuzziness(fuzziness);
+    if (m->matType == dielectricMat) static_cast<Dielectric*>(m)->setRefractionIndex(refractionIndex);
+    return true;
+}
+
+} // namespace
+
+// ====================================================================
+// 服务器
+// ====================================================================
+
+bool PreviewServer::start(int _port) {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        perror("socket");
+        return false;
+    }
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(_port);
+    if (bind(listenFd, (sockaddr*) &addr, sizeof(addr)) < 0 || ::listen(listenFd, 16) < 0) {
+        perror("bind/listen");
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(listenFd, (sockaddr*) &addr, &len);
+    port = ntohs(addr.sin_port);
+    acceptThread = std::thread(&PreviewServer::acceptLoop, this);
+    printf("Preview server: http://127.0.0.1:%d/\n", port);
+    fflush(stdout);
+    return true;
+}
+
+void PreviewServer::stop() {
+    if (listenFd < 0) return;
+    stopping = true;
+    changed.notify_all();
+    if (acceptThread.joinable()) acceptThread.join();
+    close(listenFd);
+    listenFd = -1;
+    // 连接线程最多阻塞 receiveTimeoutSeconds（读请求）或一个帧间隔（/stream）
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return connections == 0; });
+}
+
+void PreviewServer::acceptLoop() {
+    while (!stopping) {
+        pollfd pfd = {listenFd, POLLIN, 0};
+        int ready = poll(&pfd, 1, 200);
+        if (ready < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        if (ready <= 0) continue;
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) continue;
+        timeval timeout = {receiveTimeoutSeconds, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++connections;
+        }
+        std::thread([this, fd] {
+            handleConnection(fd);
+            close(fd);
+            std::lock_guard<std::mutex> lock(mutex);
+            --connections;
+            changed.notify_all();
+        }).detach();
+    }
+}
+
+void PreviewServer::handleConnection(int fd) {
+    // 读到头部结束，再按 Content-Length 读正文
+    std::string request;
+    size_t headerEnd = std::string::npos;
+    char buf[4096];
+    while (headerEnd == std::string::npos) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        request.append(buf, n);
+        headerEnd = request.find("\r\n\r\n");
+        if (request.size() > (size_t) maxRequestBytes) {
+            sendText(fd, 400, "request too large\n");
+            return;
+        }
+    }
+    std::string header = request.substr(0, headerEnd);
+    std::string body = request.substr(headerEnd + 4);
+    size_t contentLength = 0;
+    for (size_t pos = header.find("\r\n"); pos != std::string::npos; pos = header.find("\r\n", pos + 2)) {
+        if (strncasecmp(header.c_str() + pos + 2, "Content-Length:", 15) == 0) {
+            contentLength = strtoul(header.c_str() + pos + 17, nullptr, 10);
+        }
+    }
+    if (contentLength > (size_t) maxRequestBytes) {
+        sendText(fd, 400, "request too large\n");
+        return;
+    }
+    while (body.size() < contentLength) {
+        ssize_t n = recv(fd, buf, std::min(sizeof(buf), contentLength - body.size()), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        body.append(buf, n);
+    }
+
+    // 请求行：METHOD PATH HTTP/1.x
+    size_t sp1 = header.find(' ');
+    size_t sp2 = sp1 == std::string::npos ? std::string::npos : header.find(' ', sp1 + 1);
+    if (sp2 == std::string::npos) {
+        sendText(fd, 400, "bad request line\n");
+        return;
+    }
+    std::string method = header.substr(0, sp1);
+    std::string path = header.substr(sp1 + 1, sp2 - sp1 - 1);
+    size_t query = path.find('?');
+    if (query != std::string::npos) path = path.substr(0, query);
+
+    if (method == "GET" && path == "/") {
+        sendResponse(fd, 200, "text/html; charset=utf-8", indexPage, strlen(indexPage));
+    } else if (method == "GET" && path == "/stream") {
+        streamFrames(fd);
+    } else if (method == "GET" && path == "/frame.bmp") {
+        std::vector<unsigned char> bytes;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            bytes = frame;
+        }
+        if (bytes.empty()) {
+            sendText(fd, 503, "no frame yet\n");
+        } else {
+            sendResponse(fd, 200, "image/bmp", bytes.data(), bytes.size());
+        }
+    } else if (method == "GET" && path == "/status") {
+        char json[256];
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            snprintf(json, sizeof(json),
+                     "{\"spp\": %d, \"width\": %d, \"height\": %d, \"version\": %lld, \"passMs\": %.3f, \"updateMs\": %.3f}\n",
+                     spp, width, height, version, passMs, updateMs);
+        }
+        sendResponse(fd, 200, "application/json", json, strlen(json));
+    } else if (method == "GET" && path == "/scene") {
+        std::string json;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            json = sceneInfo;
+        }
+        sendResponse(fd, 200, "application/json", json.data(), json.size());
+    } else if (method == "POST" && (path == "/camera" || path == "/material")) {
+        std::shared_ptr<PreviewRequest> r = std::make_shared<PreviewRequest>();
+        r->target = path.substr(1);
+        r->fields = parseForm(body);
+        r->received = std::chrono::steady_clock::now();
+        std::string error = submit(r);
+        sendText(fd, error.empty() ? 200 : 400, error.empty() ? "ok\n" : error + "\n");
+    } else if (method == "POST" && path == "/quit") {
+        quit = true;
+        changed.notify_all();
+        sendText(fd, 200, "ok\n");
+    } else {
+        sendText(fd, 404, "not found\n");
+    }
+}
+
+void PreviewServer::streamFrames(int fd) {
+    const char* header = "HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=frame\r\n"
+                         "Cache-Control: no-store\r\nConnection: close\r\n\r\n";
+    if (!sendAll(fd, header, strlen(header))) return;
+    const auto interval = std::chrono::milliseconds(1000 / streamFps);
+    long long sent = -1;
+    std::vector<unsigned char> bytes;
+    while (!stopping && !quit) {
+        auto next = std::chrono::steady_clock::now() + interval;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait_for(lock, std::chrono::seconds(1), [&] {
+                return stopping || quit || (version != sent && !frame.empty());
+            });
+            if (stopping || quit) break;
+            if (version == sent || frame.empty()) continue;
+            bytes = frame;
+            sent = version;
+        }
+        char part[128];
+        int n = snprintf(part, sizeof(part), "--frame\r\nContent-Type: image/bmp\r\nContent-Length: %zu\r\n\r\n", bytes.size());
+        if (!sendAll(fd, part, n) || !sendAll(fd, bytes.data(), bytes.size()) || !sendAll(fd, "\r\n", 2)) break;
+        // 限制帧率：小场景一遍只要几毫秒，每遍都发会占满带宽
+        std::this_thread::sleep_until(next);
+    }
+}
+
+std::string PreviewServer::submit(const std::shared_ptr<PreviewRequest>& request) {
+    std::unique_lock<std::mutex> lock(mutex);
+    queue.push_back(request);
+    pending = true;
+    changed.notify_all();
+    bool finished = changed.wait_for(lock, std::chrono::seconds(applyTimeoutSeconds), [&] {
+        return request->done || stopping || quit;
+    });
+    if (!request->done) return finished ? "preview is shutting down" : "timed out waiting for the renderer";
+    return request->error;
+}
+
+void PreviewServer::waitForRequests(int timeoutMs) {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return !queue.empty() || quit || stopping; });
+}
+
+std::vector<std::shared_ptr<PreviewRequest>> PreviewServer::takeRequests() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::shared_ptr<PreviewRequest>> taken;
+    taken.swap(queue);
+    pending = false;
+    return taken;
+}
+
+void PreviewServer::finish(const std::vector<std::shared_ptr<PreviewRequest>>& requests) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& r : requests) r->done = true;
+    changed.notify_all();
+}
+
+void PreviewServer::publish(const Image& img, int _spp, double _passMs, double _updateMs) {
+    std::vector<unsigned char> bytes;
+    img.EncodeBMP(bytes);   // 在锁外编码
+    std::lock_guard<std::mutex> lock(mutex);
+    frame.swap(bytes);
+    width = img.Width();
+    height = img.Height();
+    spp = _spp;
+    passMs = _passMs;
+    updateMs = _updateMs;
+    ++version;
+    changed.notify_all();
+}
+
+void PreviewServer::setSceneInfo(const std::string& json) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sceneInfo = json;
+}
+
+// ====================================================================
+// 修改场景
+// ====================================================================
+
+bool applyPreviewRequest(PreviewRequest& request, PerspectiveCamera* cam, SceneParser& parser) {
+    if (request.target == "camera") return applyCamera(request, cam);
+    if (request.target == "material") return applyMaterial(request, parser);
+    request.error = "unknown target '" + request.target + "'";
+    return false;
+}
+
+std::string previewSceneInfo(const PerspectiveCamera* cam, const SceneParser& parser) {
+    char buf[512];
+    snprintf(buf, sizeof(buf),
+             "{\"camera\": {\"center\": \"%s\", \"direction\": \"%s\", \"up\": \"%s\", \"angle\": %g, "
+             "\"aperture\": %g, \"focusDistance\": %g},\n \"materials\": [",
+             formatVector(cam->getCenter()).c_str(), formatVector(cam->getDirection()).c_str(),
+             formatVector(cam->getUp()).c_str(), cam->getAngle() * 180 / M_PI, cam->getAperture(), cam->getFocusDistance());
+    std::string json = buf;
+    for (int i = 0; i < parser.getNumMaterials(); i++) {
+        const Material* m = parser.getMaterial(i);
+        snprintf(buf, sizeof(buf), "%s\n  {\"index\": %d, \"type\": \"%s\"", i > 0 ? "," : "", i, materialTypeName(m->matType));
+        json += buf;
+        const Texture* t = m->getTexture();
+        if (m->matType != otherMat && t != nullptr && t->texType == solidTex) {
+            json += ", \"color\": \"" + formatVector(static_cast<const SolidColor*>(t)->getSolidColor()) + "\"";
+        }
+        for (int k = 0; k < parser.getNumTexture(); k++) {
+            if (parser.getTexture(k) != t) continue;
+            snprintf(buf, sizeof(buf), ", \"texture\": %d", k);
+            json += buf;
+            break;
+        }
+        if (m->matType == metalMat) {
+            snprintf(buf, sizeof(buf), ", \"fuzziness\": %g", static_cast<const Metal*>(m)->getFuzziness());
+            json += buf;
+        }
+        if (m->matType == dielectricMat) {
+            snprintf(buf, sizeof(buf), ", \"refractionIndex\": %g", static_cast<const Dielectric*>(m)->getRefractionIndex());
+            json += buf;
+        }
+        json += "}";
+    }
+    json += "]}\n";
+    return json;
+}
@@ -0,0 +1,134 @@
+#include "reload.hpp"
+#include <algorithm>
+#include <cstdio>
+#include "bvh.hpp"
+#include "texture_manager.hpp"
+
+const int SceneReloader::pollMs;     // std::chrono::milliseconds 的构造函数按引用使用
+
+SceneReloader::SceneReloader(const std::string& _filename, SceneParser* _parser, const std::vector<Object3D*>& _generated,
+                             BvhNode* _bvh, bool _sah, float _refitThreshold)
+    : filename(_filename), parser(_parser), generated(_generated), bvh(_bvh), sah(_sah), refitThreshold(_refitThreshold) {
+    camera = static_cast<PerspectiveCamera*>(parser->getCamera());
+    objects = parser->getRootObjects();
+    objects.insert(objects.end(), generated.begin(), generated.end());
+    watched = parser->getDependencies();
+    lastPoll = std::chrono::steady_clock::now();
+}
+
+bool SceneReloader::changed() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastPoll < std::chrono::milliseconds(pollMs)) return false;
+    lastPoll = now;
+
+    std::map<std::string, FileStamp> current;
+    for (auto& d : watched) current[d.first] = FileStamp::of(d.first);
+    if (current == watched) {
+        pending.clear();
+        return false;
+    }
+    if (current != pending) {
+        pending = current;      // 可能还在写，下一次检查时再看
+        return false;
+    }
+    // 失败时也不再重试，直到文件再次改动
+    watched = current;
+    pending.clear();
+    return true;
+}
+
+bool SceneReloader::reload() {
+    auto start = std::chrono::steady_clock::now();
+    for (auto& d : parser->getDependencies()) {
+        if (FileStamp::of(d.first) != d.second) TextureManager::instance().forget(d.first);
+    }
+
+    std::unique_ptr<Arena> arena(new Arena());
+    std::unique_ptr<SceneParser> next;
+    try {
+        ArenaScope scope(*arena);
+        next.reset(new SceneParser(filename.c_str(), nullptr, parser));
+        Camera* cam = next->getCamera();
+        if (cam == nullptr) {
+            throw SceneError(filename + ": scene has no PerspectiveCamera");
+        }
+        if (cam->getWidth() != camera->getWidth() || cam->getHeight() != camera->getHeight()) {
+            throw SceneError(filename + ": the resolution cannot change while previewing (restart to render at "
+                             + std::to_string(cam->getWidth()) + "x" + std::to_string(cam->getHeight()) + ")");
+        }
+        if (next->getRootObjects().empty() && generated.empty()) {
+            throw SceneError(filename + ": scene has no objects");
+        }
+    } catch (const SceneError& e) {
+        printf("Reload failed, keeping the previous scene: %s\n", e.what());
+        return false;
+    }
+
+    // 解析成功，更新常驻的场景
+    next->commitMaterials();
+    bool cameraChanged = next->getCameraSignature() != parser->getCameraSignature();
+    if (cameraChanged) *camera = *static_cast<PerspectiveCamera*>(next->getCamera());
+
+    std::vector<Object3D*> newObjects = next->getRootObjects();
+    newObjects.insert(newObjects.end(), generated.begin(), generated.end());
+    // 个数不变时按位置对应：叶子上的旧物体换成同一位置的新物体。同一个物体出现在两个位置、对应不同的新物体时只能重建
+    std::map<Object3D*, Object3D*> leaves;
+    bool sameLayout = newObjects.size() == objects.size();
+    int changedObjects = 0;
+    for (size_t i = 0; sameLayout && i < objects.size(); i++) {
+        auto it = leaves.find(objects[i]);
+        if (it != leaves.end() && it->second != newObjects[i]) {
+            sameLayout = false;
+        } else if (it == leaves.end()) {
+            leaves[objects[i]] = newObjects[i];
+            if (objects[i] != newObjects[i]) changedObjects++;
+        }
+    }
+    if (!sameLayout) {
+        changedObjects = 0;
+        for (Object3D* obj : newObjects) {
+            if (std::find(objects.begin(), objects.end(), obj) == objects.end()) changedObjects++;
+        }
+    }
+    objects = newObjects;
+
+    const char* bvhAction = "unchanged";
+    float growth = 1;
+    if (!sameLayout) {
+        rebuild(*arena);
+        bvhAction = "rebuilt";
+    } else if (changedObjects > 0) {
+        bvh->replaceLeaves(leaves);
+        bvh->refit();
+        growth = bvh->refitGrowth();
+        if (growth > refitThreshold) {
+            rebuild(*arena);
+            bvhAction = "rebuilt";
+        } else {
+            bvhAction = "refit";
+        }
+    }
+
+    const SceneParser::ReuseStats& reuse = next->getReuseStats();
+    printf("Reload %d: %d of %d objects changed, %d mesh(es) and %d prototype(s) reused, "
+           "materials %d reused / %d updated / %d new, textures %d reused / %d new, camera %s, "
+           "BVH %s (node area x%.2f), %.1f ms\n",
+           ++numReloads, changedObjects, (int) objects.size(), reuse.meshes, reuse.prototypes,
+           reuse.materials, reuse.materialsUpdated, next->getNumMaterials() - reuse.materials - reuse.materialsUpdated,
+           reuse.textures, next->getNumTexture() - reuse.textures, cameraChanged ? "changed" : "unchanged",
+           bvhAction, growth, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+    arenas.push_back(std::move(arena));
+    reloaded = std::move(next);     // 释放上一次重新载入的 SceneParser，它的对象留在 Arena 里
+    parser = reloaded.get();
+    watched = parser->getDependencies();
+    pending.clear();
+    return true;
+}
+
+void SceneReloader::rebuild(Arena& arena) {
+    ArenaScope scope(arena);
+    Group* grp = arenaNew<Group>(arenaGeometry);
+    for (Object3D* obj : objects) grp->addObject(obj);
+    bvh = BvhNode::build(grp, sah);
+}
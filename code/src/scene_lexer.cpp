@@ -0,0 +1,241 @@
+#include "scene_lexer.hpp"
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+static const char* keywordTexts[numSceneKeywords] = {
+    "",
+#define SCENE_KEYWORD_TEXT(id, text) text,
+    SCENE_KEYWORDS(SCENE_KEYWORD_TEXT)
+#undef SCENE_KEYWORD_TEXT
+};
+
+// ====================================================================
+// 关键字哈希表：FNV-1a，开放寻址，表长为 2 的幂且远大于关键字个数
+// ====================================================================
+
+static inline uint32_t hashToken(const char* text, int length) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        h = (h ^ (unsigned char) text[i]) * 16777619u;
+    }
+    return h;
+}
+
+namespace {
+
+struct KeywordTable {
+    static const int size = 256;
+    unsigned char slots[size];      // SceneKeyword，kwNone 为空位
+    unsigned char lengths[numSceneKeywords];
+
+    KeywordTable() {
+        static_assert(numSceneKeywords < size / 2, "keyword table too small");
+        memset(slots, 0, sizeof(slots));
+        for (int kw = 1; kw < numSceneKeywords; kw++) {
+            lengths[kw] = (unsigned char) strlen(keywordTexts[kw]);
+            uint32_t i = hashToken(keywordTexts[kw], lengths[kw]) & (size - 1);
+            while (slots[i] != kwNone) i = (i + 1) & (size - 1);
+            slots[i] = (unsigned char) kw;
+        }
+    }
+
+    SceneKeyword find(const char* text, int length) const {
+        uint32_t i = hashToken(text, length) & (size - 1);
+        while (slots[i] != kwNone) {
+            int kw = slots[i];
+            if (lengths[kw] == length && memcmp(keywordTexts[kw], text, length) == 0) return (SceneKeyword) kw;
+            i = (i + 1) & (size - 1);
+        }
+        return kwNone;
+    }
+};
+
+} // namespace
+
+const char* SceneLexer::keywordText(SceneKeyword kw) {
+    return keywordTexts[kw];
+}
+
+SceneKeyword SceneLexer::lookupKeyword(const char* text, int length) {
+    static const KeywordTable table;
+    return table.find(text, length);
+}
+
+// ====================================================================
+// 数字
+// ====================================================================
+
+bool SceneLexer::parseInt(const char* text, int length, int& out) {
+    const char* p = text;
+    const char* e = text + length;
+    bool negative = false;
+    if (p < e && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    if (p == e) return false;
+    long long v = 0;
+    for (; p < e; p++) {
+        if (*p < '0' || *p > '9') return false;
+        v = v * 10 + (*p - '0');
+        if (v > 2147483648LL) return false;
+    }
+    if (negative) v = -v;
+    if (v > 2147483647LL) return false;
+    out = (int) v;
+    return true;
+}
+
+// 慢路径：复制成以 '\0' 结尾的字符串交给 strtof
+static bool parseFloatSlow(const char* text, int length, float& out) {
+    char tmp[128];
+    if (length == 0 || length >= (int) sizeof(tmp)) return false;
+    memcpy(tmp, text, length);
+    tmp[length] = '\0';
+    char* endp;
+    out = strtof(tmp, &endp);
+    return endp == tmp + length;
+}
+
+bool SceneLexer::parseFloat(const char* text, int length, float& out) {
+    // 快路径：不超过 15 位有效数字、10 的指数在 ±22 以内时，尾数和 10 的幂在 double 中都是精确的，
+    // 一次乘除得到正确舍入的 double。再舍入到 float 只在 double 恰好落在两个 float 正中间时可能出错，
+    // 这种情况（以及 inf、nan、非规格化数）交给 strtof
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char* p = text;
+    const char* e = text + length;
+    bool negative = false;
+    if (p < e && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0, exp10 = 0;
+    bool anyDigit = false;
+    for (; p < e && *p >= '0' && *p <= '9'; p++) {
+        anyDigit = true;
+        if (mantissa == 0 && *p == '0') continue;   // 前导零不算有效数字
+        if (++digits > 15) return parseFloatSlow(text, length, out);
+        mantissa = mantissa * 10 + (*p - '0');
+    }
+    if (p < e && *p == '.') {
+        for (p++; p < e && *p >= '0' && *p <= '9'; p++) {
+            anyDigit = true;
+            exp10--;
+            if (mantissa == 0 && *p == '0') continue;
+            if (++digits > 15) return parseFloatSlow(text, length, out);
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+    }
+    if (!anyDigit) return parseFloatSlow(text, length, out);     // inf、nan 或不是数字
+    if (p < e && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool expNegative = false;
+        if (p < e && (*p == '-' || *p == '+')) expNegative = *p++ == '-';
+        if (p == e) return false;
+        int v = 0;
+        for (; p < e && *p >= '0' && *p <= '9'; p++) {
+            if (v < 10000) v = v * 10 + (*p - '0');
+        }
+        exp10 += expNegative ? -v : v;
+    }
+    if (p != e) return false;
+    if (exp10 < -22 || exp10 > 22) return parseFloatSlow(text, length, out);
+
+    double d = (double) mantissa;
+    d = exp10 < 0 ? d / pow10[-exp10] : d * pow10[exp10];
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    const uint64_t lowMask = (1ull << 29) - 1;      // double 比 float 多 29 位尾数
+    if (mantissa != 0 && ((bits & lowMask) == (1ull << 28) || d < 1.1754943508222875e-38 || d > 3.4028234663852886e38)) {
+        return parseFloatSlow(text, length, out);
+    }
+    out = (float) (negative ? -d : d);
+    return true;
+}
+
+// ====================================================================
+// 记号
+// ====================================================================
+
+bool SceneLexer::open(const char* _filename) {
+    filename = _filename;
+    FILE* file = fopen(_filename, "rb");
+    if (file == nullptr) return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    buffer.resize(size > 0 ? size : 0);
+    size_t got = size > 0 ? fread(buffer.data(), 1, size, file) : 0;
+    fclose(file);
+    if ((long) got != size) return false;
+    pos = lineStart = buffer.data();
+    end = pos + buffer.size();
+    line = 1;
+    return true;
+}
+
+SceneToken SceneLexer::next() {
+    // 跳过空白，同时记下行号
+    while (pos < end && (unsigned char) *pos <= ' ') {
+        if (*pos == '\n') {
+            line++;
+            lineStart = pos + 1;
+        }
+        pos++;
+    }
+    SceneToken tok;
+    tok.line = line;
+    tok.column = (int) (pos - lineStart) + 1;
+    tok.source = this;
+    if (pos == end) return tok;
+    tok.text = pos;
+    while (pos < end && (unsigned char) *pos > ' ') pos++;
+    tok.length = (int) (pos - tok.text);
+    // 关键字都以字母或括号开头，数字不用查表
+    char c = tok.text[0];
+    if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '{' || c == '}' || c == '[' || c == ']') {
+        tok.keyword = lookupKeyword(tok.text, tok.length);
+    }
+    return tok;
+}
+
+SceneToken SceneLexer::peek() {
+    const char* savedPos = pos;
+    const char* savedLineStart = lineStart;
+    int savedLine = line;
+    SceneToken tok = next();
+    pos = savedPos;
+    lineStart = savedLineStart;
+    line = savedLine;
+    return tok;
+}
+
+std::string SceneLexer::readString() {
+    SceneToken tok = next();
+    if (tok.atEnd() || tok.is(kwLBrace) || tok.is(kwRBrace)) unexpected(tok, "a name");
+    return tok.str();
+}
+
+void SceneLexer::error(const SceneToken& tok, const char* fmt, ...) const {
+    char message[512];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(message, sizeof(message), fmt, args);
+    va_end(args);
+    const std::string& file = tok.source != nullptr ? tok.source->filename : filename;
+    throw SceneError(file + ":" + std::to_string(tok.line) + ":" + std::to_string(tok.column) + ": " + message);
+}
+
+void SceneLexer::addSignature(unsigned long long& signature, const void* data, size_t size) {
+    const unsigned char* p = (const unsigned char*) data;
+    for (size_t i = 0; i < size; i++) {
+        signature = (signature ^ p[i]) * 1099511628211ull;
+    }
+}
+
+void SceneLexer::unexpected(const SceneToken& tok, const char* what) const {
+    if (tok.atEnd()) error(tok, "expected %s, found end of file", what);
+    error(tok, "expected %s, found '%.*s'", what, tok.length > 64 ? 64 : tok.length, tok.text);
+}
@@ -2,56 +2,80 @@
 #include <cstring>
 #include <cstdlib>
 #include <cmath>
+#include <sys/stat.h>
 
 #include "scene_parser.hpp"
+#include "arena.hpp"
+#include "texture_manager.hpp"
+#include "settings.hpp"
+#include "bvh.hpp"
 
 #define DegreesToRadians(x) ((PI * x) / 180.0f)
 
-SceneParser::SceneParser(const char *filename) {
+FileStamp FileStamp::of(const std::string &path) {
+    FileStamp stamp;
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) {
+        stamp.mtime = (long long) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+        stamp.size = (long long) st.st_size;
+    }
+    return stamp;
+}
+
+SceneParser::SceneParser(const char *filename, RenderSettings *_settings, SceneParser *_previous) {
 
     // initialize some reasonable default values
     group = nullptr;
     camera = nullptr;
-    background_color = Vector3f(0.5, 0.5, 0.5);
+    background_color = Vector3f(0, 0, 0);   // 没有 Background 块时为黑色（与渲染器一直以来的背景相同）
     current_material = nullptr;
+    settings = _settings;
+    previous = _previous;
 
     // parse the file
     assert(filename != nullptr);
     const char *ext = &filename[strlen(filename) - 4];
 
     if (strcmp(ext, ".txt") != 0) {
-        printf("wrong file name extension\n");
-        exit(0);
+        throw SceneError(std::string(filename) + ": wrong file name extension (expected .txt)");
     }
-    file = fopen(filename, "r");
 
-    if (file == nullptr) {
-        printf("cannot open scene file\n");
-        exit(0);
+    lexers.emplace_back(new SceneLexer());
+    lexer = lexers.back().get();
+    includeStack.push_back(lexer);
+    addDependency(filename);
+    if (!lexer->open(filename)) {
+        throw SceneError(std::string(filename) + ": cannot open scene file");
     }
     parseFile();
-    fclose(file);
-    file = nullptr;
 
     if (lights.size() == 0) {
         printf("WARNING:    No lights specified\n");
     }
 }
 
+// 相机、光源、材质、纹理和物体都分配在当前的 Arena 里，由 Arena 释放
 SceneParser::~SceneParser() {
+}
 
-    delete group;
-    delete camera;
+FileStamp SceneParser::addDependency(const std::string &path) {
+    FileStamp stamp = FileStamp::of(path);
+    dependencies[path] = stamp;
+    return stamp;
+}
 
-    int i;
-    for (i = 0; i < materials.size(); i++) {
-        delete materials[i];
-    }
-    // delete[] materials;
-    for (Light* light : lights) {
-        delete light;
+// 按类型整体赋值：材质对象的地址不变，引用它的物体不必重建
+void SceneParser::commitMaterials() {
+    for (auto &p : pendingMaterials) {
+        switch (p.first->matType) {
+            case lambertMat: *static_cast<Lambert*>(p.first) = *static_cast<Lambert*>(p.second); break;
+            case metalMat: *static_cast<Metal*>(p.first) = *static_cast<Metal*>(p.second); break;
+            case dielectricMat: *static_cast<Dielectric*>(p.first) = *static_cast<Dielectric*>(p.second); break;
+            case emissiveMat: *static_cast<EmissiveMaterial*>(p.first) = *static_cast<EmissiveMaterial*>(p.second); break;
+            default: break;
+        }
     }
-    // delete[] lights;
+    pendingMaterials.clear();
 }
 
 // ====================================================================
@@ -59,27 +83,28 @@ SceneParser::~SceneParser() {
 
 void SceneParser::parseFile() {
     //
-    // at the top level, the scene can have a camera, 
+    // at the top level, the scene can have a camera,
     // background color and a group of objects
     // (we add lights and other things in future assignments)
     //
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    while (getToken(token)) {
-        if (!strcmp(token, "PerspectiveCamera")) {
-            parsePerspectiveCamera();
-        } else if (!strcmp(token, "Background")) {
-            parseBackground();
-        } else if (!strcmp(token, "Lights")) {
-            parseLights(); 
-        } else if (!strcmp(token, "Textures")) {
-            parseTextures();
-        } else if (!strcmp(token, "Materials")) {
-            parseMaterials();
-        } else if (!strcmp(token, "Group")) {
-            group = parseGroup();
-        } else {
-            printf("Unknown token in parseFile: '%s'\n", token);
-            exit(0);
+    while (true) {
+        beginSignature();
+        SceneToken token = next();
+        switch (token.keyword) {
+            case kwPerspectiveCamera:
+                parsePerspectiveCamera();
+                cameraSignature = signature;
+                break;
+            case kwBackground: parseBackground(); break;
+            case kwRenderSettings: parseRenderSettings(); break;
+            case kwLights: parseLights(); break;
+            case kwTextures: parseTextures(); break;
+            case kwMaterials: parseMaterials(); break;
+            case kwGroup: group = parseGroup(true); break;
+            case kwDefine: parseDefine(); break;
+            default:
+                if (token.atEnd()) return;
+                lexer->error(token, "unknown block '%s'", token.str().c_str());
         }
     }
 }
@@ -88,54 +113,59 @@ void SceneParser::parseFile() {
 // ====================================================================
 
 void SceneParser::parsePerspectiveCamera() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
     // read in the camera parameters
-    getToken(token);
-    assert (!strcmp(token, "{"));
-    getToken(token);
-    assert (!strcmp(token, "center"));
+    expect(kwLBrace);
+    expect(kwCenter);
     Vector3f center = readVector3f();
-    getToken(token);
-    assert (!strcmp(token, "direction"));
+    expect(kwDirection);
     Vector3f direction = readVector3f();
-    getToken(token);
-    assert (!strcmp(token, "up"));
+    expect(kwUp);
     Vector3f up = readVector3f();
-    getToken(token);
-    assert (!strcmp(token, "angle"));
+    expect(kwAngle);
     float angle_degrees = readFloat();
     float angle_radians = DegreesToRadians(angle_degrees);
-    getToken(token);
-    assert (!strcmp(token, "width"));
+    expect(kwWidth);
     int width = readInt();
-    getToken(token);
-    assert (!strcmp(token, "height"));
+    expect(kwHeight);
     int height = readInt();
-    getToken(token);
-    assert (!strcmp(token, "aperture"));
+    expect(kwAperture);
     float aperture = readFloat();
-    getToken(token);
-    assert (!strcmp(token, "focusDistance"));
+    expect(kwFocusDistance);
     float focusDist = readFloat();
-    getToken(token);
-    assert (!strcmp(token, "}"));
-    camera = new PerspectiveCamera(center, direction, up, width, height, angle_radians, aperture, focusDist);
+    expect(kwRBrace);
+    camera = arenaNew<PerspectiveCamera>(arenaOther, center, direction, up, width, height, angle_radians, aperture, focusDist);
 }
 
 void SceneParser::parseBackground() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
     // read in the background color
-    getToken(token);
-    assert (!strcmp(token, "{"));
+    expect(kwLBrace);
     while (true) {
-        getToken(token);
-        if (!strcmp(token, "}")) {
+        SceneToken token = next();
+        if (token.is(kwRBrace)) {
             break;
-        } else if (!strcmp(token, "color")) {
+        } else if (token.is(kwColor)) {
             background_color = readVector3f();
         } else {
-            printf("Unknown token in parseBackground: '%s'\n", token);
-            assert(0);
+            lexer->unexpected(token, "'color' or '}' in Background");
+        }
+    }
+}
+
+// RenderSettings { name value ... }，名字同命令行参数（去掉 --）
+void SceneParser::parseRenderSettings() {
+    expect(kwLBrace);
+    while (true) {
+        SceneToken name = next();
+        if (name.is(kwRBrace)) {
+            break;
+        }
+        if (name.atEnd()) lexer->unexpected(name, "'}'");
+        SceneToken value = next();
+        if (value.atEnd() || value.is(kwRBrace)) {
+            lexer->error(name, "missing value for '%s' in RenderSettings", name.str().c_str());
+        }
+        if (settings != nullptr && !settings->set(name.str(), value.str(), true)) {
+            lexer->error(name, "invalid setting");
         }
     }
 }
@@ -144,19 +174,16 @@ void SceneParser::parseBackground() {
 // ====================================================================
 
 void SceneParser::parseLights() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    getToken(token);
-    assert(!strcmp(token, "{"));
+    expect(kwLBrace);
     while (true) {
-        getToken(token);
-        if (!strcmp(token, "DirectionalLight")) {
+        SceneToken token = next();
+        if (token.is(kwDirectionalLight)) {
             lights.push_back(parseDirectionalLight());
-        } else if (!strcmp(token, "PointLight")) {
+        } else if (token.is(kwPointLight)) {
             lights.push_back(parsePointLight());
         } else {
-            if (strcmp(token, "}")) {
-                printf("Unknown token in parseLight: '%s'\n", token);
-                exit(0);
+            if (!token.is(kwRBrace)) {
+                lexer->unexpected(token, "a light or '}'");
             }
             break;
         }
@@ -164,51 +191,41 @@ void SceneParser::parseLights() {
 }
 
 Light *SceneParser::parseDirectionalLight() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    getToken(token);
-    assert (!strcmp(token, "{"));
-    getToken(token);
-    assert (!strcmp(token, "direction"));
+    expect(kwLBrace);
+    expect(kwDirection);
     Vector3f direction = readVector3f();
-    getToken(token);
-    assert (!strcmp(token, "color"));
+    expect(kwColor);
     Vector3f color = readVector3f();
-    getToken(token);
-    assert (!strcmp(token, "}"));
-    return new DirectionalLight(direction, color);
+    expect(kwRBrace);
+    return arenaNew<DirectionalLight>(arenaOther, direction, color);
 }
 
 Light *SceneParser::parsePointLight() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    getToken(token);
-    assert (!strcmp(token, "{"));
-    getToken(token);
-    assert (!strcmp(token, "position"));
+    expect(kwLBrace);
+    expect(kwPosition);
     Vector3f position = readVector3f();
-    getToken(token);
-    assert (!strcmp(token, "color"));
+    expect(kwColor);
     Vector3f color = readVector3f();
-    getToken(token);
-    assert (!strcmp(token, "}"));
-    return new PointLight(position, color);
+    expect(kwRBrace);
+    return arenaNew<PointLight>(arenaOther, position, color);
 }
 // ====================================================================
 // ====================================================================
 
 void SceneParser::parseTextures(){
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    getToken(token);
-    assert(!strcmp(token, "{"));
+    expect(kwLBrace);
     while (true) {
-        getToken(token);
-        if (!strcmp(token, "Checker")){
-            textures.push_back(parseCheckerTexture());
-        } else if (!strcmp(token, "Image")) {
-            textures.push_back(parseImageTexture());
+        beginSignature();
+        SceneToken token = next();
+        if (token.is(kwChecker)) {
+            textures.push_back(reuseTexture(parseCheckerTexture()));
+        } else if (token.is(kwImage)) {
+            textures.push_back(reuseTexture(parseImageTexture()));
+        } else if (token.is(kwNoise)) {
+            textures.push_back(reuseTexture(parseNoiseTexture()));
         } else {
-            if (strcmp(token, "}")) {
-                printf("Unknown token in parseTexture: '%s'\n", token);
-                exit(0);
+            if (!token.is(kwRBrace)) {
+                lexer->unexpected(token, "a texture or '}'");
             }
             break;
         }
@@ -217,468 +234,807 @@ void SceneParser::parseTextures(){
 }
 
 CheckerTexture *SceneParser::parseCheckerTexture() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    getToken(token);
-    assert(!strcmp(token, "{"));
-    Texture* t0;
-    Texture* t1;
+    expect(kwLBrace);
+    Texture* t0 = nullptr;
+    Texture* t1 = nullptr;
     while (true) {
-        getToken(token);
-        if (!strcmp(token, "color0")) {
-            t0 = new SolidColor(readVector3f());
-        } else if (!strcmp(token, "color1")) {
-            t1 = new SolidColor(readVector3f());
-        } else if (!strcmp(token, "texture0")) {
-            int idx = readInt();
-            t0 = getTexture(idx);
-        } else if (!strcmp(token, "texture1")) {
-            int idx = readInt();
-            t1 = getTexture(idx);
+        SceneToken token = next();
+        if (token.is(kwColor0)) {
+            t0 = arenaNew<SolidColor>(arenaTexture, readVector3f());
+        } else if (token.is(kwColor1)) {
+            t1 = arenaNew<SolidColor>(arenaTexture, readVector3f());
+        } else if (token.is(kwTexture0)) {
+            t0 = readTexture();
+        } else if (token.is(kwTexture1)) {
+            t1 = readTexture();
         } else {
-            if (strcmp(token, "}")) {
-                printf("Unknown token in parseCheckerTexture: '%s'\n", token);
-                exit(0);
+            if (!token.is(kwRBrace)) {
+                lexer->unexpected(token, "color0, color1, texture0, texture1 or '}'");
             }
             break;
         }
     }
-    CheckerTexture* res = new CheckerTexture(t0, t1);
+    CheckerTexture* res = arenaNew<CheckerTexture>(arenaTexture, t0, t1);
     return res;
 }
 
 ImageTexture *SceneParser::parseImageTexture() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    char filename[MAX_PARSER_TOKEN_LENGTH];
+    expect(kwLBrace);
+    expect(kwImgFile);
+    std::string filename = readString();
+    expect(kwRBrace);
+    FileStamp stamp = addDependency(filename);
+    addSignature(&stamp, sizeof(stamp));
+    return TextureManager::instance().load(filename);
+}
 
-    getToken(token);
-    assert (!strcmp(token, "{"));
-    getToken(token);
-    assert (!strcmp(token, "imgFile"));
-    getToken(filename);
-    // std::cout << "filename: " << filename << endl;
-    getToken(token);
-    assert (strcmp(token, "}"));
-    return new ImageTexture(filename);
+// Noise { pattern fbm|turbulence|marble|wood|worley  color0/texture0 ...  color1/texture1 ...
+//         frequency F  octaves N  seed S  space solid|uv  bake N }，除 pattern 外都可省略
+NoiseTexture *SceneParser::parseNoiseTexture() {
+    expect(kwLBrace);
+    NoisePattern pattern = fbmPattern;
+    Texture* t0 = nullptr;
+    Texture* t1 = nullptr;
+    float frequency = 1;
+    int octaves = 5;
+    unsigned int seed = 0;
+    bool uvSpace = false;
+    int bakeSize = 0;
+    bool hasPattern = false;
+    SceneToken bakeToken;
+    while (true) {
+        SceneToken token = next();
+        if (token.is(kwPattern)) {
+            SceneToken name = next();
+            if (!NoiseTexture::parsePattern(name.str(), pattern)) {
+                lexer->unexpected(name, "fbm, turbulence, marble, wood or worley");
+            }
+            hasPattern = true;
+        } else if (token.is(kwColor0)) {
+            t0 = arenaNew<SolidColor>(arenaTexture, readVector3f());
+        } else if (token.is(kwColor1)) {
+            t1 = arenaNew<SolidColor>(arenaTexture, readVector3f());
+        } else if (token.is(kwTexture0)) {
+            t0 = readTexture();
+        } else if (token.is(kwTexture1)) {
+            t1 = readTexture();
+        } else if (token.is(kwFrequency)) {
+            frequency = readFloat();
+        } else if (token.is(kwOctaves)) {
+            SceneToken value = peek();
+            octaves = readInt();
+            if (octaves < 1 || octaves > 16) lexer->error(value, "octaves must be between 1 and 16");
+        } else if (token.is(kwSeed)) {
+            seed = (unsigned int) readInt();
+        } else if (token.is(kwSpace)) {
+            SceneToken value = next();
+            if (value.str() != "solid" && value.str() != "uv") lexer->unexpected(value, "solid or uv");
+            uvSpace = value.str() == "uv";
+        } else if (token.is(kwBake)) {
+            bakeToken = peek();
+            bakeSize = readInt();
+            if (bakeSize < 2 || bakeSize > 8192) lexer->error(bakeToken, "bake size must be between 2 and 8192");
+        } else {
+            if (!token.is(kwRBrace)) {
+                lexer->unexpected(token, "pattern, color0, color1, texture0, texture1, frequency, octaves, seed, space, bake or '}'");
+            }
+            if (!hasPattern) lexer->error(token, "Noise texture needs a pattern");
+            break;
+        }
+    }
+    if (t0 == nullptr) t0 = arenaNew<SolidColor>(arenaTexture, 0, 0, 0);
+    if (t1 == nullptr) t1 = arenaNew<SolidColor>(arenaTexture, 1, 1, 1);
+    NoiseTexture* res = arenaNew<NoiseTexture>(arenaTexture, pattern, t0, t1, frequency, octaves, seed, uvSpace);
+    if (bakeSize > 0) {
+        // 实体纹理没有有限的定义域，不能预先算成表
+        if (!uvSpace) lexer->error(bakeToken, "bake needs 'space uv'");
+        res->bake(bakeSize);
+    }
+    return res;
+}
+
+// 纹理序号，超出范围时报错
+Texture *SceneParser::readTexture() {
+    SceneToken token = peek();
+    int idx = readInt();
+    if (idx < 0 || idx >= getNumTexture()) {
+        lexer->error(token, "texture index %d out of range (%d textures)", idx, getNumTexture());
+    }
+    Texture *t = getTexture(idx);
+    addSignature(&t, sizeof(t));
+    return t;
+}
+
+Texture *SceneParser::reuseTexture(Texture *t) {
+    int i = (int) textures.size();
+    textureSignatures.push_back(signature);
+    if (previous != nullptr && i < previous->getNumTexture() && previous->textureSignatures[i] == signature) {
+        reuseStats.textures++;
+        return previous->textures[i];
+    }
+    return t;
+}
+
+// 同一位置的材质：签名相同时沿用；类型相同时也沿用原来的对象，参数等 commitMaterials 再写入
+Material *SceneParser::reuseMaterial(Material *m) {
+    int i = (int) materials.size();
+    materialSignatures.push_back(signature);
+    if (previous == nullptr || i >= previous->getNumMaterials()) return m;
+    Material *old = previous->materials[i];
+    if (previous->materialSignatures[i] == signature) {
+        reuseStats.materials++;
+        return old;
+    }
+    if (old->matType == m->matType && m->matType != otherMat) {
+        pendingMaterials.push_back({old, m});
+        reuseStats.materialsUpdated++;
+        return old;
+    }
+    return m;
 }
 
 // ====================================================================
 // ====================================================================
 
 void SceneParser::parseMaterials() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    getToken(token);
-    assert(!strcmp(token, "{"));
+    expect(kwLBrace);
     while (true) {
-        getToken(token);
-        if (!strcmp(token, "Lambert")){
-            materials.push_back(parseLambert());
-        } else if (!strcmp(token, "Metal")){
-            materials.push_back(parseMetal());
-        } else if (!strcmp(token, "Dielectric")) {
-            materials.push_back(parseDielectric());
-        } else if (!strcmp(token, "Emissive")) {
-            materials.push_back(parseEmissiveMaterial());
+        beginSignature();
+        SceneToken token = next();
+        if (token.is(kwLambert)) {
+            materials.push_back(reuseMaterial(parseLambert()));
+        } else if (token.is(kwMetal)) {
+            materials.push_back(reuseMaterial(parseMetal()));
+        } else if (token.is(kwDielectric)) {
+            materials.push_back(reuseMaterial(parseDielectric()));
+        } else if (token.is(kwEmissive)) {
+            materials.push_back(reuseMaterial(parseEmissiveMaterial()));
         } else {
-            if (strcmp(token, "}")) {
-                printf("Unknown token in parseMaterial: '%s'\n", token);
-                exit(0);
+            if (!token.is(kwRBrace)) {
+                lexer->unexpected(token, "a material or '}'");
             }
             break;
-        } 
+        }
     }
     printf("Parsed %d materials\n", (int) materials.size());
 }
 
 Lambert* SceneParser::parseLambert() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    char filename[MAX_PARSER_TOKEN_LENGTH];
     Texture* t = nullptr;
-    getToken(token);
-    assert(!strcmp(token, "{"));
+    expect(kwLBrace);
 
     while (true) {
-        getToken(token);
-        if (!strcmp(token, "color")) {
-            t = new SolidColor(readVector3f());
-        } else if (!strcmp(token, "texture")) {
-            int idx = readInt();
-            t = getTexture(idx);
+        SceneToken token = next();
+        if (token.is(kwColor)) {
+            t = arenaNew<SolidColor>(arenaTexture, readVector3f());
+        } else if (token.is(kwTexture)) {
+            t = readTexture();
         } else {
-            assert(!strcmp(token, "}"));
+            if (!token.is(kwRBrace)) {
+                lexer->unexpected(token, "color, texture or '}' in Lambert");
+            }
             break;
         }
     }
-    return new Lambert(t);
+    return arenaNew<Lambert>(arenaMaterial, t);
 }
 
 Metal* SceneParser::parseMetal() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    char filename[MAX_PARSER_TOKEN_LENGTH];
-    filename[0] = 0;
-    Texture* t;
+    Texture* t = nullptr;
     float fuzziness = 0;
-    getToken(token);
-    assert (!strcmp(token, "{"));
+    expect(kwLBrace);
 
     while (true) {
-        getToken(token);
-        if (strcmp(token, "color") == 0){
-            t = new SolidColor(readVector3f());
-        } else if (strcmp(token, "texture") == 0){
+        SceneToken token = next();
+        if (token.is(kwColor)) {
+            t = arenaNew<SolidColor>(arenaTexture, readVector3f());
+        } else if (token.is(kwTexture)) {
             // Optional: read in texture and draw it.
-            t = getTexture(readInt());
-        } else if (!strcmp(token, "fuzziness")) {
+            t = readTexture();
+        } else if (token.is(kwFuzziness)) {
             fuzziness = readFloat();
         } else {
-            assert (!strcmp(token, "}"));
+            if (!token.is(kwRBrace)) {
+                lexer->unexpected(token, "color, texture, fuzziness or '}' in Metal");
+            }
             break;
         }
     }
-    return new Metal(t, fuzziness);
+    return arenaNew<Metal>(arenaMaterial, t, fuzziness);
 }
 
 Dielectric* SceneParser::parseDielectric() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
     float refractionIndex = 0;
-    Texture* t;
-    getToken(token);
-    assert(!strcmp(token, "{"));
+    Texture* t = nullptr;
+    expect(kwLBrace);
 
     while (true) {
-        getToken(token);
-        if (!strcmp(token, "refractionIndex")) {
+        SceneToken token = next();
+        if (token.is(kwRefractionIndex)) {
             refractionIndex = readFloat();
-        } else if (!strcmp(token, "texture")) {
-            t = getTexture(readInt());
-        } else if (!strcmp(token, "color")) {
-            t = new SolidColor(readVector3f());
+        } else if (token.is(kwTexture)) {
+            t = readTexture();
+        } else if (token.is(kwColor)) {
+            t = arenaNew<SolidColor>(arenaTexture, readVector3f());
         } else {
-            assert (!strcmp(token, "}"));
+            if (!token.is(kwRBrace)) {
+                lexer->unexpected(token, "refractionIndex, color, texture or '}' in Dielectric");
+            }
             break;
         }
     }
-    return new Dielectric(t, refractionIndex);
+    if (t == nullptr) {
+        t = arenaNew<SolidColor>(arenaTexture, 1, 1, 1);   // 未指定颜色时为无色透明
+    }
+    return arenaNew<Dielectric>(arenaMaterial, t, refractionIndex);
 }
 
 EmissiveMaterial *SceneParser::parseEmissiveMaterial(){
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    Texture *t;
-    getToken(token);
-    assert(!strcmp(token, "{"));
+    Texture *t = nullptr;
+    expect(kwLBrace);
 
     while (true) {
-        getToken(token);
-        if (!strcmp(token, "color")) {
-            t = new SolidColor(readVector3f());
-        } else if (!strcmp(token, "texture")) {
-            t = getTexture(readInt());
+        SceneToken token = next();
+        if (token.is(kwColor)) {
+            t = arenaNew<SolidColor>(arenaTexture, readVector3f());
+        } else if (token.is(kwTexture)) {
+            t = readTexture();
         } else {
-            assert (!strcmp(token, "}"));
+            if (!token.is(kwRBrace)) {
+                lexer->unexpected(token, "color, texture or '}' in Emissive");
+            }
             break;
         }
     }
-    return new EmissiveMaterial(t);
+    return arenaNew<EmissiveMaterial>(arenaMaterial, t);
 }
 
 // ====================================================================
 // ====================================================================
 
-Object3D *SceneParser::parseObject(char token[MAX_PARSER_TOKEN_LENGTH]) {
+Object3D *SceneParser::parseObject(const SceneToken &token) {
     Object3D *answer = nullptr;
-    if (!strcmp(token, "Group")) {
-        answer = (Object3D *) parseGroup();
-    } else if (!strcmp(token, "Sphere")) {
-        answer = (Object3D *) parseSphere();
-    } else if (!strcmp(token, "Plane")) {
-        answer = (Object3D *) parsePlane();
-    } else if (!strcmp(token, "Triangle")) {
-        answer = (Object3D *) parseTriangle();
-    } else if (!strcmp(token, "TriangleMesh")) {
-        answer = (Object3D *) parseTriangleMesh();
-    } else if (!strcmp(token, "Transform")) {
-        answer = (Object3D *) parseTransform();
-    } else if (!strcmp(token, "BezierCurve")) {
-        answer = (Object3D *) parseBezierCurve();
-    } else if (!strcmp(token, "RevSurface")) {
-        answer = (Object3D *) parseRevSurface();
-    } else {
-        printf("Unknown token in parseObject: '%s'\n", token);
-        exit(0);
+    switch (token.keyword) {
+        case kwGroup: answer = (Object3D *) parseGroup(); break;
+        case kwSphere: answer = (Object3D *) parseSphere(); break;
+        case kwPlane: answer = (Object3D *) parsePlane(); break;
+        case kwTriangle: answer = (Object3D *) parseTriangle(); break;
+        case kwTriangleMesh: answer = (Object3D *) parseTriangleMesh(); break;
+        case kwTransform: answer = (Object3D *) parseTransform(); break;
+        case kwBezierCurve: answer = (Object3D *) parseBezierCurve(); break;
+        case kwRevSurface: answer = (Object3D *) parseRevSurface(); break;
+        case kwInstance: answer = makeObject(parseInstance()); break;
+        default:
+            lexer->unexpected(token, "an object");
     }
     return answer;
 }
 
+// 需要材质的物体之前必须有 MaterialIndex
+void SceneParser::requireMaterial(const SceneToken &token) {
+    if (current_material == nullptr) {
+        lexer->error(token, "object has no material (missing MaterialIndex)");
+    }
+}
+
 // ====================================================================
 // ====================================================================
 
-Group *SceneParser::parseGroup() {
+Group *SceneParser::parseGroup(bool root) {
     //
-    // each group starts with an integer that specifies
-    // the number of objects in the group
+    // a group may start with an integer that specifies
+    // the number of objects in the group (a Repeat counts as one);
+    // without numObjects the objects are read until '}'
     //
     // the material index sets the material of all objects which follow,
     // until the next material index (scoping for the materials is very
     // simple, and essentially ignores any tree hierarchy)
     //
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    getToken(token);
-    assert (!strcmp(token, "{"));
+    expect(kwLBrace);
 
     // read in the number of objects
-    getToken(token);
-    assert (!strcmp(token, "numObjects"));
-    int num_objects = readInt();
-
-    auto *grp = new Group(num_objects);
+    int num_objects = -1;
+    SceneToken token = next();
+    if (token.is(kwNumObjects)) {
+        num_objects = readInt();
+        token = next();
+    }
 
     // read in the objects
+    // 根 Group 的每一项从它的第一个记号和当时的材质开始计算签名，Repeat 展开的每一份再加上序号
+    std::vector<PlacedObject> items;
+    std::vector<unsigned long long> signatures;
     int count = 0;
-    while (num_objects > count) {
-        getToken(token);
-        if (!strcmp(token, "MaterialIndex")) {
-            // change the current material
-            int index = readInt();
-            assert (index >= 0 && index <= getNumMaterials());
-            current_material = getMaterial(index);
-        } else {
-            Object3D *object = parseObject(token);
-            assert (object != nullptr);
-            grp->addObject(count, object);
-
+    while (!token.is(kwRBrace)) {
+        if (count == num_objects && !token.is(kwMaterialIndex)) {
+            lexer->unexpected(token, "'}' (numObjects is smaller than the number of objects)");
+        }
+        if (root) {
+            beginSignature();
+            addSignature(token.text, token.length);
+            addSignature(&current_material, sizeof(current_material));
+        }
+        size_t first = items.size();
+        if (parseItem(token, items)) {
             count++;
         }
+        for (size_t i = first; root && i < items.size(); i++) {
+            unsigned long long s = signature;
+            unsigned long long copy = i - first;
+            SceneLexer::addSignature(s, &copy, sizeof(copy));
+            signatures.push_back(s);
+        }
+        token = next();
+    }
+    if (count < num_objects) {
+        lexer->error(token, "Group has %d objects but numObjects is %d", count, num_objects);
     }
-    getToken(token);
-    assert (!strcmp(token, "}"));
 
-    printf("Parsed %d objects\n", num_objects);
+    // 签名与 previous 的某个物体相同时沿用那个物体（每个旧物体只用一次）
+    std::multimap<unsigned long long, Object3D*> reusable;
+    if (root && previous != nullptr) {
+        for (size_t i = 0; i < previous->rootObjects.size(); i++) {
+            reusable.insert({previous->objectSignatures[i], previous->rootObjects[i]});
+        }
+    }
+    auto *grp = arenaNew<Group>(arenaGeometry, (int) items.size());
+    for (int i = 0; i < (int) items.size(); i++) {
+        Object3D *object = nullptr;
+        if (root) {
+            auto it = reusable.find(signatures[i]);
+            if (it != reusable.end()) {
+                object = it->second;
+                reusable.erase(it);
+                reuseStats.objects++;
+            }
+        }
+        if (object == nullptr) object = makeObject(items[i]);
+        grp->addObject(i, object);
+    }
+    if (root) {
+        rootObjects = grp->getObjects();
+        objectSignatures = signatures;
+    }
+
+    printf("Parsed %d objects\n", (int) items.size());
 
     // return the group
     return grp;
 }
 
+bool SceneParser::parseItem(const SceneToken &token, std::vector<PlacedObject> &items) {
+    if (token.is(kwMaterialIndex)) {
+        // change the current material
+        SceneToken indexToken = peek();
+        int index = readInt();
+        if (index < 0 || index >= getNumMaterials()) {
+            lexer->error(indexToken, "material index %d out of range (%d materials)", index, getNumMaterials());
+        }
+        current_material = getMaterial(index);
+        addSignature(&current_material, sizeof(current_material));
+        return false;
+    } else if (token.is(kwInstance)) {
+        items.push_back(parseInstance());
+    } else if (token.is(kwRepeat)) {
+        parseRepeat(items);
+    } else {
+        items.push_back({parseObject(token), Matrix4f::identity(), false});
+    }
+    return true;
+}
+
+Object3D *SceneParser::makeObject(const PlacedObject &p) {
+    if (!p.transformed) return p.object;
+    return arenaNew<Transform>(arenaGeometry, p.matrix, p.object);
+}
+
+// Define name { 物体列表 }：定义一个原型，之后用 Instance name { 变换 } 放置。
+// 原型只解析、构建一次，所有实例共用；有多个物体时为它们建一棵 SAH BVH
+void SceneParser::parseDefine() {
+    SceneToken nameToken = peek();
+    std::string name = readString();
+    if (prototypes.count(name)) {
+        lexer->error(nameToken, "prototype '%s' is already defined", name.c_str());
+    }
+    addSignature(&current_material, sizeof(current_material));
+    expect(kwLBrace);
+    std::vector<PlacedObject> items;
+    SceneToken token = next();
+    while (!token.is(kwRBrace)) {
+        parseItem(token, items);
+        token = next();
+    }
+    if (items.empty()) {
+        lexer->error(nameToken, "prototype '%s' has no objects", name.c_str());
+    }
+
+    // 热重载时原型没变就不再建 BVH
+    prototypeSignatures[name] = signature;
+    if (previous != nullptr) {
+        auto old = previous->prototypes.find(name);
+        if (old != previous->prototypes.end() && previous->prototypeSignatures[name] == signature) {
+            prototypes[name] = old->second;
+            reuseStats.prototypes++;
+            return;
+        }
+    }
+
+    Object3D *prototype;
+    if (items.size() == 1) {
+        prototype = makeObject(items[0]);
+    } else {
+        Group *grp = arenaNew<Group>(arenaGeometry, (int) items.size());
+        for (int i = 0; i < (int) items.size(); i++) {
+            grp->addObject(i, makeObject(items[i]));
+        }
+        prototype = BvhNode::build(grp, true);
+    }
+    prototypes[name] = prototype;
+}
+
+// Instance name { 变换 }：变换的写法同 Transform
+SceneParser::PlacedObject SceneParser::parseInstance() {
+    SceneToken nameToken = peek();
+    std::string name = readString();
+    auto it = prototypes.find(name);
+    if (it == prototypes.end()) {
+        lexer->error(nameToken, "unknown prototype '%s' (Define it before use)", name.c_str());
+    }
+    PlacedObject p = {it->second, Matrix4f::identity(), false};
+    addSignature(&p.object, sizeof(p.object));
+    expect(kwLBrace);
+    SceneToken token = next();
+    while (parseTransformStep(token, p.matrix)) {
+        p.transformed = true;
+        token = next();
+    }
+    if (!token.is(kwRBrace)) {
+        lexer->unexpected(token, "a transform or '}' in Instance");
+    }
+    return p;
+}
+
+// Repeat { count N 变换 物体列表 }：物体列表只解析一次，第 i 份（从 0 开始）放在 变换^i 处，
+// 例如 Translate 2 0 0 得到沿 x 间隔 2 的一排；Repeat 可以嵌套，得到网格
+void SceneParser::parseRepeat(std::vector<PlacedObject> &items) {
+    expect(kwLBrace);
+    expect(kwCount);
+    SceneToken countToken = peek();
+    int n = readInt();
+    if (n < 0) {
+        lexer->error(countToken, "Repeat count must not be negative");
+    }
+    Matrix4f step = Matrix4f::identity();
+    SceneToken token = next();
+    while (parseTransformStep(token, step)) {
+        token = next();
+    }
+    std::vector<PlacedObject> body;
+    while (!token.is(kwRBrace)) {
+        parseItem(token, body);
+        token = next();
+    }
+
+    Matrix4f matrix = Matrix4f::identity();
+    for (int i = 0; i < n; i++) {
+        for (const PlacedObject &p : body) {
+            items.push_back({p.object, matrix * p.matrix, p.transformed || i > 0});
+        }
+        matrix = step * matrix;
+    }
+}
+
 // ====================================================================
 // ====================================================================
 
 Sphere *SceneParser::parseSphere() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    getToken(token);
-    assert (!strcmp(token, "{"));
-    getToken(token);
-    assert (!strcmp(token, "center"));
+    SceneToken start = expect(kwLBrace);
+    expect(kwCenter);
     Vector3f center = readVector3f();
-    getToken(token);
-    assert (!strcmp(token, "radius"));
+    expect(kwRadius);
     float radius = readFloat();
-    getToken(token);
-    assert (!strcmp(token, "}"));
-    assert (current_material != nullptr);
-    return new Sphere(center, radius, current_material);
+    // 可选的 velocity：运动的球，时刻 t 的球心为 center + velocity * t
+    Vector3f velocity = Vector3f::ZERO;
+    if (peek().is(kwVelocity)) {
+        next();
+        velocity = readVector3f();
+    }
+    expect(kwRBrace);
+    requireMaterial(start);
+    Sphere *sphere = arenaNew<Sphere>(arenaGeometry, center, radius, current_material);
+    sphere->setVelocity(velocity);
+    if (sphere->isMoving()) numAnimated++;
+    return sphere;
 }
 
 Plane *SceneParser::parsePlane() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    getToken(token);
-    assert (!strcmp(token, "{"));
-    getToken(token);
-    assert (!strcmp(token, "normal"));
+    SceneToken start = expect(kwLBrace);
+    expect(kwNormal);
     Vector3f normal = readVector3f();
-    getToken(token);
-    assert (!strcmp(token, "offset"));
+    expect(kwOffset);
     float offset = readFloat();
-    getToken(token);
-    assert (!strcmp(token, "}"));
-    assert (current_material != nullptr);
-    return new Plane(normal, offset, current_material);
+    expect(kwRBrace);
+    requireMaterial(start);
+    return arenaNew<Plane>(arenaGeometry, normal, offset, current_material);
 }
 
 Triangle *SceneParser::parseTriangle() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    getToken(token);
-    assert (!strcmp(token, "{"));
-    getToken(token);
-    assert (!strcmp(token, "vertex0"));
+    SceneToken start = expect(kwLBrace);
+    expect(kwVertex0);
     Vector3f v0 = readVector3f();
-    getToken(token);
-    assert (!strcmp(token, "vertex1"));
+    expect(kwVertex1);
     Vector3f v1 = readVector3f();
-    getToken(token);
-    assert (!strcmp(token, "vertex2"));
+    expect(kwVertex2);
     Vector3f v2 = readVector3f();
-    getToken(token);
-    assert (!strcmp(token, "}"));
-    assert (current_material != nullptr);
-    return new Triangle(v0, v1, v2, current_material);
+    expect(kwRBrace);
+    requireMaterial(start);
+    return arenaNew<Triangle>(arenaGeometry, v0, v1, v2, current_material);
 }
 
 Mesh *SceneParser::parseTriangleMesh() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    char filename[MAX_PARSER_TOKEN_LENGTH];
     // get the filename
-    getToken(token);
-    assert (!strcmp(token, "{"));
-    getToken(token);
-    assert (!strcmp(token, "obj_file"));
-    getToken(filename);
-    getToken(token);
-    assert (!strcmp(token, "}"));
-    const char *ext = &filename[strlen(filename) - 4];
-    assert(!strcmp(ext, ".obj"));
-    Mesh *answer = new Mesh(filename, current_material);
+    expect(kwLBrace);
+    expect(kwObjFile);
+    SceneToken fileToken = peek();
+    std::string filename = readString();
+    expect(kwRBrace);
+    if (filename.size() < 4 || filename.compare(filename.size() - 4, 4, ".obj") != 0) {
+        lexer->error(fileToken, "obj_file must be a .obj file");
+    }
+    FileStamp stamp = addDependency(filename);
+    addSignature(&stamp, sizeof(stamp));
+
+    // 热重载时 OBJ 文件和材质都没变的网格直接沿用
+    std::pair<std::string, Material*> key(filename, current_material);
+    Mesh *answer = nullptr;
+    if (previous != nullptr) {
+        auto it = previous->meshes.find(key);
+        auto dep = previous->dependencies.find(filename);
+        if (it != previous->meshes.end() && dep != previous->dependencies.end() && dep->second == stamp) {
+            answer = it->second;
+            reuseStats.meshes++;
+        }
+    }
+    if (answer == nullptr) answer = arenaNew<Mesh>(arenaGeometry, filename.c_str(), current_material);
+    meshes[key] = answer;
 
     return answer;
 }
 
 Curve *SceneParser::parseBezierCurve() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    getToken(token);
-    assert (!strcmp(token, "{"));
-    getToken(token);
-    assert (!strcmp(token, "controls"));
+    expect(kwLBrace);
+    expect(kwControls);
     vector<Vector3f> controls;
     while (true) {
-        getToken(token);
-        if (!strcmp(token, "[")) {
+        SceneToken token = next();
+        if (token.is(kwLBracket)) {
             controls.push_back(readVector3f());
-            getToken(token);
-            assert (!strcmp(token, "]"));
-        } else if (!strcmp(token, "}")) {
+            expect(kwRBracket);
+        } else if (token.is(kwRBrace)) {
             break;
         } else {
-            printf("Incorrect format for BezierCurve!\n");
-            exit(0);
+            lexer->unexpected(token, "'[' or '}' in BezierCurve");
         }
     }
-    Curve *answer = new BezierCurve(controls);
+    Curve *answer = arenaNew<BezierCurve>(arenaGeometry, controls);
     return answer;
 }
 
 RevSurface *SceneParser::parseRevSurface() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
-    getToken(token);
-    assert (!strcmp(token, "{"));
-    getToken(token);
-    assert (!strcmp(token, "profile"));
+    SceneToken start = expect(kwLBrace);
+    expect(kwProfile);
     Curve* profile;
-    getToken(token);
-    if (!strcmp(token, "BezierCurve")) {
+    SceneToken token = next();
+    if (token.is(kwBezierCurve)) {
         profile = parseBezierCurve();
     } else {
-        printf("Unknown profile type in parseRevSurface: '%s'\n", token);
-        exit(0);
+        lexer->unexpected(token, "BezierCurve as the profile of RevSurface");
     }
-    getToken(token);
-    assert (!strcmp(token, "}"));
-    RevSurface *answer = new RevSurface(profile, current_material);
+    expect(kwRBrace);
+    requireMaterial(start);
+    RevSurface *answer = arenaNew<RevSurface>(arenaGeometry, profile, current_material);
     return answer;
 }
 
 Transform *SceneParser::parseTransform() {
-    char token[MAX_PARSER_TOKEN_LENGTH];
     Matrix4f matrix = Matrix4f::identity();
-    Object3D *object = nullptr;
-    getToken(token);
-    assert (!strcmp(token, "{"));
-    // read in transformations: 
+    TransformTrack track;
+    bool hasSteps = false;
+    expect(kwLBrace);
+    // read in transformations:
     // apply to the LEFT side of the current matrix (so the first
     // transform in the list is the last applied to the object)
-    getToken(token);
-
+    // 或者是关键帧动画：Keyframe { time t 变换 } ...，两种写法不能混用
+    SceneToken token = next();
     while (true) {
-        if (!strcmp(token, "Scale")) {
+        if (token.is(kwKeyframe)) {
+            if (hasSteps) lexer->error(token, "Transform cannot mix Keyframe blocks with plain transforms");
+            Matrix4f key = parseKeyframe(track);
+            if (track.numKeys() == 1) matrix = key;     // 只有一个关键帧时就是普通的变换
+        } else if (parseTransformStep(token, matrix)) {
+            if (track.numKeys() > 0) lexer->error(token, "Transform cannot mix Keyframe blocks with plain transforms");
+            hasSteps = true;
+        } else {
+            break;
+        }
+        token = next();
+    }
+
+    // otherwise this must be an object,
+    // and there are no more transformations
+    Object3D *object = parseObject(token);
+    expect(kwRBrace);
+    if (track.numKeys() > 1) {
+        numAnimated++;
+        return arenaNew<Transform>(arenaGeometry, track, object);
+    }
+    return arenaNew<Transform>(arenaGeometry, matrix, object);
+}
+
+// Keyframe { time t 变换 }：变换的写法同 Transform，关键帧的时刻必须递增。返回这一帧的矩阵
+Matrix4f SceneParser::parseKeyframe(TransformTrack &track) {
+    expect(kwLBrace);
+    expect(kwTime);
+    SceneToken timeToken = peek();
+    float time = readFloat();
+    if (track.numKeys() > 0 && time <= track.keyTime(track.numKeys() - 1)) {
+        lexer->error(timeToken, "Keyframe times must increase");
+    }
+    Matrix4f matrix = Matrix4f::identity();
+    SceneToken token = next();
+    while (parseTransformStep(token, matrix)) {
+        token = next();
+    }
+    if (!token.is(kwRBrace)) {
+        lexer->unexpected(token, "a transform or '}' in Keyframe");
+    }
+    track.addKey(time, matrix);
+    return matrix;
+}
+
+// Transform、Instance、Repeat 共用的一步变换，token 不是变换时返回 false
+bool SceneParser::parseTransformStep(const SceneToken &token, Matrix4f &matrix) {
+    switch (token.keyword) {
+        case kwScale: {
             Vector3f s = readVector3f();
             matrix = matrix * Matrix4f::scaling(s[0], s[1], s[2]);
-        } else if (!strcmp(token, "UniformScale")) {
+            return true;
+        }
+        case kwUniformScale: {
             float s = readFloat();
             matrix = matrix * Matrix4f::uniformScaling(s);
-        } else if (!strcmp(token, "Translate")) {
+            return true;
+        }
+        case kwTranslate:
             matrix = matrix * Matrix4f::translation(readVector3f());
-        } else if (!strcmp(token, "XRotate")) {
+            return true;
+        case kwXRotate:
             matrix = matrix * Matrix4f::rotateX(DegreesToRadians(readFloat()));
-        } else if (!strcmp(token, "YRotate")) {
+            return true;
+        case kwYRotate:
             matrix = matrix * Matrix4f::rotateY(DegreesToRadians(readFloat()));
-        } else if (!strcmp(token, "ZRotate")) {
+            return true;
+        case kwZRotate:
             matrix = matrix * Matrix4f::rotateZ(DegreesToRadians(readFloat()));
-        } else if (!strcmp(token, "Rotate")) {
-            getToken(token);
-            assert (!strcmp(token, "{"));
+            return true;
+        case kwRotate: {
+            expect(kwLBrace);
             Vector3f axis = readVector3f();
             float degrees = readFloat();
             float radians = DegreesToRadians(degrees);
             matrix = matrix * Matrix4f::rotation(axis, radians);
-            getToken(token);
-            assert (!strcmp(token, "}"));
-        } else if (!strcmp(token, "Matrix4f")) {
+            expect(kwRBrace);
+            return true;
+        }
+        case kwMatrix4f: {
             Matrix4f matrix2 = Matrix4f::identity();
-            getToken(token);
-            assert (!strcmp(token, "{"));
+            expect(kwLBrace);
             for (int j = 0; j < 4; j++) {
                 for (int i = 0; i < 4; i++) {
                     float v = readFloat();
                     matrix2(i, j) = v;
                 }
             }
-            getToken(token);
-            assert (!strcmp(token, "}"));
+            expect(kwRBrace);
             matrix = matrix2 * matrix;
-        } else {
-            // otherwise this must be an object,
-            // and there are no more transformations
-            object = parseObject(token);
-            break;
+            return true;
         }
-        getToken(token);
+        default:
+            return false;
     }
-
-    assert(object != nullptr);
-    getToken(token);
-    assert (!strcmp(token, "}"));
-    return new Transform(matrix, object);
 }
 
 // ====================================================================
 // ====================================================================
 
-int SceneParser::getToken(char token[MAX_PARSER_TOKEN_LENGTH]) {
-    // for simplicity, tokens must be separated by whitespace
-    assert (file != nullptr);
-    int success = fscanf(file, "%s ", token);
-    if (success == EOF) {
-        token[0] = '\0';
-        return 0;
+SceneToken SceneParser::next() {
+    SceneToken token = hasPeeked ? peeked : lex();
+    hasPeeked = false;
+    addSignature(token.text, token.length);
+    addSignature(" ", 1);   // 记号之间的分隔，"ab c" 与 "a bc" 不同
+    return token;
+}
+
+SceneToken SceneParser::peek() {
+    if (!hasPeeked) {
+        peeked = lex();
+        hasPeeked = true;
     }
-    return 1;
+    return peeked;
 }
 
+SceneToken SceneParser::lex() {
+    while (true) {
+        SceneToken token = lexer->next();
+        if (token.is(kwInclude)) {
+            pushInclude(token);
+        } else if (token.atEnd() && includeStack.size() > 1) {
+            // 被包含的文件读完，回到包含它的文件
+            includeStack.pop_back();
+            lexer = includeStack.back();
+        } else {
+            return token;
+        }
+    }
+}
 
-Vector3f SceneParser::readVector3f() {
-    float x, y, z;
-    int count = fscanf(file, "%f %f %f", &x, &y, &z);
-    if (count != 3) {
-        printf("Error trying to read 3 floats to make a Vector3f\n");
-        assert (0);
+SceneToken SceneParser::expect(SceneKeyword kw) {
+    SceneToken tok = next();
+    if (!tok.is(kw)) {
+        std::string what = std::string("'") + SceneLexer::keywordText(kw) + "'";
+        lexer->unexpected(tok, what.c_str());
     }
-    return Vector3f(x, y, z);
+    return tok;
 }
 
+std::string SceneParser::readString() {
+    SceneToken tok = next();
+    if (tok.atEnd() || tok.is(kwLBrace) || tok.is(kwRBrace)) lexer->unexpected(tok, "a name");
+    return tok.str();
+}
 
 float SceneParser::readFloat() {
-    float answer;
-    int count = fscanf(file, "%f", &answer);
-    if (count != 1) {
-        printf("Error trying to read 1 float\n");
-        assert (0);
-    }
-    return answer;
+    SceneToken tok = next();
+    float v;
+    if (!SceneLexer::parseFloat(tok.text, tok.length, v)) lexer->unexpected(tok, "a number");
+    return v;
 }
 
-
 int SceneParser::readInt() {
-    int answer;
-    int count = fscanf(file, "%d", &answer);
-    if (count != 1) {
-        printf("Error trying to read 1 int\n");
-        assert (0);
+    SceneToken tok = next();
+    int v;
+    if (!SceneLexer::parseInt(tok.text, tok.length, v)) lexer->unexpected(tok, "an integer");
+    return v;
+}
+
+Vector3f SceneParser::readVector3f() {
+    float x = readFloat();
+    float y = readFloat();
+    float z = readFloat();
+    return Vector3f(x, y, z);
+}
+
+// Include path：把另一个场景文件的内容插入到这里。相对路径相对于当前文件所在的目录。
+// 路径必须和 Include 在同一个文件里，直接从当前的 lexer 读
+void SceneParser::pushInclude(const SceneToken &token) {
+    SceneToken pathToken = lexer->peek();
+    std::string path = lexer->readString();
+    if (path[0] != '/') {
+        const std::string &current = lexer->getFilename();
+        size_t slash = current.find_last_of('/');
+        if (slash != std::string::npos) {
+            path = current.substr(0, slash + 1) + path;
+        }
     }
-    return answer;
+    if (includeStack.size() > 16) {
+        lexer->error(token, "Include nested too deeply (recursive Include?)");
+    }
+    std::unique_ptr<SceneLexer> included(new SceneLexer());
+    addDependency(path);
+    if (!included->open(path.c_str())) {
+        lexer->error(pathToken, "cannot open included file '%s'", path.c_str());
+    }
+    lexers.push_back(std::move(included));
+    lexer = lexers.back().get();
+    includeStack.push_back(lexer);
 }
@@ -0,0 +1,260 @@
+#include "settings.hpp"
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "aov.hpp"
+#include "texture.hpp"
+#include "texture_manager.hpp"
+#include "utils.hpp"
+
+static bool parseInt(const std::string& name, const std::string& value, int& out) {
+    char* end;
+    long v = strtol(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0') {
+        printf("%s expects an integer, got '%s'\n", name.c_str(), value.c_str());
+        return false;
+    }
+    out = (int) v;
+    return true;
+}
+
+static bool parseUnsigned(const std::string& name, const std::string& value, unsigned int& out) {
+    char* end;
+    errno = 0;
+    unsigned long v = strtoul(value.c_str(), &end, 10);
+    if (value.empty() || value[0] == '-' || *end != '\0' || errno == ERANGE || v > UINT_MAX) {
+        printf("%s expects an integer between 0 and %u, got '%s'\n", name.c_str(), UINT_MAX, value.c_str());
+        return false;
+    }
+    out = (unsigned int) v;
+    return true;
+}
+
+static bool parseFloat(const std::string& name, const std::string& value, float& out) {
+    char* end;
+    float v = strtof(value.c_str(), &end);
+    if (value.empty() || *end != '\0') {
+        printf("%s expects a number, got '%s'\n", name.c_str(), value.c_str());
+        return false;
+    }
+    out = v;
+    return true;
+}
+
+static bool parseBool(const std::string& name, const std::string& value, bool& out) {
+    int v;
+    if (!parseInt(name, value, v)) return false;
+    out = v != 0;
+    return true;
+}
+
+// 二选一的名字，value 为 a 时 out = false，为 b 时 out = true
+static bool parseChoice(const std::string& name, const std::string& value, const char* a, const char* b, bool& out) {
+    if (value != a && value != b) {
+        printf("%s must be %s or %s\n", name.c_str(), a, b);
+        return false;
+    }
+    out = value == b;
+    return true;
+}
+
+bool RenderSettings::set(const std::string& name, const std::string& value, bool fromScene) {
+    if (fromScene) {
+        if (fromCommandLine.count(name)) return true;   // 命令行优先
+        if (name == "serve" || name == "spawn" || name == "bind" || name == "worker" || name == "preview") {
+            printf("%s can only be given on the command line\n", name.c_str());
+            return false;
+        }
+    } else {
+        fromCommandLine.insert(name);
+    }
+
+    if (name == "spp") {
+        if (!parseInt(name, value, samplesPerPixel)) return false;
+        if (samplesPerPixel < 1) {
+            printf("spp must be at least 1\n");
+            return false;
+        }
+    } else if (name == "max-depth") {
+        if (!parseInt(name, value, maxDepth)) return false;
+        if (maxDepth < 1) {
+            printf("max-depth must be at least 1\n");
+            return false;
+        }
+    } else if (name == "seed") {
+        if (!parseUnsigned(name, value, seed)) return false;
+        Utils::setSeed(seed);
+    } else if (name == "time-budget") {
+        return parseFloat(name, value, timeBudget);
+    } else if (name == "integrator") {
+        return parseChoice(name, value, "recursive", "wavefront", wavefront);
+    } else if (name == "ray-sort") {
+        return parseBool(name, value, raySort);
+    } else if (name == "packet") {
+        if (!parseInt(name, value, packetSize)) return false;
+        if (packetSize != 1 && packetSize != 4 && packetSize != 8 && packetSize != 16) {
+            printf("packet must be 1, 4, 8 or 16\n");
+            return false;
+        }
+    } else if (name == "accel") {
+        return parseChoice(name, value, "median", "sah", sahBvh);
+    } else if (name == "generator") {
+        if (value == "scene1") {
+            generator = scene1Generator;
+        } else if (value == "world") {
+            generator = worldGenerator;
+        } else if (value == "none") {
+            generator = noGenerator;
+        } else {
+            printf("generator must be scene1, world or none\n");
+            return false;
+        }
+    } else if (name == "world-chunks") {
+        if (!parseInt(name, value, worldChunks)) return false;
+        if (worldChunks < 1) {
+            printf("world-chunks must be at least 1\n");
+            return false;
+        }
+    } else if (name == "world-height") {
+        if (!parseInt(name, value, worldHeight)) return false;
+        if (worldHeight < 32 || worldHeight > 1024) {
+            printf("world-height must be between 32 and 1024\n");
+            return false;
+        }
+    } else if (name == "world-seed") {
+        return parseUnsigned(name, value, worldSeed);
+    } else if (name == "frames") {
+        if (!parseInt(name, value, frames)) return false;
+        if (frames < 1) {
+            printf("frames must be at least 1\n");
+            return false;
+        }
+    } else if (name == "start-time") {
+        return parseFloat(name, value, startTime);
+    } else if (name == "frame-step") {
+        return parseFloat(name, value, frameStep);
+    } else if (name == "shutter") {
+        if (!parseFloat(name, value, shutter)) return false;
+        if (shutter < 0) {
+            printf("shutter must not be negative\n");
+            return false;
+        }
+    } else if (name == "refit-threshold") {
+        if (!parseFloat(name, value, refitThreshold)) return false;
+        if (refitThreshold < 0) {
+            printf("refit-threshold must not be negative\n");
+            return false;
+        }
+    } else if (name == "env-light") {
+        return parseBool(name, value, envLight);
+    } else if (name == "texture-filter") {
+        if (value == "nearest") {
+            ImageTexture::filter = nearestFilter;
+        } else if (value == "bilinear") {
+            ImageTexture::filter = bilinearFilter;
+        } else if (value == "trilinear") {
+            ImageTexture::filter = trilinearFilter;
+        } else {
+            printf("texture-filter must be nearest, bilinear or trilinear\n");
+            return false;
+        }
+    } else if (name == "texture-linear") {
+        if (!parseBool(name, value, textureLinear)) return false;
+        TextureManager::instance().setLinearize(textureLinear);
+    } else if (name == "texture-budget") {
+        // 纹素内存上限（MB），超出时按块换出；0 表示不限制
+        float mb;
+        if (!parseFloat(name, value, mb)) return false;
+        TextureManager::instance().setBudget((size_t) (mb * 1048576));
+    } else if (name == "threads") {
+        if (!parseInt(name, value, threads)) return false;
+        if (threads < 0) {
+            printf("threads must not be negative (0 uses every hardware thread)\n");
+            return false;
+        }
+    } else if (name == "tile-size") {
+        if (!parseInt(name, value, tileSize)) return false;
+        if (tileSize < 1) {
+            printf("tile-size must be at least 1\n");
+            return false;
+        }
+    } else if (name == "serve") {
+        return parseInt(name, value, servePort);
+    } else if (name == "spawn") {
+        return parseInt(name, value, spawnCount);
+    } else if (name == "bind") {
+        bindAddress = value;
+    } else if (name == "unit-timeout") {
+        if (!parseInt(name, value, unitTimeout)) return false;
+        if (unitTimeout < 0) {
+            printf("unit-timeout must not be negative\n");
+            return false;
+        }
+    } else if (name == "worker") {
+        workerAddress = value;
+    } else if (name == "preview") {
+        return parseInt(name, value, previewPort);
+    } else if (name == "watch") {
+        return parseBool(name, value, watch);
+    } else if (name == "output-dir") {
+        outputDir = value;
+    } else if (name == "format") {
+        formats = 0;
+        size_t start = 0;
+        while (start <= value.size()) {
+            size_t end = value.find(',', start);
+            if (end == std::string::npos) end = value.size();
+            std::string item = value.substr(start, end - start);
+            start = end + 1;
+            if (item == "bmp") {
+                formats |= bmpFormat;
+            } else if (item == "ppm") {
+                formats |= ppmFormat;
+            } else if (item == "tga") {
+                formats |= tgaFormat;
+            } else {
+                printf("Unknown image format '%s', expected bmp, ppm or tga\n", item.c_str());
+                return false;
+            }
+        }
+    } else if (name == "checkpoint") {
+        return parseInt(name, value, checkpointColumns);
+    } else if (name == "aov") {
+        return AovBuffers::parseList(value, aovMask);
+    } else if (name == "denoise") {
+        return parseBool(name, value, denoise);
+    } else {
+        printf("Unknown setting: %s\n", name.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool RenderSettings::parseArgs(int argc, char* argv[], int first) {
+    for (int i = first; i < argc; i++) {
+        if (strncmp(argv[i], "--", 2) != 0 || i + 1 >= argc) {
+            printf("Unknown argument: %s\n", argv[i]);
+            return false;
+        }
+        if (!set(argv[i] + 2, argv[i + 1])) return false;
+        i++;
+    }
+    return true;
+}
+
+void RenderSettings::printUsage() {
+    printf("Usage: ./bin/PA1 <input scene file> <output name> [--name value ...]\n"
+           "  sampling:   --spp N  --max-depth N  --seed N  --time-budget SECONDS\n"
+           "  integrator: --integrator recursive|wavefront  --ray-sort 0|1  --packet 1|4|8|16  --env-light 0|1\n"
+           "  scene:      --accel median|sah  --generator scene1|world|none\n"
+           "  world:      --world-chunks N  --world-height N  --world-seed N\n"
+           "  animation:  --frames N  --start-time T  --frame-step DT  --shutter S  --refit-threshold R\n"
+           "  textures:   --texture-filter nearest|bilinear|trilinear  --texture-linear 0|1  --texture-budget MB\n"
+           "  output:     --output-dir DIR  --format bmp,ppm,tga  --checkpoint COLUMNS  --aov NAME,...|all  --denoise 0|1\n"
+           "  parallel:   --threads N  --tile-size N  --serve PORT [--spawn N] [--bind ADDR] [--unit-timeout S] | --worker HOST:PORT\n"
+           "  preview:    --preview PORT  --watch 0|1\n"
+           "The same names (without --) can be set in a RenderSettings { name value ... } block of the scene file;\n"
+           "command-line values take precedence.\n");
+}
@@ -0,0 +1,143 @@
+#include "stats.hpp"
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "image.hpp"
+#include "object3d.hpp"
+
+static std::mutex statsMutex;
+static std::vector<RenderStats*> threadStats;   // 每个线程一份，程序结束前不释放
+
+static int pixelWidth = 0;
+static int pixelHeight = 0;
+static std::vector<long long> pixelNodeVisits;
+static std::vector<int> pixelSamples;
+
+static const char* objectTypeName(int type) {
+    switch (type) {
+        case group: return "group";
+        case mesh: return "mesh";
+        case sphere: return "sphere";
+        case rectX: return "rectX";
+        case rectY: return "rectY";
+        case rectZ: return "rectZ";
+        case triangle: return "triangle";
+        case bhvNode: return "bvhNode";
+        case aabb: return "aabb";
+        case revSurface: return "revSurface";
+        case plane: return "plane";
+        case transformObj: return "transform";
+        case curveObj: return "curve";
+        case voxelObj: return "voxel";
+        case box: return "box";
+        default: return "unknown";
+    }
+}
+
+RenderStats* RenderStats::registerThread() {
+    RenderStats* s = new RenderStats();
+    std::lock_guard<std::mutex> lock(statsMutex);
+    threadStats.push_back(s);
+    return s;
+}
+
+void RenderStats::add(const RenderStats& o) {
+    cameraRays += o.cameraRays;
+    secondaryRays += o.secondaryRays;
+    shadowRays += o.shadowRays;
+    bvhNodesVisited += o.bvhNodesVisited;
+    aabbTests += o.aabbTests;
+    packetNodesVisited += o.packetNodesVisited;
+    packetFallbackRays += o.packetFallbackRays;
+    for (int i = 0; i < maxObjectTypes; i++) primitiveTests[i] += o.primitiveTests[i];
+    newtonIterations += o.newtonIterations;
+    paths += o.paths;
+    pathLengthSum += o.pathLengthSum;
+    for (int i = 0; i < pathLengthBins; i++) pathLengths[i] += o.pathLengths[i];
+}
+
+RenderStats RenderStats::total() {
+    RenderStats sum;
+    std::lock_guard<std::mutex> lock(statsMutex);
+    for (const RenderStats* s : threadStats) sum.add(*s);
+    return sum;
+}
+
+void RenderStats::report(float seconds) {
+    RenderStats s = total();
+    long long rays = s.cameraRays + s.secondaryRays + s.shadowRays;
+    double perRay = rays > 0 ? 1.0 / rays : 0;
+    printf("==== Render statistics (%d threads) ====\n", (int) threadStats.size());
+    printf("Camera rays:         %lld\n", s.cameraRays);
+    printf("Secondary rays:      %lld\n", s.secondaryRays);
+    if (s.shadowRays > 0) {
+        printf("Shadow rays:         %lld\n", s.shadowRays);
+    }
+    printf("Render time:         %.2f s\n", seconds);
+    printf("Throughput:          %.3f Mrays/s\n", seconds > 0 ? rays / seconds * 1e-6 : 0.0);
+    printf("BVH nodes visited:   %lld (%.2f per ray)\n", s.bvhNodesVisited, s.bvhNodesVisited * perRay);
+    printf("AABB tests:          %lld (%.2f per ray)\n", s.aabbTests, s.aabbTests * perRay);
+    if (s.packetNodesVisited > 0) {
+        printf("Packet nodes:        %lld (fallback to single rays: %lld rays)\n", s.packetNodesVisited, s.packetFallbackRays);
+    }
+    printf("Primitive tests:\n");
+    for (int i = 0; i < maxObjectTypes; i++) {
+        if (s.primitiveTests[i] == 0) continue;
+        printf("  %-12s %lld (%.2f per ray)\n", objectTypeName(i), s.primitiveTests[i], s.primitiveTests[i] * perRay);
+    }
+    printf("Newton iterations:   %lld\n", s.newtonIterations);
+    printf("Path length:         %.2f average over %lld paths\n",
+           s.paths > 0 ? (double) s.pathLengthSum / s.paths : 0.0, s.paths);
+    for (int i = 0; i < pathLengthBins; i++) {
+        if (s.pathLengths[i] == 0) continue;
+        printf("  %s%2d: %lld\n", i == pathLengthBins - 1 ? ">=" : "  ", i, s.pathLengths[i]);
+    }
+}
+
+void RenderStats::initPixels(int width, int height) {
+    pixelWidth = width;
+    pixelHeight = height;
+    pixelNodeVisits.assign(width * height, 0);
+    pixelSamples.assign(width * height, 0);
+}
+
+// 每个像素只由一个线程写，不需要加锁
+void RenderStats::recordPixel(int x, int y, long long nodeVisits, int spp) {
+    pixelNodeVisits[y * pixelWidth + x] += nodeVisits;
+    pixelSamples[y * pixelWidth + x] += spp;
+}
+
+// 把数值映射成 蓝 -> 绿 -> 红 的颜色
+static Vector3f heatColor(float t) {
+    t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    if (t < 0.5f) return Vector3f(0, 2 * t, 1 - 2 * t);
+    return Vector3f(2 * t - 1, 2 - 2 * t, 0);
+}
+
+template <class T>
+static void saveHeatmap(const std::vector<T>& values, const std::string& filename) {
+    double mx = 0;
+    for (T v : values) mx = std::max(mx, (double) v);
+    Image img(pixelWidth, pixelHeight);
+    for (int y = 0; y < pixelHeight; y++) {
+        for (int x = 0; x < pixelWidth; x++) {
+            double v = values[y * pixelWidth + x];
+            img.SetPixel(x, y, heatColor(mx > 0 ? v / mx : 0));
+        }
+    }
+    img.SaveBMP(filename.c_str());
+    printf("Heatmap saved! File name: %s (max %.1f)\n", filename.c_str(), mx);
+}
+
+void RenderStats::saveHeatmaps(const char* prefix) {
+    if (pixelWidth == 0) return;
+    // 节点访问次数按每个采样平均
+    std::vector<double> nodesPerSample(pixelNodeVisits.size());
+    for (size_t i = 0; i < nodesPerSample.size(); i++) {
+        nodesPerSample[i] = pixelSamples[i] > 0 ? (double) pixelNodeVisits[i] / pixelSamples[i] : 0;
+    }
+    saveHeatmap(nodesPerSample, std::string(prefix) + "_nodes.bmp");
+    saveHeatmap(pixelSamples, std::string(prefix) + "_spp.bmp");
+}
@@ -1,28 +1,144 @@
 #include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <cstdint>
 #include <vecmath.h>
+#include "arena.hpp"
 #include "utils.hpp"
 #include "texture.hpp"
+#include "texture_manager.hpp"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+TextureFilter ImageTexture::filter = trilinearFilter;
+float ImageTexture::decodeLut[256];
+// 类内初始化的常量的定义（buildTiles 中 std::min 按引用使用 tileSize）
+const int ImageTexture::bytesPerPixel;
+const int ImageTexture::tileSize;
+const int ImageTexture::tileBytes;
+
+// 线性值 -> 8 位值，decodeLut 的逆（二分查找最接近的项）
+static unsigned char encodeTexel(float c) {
+    int lo = 0, hi = 255;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (ImageTexture::decodeLut[mid] < c) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo > 0 && c - ImageTexture::decodeLut[lo - 1] < ImageTexture::decodeLut[lo] - c) --lo;
+    return (unsigned char) lo;
+}
+
 // 用stb_image载入图片
-ImageTexture::ImageTexture(const char* filename) {
+ImageTexture::ImageTexture(const char* filename, TextureManager* _manager, bool _paged)
+    : loaded(false), paged(_paged), manager(_manager), width(0), height(0) {
+    texType = imageTex;
     int compsPerPixel = bytesPerPixel;
 
-    img = stbi_load(filename, &width, &height, &compsPerPixel, compsPerPixel);
+    unsigned char* img = stbi_load(filename, &width, &height, &compsPerPixel, compsPerPixel);
     if (!img) {
         std::cerr << "Error: Loading image texture from '" << filename << "' failed\n"; 
         width = height = 0;
+        return;
     }
 
-    bytesPerRow = bytesPerPixel * width;
+    buildTiles(img, manager);
+    stbi_image_free(img);   // stbi_load 用 malloc 分配
+    loaded = true;
 }
 
-Vector3f ImageTexture::getColor(float u, float v, const Vector3f& pos) const {
-    if (!img) return Vector3f::ZERO; // shows black when image is not loaded
+ImageTexture::~ImageTexture() {
+    for (Tile& tile : tiles) {
+        free(tile.data);
+    }
+}
+
+// 逐层减半直到 1x1（奇数边长时最后一行（列）并入上一层的最后一个纹素），
+// 每层切成 tileSize x tileSize 的块，边缘不足的部分补零
+void ImageTexture::buildTiles(const unsigned char* img, TextureManager* manager) {
+    std::vector<unsigned char> cur(img, img + (size_t) width * height * bytesPerPixel);
+    std::vector<unsigned char> next;
+    int w = width, h = height;
+    std::vector<unsigned char> block(tileBytes);
+    while (true) {
+        // 切块
+        MipLevel level;
+        level.width = w;
+        level.height = h;
+        level.tilesX = (w + tileSize - 1) / tileSize;
+        level.tilesY = (h + tileSize - 1) / tileSize;
+        level.firstTile = (int) tiles.size();
+        for (int ty = 0; ty < level.tilesY; ty++) {
+            for (int tx = 0; tx < level.tilesX; tx++) {
+                std::fill(block.begin(), block.end(), 0);
+                int rows = std::min(tileSize, h - ty * tileSize);
+                int cols = std::min(tileSize, w - tx * tileSize);
+                for (int r = 0; r < rows; r++) {
+                    const unsigned char* src = cur.data() + ((size_t) (ty * tileSize + r) * w + tx * tileSize) * bytesPerPixel;
+                    memcpy(block.data() + r * tileSize * bytesPerPixel, src, cols * bytesPerPixel);
+                }
+                Tile tile;
+                if (paged) {
+                    tile.fileOffset = manager->writeTile(block.data());   // 用到时才读入
+                } else {
+                    tile.data = (unsigned char*) malloc(tileBytes);
+                    memcpy(tile.data, block.data(), tileBytes);
+                    manager->addResident(tileBytes);
+                }
+                tiles.push_back(tile);
+            }
+        }
+        levels.push_back(level);
+        if (w == 1 && h == 1) break;
 
-    u = Utils::clamp(u, 0.0, 1.0);
-    v = 1.0f - Utils::clamp(v, 0.0, 1.0);
+        // 下一层：在线性空间中平均
+        int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+        next.assign((size_t) nw * nh * bytesPerPixel, 0);
+        for (int y = 0; y < nh; y++) {
+            int y0 = 2 * y, y1 = y == nh - 1 ? h : std::min(2 * y + 2, h);
+            for (int x = 0; x < nw; x++) {
+                int x0 = 2 * x, x1 = x == nw - 1 ? w : std::min(2 * x + 2, w);
+                float sum[bytesPerPixel] = {};
+                for (int sy = y0; sy < y1; sy++) {
+                    for (int sx = x0; sx < x1; sx++) {
+                        const unsigned char* p = cur.data() + ((size_t) sy * w + sx) * bytesPerPixel;
+                        for (int c = 0; c < bytesPerPixel; c++) sum[c] += decodeLut[p[c]];
+                    }
+                }
+                float n = (float) ((y1 - y0) * (x1 - x0));
+                for (int c = 0; c < bytesPerPixel; c++) {
+                    next[((size_t) y * nw + x) * bytesPerPixel + c] = encodeTexel(sum[c] / n);
+                }
+            }
+        }
+        cur.swap(next);
+        w = nw;
+        h = nh;
+    }
+}
+
+Vector3f ImageTexture::texel(const MipLevel& level, int x, int y) const {
+    int tileIndex = level.firstTile + (y / tileSize) * level.tilesX + x / tileSize;
+    int offset = ((y % tileSize) * tileSize + x % tileSize) * bytesPerPixel;
+    if (paged) {
+        unsigned char pixel[bytesPerPixel];
+        manager->readPaged(const_cast<ImageTexture*>(this), tileIndex, offset, pixel);
+        return Vector3f(decodeLut[pixel[0]], decodeLut[pixel[1]], decodeLut[pixel[2]]);
+    }
+    const unsigned char* pixel = tiles[tileIndex].data + offset;
+    return Vector3f(decodeLut[pixel[0]], decodeLut[pixel[1]], decodeLut[pixel[2]]);
+}
+
+// 限制到 [0, 1]，NaN 取 0（否则换算成纹素下标后越界）
+static inline float clampUv(float x) {
+    return x >= 0 ? (x <= 1 ? x : 1) : 0;
+}
+
+Vector3f ImageTexture::nearest(float u, float v) const {
+    u = clampUv(u);
+    v = 1.0f - clampUv(v);
 
     int x = (int) (u * width);
     int y = (int) (v * height);
@@ -31,8 +147,288 @@ Vector3f ImageTexture::getColor(float u, float v, const Vector3f& pos) const {
     if (x >= width) x = width - 1;
     if (y >= height) y = height - 1;
 
-    const float m = 1.0f / 255.0f;
-    unsigned char* pixel = img + y * bytesPerRow + x * bytesPerPixel;
+    return texel(levels[0], x, y);
+}
+
+// 纹素中心位于 (i + 0.5) / width，边界外按边缘纹素处理
+Vector3f ImageTexture::bilinear(const MipLevel& level, float u, float v) const {
+    u = clampUv(u);
+    v = 1.0f - clampUv(v);
+
+    float fx = u * level.width - 0.5f;
+    float fy = v * level.height - 0.5f;
+    int x0 = (int) std::floor(fx);
+    int y0 = (int) std::floor(fy);
+    float ax = fx - x0;
+    float ay = fy - y0;
+    int x1 = std::min(x0 + 1, level.width - 1);
+    int y1 = std::min(y0 + 1, level.height - 1);
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+
+    return (1 - ay) * ((1 - ax) * texel(level, x0, y0) + ax * texel(level, x1, y0))
+         + ay * ((1 - ax) * texel(level, x0, y1) + ax * texel(level, x1, y1));
+}
+
+Vector3f ImageTexture::getColor(float u, float v, const Vector3f& pos) const {
+    return sample(u, v, 0);
+}
+
+Vector3f ImageTexture::sample(float u, float v, float uvWidth) const {
+    if (!loaded) return Vector3f::ZERO; // shows black when image is not loaded
+
+    if (filter == nearestFilter) return nearest(u, v);
+    if (filter == bilinearFilter) return bilinear(levels[0], u, v);
+
+    // 光线锥覆盖的纹素数取 log2 即为层级
+    float texels = uvWidth * std::max(width, height);
+    if (!(texels > 1)) return nearest(u, v);          // 放大（或 NaN）
+    float lod = std::log2(texels);
+    int maxLevel = (int) levels.size() - 1;
+    if (!(lod < maxLevel)) return bilinear(levels[maxLevel], u, v);
+    int l = (int) lod;
+    float a = lod - l;
+    return (1 - a) * bilinear(levels[l], u, v) + a * bilinear(levels[l + 1], u, v);
+}
+
+// ====================================================================
+// 程序化纹理
+// ====================================================================
+
+namespace {
+
+const float turbulenceMean = 0.22f;     // |noise| 的平均值（实测）
+
+// 足迹宽度内有 fw 个周期：不超过 1/4 时完整保留，达到 1/2（奈奎斯特频率）时完全淡出
+inline float bandFade(float fw) {
+    return std::min(1.0f, std::max(0.0f, 2 - 4 * fw));
+}
+
+inline uint32_t cellHash(int x, int y, int z, uint32_t seed) {
+    uint32_t h = seed * 0x9E3779B9u ^ (uint32_t) x * 0x85EBCA6Bu ^ (uint32_t) y * 0xC2B2AE35u ^ (uint32_t) z * 0x27D4EB2Fu;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// 每层噪声先做一次固定的旋转再放大一倍，各层的格点平面互不对齐：
+// 与坐标轴平行（或接近平行，如大球的表面）的面不会落在噪声格点平面附近而出现条带
+const float octaveRotation[3][3] = {{0.00f, 0.80f, 0.60f}, {-0.80f, 0.36f, -0.48f}, {-0.60f, -0.48f, 0.64f}};
+
+inline void rotateOctave(float& x, float& y, float& z) {
+    float rx = octaveRotation[0][0] * x + octaveRotation[0][1] * y + octaveRotation[0][2] * z;
+    float ry = octaveRotation[1][0] * x + octaveRotation[1][1] * y + octaveRotation[1][2] * z;
+    float rz = octaveRotation[2][0] * x + octaveRotation[2][1] * y + octaveRotation[2][2] * z;
+    x = rx;
+    y = ry;
+    z = rz;
+}
 
-    return Vector3f(m * pixel[0], m * pixel[1], m * pixel[2]);
-}
\ No newline at end of file
+// 各图案值的平均值，足迹过宽时淡出到这个值
+float patternMean(NoisePattern pattern) {
+    switch (pattern) {
+        case turbulencePattern: return 2 * turbulenceMean;
+        case worleyPattern: return 0.4f;
+        default: return 0.5f;
+    }
+}
+
+// 图案用到的是带符号的噪声（fbm）还是绝对值（湍流）
+bool usesTurbulence(NoisePattern pattern) {
+    return pattern == turbulencePattern || pattern == marblePattern;
+}
+
+} // namespace
+
+NoiseTexture::NoiseTexture(NoisePattern _pattern, Texture* t0, Texture* t1, float _frequency, int _octaves,
+                           unsigned int _seed, bool _uvSpace)
+    : pattern(_pattern), texture0(t0), texture1(t1), frequency(_frequency), octaves(_octaves), seed(_seed),
+      uvSpace(_uvSpace), perlin(_seed) {
+    texType = noiseTex;
+}
+
+bool NoiseTexture::parsePattern(const std::string& name, NoisePattern& out) {
+    static const char* names[] = {"fbm", "turbulence", "marble", "wood", "worley"};
+    for (int i = 0; i < 5; i++) {
+        if (name == names[i]) {
+            out = (NoisePattern) i;
+            return true;
+        }
+    }
+    return false;
+}
+
+float NoiseTexture::octaveSum(const Vector3f& p, float width, bool absolute) const {
+    float mean = absolute ? turbulenceMean : 0;
+    float sum = 0, amp = 1, norm = 0, freq = 1;
+    float x = p.x(), y = p.y(), z = p.z();
+    for (int i = 0; i < octaves; i++) {
+        float fade = width > 0 ? bandFade(freq * width) : 1;
+        float n = mean;
+        rotateOctave(x, y, z);
+        if (fade > 0) {
+            n = perlin.noise(x, y, z);
+            if (absolute) n = std::fabs(n);
+            n = mean + fade * (n - mean);
+        }
+        sum += amp * n;
+        norm += amp;
+        amp *= 0.5f;
+        freq *= 2;
+        x *= 2;
+        y *= 2;
+        z *= 2;
+    }
+    return norm > 0 ? sum / norm : mean;
+}
+
+void NoiseTexture::octaveSums(const float* x, const float* y, const float* z, float width, bool absolute,
+                              float* out, int n) const {
+    float mean = absolute ? turbulenceMean : 0;
+    const int block = 64;
+    float sx[block], sy[block], sz[block], layer[block];
+    for (int start = 0; start < n; start += block) {
+        int m = std::min(block, n - start);
+        float* dst = out + start;
+        for (int i = 0; i < m; i++) {
+            dst[i] = 0;
+            sx[i] = x[start + i];
+            sy[i] = y[start + i];
+            sz[i] = z[start + i];
+        }
+        float amp = 1, norm = 0, freq = 1;
+        for (int o = 0; o < octaves; o++) {
+            float fade = width > 0 ? bandFade(freq * width) : 1;
+            for (int i = 0; i < m; i++) rotateOctave(sx[i], sy[i], sz[i]);
+            if (fade > 0) {
+                perlin.noise(sx, sy, sz, layer, m);
+                for (int i = 0; i < m; i++) {
+                    float v = absolute ? std::fabs(layer[i]) : layer[i];
+                    dst[i] += amp * (mean + fade * (v - mean));
+                }
+            } else {
+                for (int i = 0; i < m; i++) dst[i] += amp * mean;
+            }
+            norm += amp;
+            amp *= 0.5f;
+            freq *= 2;
+            for (int i = 0; i < m; i++) {
+                sx[i] *= 2;
+                sy[i] *= 2;
+                sz[i] *= 2;
+            }
+        }
+        for (int i = 0; i < m; i++) dst[i] = norm > 0 ? dst[i] / norm : mean;
+    }
+}
+
+float NoiseTexture::worley(const Vector3f& p) const {
+    int cx = (int) std::floor(p.x()), cy = (int) std::floor(p.y()), cz = (int) std::floor(p.z());
+    float best = 1e30f;
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                // 每格一个特征点，位置由格子坐标的哈希决定
+                uint32_t h = cellHash(cx + dx, cy + dy, cz + dz, seed);
+                float fx = cx + dx + (h & 1023) * (1.0f / 1024) - p.x();
+                float fy = cy + dy + ((h >> 10) & 1023) * (1.0f / 1024) - p.y();
+                float fz = cz + dz + ((h >> 20) & 1023) * (1.0f / 1024) - p.z();
+                best = std::min(best, fx * fx + fy * fy + fz * fz);
+            }
+        }
+    }
+    return std::sqrt(best);
+}
+
+// 由噪声值 n（octaveSum 的结果）得到图案值
+float NoiseTexture::shape(const Vector3f& p, float n, float width) const {
+    float mean = patternMean(pattern);
+    float raw, fade = 1;
+    switch (pattern) {
+        case fbmPattern:
+            return std::min(1.0f, std::max(0.0f, 0.5f + n));
+        case turbulencePattern:
+            return std::min(1.0f, 2 * n);
+        case marblePattern:
+            raw = 0.5f + 0.5f * std::sin((p.x() + 4 * n) * (float) M_PI);   // 周期为 2
+            if (width > 0) fade = bandFade(0.5f * width);
+            break;
+        case woodPattern: {
+            float r = std::sqrt(p.x() * p.x() + p.z() * p.z()) + 0.5f * n;
+            raw = r - std::floor(r);
+            if (width > 0) fade = bandFade(width);
+            break;
+        }
+        default:
+            raw = std::min(1.0f, worley(p));
+            if (width > 0) fade = bandFade(width);
+            break;
+    }
+    return mean + fade * (raw - mean);
+}
+
+float NoiseTexture::value(const Vector3f& p, float width) const {
+    float n = pattern == worleyPattern ? 0 : octaveSum(p, width, usesTurbulence(pattern));
+    return shape(p, n, width);
+}
+
+void NoiseTexture::values(const float* x, const float* y, const float* z, float width, float* out, int n) const {
+    if (pattern != worleyPattern) {
+        octaveSums(x, y, z, width, usesTurbulence(pattern), out, n);
+    }
+    for (int i = 0; i < n; i++) {
+        out[i] = shape(Vector3f(x[i], y[i], z[i]), pattern == worleyPattern ? 0 : out[i], width);
+    }
+}
+
+// resolution 至少为 2
+void NoiseTexture::bake(int resolution) {
+    bakeSize = resolution;
+    baked.resize((size_t) resolution * resolution);
+    std::vector<float> x(resolution), y(resolution), z(resolution, 0.5f);
+    float texel = frequency / resolution;
+    for (int j = 0; j < resolution; j++) {
+        for (int i = 0; i < resolution; i++) {
+            x[i] = (i + 0.5f) * texel;
+            y[i] = (j + 0.5f) * texel;
+        }
+        // 表的分辨率决定了能保留的最高频率
+        values(x.data(), y.data(), z.data(), texel, baked.data() + (size_t) j * resolution, resolution);
+    }
+    Arena::current().addExternal(arenaTexture, baked.capacity() * sizeof(float));
+}
+
+float NoiseTexture::bakedValue(float u, float v, float uvWidth) const {
+    // 双线性插值，超出 [0, 1] 时取边缘
+    float fx = std::min(std::max(u * bakeSize - 0.5f, 0.0f), bakeSize - 1.0f);
+    float fy = std::min(std::max(v * bakeSize - 0.5f, 0.0f), bakeSize - 1.0f);
+    int x0 = std::min((int) fx, bakeSize - 2), y0 = std::min((int) fy, bakeSize - 2);
+    int x1 = x0 + 1, y1 = y0 + 1;
+    float ax = fx - x0, ay = fy - y0;
+    const float* row0 = baked.data() + (size_t) y0 * bakeSize;
+    const float* row1 = baked.data() + (size_t) y1 * bakeSize;
+    float t = (1 - ay) * ((1 - ax) * row0[x0] + ax * row0[x1]) + ay * ((1 - ax) * row1[x0] + ax * row1[x1]);
+    // 表中没有比纹素更细的细节；足迹宽到图案的基本频率也分辨不出时淡出到平均值
+    if (uvWidth > 0) {
+        float mean = patternMean(pattern);
+        t = mean + bandFade(uvWidth * frequency) * (t - mean);
+    }
+    return t;
+}
+
+Vector3f NoiseTexture::sample(float u, float v, const Vector3f& pos, float uvWidth, float worldWidth) const {
+    float t;
+    if (!uvSpace) {
+        t = value(pos * frequency, worldWidth * frequency);
+    } else if (bakeSize > 0) {
+        t = bakedValue(u, v, uvWidth);
+    } else {
+        t = value(Vector3f(u * frequency, v * frequency, 0.5f), uvWidth * frequency);
+    }
+    Vector3f c0 = textureColorByType(texture0, u, v, pos, uvWidth, worldWidth);
+    Vector3f c1 = textureColorByType(texture1, u, v, pos, uvWidth, worldWidth);
+    return c0 + t * (c1 - c0);
+}
@@ -0,0 +1,115 @@
+#include "texture_manager.hpp"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+TextureManager& TextureManager::instance() {
+    static TextureManager manager;
+    return manager;
+}
+
+TextureManager::TextureManager() {
+    setLinearize(false);
+}
+
+TextureManager::~TextureManager() {
+    textures.clear();
+    if (backing != nullptr) fclose(backing);
+}
+
+void TextureManager::setLinearize(bool linear) {
+    for (int i = 0; i < 256; i++) {
+        float c = i * (1.0f / 255.0f);
+        if (linear) {
+            c = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        ImageTexture::decodeLut[i] = c;
+    }
+}
+
+ImageTexture* TextureManager::load(const std::string& path) {
+    auto it = textures.find(path);
+    if (it != textures.end()) {
+        ++dedupHits;
+        return it->second.get();
+    }
+    ImageTexture* tex = new ImageTexture(path.c_str(), this, budget > 0);
+    textures[path].reset(tex);
+    return tex;
+}
+
+void TextureManager::forget(const std::string& path) {
+    auto it = textures.find(path);
+    if (it == textures.end()) return;
+    retired.push_back(std::move(it->second));
+    textures.erase(it);
+}
+
+long long TextureManager::writeTile(const unsigned char* data) {
+    if (backing == nullptr) {
+        backing = tmpfile();
+        if (backing == nullptr) {
+            printf("TextureManager: cannot create backing file for paged textures\n");
+            exit(1);
+        }
+    }
+    fseek(backing, 0, SEEK_END);
+    long long offset = ftell(backing);
+    fwrite(data, 1, ImageTexture::tileBytes, backing);
+    return offset;
+}
+
+// 预算之内直接分配；否则用 CLOCK 找一个最近未访问的块换出，复用它的内存
+unsigned char* TextureManager::takeBuffer() {
+    if (residentBytes + ImageTexture::tileBytes <= budget || clock.empty()) {
+        residentBytes += ImageTexture::tileBytes;
+        return (unsigned char*) malloc(ImageTexture::tileBytes);
+    }
+    while (true) {
+        if (clockHand >= clock.size()) clockHand = 0;
+        ResidentTile victim = clock[clockHand];
+        ImageTexture::Tile& tile = victim.tex->tiles[victim.tileIndex];
+        if (tile.referenced) {
+            tile.referenced = false;
+            ++clockHand;
+            continue;
+        }
+        unsigned char* data = tile.data;
+        tile.data = nullptr;
+        clock[clockHand] = clock.back();
+        clock.pop_back();
+        ++evictions;
+        return data;
+    }
+}
+
+void TextureManager::readPaged(ImageTexture* tex, int tileIndex, int offset, unsigned char out[ImageTexture::bytesPerPixel]) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ImageTexture::Tile& tile = tex->tiles[tileIndex];
+    if (tile.data == nullptr) {
+        ++tileMisses;
+        tile.data = takeBuffer();
+        fseek(backing, tile.fileOffset, SEEK_SET);
+        if (fread(tile.data, 1, ImageTexture::tileBytes, backing) != (size_t) ImageTexture::tileBytes) {
+            memset(tile.data, 0, ImageTexture::tileBytes);
+        }
+        clock.push_back({tex, tileIndex});
+    }
+    tile.referenced = true;
+    memcpy(out, tile.data + offset, ImageTexture::bytesPerPixel);
+}
+
+void TextureManager::printReport() const {
+    if (textures.empty()) return;
+    size_t total = 0;
+    for (const auto& entry : textures) {
+        total += (size_t) entry.second->getNumTiles() * ImageTexture::tileBytes;
+    }
+    printf("---- Textures ----\n");
+    printf("  %zu images (%lld duplicate loads shared), %.1f MB of tiles, %.1f MB resident",
+           textures.size(), dedupHits, total / 1048576.0, residentBytes / 1048576.0);
+    if (budget > 0) {
+        printf(", budget %.1f MB, %lld tile misses, %lld evictions", budget / 1048576.0, tileMisses, evictions);
+    }
+    printf("\n");
+}
@@ -0,0 +1,277 @@
+#include "voxel_world.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <thread>
+#include "arena.hpp"
+#include "stats.hpp"
+
+namespace {
+
+const float terrainFrequency = 1.0f / 64;  // 高度图：约 64 个方块一个起伏
+const int terrainOctaves = 5;
+const float caveFrequency = 1.0f / 24;
+const float caveWidth = 0.07f;             // 两个噪声都在 ±caveWidth 以内的地方挖空
+const int caveRoof = 4;                    // 洞穴顶部距地面至少 4 格，不挖穿草地
+const float coalChance = 0.012f;
+const float goldChance = 0.003f;
+const float treeChance = 0.012f;
+const int canopyRadius = 2;                // 树冠半径，区块生成时要看边界外这么远的树
+
+inline uint32_t hash3(int x, int y, int z, uint32_t seed) {
+    uint32_t h = seed * 0x9E3779B9u ^ (uint32_t) x * 0x85EBCA6Bu ^ (uint32_t) y * 0xC2B2AE35u ^ (uint32_t) z * 0x27D4EB2Fu;
+    h ^= h >> 16;
+    h *= 0x7FEB352Du;
+    h ^= h >> 15;
+    h *= 0x846CA68Bu;
+    h ^= h >> 16;
+    return h;
+}
+
+// [0, 1) 的均匀分布
+inline float hashFloat(int x, int y, int z, uint32_t seed) {
+    return (hash3(x, y, z, seed) >> 8) * (1.0f / 16777216);
+}
+
+} // namespace
+
+VoxelWorld::VoxelWorld(int _chunksX, int _chunksZ, int _height, unsigned int _seed)
+    : chunksX(_chunksX), chunksZ(_chunksZ), height(_height), seed(_seed),
+      terrainNoise(_seed), caveNoise0(_seed + 1), caveNoise1(_seed + 2) {
+    baseHeight = (int) (height * 0.4f);
+    blocks.assign((size_t) chunksX * chunksZ * chunkSize * chunkSize * height, airVoxel);
+    chunkTops.assign(chunksX * chunksZ, 0);
+}
+
+void VoxelWorld::generate(int threads) {
+    int numChunks = chunksX * chunksZ;
+    int numThreads = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+    numThreads = std::min(numThreads, numChunks);
+    // 区块之间没有依赖，线程按顺序领取下一个区块
+    std::atomic<int> nextChunk(0);
+    auto worker = [&]() {
+        for (int c = nextChunk++; c < numChunks; c = nextChunk++) generateChunk(c % chunksX, c / chunksX);
+    };
+    if (numThreads <= 1) {
+        worker();
+        return;
+    }
+    std::vector<std::thread> pool;
+    for (int i = 0; i < numThreads; i++) pool.emplace_back(worker);
+    for (std::thread& t : pool) t.join();
+}
+
+void VoxelWorld::generateChunk(int cx, int cz) {
+    const int S = chunkSize;
+    const int x0 = cx * S, z0 = cz * S;
+    unsigned char* chunk = blocks.data() + ((size_t) cz * chunksX + cx) * S * S * height;
+
+    // 高度图，含边界外 canopyRadius 格（那里的树冠可能伸进本区块）。
+    // 相邻区块对同一列求出的高度必须相同：点数是 4 的倍数，每个点都走同一条批量路径
+    const int M = canopyRadius;
+    const int W = S + 2 * M;
+    float hx[W * W], hy[W * W], hz[W * W], hn[W * W];
+    for (int j = 0; j < W; j++) {
+        for (int i = 0; i < W; i++) {
+            hx[j * W + i] = (x0 - M + i) * terrainFrequency;
+            hy[j * W + i] = 0.5f;
+            hz[j * W + i] = (z0 - M + j) * terrainFrequency;
+        }
+    }
+    terrainNoise.fbm(hx, hy, hz, hn, W * W, terrainOctaves);
+    int heights[W * W];
+    for (int k = 0; k < W * W; k++) {
+        int h = baseHeight + (int) std::floor(hn[k] * height * 0.5f);
+        heights[k] = std::max(4, std::min(height - 10, h));
+    }
+    auto columnHeight = [&](int x, int z) { return heights[(z + M) * W + (x + M)]; };
+
+    // 地形：石头、三层泥土、草
+    int top = 0;
+    for (int z = 0; z < S; z++) {
+        for (int x = 0; x < S; x++) {
+            int h = columnHeight(x, z);
+            for (int y = 0; y < h; y++) {
+                chunk[index(x, y, z)] = y == h - 1 ? grassVoxel : (y >= h - 4 ? dirtVoxel : stoneVoxel);
+            }
+            top = std::max(top, h);
+        }
+    }
+
+    // 洞穴和矿石：每行 16 个方块一起求噪声
+    float px[S], py[S], pz[S], n0[S], n1[S];
+    for (int y = 1; y < top; y++) {
+        for (int z = 0; z < S; z++) {
+            bool anyStone = false;
+            for (int x = 0; x < S; x++) anyStone |= y < columnHeight(x, z) - caveRoof;
+            if (!anyStone) continue;
+            for (int x = 0; x < S; x++) {
+                px[x] = (x0 + x) * caveFrequency;
+                py[x] = y * caveFrequency;
+                pz[x] = (z0 + z) * caveFrequency;
+            }
+            caveNoise0.noise(px, py, pz, n0, S);
+            caveNoise1.noise(px, py, pz, n1, S);
+            for (int x = 0; x < S; x++) {
+                if (y >= columnHeight(x, z) - caveRoof) continue;
+                unsigned char& b = chunk[index(x, y, z)];
+                if (std::fabs(n0[x]) < caveWidth && std::fabs(n1[x]) < caveWidth) {
+                    b = airVoxel;
+                } else if (b == stoneVoxel) {
+                    float r = hashFloat(x0 + x, y, z0 + z, seed);
+                    if (r < goldChance && y < height / 5) {
+                        b = goldOreVoxel;
+                    } else if (r < coalChance) {
+                        b = coalOreVoxel;
+                    }
+                }
+            }
+        }
+    }
+
+    // 树：树干覆盖任何方块，树叶只填空气，所以结果与各棵树的处理顺序无关，相邻区块得到相同的树
+    for (int tz = -M; tz < S + M; tz++) {
+        for (int tx = -M; tx < S + M; tx++) {
+            int wx = x0 + tx, wz = z0 + tz;
+            if (wx < M || wz < M || wx >= sizeX() - M || wz >= sizeZ() - M) continue;    // 树冠留在世界内
+            if (hashFloat(wx, -1, wz, seed) >= treeChance) continue;
+            int ground = columnHeight(tx, tz);
+            int trunk = 4 + (int) (hash3(wx, -2, wz, seed) % 3);
+            int crown = ground + trunk;     // 树干顶部的上一格
+            for (int y = crown - 3; y <= crown; y++) {
+                int r = y >= crown - 1 ? 1 : canopyRadius;
+                for (int dz = -r; dz <= r; dz++) {
+                    for (int dx = -r; dx <= r; dx++) {
+                        if (y == crown && dx != 0 && dz != 0) continue;    // 顶层为十字形
+                        if (r == canopyRadius && std::abs(dx) == r && std::abs(dz) == r) continue;
+                        int x = tx + dx, z = tz + dz;
+                        if (x < 0 || z < 0 || x >= S || z >= S) continue;
+                        unsigned char& b = chunk[index(x, y, z)];
+                        if (b == airVoxel) b = leavesVoxel;
+                    }
+                }
+            }
+            if (tx >= 0 && tz >= 0 && tx < S && tz < S) {
+                for (int y = ground; y < crown; y++) chunk[index(tx, y, tz)] = oakLogVoxel;
+            }
+            top = std::max(top, crown + 1);
+        }
+    }
+    chunkTops[cz * chunksX + cx] = std::min(top, height);
+}
+
+long long VoxelWorld::countBlocks(VoxelBlock block) const {
+    return std::count(blocks.begin(), blocks.end(), (unsigned char) block);
+}
+
+void VoxelWorld::addChunks(Group* grp, const Vector3f& origin) {
+    for (int cz = 0; cz < chunksZ; cz++) {
+        for (int cx = 0; cx < chunksX; cx++) {
+            if (chunkTop(cx, cz) == 0) continue;
+            Vector3f mn = origin + Vector3f(cx * chunkSize, 0, cz * chunkSize);
+            grp->addObject(arenaNew<VoxelChunk>(arenaGeometry, this, cx, cz, mn));
+        }
+    }
+    Arena::current().addExternal(arenaGeometry, blocks.capacity() + chunkTops.capacity() * sizeof(int));
+}
+
+// ====================================================================
+// 求交
+// ====================================================================
+
+VoxelChunk::VoxelChunk(const VoxelWorld* _world, int cx, int cz, const Vector3f& _mn)
+    : blocks(_world->chunkBlocks(cx, cz)), world(_world), mn(_mn) {
+    objType = voxelObj;
+    dims[0] = VoxelWorld::chunkSize;
+    dims[1] = _world->chunkTop(cx, cz);
+    dims[2] = VoxelWorld::chunkSize;
+}
+
+bool VoxelChunk::intersect(const Ray& ray, Hit& hit, float tmin, float tmax) {
+    STATS_PRIM(voxelObj);
+    const Vector3f o = ray.getOrigin() - mn;
+    const Vector3f& d = ray.getDirection();
+    tmax = std::min(tmax, hit.getT());
+
+    // 与区块包围盒求交，记下进入包围盒的面
+    float t0 = tmin, t1 = tmax;
+    int entryAxis = -1;
+    for (int a = 0; a < 3; a++) {
+        if (d[a] == 0) {
+            if (o[a] < 0 || o[a] > dims[a]) return false;
+            continue;
+        }
+        float inv = 1.0f / d[a];
+        float ta = -o[a] * inv;
+        float tb = (dims[a] - o[a]) * inv;
+        if (ta > tb) std::swap(ta, tb);
+        if (ta > t0) {
+            t0 = ta;
+            entryAxis = a;
+        }
+        t1 = std::min(t1, tb);
+        if (t1 < t0) return false;
+    }
+
+    // DDA 初始化：起点所在的格子、沿各轴到下一个格子边界的 t
+    int cell[3], step[3];
+    float tNext[3], tDelta[3];
+    for (int a = 0; a < 3; a++) {
+        float p = o[a] + d[a] * t0;
+        cell[a] = std::max(0, std::min(dims[a] - 1, (int) std::floor(p)));
+        if (d[a] > 0) {
+            step[a] = 1;
+            tNext[a] = (cell[a] + 1 - o[a]) / d[a];
+            tDelta[a] = 1 / d[a];
+        } else if (d[a] < 0) {
+            step[a] = -1;
+            tNext[a] = (cell[a] - o[a]) / d[a];
+            tDelta[a] = -1 / d[a];
+        } else {
+            step[a] = 0;
+            tNext[a] = tDelta[a] = INFINITY;
+        }
+    }
+
+    // 起点在区块内部时（光线从某个方块表面出发），起点所在的格子是出发的方块本身，跳过
+    int axis = entryAxis;
+    float t = t0;
+    bool skip = entryAxis < 0;
+    while (true) {
+        unsigned char block = blocks[VoxelWorld::index(cell[0], cell[1], cell[2])];
+        if (block != airVoxel && !skip) {
+            VoxelFace face = axis != 1 ? voxelSide : (step[1] < 0 ? voxelTop : voxelBottom);
+            Material* m = world->getMaterial(block, face);
+            if (m != nullptr) {
+                Vector3f p = ray.pointAtParameter(t);
+                Vector3f local = p - mn;
+                float fx = std::min(1.0f, std::max(0.0f, local.x() - cell[0]));
+                float fy = std::min(1.0f, std::max(0.0f, local.y() - cell[1]));
+                float fz = std::min(1.0f, std::max(0.0f, local.z() - cell[2]));
+                // 与 Box 各面（RectX / RectY / RectZ）的 uv 约定相同
+                Vector3f normal(0, 0, 0);
+                normal[axis] = (float) -step[axis];
+                if (axis == 0) {
+                    hit.setUv(fz, fy);
+                } else if (axis == 1) {
+                    hit.setUv(fx, fz);
+                } else {
+                    hit.setUv(fx, fy);
+                }
+                hit.set(p, t, m);
+                hit.setUvScale(1);
+                hit.setNormal(ray, normal);
+                return true;
+            }
+        }
+        skip = false;
+
+        axis = tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2);
+        t = tNext[axis];
+        if (t > t1) return false;
+        cell[axis] += step[axis];
+        if (cell[axis] < 0 || cell[axis] >= dims[axis]) return false;
+        tNext[axis] += tDelta[axis];
+    }
+}
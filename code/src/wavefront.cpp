@@ -0,0 +1,219 @@
+#include "wavefront.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <utility>
+#include "bvh.hpp"
+#include "material.hpp"
+#include "packet.hpp"
+#include "stats.hpp"
+#include "utils.hpp"
+
+// 类内初始化的常量被按引用使用（std::min）时需要一个定义，否则 Debug / LTO 构建链接失败
+const int RayPacket::maxSize;
+
+void WavefrontIntegrator::PathQueue::clear() {
+    rays.clear();
+    throughput.clear();
+    pixel.clear();
+    depth.clear();
+    bsdfPdf.clear();
+}
+
+void WavefrontIntegrator::PathQueue::push(const Ray& r, const Vector3f& t, int pix, int d, float pdf) {
+    rays.push_back(r);
+    throughput.push_back(t);
+    pixel.push_back(pix);
+    depth.push_back(d);
+    bsdfPdf.push_back(pdf);
+}
+
+void WavefrontIntegrator::PathQueue::reserve(int n) {
+    rays.reserve(n);
+    throughput.reserve(n);
+    pixel.reserve(n);
+    depth.reserve(n);
+    bsdfPdf.reserve(n);
+    hits.reserve(n);
+    found.reserve(n);
+}
+
+WavefrontIntegrator::WavefrontIntegrator(Camera* _cam, Object3D* _scene, const Vector3f& _bgColor, int _maxDepth)
+    : cam(_cam), scene(_scene), bgColor(_bgColor), maxDepth(_maxDepth) {
+    if (!scene->hitbox(sceneBox)) {
+        sceneBox = Aabb(Vector3f(-1, -1, -1), Vector3f(1, 1, 1));
+    }
+}
+
+// 生成第 first 到 first + count - 1 个（采样, 像素）对应的相机光线
+void WavefrontIntegrator::generate(long long first, int count) {
+    int width = cam->getWidth();
+    int numPixels = width * cam->getHeight();
+    for (long long k = first; k < first + count; k++) {
+        int p = (int) (k % numPixels);
+        int x = p % width;
+        int y = p / width;
+        Vector2f screenPoint(x + Utils::randomFloat(), y + Utils::randomFloat());
+        queue.push(cam->generateRay(screenPoint), Vector3f(1, 1, 1), p, maxDepth);
+        STATS_INC(cameraRays);
+    }
+}
+
+static inline unsigned spreadBits5(unsigned v) {
+    // 把 5 位整数的各位间隔两位展开，用于 Morton 码
+    v &= 0x1f;
+    v = (v | (v << 8)) & 0x100f;
+    v = (v | (v << 4)) & 0x10c3;
+    v = (v | (v << 2)) & 0x1249;
+    return v;
+}
+
+unsigned WavefrontIntegrator::sortKey(const Ray& r) const {
+    Vector3f mn = sceneBox.getMin();
+    Vector3f extent = sceneBox.getMax() - mn;
+    unsigned cell = 0;
+    for (int a = 0; a < 3; a++) {
+        float f = extent[a] > 0 ? (r.getOrigin()[a] - mn[a]) / extent[a] : 0;
+        int c = (int) (f * 32);
+        c = c < 0 ? 0 : (c > 31 ? 31 : c);
+        cell |= spreadBits5(c) << a;
+    }
+    const Vector3f& d = r.getDirection();
+    unsigned octant = (d.x() < 0) | ((d.y() < 0) << 1) | ((d.z() < 0) << 2);
+    return (cell << 3) | octant;
+}
+
+// 按 (网格单元, 方向卦限) 给队列排序，queue 和 next 交换
+void WavefrontIntegrator::sortQueue() {
+    int n = queue.size();
+    std::vector<unsigned long long> keys(n);
+    for (int i = 0; i < n; i++) {
+        keys[i] = ((unsigned long long) sortKey(queue.rays[i]) << 32) | (unsigned) i;
+    }
+    std::sort(keys.begin(), keys.end());
+    next.clear();
+    for (int j = 0; j < n; j++) {
+        int i = (int) (keys[j] & 0xffffffffu);
+        next.push(queue.rays[i], queue.throughput[i], queue.pixel[i], queue.depth[i], queue.bsdfPdf[i]);
+    }
+    std::swap(queue, next);
+}
+
+// 深度用尽的路径不再求交（同递归版本 depth <= 0 时的返回值），其余光线求最近交点。
+// 相机光线按像素顺序排列，相邻的 16 条组成光线包求交。
+void WavefrontIntegrator::extend(bool cameraRays) {
+    int n = queue.size();
+    queue.hits.resize(n);
+    queue.found.resize(n);
+    if (cameraRays && scene->objType == bhvNode) {
+        BvhNode* root = static_cast<BvhNode*>(scene);
+        RayPacket packet;
+        for (int first = 0; first < n; first += RayPacket::maxSize) {
+            packet.clear();
+            int count = std::min(RayPacket::maxSize, n - first);
+            for (int i = first; i < first + count; i++) {
+                packet.add(queue.rays[i]);
+                queue.hits[i] = Hit();
+            }
+            packet.finalize();
+            unsigned mask = root->intersectPacket(packet, &queue.hits[first], 0.0001);
+            for (int i = 0; i < count; i++) queue.found[first + i] = (mask >> i) & 1;
+        }
+        raysTraced += n;
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        ++raysTraced;
+        if (queue.depth[i] <= 0) {
+            queue.found[i] = 0;
+            continue;
+        }
+        queue.hits[i] = Hit();
+        queue.found[i] = scene->intersect(queue.rays[i], queue.hits[i], 0.0001, INF);
+    }
+}
+
+// 同 main.cpp 中的 background
+Vector3f WavefrontIntegrator::background(const Ray& ray, float bsdfPdf) const {
+    if (envMap == nullptr) return bgColor;
+    if (bsdfPdf <= 0) return envMap->eval(ray);
+    float lightPdf;
+    Vector3f radiance = envMap->eval(ray, &lightPdf);
+    return radiance * EnvironmentMap::powerHeuristic(bsdfPdf, lightPdf);
+}
+
+void WavefrontIntegrator::shadeAndConnect() {
+    int n = queue.size();
+    // 未击中 / 深度用尽：直接累加到像素；有交点的按材质分组
+    std::vector<std::pair<const Material*, int>> byMaterial;
+    byMaterial.reserve(n);
+    for (int i = 0; i < n; i++) {
+        if (queue.found[i]) {
+            byMaterial.push_back(std::make_pair(queue.hits[i].getMaterial(), i));
+        } else if (queue.depth[i] <= 0) {
+            STATS_PATH(maxDepth);
+            film[queue.pixel[i]] += queue.throughput[i] * Vector3f(0.01, 0.01, 0.01);
+        } else {
+            STATS_PATH(maxDepth - queue.depth[i]);
+            film[queue.pixel[i]] += queue.throughput[i] * background(queue.rays[i], queue.bsdfPdf[i]);
+        }
+    }
+    std::sort(byMaterial.begin(), byMaterial.end());
+
+    next.clear();
+    for (const auto& entry : byMaterial) {
+        int i = entry.second;
+        const Hit& hit = queue.hits[i];
+        Ray scattered;
+        Vector3f color(0, 0, 0);
+        if (!scatterByType(entry.first, queue.rays[i], hit, color, scattered)) {
+            // 既不反射亦不折射，是Emissive材质
+            STATS_PATH(maxDepth - queue.depth[i] + 1);
+            film[queue.pixel[i]] += queue.throughput[i] * emitColorByType(entry.first, queue.rays[i], hit);
+            continue;
+        }
+        STATS_INC(secondaryRays);
+        Vector3f throughput = queue.throughput[i] * color;
+        if (envMap != nullptr && entry.first->matType == lambertMat) {
+            film[queue.pixel[i]] += throughput * envMap->sampleDirect(hit, scattered, scene, raysTraced);
+            float pdf = Vector3f::dot(hit.getNormal(), scattered.getDirection()) / PI;
+            next.push(scattered, throughput, queue.pixel[i], queue.depth[i] - 1, pdf);
+            continue;
+        }
+        next.push(scattered, throughput, queue.pixel[i], queue.depth[i] - 1);
+    }
+    std::swap(queue, next);
+}
+
+std::vector<Vector3f> WavefrontIntegrator::render(int spp) {
+    int numPixels = cam->getWidth() * cam->getHeight();
+    long long totalPaths = (long long) numPixels * spp;
+    film.assign(numPixels, Vector3f::ZERO);
+    queue.reserve(waveSize);
+    next.reserve(waveSize);
+
+    clock_t startTime = clock();
+    float lastTime = 0;
+    for (long long first = 0; first < totalPaths; first += waveSize) {
+        int count = (int) std::min<long long>(waveSize, totalPaths - first);
+        queue.clear();
+        generate(first, count);
+
+        for (int bounce = 0; queue.size() > 0; bounce++) {
+            if (sortRays && bounce > 0) sortQueue();   // 相机光线本身已按像素顺序排列
+            extend(bounce == 0);
+            shadeAndConnect();
+        }
+
+        float timeElapsed = Utils::getTimeElapsed(startTime);
+        if (timeElapsed - lastTime > 1.0f) {
+            lastTime = timeElapsed;
+            float done = (float) (first + count) / totalPaths;
+            printf("[wavefront %5.1f%%] Time elapsed: %.2f, Est. time left: %.2f\n",
+                   100 * done, timeElapsed, timeElapsed / done * (1 - done));
+        }
+    }
+
+    for (Vector3f& c : film) c /= spp;
+    return film;
+}